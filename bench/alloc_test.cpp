@@ -0,0 +1,177 @@
+//
+// alloc_test.cpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// 检查http_stream::async_read_some的稳定读取循环中没有堆分配. 每种响应(普通, chunked,
+// gzip, gzip+chunked, deflate)打开后先读取warmup次, 然后统计剩余读取过程中的分配次数, 任何一种
+// 响应分配次数不为0时返回非0.
+//
+// 用法: avhttp_alloc_test [--size 1048576] [--buffer 512] [--warmup 16]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "avhttp.hpp"
+
+#include "loopback_server.hpp"
+#include "bench_util.hpp"
+
+namespace po = boost::program_options;
+
+// 使用固定的缓冲不断async_read_some直到body读完.
+class async_reader
+{
+public:
+	async_reader(avhttp::http_stream &stream, std::size_t buffer_size, int warmup)
+		: m_stream(stream)
+		, m_buffer(buffer_size)
+		, m_warmup(warmup)
+		, m_reads(0)
+		, m_counted_reads(0)
+		, m_bytes(0)
+		, m_allocations(0)
+	{}
+
+	void start()
+	{
+		m_stream.async_read_some(boost::asio::buffer(m_buffer),
+			boost::bind(&async_reader::handle_read, this,
+				boost::asio::placeholders::error,
+				boost::asio::placeholders::bytes_transferred
+			)
+		);
+	}
+
+	void handle_read(const boost::system::error_code &ec, std::size_t bytes_transferred)
+	{
+		// 统计从上一次发起读取到这一次回调之间的分配.
+		if (m_reads > m_warmup)
+		{
+			m_allocations += bench::alloc_count_end();
+			m_counted_reads++;
+		}
+
+		m_reads++;
+		m_bytes += bytes_transferred;
+		m_ec = ec;
+		if (ec || bytes_transferred == 0)
+		{
+			return;
+		}
+
+		if (m_reads > m_warmup)
+		{
+			bench::alloc_count_begin();
+		}
+		start();
+	}
+
+	int reads() const { return m_reads; }
+	int counted_reads() const { return m_counted_reads; }
+	boost::int64_t bytes() const { return m_bytes; }
+	boost::uint64_t allocations() const { return m_allocations; }
+	const boost::system::error_code& error() const { return m_ec; }
+
+private:
+	avhttp::http_stream &m_stream;
+	std::vector<char> m_buffer;
+	int m_warmup;
+	int m_reads;
+	int m_counted_reads;
+	boost::int64_t m_bytes;
+	boost::uint64_t m_allocations;
+	boost::system::error_code m_ec;
+};
+
+// 打开url并读取完整的body, 返回是否通过检查.
+bool check(const std::string &name, const std::string &url, const std::string &encoding,
+	std::size_t buffer_size, int warmup)
+{
+	boost::asio::io_service io;
+	avhttp::http_stream h(io);
+	if (!encoding.empty())
+	{
+		avhttp::request_opts req;
+		req.insert(avhttp::http_options::accept_encoding, encoding);
+		h.request_options(req);
+	}
+
+	boost::system::error_code ec;
+	h.open(url, ec);
+	if (ec)
+	{
+		std::printf("%-24s open failed: %s\n", name.c_str(), ec.message().c_str());
+		return false;
+	}
+
+	async_reader reader(h, buffer_size, warmup);
+	reader.start();
+	io.run();
+	bench::alloc_count_end();
+
+	bool ok = reader.allocations() == 0 && reader.counted_reads() > 0
+		&& (!reader.error() || reader.error() == boost::asio::error::eof);
+	std::printf("%-24s %8d %10d %12lld %10llu %s\n", name.c_str(),
+		reader.reads(), reader.counted_reads(), (long long)reader.bytes(),
+		(unsigned long long)reader.allocations(), ok ? "ok" : "FAILED");
+	std::fflush(stdout);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	int size;
+	int buffer_size;
+	int warmup;
+
+	po::options_description desc("avhttp allocation test options");
+	desc.add_options()
+		("help", "show this message")
+		("size", po::value<int>(&size)->default_value(1024 * 1024), "response body size")
+		("buffer", po::value<int>(&buffer_size)->default_value(512), "async_read_some buffer size")
+		("warmup", po::value<int>(&warmup)->default_value(16), "reads before counting allocations")
+		;
+
+	po::variables_map vm;
+	try
+	{
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl << desc << std::endl;
+		return -1;
+	}
+
+	if (vm.count("help"))
+	{
+		std::cout << desc << std::endl;
+		return 0;
+	}
+
+	bench::loopback_server server;
+	const std::string path = "/" + boost::lexical_cast<std::string>(size);
+
+	std::printf("%-24s %8s %10s %12s %10s\n", "response", "reads", "counted", "bytes", "allocs");
+
+	bool ok = true;
+	ok = check("identity", server.url(path), "", buffer_size, warmup) && ok;
+	ok = check("chunked", server.url(path + "?chunked=1"), "", buffer_size, warmup) && ok;
+#ifdef AVHTTP_ENABLE_ZLIB
+	ok = check("gzip", server.url(path), "gzip", buffer_size, warmup) && ok;
+	ok = check("gzip+chunked", server.url(path + "?chunked=1"), "gzip", buffer_size, warmup) && ok;
+	ok = check("deflate", server.url(path), "deflate", buffer_size, warmup) && ok;
+#endif
+
+	return ok ? 0 : 1;
+}
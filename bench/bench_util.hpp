@@ -0,0 +1,195 @@
+//
+// bench_util.hpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __BENCH_UTIL_HPP__
+#define __BENCH_UTIL_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+// 性能测试的公共工具: 计时, 延迟统计和内存分配计数.
+// 注意: 这个文件替换了全局的operator new/delete, 每个可执行程序只能有一个编译单元包含它.
+
+#if defined(_MSC_VER)
+# define AVHTTP_BENCH_TLS __declspec(thread)
+#else
+# define AVHTTP_BENCH_TLS __thread
+#endif
+
+#if __cplusplus >= 201103L || defined(_MSC_VER)
+# define AVHTTP_BENCH_THROW_BAD_ALLOC
+#else
+# define AVHTTP_BENCH_THROW_BAD_ALLOC throw(std::bad_alloc)
+#endif
+
+namespace bench {
+namespace detail {
+
+// 只统计开启了计数的线程中的分配, 避免把服务器线程的分配计算在内.
+static AVHTTP_BENCH_TLS bool counting = false;
+static AVHTTP_BENCH_TLS boost::uint64_t allocations = 0;
+
+} // namespace detail
+
+///开始统计当前线程的内存分配次数.
+inline void alloc_count_begin()
+{
+	detail::allocations = 0;
+	detail::counting = true;
+}
+
+///停止统计当前线程的内存分配次数.
+// @返回alloc_count_begin之后的分配次数.
+inline boost::uint64_t alloc_count_end()
+{
+	detail::counting = false;
+	return detail::allocations;
+}
+
+///返回当前时间, 单位微秒.
+inline boost::int64_t now_us()
+{
+	static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+	return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds();
+}
+
+// 一组测试结果.
+struct bench_result
+{
+	bench_result()
+		: requests(0)
+		, bytes(0)
+		, elapsed_us(0)
+		, allocations(0)
+	{}
+
+	// 测试名称.
+	std::string name;
+
+	// 完成的请求数.
+	boost::int64_t requests;
+
+	// 接收的数据字节数.
+	boost::int64_t bytes;
+
+	// 总耗时, 单位微秒.
+	boost::int64_t elapsed_us;
+
+	// 内存分配次数.
+	boost::uint64_t allocations;
+
+	// 每个请求的延迟, 单位微秒.
+	std::vector<boost::int64_t> latencies;
+
+	///返回延迟的百分位数, 单位毫秒.
+	// @param p百分位, 如50或99.
+	double percentile(double p) const
+	{
+		if (latencies.empty())
+		{
+			return 0;
+		}
+		std::vector<boost::int64_t> sorted(latencies);
+		std::sort(sorted.begin(), sorted.end());
+		std::size_t index = static_cast<std::size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+		return sorted[(std::min)(index, sorted.size() - 1)] / 1000.0;
+	}
+};
+
+///输出表头.
+inline void print_header()
+{
+	std::printf("%-36s %9s %10s %10s %9s %9s %11s\n",
+		"benchmark", "requests", "req/s", "MB/s", "p50(ms)", "p99(ms)", "allocs/req");
+}
+
+///输出一组测试结果.
+inline void print_result(const bench_result &r)
+{
+	double seconds = r.elapsed_us / 1000000.0;
+	if (seconds <= 0)
+	{
+		seconds = 1e-6;
+	}
+	std::printf("%-36s %9lld %10.1f %10.2f %9.3f %9.3f %11.1f\n",
+		r.name.c_str(), (long long)r.requests,
+		r.requests / seconds, r.bytes / seconds / (1024.0 * 1024.0),
+		r.percentile(50), r.percentile(99),
+		r.requests ? double(r.allocations) / r.requests : 0.0);
+	std::fflush(stdout);
+}
+
+} // namespace bench
+
+void* operator new(std::size_t size) AVHTTP_BENCH_THROW_BAD_ALLOC
+{
+	if (bench::detail::counting)
+	{
+		bench::detail::allocations++;
+	}
+	void *p = std::malloc(size == 0 ? 1 : size);
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](std::size_t size) AVHTTP_BENCH_THROW_BAD_ALLOC
+{
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) throw()
+{
+	if (bench::detail::counting)
+	{
+		bench::detail::allocations++;
+	}
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) throw()
+{
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) throw()
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+	std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) throw()
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) throw()
+{
+	std::free(p);
+}
+
+#endif // __BENCH_UTIL_HPP__
@@ -0,0 +1,468 @@
+//
+// http_bench.cpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// http_stream/async_read_body/multi_download的吞吐量和延迟测试, 使用进程内的
+// 本地回环服务器, 不需要访问网络.
+//
+// 用法: avhttp_bench [--requests 200] [--size 65536] [--concurrency 8]
+//       [--latency 0] [--bandwidth -1] [--md-size 16777216] [--md-runs 3] [--filter str]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+#include "avhttp.hpp"
+
+#include "loopback_server.hpp"
+#include "bench_util.hpp"
+
+namespace po = boost::program_options;
+
+struct bench_options
+{
+	int requests;
+	int size;
+	int concurrency;
+	int md_size;
+	int md_runs;
+	std::string filter;
+};
+
+// 读取完整的响应body.
+boost::int64_t read_body(avhttp::http_stream &h, std::vector<char> &buffer, boost::system::error_code &ec)
+{
+	boost::int64_t total = 0;
+	boost::int64_t length = h.content_length();
+	while (length == -1 || total < length)
+	{
+		std::size_t n = h.read_some(boost::asio::buffer(buffer), ec);
+		total += n;
+		if (ec)
+		{
+			if (ec == boost::asio::error::eof)
+			{
+				ec = boost::system::error_code();
+			}
+			break;
+		}
+	}
+	return total;
+}
+
+// 每个请求使用新的连接同步读取.
+bench::bench_result bench_sync(const std::string &name, const std::string &url,
+	const bench_options &opts, bool gzip)
+{
+	bench::bench_result r;
+	r.name = name;
+
+	boost::asio::io_service io;
+	std::vector<char> buffer(64 * 1024);
+	avhttp::request_opts req;
+	if (gzip)
+	{
+		req.insert(avhttp::http_options::accept_encoding, "gzip");
+	}
+
+	boost::int64_t start = bench::now_us();
+	bench::alloc_count_begin();
+	for (int i = 0; i < opts.requests; i++)
+	{
+		boost::int64_t t = bench::now_us();
+		avhttp::http_stream h(io);
+		h.request_options(req);
+		boost::system::error_code ec;
+		h.open(url, ec);
+		if (ec)
+		{
+			std::cerr << name << ": " << ec.message() << std::endl;
+			break;
+		}
+		r.bytes += read_body(h, buffer, ec);
+		h.close(ec);
+		r.requests++;
+		r.latencies.push_back(bench::now_us() - t);
+	}
+	r.allocations = bench::alloc_count_end();
+	r.elapsed_us = bench::now_us() - start;
+
+	return r;
+}
+
+// 异步读取的客户端, 顺序完成若干个请求.
+class async_client
+{
+public:
+	async_client(boost::asio::io_service &io, const std::string &url,
+		int requests, bench::bench_result &result)
+		: m_io_service(io)
+		, m_url(url)
+		, m_requests(requests)
+		, m_result(result)
+		, m_buffer(64 * 1024)
+		, m_start(0)
+		, m_bytes(0)
+	{}
+
+	void start()
+	{
+		if (m_requests-- <= 0)
+		{
+			return;
+		}
+
+		m_start = bench::now_us();
+		m_bytes = 0;
+		m_stream.reset(new avhttp::http_stream(m_io_service));
+		m_stream->async_open(m_url,
+			boost::bind(&async_client::handle_open, this, boost::asio::placeholders::error));
+	}
+
+private:
+
+	void handle_open(const boost::system::error_code &ec)
+	{
+		if (ec)
+		{
+			std::cerr << "async open: " << ec.message() << std::endl;
+			return;
+		}
+		read();
+	}
+
+	void read()
+	{
+		m_stream->async_read_some(boost::asio::buffer(m_buffer),
+			boost::bind(&async_client::handle_read, this,
+				boost::asio::placeholders::error,
+				boost::asio::placeholders::bytes_transferred
+			)
+		);
+	}
+
+	void handle_read(const boost::system::error_code &ec, std::size_t bytes_transferred)
+	{
+		m_bytes += bytes_transferred;
+		if (!ec && (m_stream->content_length() == -1 || m_bytes < m_stream->content_length()))
+		{
+			read();
+			return;
+		}
+
+		if (ec && ec != boost::asio::error::eof)
+		{
+			std::cerr << "async read: " << ec.message() << std::endl;
+			return;
+		}
+
+		boost::system::error_code ignore;
+		m_stream->close(ignore);
+		m_result.requests++;
+		m_result.bytes += m_bytes;
+		m_result.latencies.push_back(bench::now_us() - m_start);
+		start();
+	}
+
+private:
+	boost::asio::io_service &m_io_service;
+	std::string m_url;
+	int m_requests;
+	bench::bench_result &m_result;
+	boost::scoped_ptr<avhttp::http_stream> m_stream;
+	std::vector<char> m_buffer;
+	boost::int64_t m_start;
+	boost::int64_t m_bytes;
+};
+
+bench::bench_result bench_async(const std::string &name, const std::string &url, const bench_options &opts)
+{
+	bench::bench_result r;
+	r.name = name;
+
+	boost::asio::io_service io;
+	std::vector<boost::shared_ptr<async_client> > clients;
+	for (int i = 0; i < opts.concurrency; i++)
+	{
+		int n = opts.requests / opts.concurrency + (i < opts.requests % opts.concurrency ? 1 : 0);
+		clients.push_back(boost::shared_ptr<async_client>(new async_client(io, url, n, r)));
+	}
+
+	boost::int64_t start = bench::now_us();
+	bench::alloc_count_begin();
+	for (std::size_t i = 0; i < clients.size(); i++)
+	{
+		clients[i]->start();
+	}
+	io.run();
+	r.allocations = bench::alloc_count_end();
+	r.elapsed_us = bench::now_us() - start;
+
+	return r;
+}
+
+// 使用async_read_body读取的客户端.
+class read_body_client
+{
+public:
+	read_body_client(boost::asio::io_service &io, const std::string &url,
+		int size, int requests, bench::bench_result &result)
+		: m_io_service(io)
+		, m_url(url)
+		, m_requests(requests)
+		, m_result(result)
+		, m_data(size)
+		, m_buffer(boost::asio::buffer(m_data))
+		, m_start(0)
+	{}
+
+	void start()
+	{
+		if (m_requests-- <= 0)
+		{
+			return;
+		}
+
+		m_start = bench::now_us();
+		m_stream.reset(new avhttp::http_stream(m_io_service));
+		avhttp::async_read_body(*m_stream, m_url, m_buffer,
+			boost::bind(&read_body_client::handle_body, this,
+				boost::asio::placeholders::error,
+				boost::asio::placeholders::bytes_transferred
+			)
+		);
+	}
+
+private:
+
+	void handle_body(const boost::system::error_code &ec, std::size_t bytes_transferred)
+	{
+		if (ec && ec != boost::asio::error::eof)
+		{
+			std::cerr << "async_read_body: " << ec.message() << std::endl;
+			return;
+		}
+
+		m_result.requests++;
+		m_result.bytes += bytes_transferred;
+		m_result.latencies.push_back(bench::now_us() - m_start);
+		start();
+	}
+
+private:
+	boost::asio::io_service &m_io_service;
+	std::string m_url;
+	int m_requests;
+	bench::bench_result &m_result;
+	boost::scoped_ptr<avhttp::http_stream> m_stream;
+	std::vector<char> m_data;
+	boost::asio::mutable_buffers_1 m_buffer;
+	boost::int64_t m_start;
+};
+
+bench::bench_result bench_read_body(const std::string &name, const std::string &url, const bench_options &opts)
+{
+	bench::bench_result r;
+	r.name = name;
+
+	boost::asio::io_service io;
+	std::vector<boost::shared_ptr<read_body_client> > clients;
+	for (int i = 0; i < opts.concurrency; i++)
+	{
+		int n = opts.requests / opts.concurrency + (i < opts.requests % opts.concurrency ? 1 : 0);
+		clients.push_back(boost::shared_ptr<read_body_client>(
+			new read_body_client(io, url, opts.size, n, r)));
+	}
+
+	boost::int64_t start = bench::now_us();
+	bench::alloc_count_begin();
+	for (std::size_t i = 0; i < clients.size(); i++)
+	{
+		clients[i]->start();
+	}
+	io.run();
+	r.allocations = bench::alloc_count_end();
+	r.elapsed_us = bench::now_us() - start;
+
+	return r;
+}
+
+// 丢弃数据的存储, 使multi_download的测试不受磁盘影响.
+class null_storage : public avhttp::storage_interface
+{
+public:
+	virtual void open(const avhttp::fs::path &, boost::system::error_code &ec)
+	{
+		ec = boost::system::error_code();
+	}
+
+	virtual void close()
+	{}
+
+	virtual std::streamsize write(const char *, boost::uint64_t, int size)
+	{
+		return size;
+	}
+
+	virtual std::streamsize read(char *, boost::uint64_t, int size)
+	{
+		return size;
+	}
+};
+
+avhttp::storage_interface* null_storage_constructor()
+{
+	return new null_storage();
+}
+
+void run_counted(boost::asio::io_service &io, boost::uint64_t &allocations)
+{
+	bench::alloc_count_begin();
+	io.run();
+	allocations = bench::alloc_count_end();
+}
+
+bench::bench_result bench_multi_download(const std::string &name, const std::string &url,
+	const bench_options &opts, int connections)
+{
+	bench::bench_result r;
+	r.name = name;
+
+	avhttp::fs::path meta = avhttp::fs::temp_directory_path() /
+		avhttp::fs::unique_path("avhttp-bench-%%%%%%%%.meta");
+
+	boost::int64_t start = bench::now_us();
+	for (int i = 0; i < opts.md_runs; i++)
+	{
+		boost::int64_t t = bench::now_us();
+		boost::asio::io_service io;
+		avhttp::multi_download d(io);
+
+		avhttp::settings s;
+		s.connections_limit = connections;
+		s.storage = &null_storage_constructor;
+		s.meta_file = meta;
+
+		bench::alloc_count_begin();
+		boost::system::error_code ec;
+		d.start(url, s, ec);
+		r.allocations += bench::alloc_count_end();
+		if (ec)
+		{
+			std::cerr << name << ": " << ec.message() << std::endl;
+			break;
+		}
+
+		boost::uint64_t allocations = 0;
+		boost::thread t1(boost::bind(&run_counted, boost::ref(io), boost::ref(allocations)));
+		d.wait_for_complete();
+		t1.join();
+		r.allocations += allocations;
+
+		r.requests++;
+		r.bytes += d.bytes_download();
+		r.latencies.push_back(bench::now_us() - t);
+
+		boost::system::error_code ignore;
+		avhttp::fs::remove(meta, ignore);
+	}
+	r.elapsed_us = bench::now_us() - start;
+
+	return r;
+}
+
+bool selected(const bench_options &opts, const std::string &name)
+{
+	return opts.filter.empty() || name.find(opts.filter) != std::string::npos;
+}
+
+int main(int argc, char **argv)
+{
+	bench_options opts;
+	bench::server_options server_opts;
+
+	po::options_description desc("avhttp benchmark options");
+	desc.add_options()
+		("help", "show this message")
+		("requests", po::value<int>(&opts.requests)->default_value(200), "requests per benchmark")
+		("size", po::value<int>(&opts.size)->default_value(64 * 1024), "response body size")
+		("concurrency", po::value<int>(&opts.concurrency)->default_value(8), "concurrent async clients")
+		("latency", po::value<int>(&server_opts.latency)->default_value(0), "server latency per response (ms)")
+		("bandwidth", po::value<int>(&server_opts.bandwidth)->default_value(-1), "server bandwidth per connection (byte/s)")
+		("md-size", po::value<int>(&opts.md_size)->default_value(16 * 1024 * 1024), "multi_download file size")
+		("md-runs", po::value<int>(&opts.md_runs)->default_value(3), "multi_download runs per connection count")
+		("filter", po::value<std::string>(&opts.filter), "only run benchmarks whose name contains this")
+		;
+
+	po::variables_map vm;
+	try
+	{
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl << desc << std::endl;
+		return -1;
+	}
+
+	if (vm.count("help"))
+	{
+		std::cout << desc << std::endl;
+		return 0;
+	}
+
+	opts.concurrency = (std::max)(opts.concurrency, 1);
+
+	bench::loopback_server server(server_opts);
+	const std::string size = boost::lexical_cast<std::string>(opts.size);
+	const std::string url = server.url("/" + size);
+	const std::string c = boost::lexical_cast<std::string>(opts.concurrency);
+
+	bench::print_header();
+
+	if (selected(opts, "http_stream sync"))
+	{
+		bench::print_result(bench_sync("http_stream sync", url, opts, false));
+	}
+	if (selected(opts, "http_stream sync chunked"))
+	{
+		bench::print_result(bench_sync("http_stream sync chunked", server.url("/" + size + "?chunked=1"), opts, false));
+	}
+#ifdef AVHTTP_ENABLE_ZLIB
+	if (selected(opts, "http_stream sync gzip"))
+	{
+		bench::print_result(bench_sync("http_stream sync gzip", url, opts, true));
+	}
+#endif
+	if (selected(opts, "http_stream async c=" + c))
+	{
+		bench::print_result(bench_async("http_stream async c=" + c, url, opts));
+	}
+	if (selected(opts, "async_read_body c=" + c))
+	{
+		bench::print_result(bench_read_body("async_read_body c=" + c, url, opts));
+	}
+
+	const std::string md_url = server.url("/" + boost::lexical_cast<std::string>(opts.md_size));
+	const int connections[] = { 1, 2, 4, 8 };
+	for (std::size_t i = 0; i < sizeof(connections) / sizeof(connections[0]); i++)
+	{
+		std::string name = "multi_download conn=" + boost::lexical_cast<std::string>(connections[i]);
+		if (selected(opts, name))
+		{
+			bench::print_result(bench_multi_download(name, md_url, opts, connections[i]));
+		}
+	}
+
+	return 0;
+}
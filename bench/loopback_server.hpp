@@ -0,0 +1,524 @@
+//
+// loopback_server.hpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __LOOPBACK_SERVER_HPP__
+#define __LOOPBACK_SERVER_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/format.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#ifdef AVHTTP_ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
+// 用于测试和性能测试的本地回环HTTP/1.1服务器, 运行在独立的线程中.
+//
+// 请求的路径为body的大小, 如"/1048576"返回1M字节的数据, 数据内容是确定的, 第i个字节
+// 为body_corpus()[i % body_corpus().size()], 可以直接校验. 支持以下特性:
+//  Range: bytes=a-b, bytes=a-    返回206, 区间无效时返回416.
+//  Connection: close/keep-alive  HTTP/1.1默认为长连接.
+//  Accept-Encoding: gzip/deflate 非Range请求返回gzip(优先)或deflate压缩的数据, 需要AVHTTP_ENABLE_ZLIB.
+//  ?chunked=1                    使用chunked编码返回数据.
+// server_options中可以设置每个响应的延迟和每个连接的带宽, 用于模拟广域网.
+
+namespace bench {
+
+// 服务器设置.
+struct server_options
+{
+	server_options()
+		: latency(0)
+		, bandwidth(-1)
+		, write_size(64 * 1024)
+	{}
+
+	// 发送每个响应头之前的延迟, 单位毫秒.
+	int latency;
+
+	// 每个连接的带宽, 单位byte/s, -1为无限制.
+	int bandwidth;
+
+	// 每次写入socket的最大字节数.
+	int write_size;
+};
+
+///返回body数据的内容, 由单词组成的伪文本, 可以被gzip压缩.
+inline const std::string& body_corpus()
+{
+	static std::string corpus;
+	if (corpus.empty())
+	{
+		static const char *words[] = {
+			"http", "stream", "range", "piece", "socket", "buffer", "header", "chunked",
+			"gzip", "proxy", "download", "avhttp", "asio", "boost", "request", "response",
+			"keep-alive", "content", "length", "connection", "timeout", "bitfield", "meta", "url",
+		};
+		const int num_words = sizeof(words) / sizeof(words[0]);
+		boost::uint32_t seed = 2013;
+		corpus.reserve(64 * 1024 + 16);
+		while (corpus.size() < 64 * 1024)
+		{
+			seed = seed * 1103515245 + 12345;
+			corpus += words[(seed >> 16) % num_words];
+			corpus += ((seed >> 8) % 16 == 0) ? '\n' : ' ';
+		}
+		corpus.resize(64 * 1024);
+	}
+	return corpus;
+}
+
+#ifdef AVHTTP_ENABLE_ZLIB
+///使用gzip压缩数据, window_bits为15 + 16时为gzip格式, 15时为zlib格式, -15时为裸deflate.
+inline std::string gzip_compress(const std::string &data, int window_bits = 15 + 16)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+
+	std::string out;
+	out.resize(deflateBound(&zs, data.size()));
+	zs.next_in = (Bytef*)data.data();
+	zs.avail_in = data.size();
+	zs.next_out = (Bytef*)&out[0];
+	zs.avail_out = out.size();
+	deflate(&zs, Z_FINISH);
+	out.resize(zs.total_out);
+	deflateEnd(&zs);
+
+	return out;
+}
+#endif
+
+// 一个客户端连接.
+class loopback_session
+	: public boost::enable_shared_from_this<loopback_session>
+	, public boost::noncopyable
+{
+public:
+	loopback_session(boost::asio::io_service &io, const server_options &opts)
+		: m_socket(io)
+		, m_timer(io)
+		, m_options(opts)
+		, m_offset(0)
+		, m_remaining(0)
+		, m_sent(0)
+		, m_chunked(false)
+		, m_keep_alive(false)
+	{}
+
+	boost::asio::ip::tcp::socket& socket()
+	{
+		return m_socket;
+	}
+
+	void start()
+	{
+		boost::system::error_code ignore;
+		m_socket.set_option(boost::asio::ip::tcp::no_delay(true), ignore);
+		read_request();
+	}
+
+private:
+
+	void read_request()
+	{
+		boost::asio::async_read_until(m_socket, m_request, "\r\n\r\n",
+			boost::bind(&loopback_session::handle_request, shared_from_this(),
+				boost::asio::placeholders::error,
+				boost::asio::placeholders::bytes_transferred
+			)
+		);
+	}
+
+	void handle_request(const boost::system::error_code &ec, std::size_t bytes_transferred)
+	{
+		if (ec)
+		{
+			return;
+		}
+
+		std::string header(boost::asio::buffers_begin(m_request.data()),
+			boost::asio::buffers_begin(m_request.data()) + bytes_transferred);
+		m_request.consume(bytes_transferred);
+
+		// 解析请求行和请求头.
+		std::istringstream is(header);
+		std::string method, target, version, line;
+		is >> method >> target >> version;
+		std::getline(is, line);
+		std::map<std::string, std::string> headers;
+		while (std::getline(is, line))
+		{
+			std::string::size_type pos = line.find(':');
+			if (pos == std::string::npos)
+			{
+				continue;
+			}
+			std::string name = boost::to_lower_copy(boost::trim_copy(line.substr(0, pos)));
+			headers[name] = boost::trim_copy(line.substr(pos + 1));
+		}
+
+		std::string connection = boost::to_lower_copy(headers["connection"]);
+		m_keep_alive = (version == "HTTP/1.1" && connection != "close") || connection == "keep-alive";
+
+		// 路径为body大小, 查询参数chunked=1表示使用chunked编码.
+		std::string path = target;
+		std::string query;
+		std::string::size_type q = target.find('?');
+		if (q != std::string::npos)
+		{
+			path = target.substr(0, q);
+			query = target.substr(q + 1);
+		}
+		boost::int64_t size = std::strtol(path.c_str() + (path.empty() ? 0 : 1), NULL, 10);
+		m_chunked = query.find("chunked=1") != std::string::npos;
+
+		std::string status = "200 OK";
+		std::string extra;
+		boost::int64_t first = 0;
+		boost::int64_t last = size - 1;
+
+		std::string range = headers["range"];
+		if (!range.empty())
+		{
+			boost::int64_t a = -1, b = -1;
+			std::string spec = range.substr(range.find('=') + 1);
+			std::string::size_type dash = spec.find('-');
+			if (dash != std::string::npos)
+			{
+				a = std::strtol(spec.substr(0, dash).c_str(), NULL, 10);
+				b = dash + 1 < spec.size() ? std::strtol(spec.substr(dash + 1).c_str(), NULL, 10) : size - 1;
+			}
+			if (a < 0 || a >= size || b < a)
+			{
+				m_header = boost::str(boost::format("HTTP/1.1 416 Requested Range Not Satisfiable\r\n"
+					"Content-Range: bytes */%lld\r\nContent-Length: 0\r\n%s\r\n")
+					% size % (m_keep_alive ? "" : "Connection: close\r\n"));
+				m_remaining = 0;
+				m_chunked = false;
+				m_gzip.clear();
+				send_response();
+				return;
+			}
+
+			first = a;
+			last = (std::min)(b, size - 1);
+			status = "206 Partial Content";
+			extra += boost::str(boost::format("Content-Range: bytes %lld-%lld/%lld\r\n") % first % last % size);
+		}
+
+		m_offset = first;
+		m_remaining = last - first + 1;
+		m_gzip.clear();
+
+#ifdef AVHTTP_ENABLE_ZLIB
+		// 只压缩完整的body.
+		const std::string &accept_encoding = headers["accept-encoding"];
+		bool gzip = accept_encoding.find("gzip") != std::string::npos;
+		if (range.empty() && (gzip || accept_encoding.find("deflate") != std::string::npos))
+		{
+			std::string body;
+			body.reserve(m_remaining);
+			while (static_cast<boost::int64_t>(body.size()) < m_remaining)
+			{
+				boost::asio::const_buffer b = source(body.size(), m_remaining - body.size());
+				body.append(boost::asio::buffer_cast<const char*>(b), boost::asio::buffer_size(b));
+			}
+			m_gzip = gzip_compress(body, gzip ? 15 + 16 : 15);
+			m_offset = 0;
+			m_remaining = m_gzip.size();
+			extra += gzip ? "Content-Encoding: gzip\r\n" : "Content-Encoding: deflate\r\n";
+		}
+#endif
+
+		if (m_chunked)
+		{
+			extra += "Transfer-Encoding: chunked\r\n";
+		}
+		else
+		{
+			extra += boost::str(boost::format("Content-Length: %lld\r\n") % m_remaining);
+		}
+
+		// 客户端明确要求长连接时回应keep-alive, multi_download依据它判断是否支持长连接.
+		if (!m_keep_alive)
+		{
+			extra += "Connection: close\r\n";
+		}
+		else if (connection == "keep-alive")
+		{
+			extra += "Connection: keep-alive\r\n";
+		}
+
+		m_header = "HTTP/1.1 " + status + "\r\nServer: avhttp-loopback\r\n"
+			"Accept-Ranges: bytes\r\nContent-Type: application/octet-stream\r\n" + extra + "\r\n";
+
+		if (method == "HEAD")
+		{
+			m_remaining = 0;
+			m_chunked = false;
+		}
+
+		send_response();
+	}
+
+	void send_response()
+	{
+		if (m_options.latency > 0)
+		{
+			m_timer.expires_from_now(boost::posix_time::milliseconds(m_options.latency));
+			m_timer.async_wait(boost::bind(&loopback_session::write_header,
+				shared_from_this(), boost::asio::placeholders::error));
+			return;
+		}
+
+		write_header(boost::system::error_code());
+	}
+
+	void write_header(const boost::system::error_code &ec)
+	{
+		if (ec)
+		{
+			return;
+		}
+
+		m_start_time = boost::posix_time::microsec_clock::local_time();
+		m_sent = 0;
+
+		boost::asio::async_write(m_socket, boost::asio::buffer(m_header),
+			boost::bind(&loopback_session::handle_write, shared_from_this(),
+				boost::asio::placeholders::error, 0
+			)
+		);
+	}
+
+	// 得到[offset, offset + length)的数据, 返回的数据可能比length小.
+	boost::asio::const_buffer source(boost::int64_t offset, boost::int64_t length) const
+	{
+		if (!m_gzip.empty())
+		{
+			return boost::asio::buffer(m_gzip.data() + offset, length);
+		}
+
+		const std::string &corpus = body_corpus();
+		std::size_t pos = offset % corpus.size();
+		return boost::asio::buffer(corpus.data() + pos,
+			static_cast<std::size_t>((std::min)(length, boost::int64_t(corpus.size() - pos))));
+	}
+
+	void write_body()
+	{
+		if (m_remaining == 0)
+		{
+			if (m_chunked)
+			{
+				m_chunked = false;
+				boost::asio::async_write(m_socket, boost::asio::buffer("0\r\n\r\n", 5),
+					boost::bind(&loopback_session::handle_write, shared_from_this(),
+						boost::asio::placeholders::error, 0
+					)
+				);
+				return;
+			}
+
+			// 响应完成.
+			if (m_keep_alive)
+			{
+				read_request();
+			}
+			else
+			{
+				boost::system::error_code ignore;
+				m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignore);
+			}
+			return;
+		}
+
+		boost::int64_t length = (std::min)(m_remaining, boost::int64_t(m_options.write_size));
+		if (m_options.bandwidth > 0)
+		{
+			// 每次最多发送10毫秒的数据量, 使发送尽量平滑.
+			length = (std::min)(length, boost::int64_t((std::max)(m_options.bandwidth / 100, 1)));
+		}
+
+		boost::asio::const_buffer data = source(m_offset, length);
+		length = boost::asio::buffer_size(data);
+
+		std::vector<boost::asio::const_buffer> buffers;
+		if (m_chunked)
+		{
+			m_chunk_header = boost::str(boost::format("%x\r\n") % length);
+			buffers.push_back(boost::asio::buffer(m_chunk_header));
+			buffers.push_back(data);
+			buffers.push_back(boost::asio::buffer("\r\n", 2));
+		}
+		else
+		{
+			buffers.push_back(data);
+		}
+
+		boost::asio::async_write(m_socket, buffers,
+			boost::bind(&loopback_session::handle_write, shared_from_this(),
+				boost::asio::placeholders::error, length
+			)
+		);
+	}
+
+	void handle_write(const boost::system::error_code &ec, boost::int64_t length)
+	{
+		if (ec)
+		{
+			return;
+		}
+
+		m_offset += length;
+		m_remaining -= length;
+		m_sent += length;
+
+		// 限速, 等到按带宽计算应当发送完成的时间再继续发送.
+		if (m_options.bandwidth > 0 && length > 0)
+		{
+			boost::posix_time::ptime due = m_start_time +
+				boost::posix_time::microseconds(m_sent * 1000000 / m_options.bandwidth);
+			if (due > boost::posix_time::microsec_clock::local_time())
+			{
+				m_timer.expires_at(due);
+				m_timer.async_wait(boost::bind(&loopback_session::handle_shaping,
+					shared_from_this(), boost::asio::placeholders::error));
+				return;
+			}
+		}
+
+		write_body();
+	}
+
+	void handle_shaping(const boost::system::error_code &ec)
+	{
+		if (!ec)
+		{
+			write_body();
+		}
+	}
+
+private:
+	boost::asio::ip::tcp::socket m_socket;
+	boost::asio::deadline_timer m_timer;
+	server_options m_options;
+	boost::asio::streambuf m_request;
+	std::string m_header;
+	std::string m_chunk_header;
+	std::string m_gzip;
+	boost::int64_t m_offset;
+	boost::int64_t m_remaining;
+	boost::int64_t m_sent;
+	boost::posix_time::ptime m_start_time;
+	bool m_chunked;
+	bool m_keep_alive;
+};
+
+// 本地回环服务器, 监听127.0.0.1上的随机端口.
+class loopback_server : public boost::noncopyable
+{
+public:
+	explicit loopback_server(const server_options &opts = server_options())
+		: m_options(opts)
+		, m_acceptor(m_io_service, boost::asio::ip::tcp::endpoint(
+			boost::asio::ip::address_v4::loopback(), 0))
+	{
+		start_accept();
+		m_thread.reset(new boost::thread(boost::bind(&loopback_server::run, this)));
+	}
+
+	~loopback_server()
+	{
+		stop();
+	}
+
+	///停止服务器.
+	void stop()
+	{
+		if (!m_thread)
+		{
+			return;
+		}
+		m_io_service.stop();
+		m_thread->join();
+		m_thread.reset();
+	}
+
+	///返回监听的端口.
+	unsigned short port() const
+	{
+		return m_acceptor.local_endpoint().port();
+	}
+
+	///返回指定路径的url, 如url("/1024")或url("/1024?chunked=1").
+	std::string url(const std::string &target) const
+	{
+		return boost::str(boost::format("http://127.0.0.1:%d%s") % port() % target);
+	}
+
+private:
+
+	void run()
+	{
+		boost::system::error_code ignore;
+		m_io_service.run(ignore);
+	}
+
+	void start_accept()
+	{
+		boost::shared_ptr<loopback_session> session(new loopback_session(m_io_service, m_options));
+		m_acceptor.async_accept(session->socket(),
+			boost::bind(&loopback_server::handle_accept, this,
+				session, boost::asio::placeholders::error
+			)
+		);
+	}
+
+	void handle_accept(boost::shared_ptr<loopback_session> session, const boost::system::error_code &ec)
+	{
+		if (!ec)
+		{
+			session->start();
+		}
+		start_accept();
+	}
+
+private:
+	boost::asio::io_service m_io_service;
+	server_options m_options;
+	boost::asio::ip::tcp::acceptor m_acceptor;
+	boost::scoped_ptr<boost::thread> m_thread;
+};
+
+} // namespace bench
+
+#endif // __LOOPBACK_SERVER_HPP__
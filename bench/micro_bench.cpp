@@ -0,0 +1,610 @@
+//
+// micro_bench.cpp
+// ~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// 解析和数据结构热点路径的微基准测试: http状态行/头解析, url解析/生成, 路径转义,
+// bencode/bdecode, 碎片化的rangefield以及bitfield.
+//
+// 用法: avhttp_micro_bench [--corpus bench/corpus] [--filter str] [--time 200]
+//       [--check bench/micro_thresholds.txt] [--scale 1.0] [--write file]
+//
+// --check时任何一项的ns/op超过阈值乘以scale即返回非0, 可用于回归测试.
+// --write将本次结果乘以3倍余量写为阈值文件.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/program_options.hpp>
+
+#include "avhttp.hpp"
+
+#include "bench_util.hpp"
+
+namespace po = boost::program_options;
+
+#ifndef AVHTTP_BENCH_CORPUS_DIR
+# define AVHTTP_BENCH_CORPUS_DIR "bench/corpus"
+#endif
+
+// 防止被测代码的结果被编译器优化掉.
+static volatile boost::uint64_t sink = 0;
+
+// 一个测试项, 每次调用run执行ops_per_run个操作.
+struct micro_case
+{
+	std::string name;
+	int ops_per_run;
+	boost::function<boost::uint64_t()> run;
+};
+
+struct micro_result
+{
+	std::string name;
+	double ns_per_op;
+	double allocs_per_op;
+};
+
+// 一组录制的http响应头, 分成状态行和其余的头部分.
+struct header_sample
+{
+	std::string status_line;
+	std::string headers;
+};
+
+///读取整个文件.
+static bool read_file(const std::string &path, std::string &content)
+{
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in)
+	{
+		return false;
+	}
+	std::ostringstream ss;
+	ss << in.rdbuf();
+	content = ss.str();
+	return true;
+}
+
+///按行分割, 去掉行尾的\r.
+static std::vector<std::string> split_lines(const std::string &content)
+{
+	std::vector<std::string> lines;
+	std::istringstream in(content);
+	std::string line;
+	while (std::getline(in, line))
+	{
+		if (!line.empty() && line[line.size() - 1] == '\r')
+		{
+			line.resize(line.size() - 1);
+		}
+		lines.push_back(line);
+	}
+	return lines;
+}
+
+///载入响应头样本, 每组之间以"%%"行分隔, 行尾统一转换为CRLF.
+static std::vector<header_sample> load_headers(const std::string &path)
+{
+	std::vector<header_sample> samples;
+	std::string content;
+	if (!read_file(path, content))
+	{
+		return samples;
+	}
+
+	std::vector<std::string> lines = split_lines(content);
+	header_sample current;
+	for (std::size_t i = 0; i <= lines.size(); i++)
+	{
+		if (i == lines.size() || lines[i] == "%%")
+		{
+			if (!current.status_line.empty())
+			{
+				current.headers += "\r\n";
+				samples.push_back(current);
+			}
+			current = header_sample();
+			continue;
+		}
+		if (lines[i].empty())
+		{
+			continue;
+		}
+		if (current.status_line.empty())
+		{
+			current.status_line = lines[i] + "\r\n";
+		}
+		else
+		{
+			current.headers += lines[i] + "\r\n";
+		}
+	}
+	return samples;
+}
+
+///载入url列表, 忽略空行和#开头的行.
+static std::vector<std::string> load_urls(const std::string &path)
+{
+	std::vector<std::string> urls;
+	std::string content;
+	if (!read_file(path, content))
+	{
+		return urls;
+	}
+	std::vector<std::string> lines = split_lines(content);
+	for (std::size_t i = 0; i < lines.size(); i++)
+	{
+		if (!lines[i].empty() && lines[i][0] != '#')
+		{
+			urls.push_back(lines[i]);
+		}
+	}
+	return urls;
+}
+
+// 固定种子的线性同余随机数, 保证每次生成相同的数据.
+struct lcg
+{
+	lcg(boost::uint32_t seed) : state(seed) {}
+
+	boost::uint32_t next()
+	{
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+
+	boost::uint32_t state;
+};
+
+// 碎片化rangefield的生成参数, 模拟1GB文件多连接下载了一部分时的状态.
+static const boost::int64_t fragmented_size = 1024 * 1024 * 1024;
+static const int fragmented_ranges = 10000;
+static const int fragmented_piece_size = 32 * 1024;
+
+///生成一个有fragmented_ranges个互不相邻区间的rangefield.
+// @param ranges返回生成的区间.
+static void make_fragmented(avhttp::rangefield &field, std::vector<avhttp::range> &ranges)
+{
+	field.reset(fragmented_size);
+	ranges.clear();
+	lcg rand(20130917);
+	boost::int64_t slot = fragmented_size / fragmented_ranges;
+	for (int i = 0; i < fragmented_ranges; i++)
+	{
+		// 每个区间位于自己的槽内, 并在两端留出空隙, 保证不会被合并.
+		boost::int64_t left = i * slot + 1 + rand.next() % (slot / 4);
+		boost::int64_t right = left + 1 + rand.next() % (slot / 2);
+		field.update(left, right);
+		ranges.push_back(avhttp::range(left, right));
+	}
+}
+
+// 各个测试项的数据.
+struct micro_data
+{
+	std::vector<header_sample> headers;
+	std::vector<std::string> urls;
+	std::vector<avhttp::url> parsed_urls;
+	std::vector<std::string> paths;
+	std::vector<std::string> escaped_paths;
+	std::string meta;
+	avhttp::entry meta_entry;
+	avhttp::rangefield fragmented;
+	std::vector<avhttp::range> ranges;
+	std::vector<boost::int64_t> offsets;
+	avhttp::bitfield pieces;
+};
+
+static boost::uint64_t run_status_line(micro_data &d)
+{
+	boost::uint64_t sum = 0;
+	for (std::size_t i = 0; i < d.headers.size(); i++)
+	{
+		int major = 0, minor = 0, status = 0;
+		avhttp::detail::parse_http_status_line(d.headers[i].status_line.begin(),
+			d.headers[i].status_line.end(), major, minor, status);
+		sum += status;
+	}
+	return sum;
+}
+
+static boost::uint64_t run_headers(micro_data &d)
+{
+	boost::uint64_t sum = 0;
+	for (std::size_t i = 0; i < d.headers.size(); i++)
+	{
+		std::string content_type;
+		boost::int64_t content_length = 0;
+		std::string location;
+		avhttp::option::option_item_list headers;
+		avhttp::detail::parse_http_headers(d.headers[i].headers.begin(), d.headers[i].headers.end(),
+			content_type, content_length, location, headers);
+		sum += headers.size() + content_length;
+	}
+	return sum;
+}
+
+static boost::uint64_t run_url_from_string(micro_data &d)
+{
+	boost::uint64_t sum = 0;
+	for (std::size_t i = 0; i < d.urls.size(); i++)
+	{
+		boost::system::error_code ec;
+		avhttp::url u = avhttp::url::from_string(d.urls[i], ec);
+		sum += u.port();
+	}
+	return sum;
+}
+
+static boost::uint64_t run_url_to_string(micro_data &d)
+{
+	boost::uint64_t sum = 0;
+	for (std::size_t i = 0; i < d.parsed_urls.size(); i++)
+	{
+		sum += d.parsed_urls[i].to_string().size();
+	}
+	return sum;
+}
+
+static boost::uint64_t run_escape_path(micro_data &d)
+{
+	boost::uint64_t sum = 0;
+	for (std::size_t i = 0; i < d.paths.size(); i++)
+	{
+		sum += avhttp::detail::escape_path(d.paths[i]).size();
+	}
+	return sum;
+}
+
+static boost::uint64_t run_unescape_path(micro_data &d)
+{
+	boost::uint64_t sum = 0;
+	std::string out;
+	for (std::size_t i = 0; i < d.escaped_paths.size(); i++)
+	{
+		out.clear();
+		avhttp::detail::unescape_path(d.escaped_paths[i], out);
+		sum += out.size();
+	}
+	return sum;
+}
+
+static boost::uint64_t run_bencode(micro_data &d)
+{
+	std::vector<char> buffer;
+	avhttp::bencode(std::back_inserter(buffer), d.meta_entry);
+	return buffer.size();
+}
+
+static boost::uint64_t run_bdecode(micro_data &d)
+{
+	avhttp::entry e = avhttp::bdecode(d.meta.begin(), d.meta.end());
+	return e.type();
+}
+
+static boost::uint64_t run_update_merge(micro_data &d, std::size_t &index)
+{
+	// 重复更新一个已经存在的区间, 区间结构不变, 但下一次查询时需要重新整理整个map.
+	const avhttp::range &r = d.ranges[index++ % d.ranges.size()];
+	d.fragmented.update(r.left, r.right);
+	return d.fragmented.check_range(r.left, r.right);
+}
+
+static boost::uint64_t run_check_range(micro_data &d, std::size_t &index)
+{
+	boost::uint64_t sum = 0;
+	for (int i = 0; i < 64; i++)
+	{
+		const avhttp::range &r = d.ranges[index++ % d.ranges.size()];
+		sum += d.fragmented.check_range(r.left, r.right);
+		sum += d.fragmented.check_range(r.left, r.right + 1);
+	}
+	return sum;
+}
+
+static boost::uint64_t run_out_space(micro_data &d, std::size_t &index)
+{
+	boost::int64_t left = 0, right = 0;
+	d.fragmented.out_space(d.offsets[index++ % d.offsets.size()], left, right);
+	return right - left;
+}
+
+static boost::uint64_t run_range_to_bitfield(micro_data &d)
+{
+	avhttp::bitfield bf;
+	d.fragmented.range_to_bitfield(bf, fragmented_piece_size);
+	return bf.size();
+}
+
+static boost::uint64_t run_bitfield_count(micro_data &d)
+{
+	return d.pieces.count();
+}
+
+///准备所有测试数据.
+static bool prepare(micro_data &d, const std::string &corpus)
+{
+	d.headers = load_headers(corpus + "/headers.txt");
+	d.urls = load_urls(corpus + "/urls.txt");
+	if (d.headers.empty() || d.urls.empty())
+	{
+		std::cerr << "Failed to load corpus from '" << corpus << "'" << std::endl;
+		return false;
+	}
+
+	for (std::size_t i = 0; i < d.urls.size(); i++)
+	{
+		boost::system::error_code ec;
+		avhttp::url u = avhttp::url::from_string(d.urls[i], ec);
+		if (ec)
+		{
+			continue;
+		}
+		d.parsed_urls.push_back(u);
+		std::string path = u.path();
+		std::string unescaped;
+		if (avhttp::detail::unescape_path(path, unescaped))
+		{
+			d.paths.push_back(unescaped);
+			d.escaped_paths.push_back(avhttp::detail::escape_path(unescaped));
+		}
+	}
+
+	make_fragmented(d.fragmented, d.ranges);
+	lcg rand(1379405592);
+	for (int i = 0; i < 1024; i++)
+	{
+		d.offsets.push_back(((boost::int64_t)rand.next() << 8) % fragmented_size);
+	}
+	d.fragmented.range_to_bitfield(d.pieces, fragmented_piece_size);
+
+	// 与multi_download保存的meta文件相同的结构, 包含每个分片的hash.
+	avhttp::entry &e = d.meta_entry;
+	e = avhttp::entry();
+	e["final_url"] = d.urls[0];
+	e["file_size"] = fragmented_size;
+	e["piece_size"] = fragmented_piece_size;
+	e["piece_num"] = d.pieces.size();
+	e["hash"] = "sha1";
+	avhttp::entry::list_type hashes;
+	for (std::size_t i = 0; i < d.pieces.size(); i++)
+	{
+		std::string hash;
+		if (d.pieces.get_bit(i))
+		{
+			hash.resize(20);
+			for (int j = 0; j < 20; j++)
+			{
+				hash[j] = static_cast<char>(rand.next());
+			}
+		}
+		hashes.push_back(avhttp::entry(hash));
+	}
+	e["piece_hashes"] = hashes;
+	e["bitfield"] = std::string(d.pieces.bytes(), d.pieces.bytes_size());
+	std::vector<char> buffer;
+	avhttp::bencode(std::back_inserter(buffer), e);
+	d.meta.assign(buffer.begin(), buffer.end());
+
+	return true;
+}
+
+///以至少min_ms毫秒的时间执行测试项, 取3次中最好的结果.
+static micro_result measure(const micro_case &c, int min_ms)
+{
+	// 先找到耗时足够长的执行次数.
+	boost::int64_t runs = 1;
+	boost::int64_t elapsed = 0;
+	for (;;)
+	{
+		boost::int64_t start = bench::now_us();
+		for (boost::int64_t i = 0; i < runs; i++)
+		{
+			sink += c.run();
+		}
+		elapsed = bench::now_us() - start;
+		if (elapsed * 10 >= min_ms * 1000)
+		{
+			break;
+		}
+		runs *= 2;
+	}
+	runs = (std::max)(runs, runs * min_ms * 1000 / (std::max)(elapsed, boost::int64_t(1)));
+
+	micro_result result;
+	result.name = c.name;
+	result.ns_per_op = -1;
+	result.allocs_per_op = 0;
+	for (int round = 0; round < 3; round++)
+	{
+		bench::alloc_count_begin();
+		boost::int64_t start = bench::now_us();
+		for (boost::int64_t i = 0; i < runs; i++)
+		{
+			sink += c.run();
+		}
+		elapsed = bench::now_us() - start;
+		boost::uint64_t allocs = bench::alloc_count_end();
+
+		double ops = double(runs) * c.ops_per_run;
+		double ns = elapsed * 1000.0 / ops;
+		if (result.ns_per_op < 0 || ns < result.ns_per_op)
+		{
+			result.ns_per_op = ns;
+		}
+		result.allocs_per_op = allocs / ops;
+	}
+	return result;
+}
+
+///载入阈值文件, 每行为"名称 ns/op", #开头的行为注释.
+static std::map<std::string, double> load_thresholds(const std::string &path, bool &ok)
+{
+	std::map<std::string, double> thresholds;
+	std::string content;
+	ok = read_file(path, content);
+	std::vector<std::string> lines = split_lines(content);
+	for (std::size_t i = 0; i < lines.size(); i++)
+	{
+		if (lines[i].empty() || lines[i][0] == '#')
+		{
+			continue;
+		}
+		std::istringstream in(lines[i]);
+		std::string name;
+		double value = 0;
+		if (in >> name >> value)
+		{
+			thresholds[name] = value;
+		}
+	}
+	return thresholds;
+}
+
+int main(int argc, char **argv)
+{
+	std::string corpus;
+	std::string filter;
+	std::string check_file;
+	std::string write_file;
+	double scale = 1.0;
+	int min_ms = 200;
+
+	po::options_description desc("avhttp micro benchmark options");
+	desc.add_options()
+		("help,h", "help message")
+		("corpus", po::value<std::string>(&corpus)->default_value(AVHTTP_BENCH_CORPUS_DIR), "corpus directory")
+		("filter", po::value<std::string>(&filter), "only run benchmarks whose name contains this")
+		("time", po::value<int>(&min_ms)->default_value(200), "minimum time per measurement (ms)")
+		("check", po::value<std::string>(&check_file), "fail if any result exceeds the thresholds in this file")
+		("scale", po::value<double>(&scale)->default_value(1.0), "multiply all thresholds by this factor")
+		("write", po::value<std::string>(&write_file), "write thresholds (3x the results) to this file")
+		;
+
+	po::variables_map vm;
+	try
+	{
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl << desc << std::endl;
+		return -1;
+	}
+
+	if (vm.count("help"))
+	{
+		std::cout << desc << std::endl;
+		return 0;
+	}
+
+	micro_data data;
+	if (!prepare(data, corpus))
+	{
+		return -1;
+	}
+
+	std::size_t index = 0;
+	int headers = static_cast<int>(data.headers.size());
+	std::vector<micro_case> cases;
+	micro_case c;
+
+	c.name = "parse_http_status_line"; c.ops_per_run = headers;
+	c.run = boost::bind(&run_status_line, boost::ref(data)); cases.push_back(c);
+	c.name = "parse_http_headers"; c.ops_per_run = headers;
+	c.run = boost::bind(&run_headers, boost::ref(data)); cases.push_back(c);
+	c.name = "url.from_string"; c.ops_per_run = static_cast<int>(data.urls.size());
+	c.run = boost::bind(&run_url_from_string, boost::ref(data)); cases.push_back(c);
+	c.name = "url.to_string"; c.ops_per_run = static_cast<int>(data.parsed_urls.size());
+	c.run = boost::bind(&run_url_to_string, boost::ref(data)); cases.push_back(c);
+	c.name = "escape_path"; c.ops_per_run = static_cast<int>(data.paths.size());
+	c.run = boost::bind(&run_escape_path, boost::ref(data)); cases.push_back(c);
+	c.name = "unescape_path"; c.ops_per_run = static_cast<int>(data.escaped_paths.size());
+	c.run = boost::bind(&run_unescape_path, boost::ref(data)); cases.push_back(c);
+	c.name = "bencode.meta"; c.ops_per_run = 1;
+	c.run = boost::bind(&run_bencode, boost::ref(data)); cases.push_back(c);
+	c.name = "bdecode.meta"; c.ops_per_run = 1;
+	c.run = boost::bind(&run_bdecode, boost::ref(data)); cases.push_back(c);
+	c.name = "rangefield.check_range"; c.ops_per_run = 128;
+	c.run = boost::bind(&run_check_range, boost::ref(data), boost::ref(index)); cases.push_back(c);
+	c.name = "rangefield.update_merge"; c.ops_per_run = 1;
+	c.run = boost::bind(&run_update_merge, boost::ref(data), boost::ref(index)); cases.push_back(c);
+	c.name = "rangefield.out_space"; c.ops_per_run = 1;
+	c.run = boost::bind(&run_out_space, boost::ref(data), boost::ref(index)); cases.push_back(c);
+	c.name = "rangefield.range_to_bitfield"; c.ops_per_run = 1;
+	c.run = boost::bind(&run_range_to_bitfield, boost::ref(data)); cases.push_back(c);
+	c.name = "bitfield.count"; c.ops_per_run = 1;
+	c.run = boost::bind(&run_bitfield_count, boost::ref(data)); cases.push_back(c);
+
+	std::printf("corpus: %d header sets, %d urls, %d ranges in %lld bytes, %d pieces, meta %d bytes\n",
+		headers, (int)data.urls.size(), fragmented_ranges, (long long)fragmented_size,
+		(int)data.pieces.size(), (int)data.meta.size());
+	std::printf("%-32s %12s %11s\n", "benchmark", "ns/op", "allocs/op");
+
+	std::vector<micro_result> results;
+	for (std::size_t i = 0; i < cases.size(); i++)
+	{
+		if (!filter.empty() && cases[i].name.find(filter) == std::string::npos)
+		{
+			continue;
+		}
+		micro_result r = measure(cases[i], min_ms);
+		std::printf("%-32s %12.1f %11.2f\n", r.name.c_str(), r.ns_per_op, r.allocs_per_op);
+		std::fflush(stdout);
+		results.push_back(r);
+	}
+
+	if (!write_file.empty())
+	{
+		std::ofstream out(write_file.c_str());
+		out << "# avhttp_micro_bench regression thresholds, ns/op (Release build, about 3x the" << std::endl;
+		out << "# measured results). Regenerate with --write after intended performance changes." << std::endl;
+		for (std::size_t i = 0; i < results.size(); i++)
+		{
+			out << results[i].name << " " << static_cast<boost::int64_t>(results[i].ns_per_op * 3 + 1) << std::endl;
+		}
+	}
+
+	int failed = 0;
+	if (!check_file.empty())
+	{
+		bool ok = false;
+		std::map<std::string, double> thresholds = load_thresholds(check_file, ok);
+		if (!ok)
+		{
+			std::cerr << "Failed to open thresholds file '" << check_file << "'" << std::endl;
+			return -1;
+		}
+		for (std::size_t i = 0; i < results.size(); i++)
+		{
+			std::map<std::string, double>::iterator it = thresholds.find(results[i].name);
+			if (it == thresholds.end())
+			{
+				continue;
+			}
+			double limit = it->second * scale;
+			if (results[i].ns_per_op > limit)
+			{
+				std::printf("REGRESSION: %s %.1f ns/op > %.1f ns/op\n",
+					results[i].name.c_str(), results[i].ns_per_op, limit);
+				failed++;
+			}
+		}
+		std::printf("%d regression(s) against '%s'\n", failed, check_file.c_str());
+	}
+
+	return failed == 0 ? 0 : 1;
+}
@@ -31,10 +31,9 @@ public:
 		// 设置处理https不进行认证.
 		m_stream.check_certificate(false);
 
-		avhttp::request_opts opt;
-		opt.insert(avhttp::http_options::accept_encoding, "gzip");
-		// 设置接受gzip格式, 需要启用AVHTTP_ENABLE_ZLIB.
-		// m_stream.request_options(opt);
+		// 自动添加Accept-Encoding, 只包括编译时启用的编码(AVHTTP_ENABLE_ZLIB,
+		// AVHTTP_ENABLE_BROTLI, AVHTTP_ENABLE_ZSTD).
+		// m_stream.auto_accept_encoding(true);
 
 		m_stream.async_open(url,
 			boost::bind(&downloader::handle_open, shared_from_this(), boost::asio::placeholders::error));
@@ -0,0 +1,74 @@
+#include <iostream>
+#include <fstream>
+
+#include "avhttp.hpp"
+
+// 从文件中按行读取url, 每次提供一个请求.
+bool next_url(std::istream &in, avhttp::batch_request &request)
+{
+	std::string url;
+	while (std::getline(in, url))
+	{
+		boost::algorithm::trim(url);
+		if (url.empty())
+			continue;
+		request.url = url;
+		return true;
+	}
+	return false;
+}
+
+void on_result(const avhttp::batch_result &result)
+{
+	if (result.status_code == 0)
+		std::cout << result.url << " error: " << result.ec.message() << "\n";
+	else
+		std::cout << result.url << " " << result.status_code << " "
+			<< result.body.size() << " bytes, attempts " << result.attempts << "\n";
+}
+
+void on_complete()
+{
+	std::cout << "all done\n";
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc != 2)
+	{
+		std::cerr << "usage: " << argv[0] << " <url_list.txt>\n";
+		return -1;
+	}
+
+	// 文件中的每一行是一个url, 例如:
+	// http://www.boost.org/LICENSE_1_0.txt
+	// http://www.boost.org/users/license.html
+	std::ifstream file(argv[1]);
+	if (!file)
+	{
+		std::cerr << "can't open " << argv[1] << "\n";
+		return -1;
+	}
+
+	boost::asio::io_service io;
+	avhttp::batch_fetcher fetcher(io);
+
+	// 同时最多100个请求, 每个主机最多6个连接.
+	fetcher.max_concurrency(100);
+	fetcher.max_per_host(6);
+
+	// 失败时最多重试2次, 等待时间从200毫秒开始加倍.
+	fetcher.max_retries(2);
+	fetcher.retry_backoff(boost::posix_time::milliseconds(200), boost::posix_time::seconds(5));
+
+	// 设置处理https不进行认证.
+	fetcher.check_certificate(false);
+
+	// url很多时不必一次全部添加, 由source按需读取.
+	fetcher.source(boost::bind(&next_url, boost::ref(file), _1));
+	fetcher.async_run(&on_result, &on_complete);
+
+	io.run();
+
+	return 0;
+}
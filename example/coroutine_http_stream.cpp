@@ -0,0 +1,90 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "avhttp.hpp"
+
+// 使用C++20协程同时下载多个url, 需要编译器支持co_await, 如g++ -std=c++20.
+// 用法: coroutine_http_stream <url>
+//       coroutine_http_stream <url_list.txt>
+
+#ifdef AVHTTP_HAS_CO_AWAIT
+
+boost::asio::awaitable<void> download(boost::asio::io_service &io, std::string url)
+{
+	avhttp::http_stream stream(io);
+
+	// 设置处理https不进行认证.
+	stream.check_certificate(false);
+
+	try
+	{
+		co_await stream.async_open(url, boost::asio::use_awaitable);
+	}
+	catch (boost::system::system_error &e)
+	{
+		std::cerr << url << ": " << e.what() << std::endl;
+		co_return;
+	}
+
+	// 使用redirect_error得到error_code, 读取到eof时不抛出异常.
+	boost::system::error_code ec;
+	boost::int64_t total = 0;
+	char buffer[4096];
+	while (!ec)
+	{
+		std::size_t bytes_transferred = co_await stream.async_read_some(boost::asio::buffer(buffer),
+			boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+		total += bytes_transferred;
+	}
+
+	std::cout << url << ": " << stream.response_options().find(avhttp::http_options::status_code)
+		<< ", " << total << " bytes, " << stream.timing().total() / 1000.0 << " ms" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc != 2)
+	{
+		std::cerr << "usage: " << argv[0] << " <url>\n";
+		std::cerr << "usage: " << argv[0] << " <url_list.txt>\n";
+		return -1;
+	}
+
+	std::vector<std::string> urls;
+	std::ifstream file(argv[1]);
+	if (file)
+	{
+		// txt文件中的每一行是一个url.
+		std::string url;
+		while (std::getline(file, url))
+		{
+			if (!url.empty())
+				urls.push_back(url);
+		}
+	}
+	else
+	{
+		urls.push_back(argv[1]);
+	}
+
+	boost::asio::io_service io;
+	for (std::size_t i = 0; i < urls.size(); i++)
+	{
+		boost::asio::co_spawn(io, download(io, urls[i]), boost::asio::detached);
+	}
+	io.run();
+
+	return 0;
+}
+
+#else
+
+int main(int argc, char* argv[])
+{
+	std::cerr << "this example requires C++20 coroutine support (AVHTTP_HAS_CO_AWAIT).\n";
+	return -1;
+}
+
+#endif // AVHTTP_HAS_CO_AWAIT
@@ -84,7 +84,11 @@ int main(int argc, char* argv[])
 			std::cout << "file \'" << d.file_name().c_str() <<
 			"\' size is: " << "(" << d.file_size() << " bytes) " << add_suffix((float)d.file_size()).c_str() << std::endl;
 
-		boost::thread t(boost::bind(&boost::asio::io_service::run, &io));
+		// multi_download可以在多个线程中运行io_service, 每个连接的handler在各自的strand中执行.
+		boost::thread_group threads;
+		unsigned int thread_count = (std::max)(boost::thread::hardware_concurrency(), 1u);
+		for (unsigned int i = 0; i < thread_count; i++)
+			threads.create_thread(boost::bind(&boost::asio::io_service::run, &io));
 
 		if (d.file_size() != -1)
 		{
@@ -111,7 +115,7 @@ int main(int argc, char* argv[])
 			printf("\n");
 		}
 
-		t.join();
+		threads.join_all();
 
 		std::cout << "\n*** download completed! ***\n";
 	}
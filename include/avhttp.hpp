@@ -47,9 +47,12 @@ namespace
 
 #include "avhttp/version.hpp"
 #include "avhttp/logging.hpp"
+#include "avhttp/metrics.hpp"
 #include "avhttp/detail/error_codec.hpp"
 #include "avhttp/url.hpp"
 #include "avhttp/http_stream.hpp"
+#include "avhttp/io_service_pool.hpp"
+#include "avhttp/batch_fetcher.hpp"
 #ifndef AVHTTP_DISABLE_MULTI_DOWNLOAD
 #include "avhttp/entry.hpp"
 #include "avhttp/bencode.hpp"
@@ -0,0 +1,172 @@
+//
+// async_open_retry.hpp
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __ASYNC_OPEN_RETRY_HPP__
+#define __ASYNC_OPEN_RETRY_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <boost/shared_ptr.hpp>
+#include <boost/asio/deadline_timer.hpp>
+
+#include "avhttp/http_stream.hpp"
+#include "avhttp/retry_policy.hpp"
+
+namespace avhttp {
+namespace detail {
+
+template <typename AsyncReadStream, typename Handler>
+class open_retry_op
+{
+public:
+	open_retry_op(AsyncReadStream &stream, const avhttp::url &url,
+		retry_policy_ptr policy, Handler handler)
+		: m_stream(stream)
+		, m_url(url)
+		, m_host(origin_key(url))
+		, m_policy(policy)
+		, m_handler(BOOST_ASIO_MOVE_CAST(Handler)(handler))
+		, m_timer(new boost::asio::deadline_timer(stream.get_io_service()))
+		, m_attempts(0)
+	{}
+
+	// 发出请求, 熔断器打开时等待到允许请求.
+	void start()
+	{
+		boost::posix_time::time_duration delay;
+		if (!m_policy->allow_request(m_host, delay))
+		{
+			wait(delay);
+			return;
+		}
+
+		m_attempts++;
+		m_stream.async_open(m_url, *this);
+	}
+
+	// async_open完成.
+	void operator()(const boost::system::error_code &ec)
+	{
+		if (!ec)
+		{
+			m_policy->on_success(m_host);
+			m_handler(ec);
+			return;
+		}
+
+		boost::posix_time::time_duration delay;
+		if (!m_policy->should_retry(m_host, m_attempts, ec, m_stream.response_options(), delay))
+		{
+			m_handler(ec);
+			return;
+		}
+
+		LOG_DEBUG_CAT(log_connect, "Retry \'" << m_url.to_string() << "\' in "
+			<< delay.total_milliseconds() << "ms, " << ec.message());
+
+		// 关闭后在同一个stream上重新请求.
+		boost::system::error_code ignore_ec;
+		m_stream.close(ignore_ec);
+		wait(delay);
+	}
+
+	void handle_timer(const boost::system::error_code &ec)
+	{
+		if (ec)
+		{
+			m_handler(ec);
+			return;
+		}
+		start();
+	}
+
+private:
+	void wait(const boost::posix_time::time_duration &delay)
+	{
+		m_timer->expires_from_now(delay);
+		m_timer->async_wait(boost::bind(&open_retry_op::handle_timer, *this,
+			boost::asio::placeholders::error));
+	}
+
+private:
+	AsyncReadStream &m_stream;
+	avhttp::url m_url;
+	std::string m_host;
+	retry_policy_ptr m_policy;
+	Handler m_handler;
+	// 操作在各个handler中复制, 定时器共享.
+	boost::shared_ptr<boost::asio::deadline_timer> m_timer;
+	int m_attempts;
+};
+
+} // namespace detail
+
+
+///按重试策略异步打开url.
+// 失败时由policy决定是否重试和等待的时间, 在同一个stream上关闭后重新async_open,
+// 直到成功, 或者policy不再重试, 并通过handler回调通知用户.
+// @注意:
+//  1. 返回的错误与async_open相同, 非200/206的状态以对应的errc表示, 是最后一次请求的错误.
+//  2. 在完成整个过程中, 应该保持stream的生命期. 等待重试期间关闭stream不会取消等待.
+//  3. 请求的选项在每次请求时重新使用, 所以需要在调用之前设置好request_options.
+// @param stream 一个http_stream对象.
+// @param url 指定的url.
+// @param policy 使用的重试策略, 可以在多个请求之间共享, 共享熔断器和重试预算.
+// @param handler 在请求成功或放弃重试时, 将被回调, 它满足以下条件:
+// @begin code
+//  void handler(
+//    const boost::system::error_code &ec	// 用于返回操作状态.
+//  );
+// @end code
+// @begin example
+//  void handler(const boost::system::error_code &ec)
+//  {
+//      // 处理异步回调.
+//  }
+//  ...
+//  avhttp::retry_policy_ptr policy(new avhttp::default_retry_policy());
+//  avhttp::http_stream h(io);
+//  avhttp::async_open_retry(h, "http://www.boost.org/LICENSE_1_0.txt", policy, handler);
+//  io.run();
+//  ...
+// @end example
+template <typename AsyncReadStream, typename Handler>
+void async_open_retry(AsyncReadStream &stream,
+	const avhttp::url &url, retry_policy_ptr policy, Handler handler)
+{
+	detail::open_retry_op<AsyncReadStream, Handler>(stream, url, policy, handler).start();
+}
+
+#ifdef AVHTTP_HAS_CO_AWAIT
+///使用完成令牌的async_open_retry, 如boost::asio::use_awaitable.
+// @begin example
+//  co_await avhttp::async_open_retry(h, "http://www.boost.org/LICENSE_1_0.txt",
+//      policy, boost::asio::use_awaitable);
+// @end example
+template <typename AsyncReadStream, typename CompletionToken>
+	requires detail::completion_token<CompletionToken, void (boost::system::error_code)>
+BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code))
+async_open_retry(AsyncReadStream &stream,
+	const avhttp::url &url, retry_policy_ptr policy, CompletionToken token)
+{
+	return boost::asio::async_initiate<CompletionToken, void (boost::system::error_code)>(
+		[&stream](auto handler, const avhttp::url &url, retry_policy_ptr policy)
+		{
+			auto h = detail::make_shared_handler(std::move(handler));
+			detail::open_retry_op<AsyncReadStream, decltype(h)>(stream, url, policy, h).start();
+		}, token, url, policy);
+}
+#endif // AVHTTP_HAS_CO_AWAIT
+
+} // namespace avhttp
+
+#endif // __ASYNC_OPEN_RETRY_HPP__
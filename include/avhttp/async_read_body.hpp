@@ -118,6 +118,26 @@ AVHTTP_DECL void async_read_body(AsyncReadStream &stream,
 	detail::make_read_body_op(stream, url, buffers, handler);
 }
 
+#ifdef AVHTTP_HAS_CO_AWAIT
+///使用完成令牌的async_read_body, 如boost::asio::use_awaitable, 返回读取的字节数.
+// @begin example
+//  std::size_t n = co_await avhttp::async_read_body(h, "http://www.boost.org/LICENSE_1_0.txt",
+//      buffers, boost::asio::use_awaitable);
+// @end example
+template<typename AsyncReadStream, typename MutableBufferSequence, typename CompletionToken>
+	requires detail::completion_token<CompletionToken, void (boost::system::error_code, std::size_t)>
+BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code, std::size_t))
+async_read_body(AsyncReadStream &stream,
+	const avhttp::url &url, MutableBufferSequence &buffers, CompletionToken token)
+{
+	return boost::asio::async_initiate<CompletionToken, void (boost::system::error_code, std::size_t)>(
+		[&stream, &buffers](auto handler, const avhttp::url &url)
+		{
+			detail::make_read_body_op(stream, url, buffers, detail::make_shared_handler(std::move(handler)));
+		}, token, url);
+}
+#endif // AVHTTP_HAS_CO_AWAIT
+
 } // namespace avhttp
 
 #endif // __AVHTTP_MISC_HTTP_READBODY_HPP__
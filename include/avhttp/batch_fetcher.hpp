@@ -0,0 +1,847 @@
+//
+// batch_fetcher.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __BATCH_FETCHER_HPP__
+#define __BATCH_FETCHER_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+#include <string>
+#include <cstdlib>		// for std::atoi
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "avhttp/http_stream.hpp"
+
+// 每个连接读取body的缓冲大小.
+#ifndef AVHTTP_BATCH_BUFFER_SIZE
+# define AVHTTP_BATCH_BUFFER_SIZE (16 * 1024)
+#endif
+
+namespace avhttp {
+
+///批量请求中的一个请求.
+struct batch_request
+{
+	batch_request()
+	{}
+
+	batch_request(const std::string &u)
+		: url(u)
+	{}
+
+	// 请求的url.
+	std::string url;
+
+	// 请求选项, 如_request_method, _request_body和其它请求头, 参见http_stream::request_options.
+	request_opts opts;
+
+	// 接收body数据的回调, 为空时body保存在batch_result::body中.
+	// 数据交给body_sink后请求不再重试.
+	boost::function<void (const char*, std::size_t)> body_sink;
+};
+
+///批量请求的结果.
+struct batch_result
+{
+	batch_result()
+		: id(0)
+		, status_code(0)
+		, attempts(0)
+	{}
+
+	// add返回的请求编号.
+	std::size_t id;
+
+	// 请求的url.
+	std::string url;
+
+	// 与http_stream::async_open相同, 状态不是200/206时为对应的errc, 但body仍然会被读取.
+	// 连接或读取出错时为相应的错误, stop后没有完成的请求为operation_aborted.
+	boost::system::error_code ec;
+
+	// http状态码, 没有收到响应时为0.
+	int status_code;
+
+	// 响应头.
+	response_opts headers;
+
+	// 解码后的body, 请求指定了body_sink时为空.
+	std::string body;
+
+	// 发出请求的次数, 包括重试.
+	int attempts;
+};
+
+///批量请求多个url.
+// 请求按主机排队, 在全局和每个主机的并发限制内轮流从各个主机取出请求, 同一主机的
+// 请求复用keep-alive连接. 请求完成(包括失败)时通过回调返回结果, 结果按完成的顺序返回,
+// 每个请求有且只有一个结果.
+// 连接出错, 超时和408/429/500/502/503/504的响应按指数退避重试, 只重试GET/HEAD/PUT/
+// DELETE/OPTIONS/TRACE请求. 在复用的连接上发送请求失败时(服务器已经关闭了空闲连接),
+// 立即在新的连接上重发, 不计入重试次数.
+// @备注: batch_fetcher不是线程安全的, 所有调用都应在运行io_service的线程中进行. 在
+//  完成回调之前必须保持batch_fetcher的生命期, stop后同样需要等待完成回调.
+// @begin example
+//  void on_result(const avhttp::batch_result &r)
+//  {
+//      std::cout << r.url << " " << r.status_code << " " << r.body.size() << std::endl;
+//  }
+//  ...
+//  avhttp::batch_fetcher fetcher(io);
+//  fetcher.max_concurrency(128);
+//  for (std::size_t i = 0; i < urls.size(); i++)
+//      fetcher.add(urls[i]);
+//  fetcher.async_run(on_result, on_complete);
+//  io.run();
+// @end example
+class batch_fetcher : public boost::noncopyable
+{
+public:
+	// 返回结果的回调.
+	typedef boost::function<void (const batch_result&)> result_handler;
+
+	// 所有请求完成的回调.
+	typedef boost::function<void ()> complete_handler;
+
+	// 按需提供请求, 返回false表示没有更多的请求.
+	typedef boost::function<bool (batch_request&)> request_source;
+
+private:
+	// 一个请求的状态.
+	struct job
+	{
+		job()
+			: sink_used(false)
+			, fresh_connection(false)
+		{}
+
+		batch_request request;
+		batch_result result;
+		std::string host;			// 连接复用的键, protocol://host:port.
+		boost::system::error_code url_error;
+		bool sink_used;				// 已经有数据交给了body_sink.
+		bool fresh_connection;		// 在复用的连接上失败, 需要在新的连接上重发.
+		boost::scoped_ptr<boost::asio::deadline_timer> timer;	// 等待重试的定时器.
+	};
+	typedef boost::shared_ptr<job> job_ptr;
+
+	// 一个连接.
+	struct connection
+	{
+		connection(boost::asio::io_service &io, const std::string &key)
+			: stream(io)
+			, host(key)
+			, buffer(AVHTTP_BATCH_BUFFER_SIZE)
+			, reused(false)
+			, chunked(false)
+			, final_crlf(false)
+		{}
+
+		http_stream stream;
+		std::string host;
+		job_ptr current;
+		std::vector<char> buffer;
+		bool reused;				// 当前请求在复用的连接上发送.
+		bool chunked;				// 当前响应为chunked编码.
+		bool final_crlf;			// 已经读到最后一个块, 还需要跳过结尾的CRLF.
+	};
+	typedef boost::shared_ptr<connection> connection_ptr;
+
+	// 一个主机上的请求和连接.
+	struct host_state
+	{
+		host_state()
+			: active(0)
+			, ready(false)
+		{}
+
+		std::deque<job_ptr> queue;			// 等待发送的请求.
+		std::vector<connection_ptr> idle;	// 空闲的keep-alive连接.
+		int active;							// 正在进行请求的连接数.
+		bool ready;							// 是否在m_ready中.
+	};
+	typedef std::map<std::string, host_state> host_map;
+
+public:
+	explicit batch_fetcher(boost::asio::io_service &io)
+		: m_io_service(io)
+		, m_max_concurrency(64)
+		, m_max_per_host(6)
+		, m_max_retries(2)
+		, m_backoff_base(boost::posix_time::milliseconds(100))
+		, m_backoff_max(boost::posix_time::seconds(10))
+		, m_check_certificate(true)
+		, m_next_id(0)
+		, m_outstanding(0)
+		, m_running(0)
+		, m_idle(0)
+		, m_started(false)
+		, m_stopped(false)
+		, m_completed(false)
+		, m_source_done(true)
+	{}
+
+	~batch_fetcher()
+	{}
+
+public:
+
+	///设置同时进行的请求数, 默认为64.
+	void max_concurrency(int n)
+	{
+		m_max_concurrency = (std::max)(n, 1);
+	}
+
+	///设置每个主机同时进行的请求数, 也就是每个主机的连接数, 默认为6.
+	void max_per_host(int n)
+	{
+		m_max_per_host = (std::max)(n, 1);
+	}
+
+	///设置失败后的最大重试次数, 默认为2.
+	void max_retries(int n)
+	{
+		m_max_retries = (std::max)(n, 0);
+	}
+
+	///设置重试的退避时间.
+	// @param base 第一次重试前等待的时间, 之后每次加倍, 默认为100毫秒.
+	// @param max 等待时间的上限, 默认为10秒.
+	void retry_backoff(const boost::posix_time::time_duration &base,
+		const boost::posix_time::time_duration &max)
+	{
+		m_backoff_base = base;
+		m_backoff_max = max;
+	}
+
+	///设置每个请求的超时, 参见http_stream::timeouts.
+	void timeouts(const timeout_settings &s)
+	{
+		m_timeouts = s;
+	}
+
+	///设置是否认证服务器证书, 默认为认证.
+	void check_certificate(bool is_check)
+	{
+		m_check_certificate = is_check;
+	}
+
+	///添加一个请求.
+	// @param request 请求的url和选项.
+	// @返回请求的编号, 与batch_result::id对应.
+	// @备注: 可以在async_run之后(包括在结果回调中)继续添加请求.
+	std::size_t add(const batch_request &request)
+	{
+		job_ptr j(new job);
+		j->request = request;
+		enqueue(j);
+		if (m_started)
+			dispatch();
+		return j->result.id;
+	}
+
+	///添加一个GET请求.
+	std::size_t add(const std::string &url)
+	{
+		return add(batch_request(url));
+	}
+
+	///设置请求的来源.
+	// @param source 在正在进行和等待中的请求少于2倍的max_concurrency时被调用, 每次
+	//  提供一个请求, 返回false时不再调用. 用于请求数量很大时不必预先全部添加.
+	void source(const request_source &source)
+	{
+		m_source = source;
+		m_source_done = !source;
+	}
+
+	///开始请求.
+	// @param on_result 每个请求完成时回调, 满足以下条件:
+	// @begin code
+	//  void on_result(const batch_result &result);
+	// @end code
+	// @param on_complete 所有请求完成(或stop后所有请求都已返回结果)时回调, 满足以下条件:
+	// @begin code
+	//  void on_complete();
+	// @end code
+	void async_run(const result_handler &on_result, const complete_handler &on_complete)
+	{
+		m_result_handler = on_result;
+		m_complete_handler = on_complete;
+		m_started = true;
+		m_io_service.post(boost::bind(&batch_fetcher::start, this));
+	}
+
+	///停止所有请求.
+	// 等待中的请求和正在进行的请求以operation_aborted返回结果, 然后回调on_complete.
+	void stop()
+	{
+		if (m_stopped)
+			return;
+		m_stopped = true;
+		m_source_done = true;
+
+		boost::system::error_code ignore_ec;
+		for (host_map::iterator i = m_hosts.begin(); i != m_hosts.end(); i++)
+		{
+			host_state &hs = i->second;
+			for (std::deque<job_ptr>::iterator j = hs.queue.begin(); j != hs.queue.end(); j++)
+				post_failure(*j, boost::asio::error::operation_aborted);
+			hs.queue.clear();
+			for (std::vector<connection_ptr>::iterator c = hs.idle.begin(); c != hs.idle.end(); c++)
+				(*c)->stream.close(ignore_ec);
+			hs.idle.clear();
+		}
+		m_idle = 0;
+		m_ready.clear();
+
+		for (std::deque<job_ptr>::iterator j = m_invalid.begin(); j != m_invalid.end(); j++)
+			post_failure(*j, boost::asio::error::operation_aborted);
+		m_invalid.clear();
+
+		// 正在进行的请求和等待重试的请求在各自的回调中返回结果.
+		for (std::set<connection_ptr>::iterator c = m_active.begin(); c != m_active.end(); c++)
+			(*c)->stream.close(ignore_ec);
+		for (std::set<job_ptr>::iterator j = m_waiting.begin(); j != m_waiting.end(); j++)
+			(*j)->timer->cancel(ignore_ec);
+
+		check_complete();
+	}
+
+	///返回还没有返回结果的请求数.
+	std::size_t pending() const
+	{
+		return m_outstanding;
+	}
+
+private:
+
+	void start()
+	{
+		dispatch();
+		check_complete();
+	}
+
+	// 把请求放入所属主机的队列.
+	void enqueue(const job_ptr &j)
+	{
+		if (j->result.attempts == 0)
+		{
+			j->result.id = m_next_id++;
+			j->result.url = j->request.url;
+			m_outstanding++;
+
+			url u = url::from_string(j->request.url, j->url_error);
+			if (!j->url_error && u.host().empty())
+				j->url_error = boost::asio::error::invalid_argument;
+			if (j->url_error || m_stopped)
+			{
+				if (m_stopped)
+					j->url_error = boost::asio::error::operation_aborted;
+				m_invalid.push_back(j);
+				return;
+			}
+			j->host = host_key(u);
+		}
+
+		host_state &hs = m_hosts[j->host];
+		if (j->fresh_connection)
+			hs.queue.push_front(j);
+		else
+			hs.queue.push_back(j);
+		mark_ready(j->host, hs);
+	}
+
+	// 主机还有请求并且没有达到连接数限制时, 加入轮询的列表.
+	void mark_ready(const std::string &host, host_state &hs)
+	{
+		if (!hs.ready && !hs.queue.empty() && hs.active < m_max_per_host)
+		{
+			hs.ready = true;
+			m_ready.push_back(host);
+		}
+	}
+
+	// 从请求来源取得更多的请求.
+	void pull_source()
+	{
+		while (!m_source_done && m_outstanding < std::size_t(m_max_concurrency) * 2)
+		{
+			batch_request request;
+			if (!m_source(request))
+			{
+				m_source_done = true;
+				break;
+			}
+			job_ptr j(new job);
+			j->request = request;
+			enqueue(j);
+		}
+	}
+
+	// 在并发限制内从各个主机轮流取出请求发送.
+	void dispatch()
+	{
+		if (m_stopped)
+			return;
+
+		pull_source();
+
+		// url错误的请求直接返回结果.
+		while (!m_invalid.empty())
+		{
+			post_failure(m_invalid.front(), m_invalid.front()->url_error);
+			m_invalid.pop_front();
+		}
+
+		while (m_running < m_max_concurrency && !m_ready.empty())
+		{
+			std::string host = m_ready.front();
+			m_ready.pop_front();
+			host_state &hs = m_hosts[host];
+			hs.ready = false;
+			if (hs.queue.empty() || hs.active >= m_max_per_host)
+				continue;
+
+			job_ptr j = hs.queue.front();
+			hs.queue.pop_front();
+
+			// 优先使用空闲的连接.
+			connection_ptr conn;
+			if (!hs.idle.empty() && !j->fresh_connection)
+			{
+				conn = hs.idle.back();
+				hs.idle.pop_back();
+				m_idle--;
+			}
+			else
+			{
+				conn.reset(new connection(m_io_service, host));
+				conn->stream.timeouts(m_timeouts);
+				conn->stream.check_certificate(m_check_certificate);
+			}
+
+			hs.active++;
+			m_running++;
+			m_active.insert(conn);
+			mark_ready(host, hs);
+
+			start_request(conn, j);
+		}
+	}
+
+	// 在连接上发送请求.
+	void start_request(const connection_ptr &conn, const job_ptr &j)
+	{
+		conn->current = j;
+		conn->chunked = false;
+		conn->final_crlf = false;
+		j->result.attempts++;
+		j->result.ec = boost::system::error_code();
+		j->result.status_code = 0;
+		j->result.headers.clear();
+		j->result.body.clear();
+
+		request_opts opts = j->request.opts;
+		if (opts.find(http_options::connection).empty())
+			opts.insert(http_options::connection, "keep-alive");
+
+		conn->reused = conn->stream.is_open();
+		if (conn->reused)
+		{
+			opts.insert(http_options::url, j->request.url);
+			conn->stream.async_request(opts,
+				boost::bind(&batch_fetcher::handle_open, this, conn, boost::asio::placeholders::error));
+			return;
+		}
+
+		conn->stream.request_options(opts);
+		conn->stream.async_open(j->request.url,
+			boost::bind(&batch_fetcher::handle_open, this, conn, boost::asio::placeholders::error));
+	}
+
+	void handle_open(connection_ptr conn, const boost::system::error_code &ec)
+	{
+		job_ptr j = conn->current;
+		if (m_stopped)
+		{
+			finish_request(conn, boost::asio::error::operation_aborted, false);
+			return;
+		}
+
+		// 非200/206的状态也以错误返回, 这时响应头已经完整, body可以读取.
+		const response_opts &headers = conn->stream.response_options();
+		int status_code = std::atoi(headers.find(http_options::status_code).c_str());
+		if (ec && (status_code == 0 || ec != make_error_code(static_cast<errc::errc_t>(status_code))))
+		{
+			// 服务器关闭了空闲的连接, 同一主机的其它空闲连接很可能也已经关闭, 全部
+			// 关闭后在新的连接上重发, 不计入重试次数.
+			if (conn->reused && !j->fresh_connection && idempotent(j->request))
+			{
+				LOG_DEBUG_CAT(log_connect, "Reused connection failed, resend \'" << j->request.url << "\'");
+				release_connection(conn, false);
+				close_idle(conn->host);
+				j->fresh_connection = true;
+				j->result.attempts--;
+				enqueue(j);
+				resume(conn->host);
+				return;
+			}
+			finish_request(conn, ec, false);
+			return;
+		}
+
+		j->result.ec = ec;
+		j->result.status_code = status_code;
+		j->result.headers = headers;
+
+		// 可以重试的状态不再读取body, 关闭连接后重试.
+		if (retryable_status(status_code) && can_retry(j))
+		{
+			finish_request(conn, ec, false);
+			return;
+		}
+
+		// 这些响应没有body.
+		if (boost::algorithm::iequals(j->request.opts.find(http_options::request_method), "HEAD") ||
+			status_code == errc::no_content || status_code == errc::not_modified ||
+			(status_code >= 100 && status_code < 200))
+		{
+			finish_request(conn, ec, keep_alive(conn));
+			return;
+		}
+
+		conn->chunked = boost::algorithm::iequals(
+			headers.find(http_options::transfer_encoding), "chunked");
+		conn->stream.async_read_some(boost::asio::buffer(conn->buffer),
+			boost::bind(&batch_fetcher::handle_read, this, conn,
+				boost::asio::placeholders::error,
+				boost::asio::placeholders::bytes_transferred
+			)
+		);
+	}
+
+	void handle_read(connection_ptr conn, const boost::system::error_code &ec, std::size_t bytes_transferred)
+	{
+		job_ptr j = conn->current;
+		if (m_stopped)
+		{
+			finish_request(conn, boost::asio::error::operation_aborted, false);
+			return;
+		}
+
+		if (bytes_transferred != 0)
+		{
+			if (j->request.body_sink)
+			{
+				j->sink_used = true;
+				j->request.body_sink(&conn->buffer[0], bytes_transferred);
+			}
+			else
+			{
+				j->result.body.append(&conn->buffer[0], bytes_transferred);
+			}
+		}
+
+		// 没有Content-Length的body以连接关闭结束.
+		if (ec == boost::asio::error::eof)
+		{
+			finish_request(conn, j->result.ec, false);
+			return;
+		}
+		if (ec)
+		{
+			finish_request(conn, ec, false);
+			return;
+		}
+
+		// body读完时返回0, chunked的body在读到最后一个块时返回0, 还需要再读一次跳过结尾的CRLF.
+		if (bytes_transferred == 0 && (!conn->chunked || conn->final_crlf))
+		{
+			finish_request(conn, j->result.ec, keep_alive(conn));
+			return;
+		}
+		if (bytes_transferred == 0)
+			conn->final_crlf = true;
+
+		conn->stream.async_read_some(boost::asio::buffer(conn->buffer),
+			boost::bind(&batch_fetcher::handle_read, this, conn,
+				boost::asio::placeholders::error,
+				boost::asio::placeholders::bytes_transferred
+			)
+		);
+	}
+
+	// 当前请求在连接上结束, 返回结果或者安排重试.
+	// @param ec 请求的结果, 对于http的响应为async_open返回的状态错误.
+	// @param reusable 连接是否可以发送下一个请求.
+	void finish_request(const connection_ptr &conn, const boost::system::error_code &ec, bool reusable)
+	{
+		job_ptr j = conn->current;
+		release_connection(conn, reusable);
+
+		if (m_stopped)
+			deliver(j, boost::asio::error::operation_aborted);
+		else if (!reusable && retryable(j, ec) && can_retry(j))
+			schedule_retry(j);
+		else
+			deliver(j, ec);
+
+		resume(conn->host);
+	}
+
+	// 请求结束后保留或者关闭连接.
+	void release_connection(const connection_ptr &conn, bool reusable)
+	{
+		conn->current.reset();
+
+		host_state &hs = m_hosts[conn->host];
+		hs.active--;
+		m_running--;
+		m_active.erase(conn);
+
+		// 跳转到其它主机后, 连接不再属于这个主机.
+		if (reusable && !m_stopped && same_host(conn))
+		{
+			// 空闲的连接太多时关闭.
+			if (m_idle < std::size_t(m_max_concurrency))
+			{
+				hs.idle.push_back(conn);
+				m_idle++;
+			}
+		}
+		else
+		{
+			boost::system::error_code ignore_ec;
+			conn->stream.close(ignore_ec);
+		}
+	}
+
+	// 关闭主机所有的空闲连接.
+	void close_idle(const std::string &host)
+	{
+		host_state &hs = m_hosts[host];
+		boost::system::error_code ignore_ec;
+		for (std::vector<connection_ptr>::iterator i = hs.idle.begin(); i != hs.idle.end(); i++)
+			(*i)->stream.close(ignore_ec);
+		m_idle -= hs.idle.size();
+		hs.idle.clear();
+	}
+
+	// 一个连接空闲下来后继续发送请求.
+	void resume(const std::string &host)
+	{
+		host_map::iterator i = m_hosts.find(host);
+		if (i != m_hosts.end())
+		{
+			mark_ready(host, i->second);
+			cleanup_host(host);
+		}
+		dispatch();
+		check_complete();
+	}
+
+	// 按指数退避等待后重试.
+	void schedule_retry(const job_ptr &j)
+	{
+		boost::posix_time::time_duration delay = m_backoff_base;
+		for (int i = 1; i < j->result.attempts && delay < m_backoff_max; i++)
+			delay = delay * 2;
+		if (delay > m_backoff_max)
+			delay = m_backoff_max;
+
+		LOG_DEBUG_CAT(log_connect, "Retry \'" << j->request.url << "\' after "
+			<< delay.total_milliseconds() << "ms, attempts " << j->result.attempts);
+
+		j->fresh_connection = false;
+		if (!j->timer)
+			j->timer.reset(new boost::asio::deadline_timer(m_io_service));
+		m_waiting.insert(j);
+		j->timer->expires_from_now(delay);
+		j->timer->async_wait(boost::bind(&batch_fetcher::handle_retry, this, j,
+			boost::asio::placeholders::error));
+	}
+
+	void handle_retry(job_ptr j, const boost::system::error_code &ec)
+	{
+		m_waiting.erase(j);
+		if (m_stopped || ec)
+		{
+			deliver(j, boost::asio::error::operation_aborted);
+			check_complete();
+			return;
+		}
+		enqueue(j);
+		dispatch();
+	}
+
+	// 投递一个没有发送的请求的结果.
+	void post_failure(const job_ptr &j, const boost::system::error_code &ec)
+	{
+		m_io_service.post(boost::bind(&batch_fetcher::handle_failure, this, j, ec));
+	}
+
+	void handle_failure(job_ptr j, const boost::system::error_code &ec)
+	{
+		deliver(j, ec);
+		check_complete();
+	}
+
+	// 返回请求的结果.
+	void deliver(const job_ptr &j, const boost::system::error_code &ec)
+	{
+		j->result.ec = ec;
+		m_outstanding--;
+		if (m_result_handler)
+			m_result_handler(j->result);
+	}
+
+	// 所有请求都返回了结果时回调on_complete.
+	void check_complete()
+	{
+		if (!m_started || m_completed || m_outstanding != 0 || !m_source_done)
+			return;
+		m_completed = true;
+		if (m_complete_handler)
+			m_io_service.post(m_complete_handler);
+	}
+
+	// 删除没有请求和连接的主机.
+	void cleanup_host(const std::string &host)
+	{
+		host_map::iterator i = m_hosts.find(host);
+		if (i == m_hosts.end())
+			return;
+		host_state &hs = i->second;
+		if (hs.queue.empty() && hs.idle.empty() && hs.active == 0 && !hs.ready)
+			m_hosts.erase(i);
+	}
+
+	// 服务器是否会保持连接.
+	bool keep_alive(const connection_ptr &conn) const
+	{
+		const request_opts &opts = conn->current->request.opts;
+		if (boost::algorithm::iequals(opts.find(http_options::connection), "close"))
+			return false;
+		const response_opts &headers = conn->current->result.headers;
+		return !boost::algorithm::iequals(headers.find(http_options::connection), "close");
+	}
+
+	// 连接最终请求的是否还是原来的主机.
+	bool same_host(const connection_ptr &conn) const
+	{
+		boost::system::error_code ec;
+		url u = url::from_string(conn->stream.final_url(), ec);
+		if (ec)
+			return false;
+		return host_key(u) == conn->host;
+	}
+
+	// 连接复用的键.
+	static std::string host_key(const url &u)
+	{
+		return u.protocol() + "://" + boost::algorithm::to_lower_copy(u.host()) + ":" +
+			boost::lexical_cast<std::string>(u.port());
+	}
+
+	// 请求是否可以安全地重发.
+	static bool idempotent(const batch_request &request)
+	{
+		std::string method = request.opts.find(http_options::request_method);
+		if (method.empty())
+			return true;
+		boost::algorithm::to_upper(method);
+		return method == "GET" || method == "HEAD" || method == "PUT" ||
+			method == "DELETE" || method == "OPTIONS" || method == "TRACE";
+	}
+
+	// 服务器暂时无法处理请求的状态.
+	static bool retryable_status(int status_code)
+	{
+		return status_code == errc::request_timeout || status_code == 429 ||
+			status_code == errc::internal_server_error || status_code == errc::bad_gateway ||
+			status_code == errc::service_unavailable || status_code == errc::gateway_timeout;
+	}
+
+	// 连接和超时的错误, 以及可以重试的状态.
+	static bool retryable(const job_ptr &j, const boost::system::error_code &ec)
+	{
+		if (j->result.status_code != 0)
+			return retryable_status(j->result.status_code) && ec == make_error_code(
+				static_cast<errc::errc_t>(j->result.status_code));
+		return ec == boost::asio::error::eof ||
+			ec == boost::asio::error::connection_reset ||
+			ec == boost::asio::error::connection_refused ||
+			ec == boost::asio::error::connection_aborted ||
+			ec == boost::asio::error::broken_pipe ||
+			ec == boost::asio::error::timed_out ||
+			ec == boost::asio::error::network_unreachable ||
+			ec == boost::asio::error::host_unreachable ||
+			ec == boost::asio::error::try_again ||
+			ec == errc::timed_out;
+	}
+
+	bool can_retry(const job_ptr &j) const
+	{
+		return !m_stopped && !j->sink_used && j->result.attempts <= m_max_retries &&
+			idempotent(j->request);
+	}
+
+private:
+	boost::asio::io_service &m_io_service;
+
+	// 设置.
+	int m_max_concurrency;
+	int m_max_per_host;
+	int m_max_retries;
+	boost::posix_time::time_duration m_backoff_base;
+	boost::posix_time::time_duration m_backoff_max;
+	timeout_settings m_timeouts;
+	bool m_check_certificate;
+
+	// 回调.
+	result_handler m_result_handler;
+	complete_handler m_complete_handler;
+	request_source m_source;
+
+	// 主机和请求.
+	host_map m_hosts;
+	std::deque<std::string> m_ready;		// 有请求并且可以建立连接的主机, 轮流发送.
+	std::deque<job_ptr> m_invalid;			// url错误的请求.
+	std::set<connection_ptr> m_active;		// 正在进行请求的连接.
+	std::set<job_ptr> m_waiting;			// 等待重试的请求.
+
+	std::size_t m_next_id;
+	std::size_t m_outstanding;				// 还没有返回结果的请求数.
+	int m_running;							// 正在进行的请求数.
+	std::size_t m_idle;						// 空闲的连接数.
+	bool m_started;
+	bool m_stopped;
+	bool m_completed;
+	bool m_source_done;
+};
+
+} // namespace avhttp
+
+#endif // __BATCH_FETCHER_HPP__
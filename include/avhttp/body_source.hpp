@@ -0,0 +1,350 @@
+//
+// body_source.hpp
+// ~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __BODY_SOURCE_HPP__
+#define __BODY_SOURCE_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <string>
+#include <cerrno>
+#include <cstring>		// for std::memcpy
+#include <algorithm>	// for std::min
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/throw_exception.hpp>
+#include <boost/system/system_error.hpp>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+namespace avhttp {
+
+namespace fs = boost::filesystem;
+
+namespace detail {
+
+// 以只读方式打开的body文件, 按偏移读取, 不改变文件位置.
+class body_file : public boost::noncopyable
+{
+public:
+	body_file()
+		: m_size(0)
+	{
+#if !defined(_WIN32)
+		m_fd = -1;
+#endif
+	}
+
+	~body_file()
+	{
+#if !defined(_WIN32)
+		if (m_fd != -1)
+			::close(m_fd);
+#endif
+	}
+
+	void open(const fs::path &file_path, boost::system::error_code &ec)
+	{
+#if !defined(_WIN32)
+		m_fd = ::open(file_path.string().c_str(), O_RDONLY);
+		if (m_fd == -1)
+		{
+			ec = boost::system::error_code(errno, boost::system::system_category());
+			return;
+		}
+#else
+		m_fstream.open(file_path, std::ios::binary | std::ios::in);
+		if (!m_fstream.is_open())
+		{
+			ec = boost::asio::error::not_found;
+			return;
+		}
+#endif
+		m_size = static_cast<boost::int64_t>(fs::file_size(file_path, ec));
+	}
+
+	// 从offset处读取最多size字节, 返回读取的字节数, 返回0表示已到文件尾.
+	std::size_t read(boost::int64_t offset, char *buf, std::size_t size, boost::system::error_code &ec)
+	{
+#if !defined(_WIN32)
+		for (;;)
+		{
+			ssize_t ret = ::pread(m_fd, buf, size, static_cast<off_t>(offset));
+			if (ret >= 0)
+				return static_cast<std::size_t>(ret);
+			if (errno == EINTR)
+				continue;
+			ec = boost::system::error_code(errno, boost::system::system_category());
+			return 0;
+		}
+#else
+		m_fstream.clear();
+		m_fstream.seekg(offset, std::ios::beg);
+		m_fstream.read(buf, size);
+		if (m_fstream.bad())
+		{
+			ec = boost::asio::error::fault;
+			return 0;
+		}
+		return static_cast<std::size_t>(m_fstream.gcount());
+#endif
+	}
+
+	// 文件大小.
+	boost::int64_t size() const
+	{
+		return m_size;
+	}
+
+#if !defined(_WIN32)
+	// 文件描述符, 用于sendfile.
+	int native_handle() const
+	{
+		return m_fd;
+	}
+#endif
+
+private:
+#if !defined(_WIN32)
+	int m_fd;
+#else
+	fs::ifstream m_fstream;
+#endif
+	boost::int64_t m_size;
+};
+
+} // namespace detail
+
+// 请求的body数据来源, 由http_stream在发送请求头后发送.
+// 长度已知时使用Content-Length, 长度未知(生成器未指定长度)时使用chunked编码.
+// body_source可以复制, 复制后的对象引用同一份数据.
+//
+// 以下是上传文件的示例:
+// @begin example
+//  avhttp::http_stream h(io);
+//  h.request_options(avhttp::request_opts()
+//    (avhttp::http_options::request_method, "PUT"));
+//  h.request_body(avhttp::body_source::from_file("upload.bin"));
+//  h.open("http://example.com/upload.bin");
+// @end example
+class body_source
+{
+public:
+	///生成器类型.
+	// 向buf写入最多size字节的数据, 返回写入的字节数, 返回0表示body结束.
+	// @param ec在出错时保存了详细的错误信息, 出错时请求失败.
+	typedef boost::function<std::size_t (char *buf, std::size_t size,
+		boost::system::error_code &ec)> generator_type;
+
+	// body来源的类型.
+	enum source_type
+	{
+		// 没有body.
+		empty_body,
+
+		// 内存中的数据, 发送时不复制.
+		memory_body,
+
+		// 文件中的一段数据, 非ssl连接在linux上使用sendfile发送.
+		file_body,
+
+		// 由生成器按需生成的数据.
+		generator_body
+	};
+
+public:
+
+	body_source()
+		: m_type(empty_body)
+		, m_data(NULL)
+		, m_offset(0)
+		, m_size(0)
+	{}
+
+	///使用内存中的数据作为body.
+	// @param data指向body数据, 在请求发送完成前必须保持有效.
+	// @param size是数据的大小.
+	static body_source from_memory(const void *data, std::size_t size)
+	{
+		body_source body;
+		body.m_type = memory_body;
+		body.m_data = static_cast<const char*>(data);
+		body.m_size = size;
+		return body;
+	}
+
+	///使用字符串作为body.
+	// @param str是body数据, 会被交换到body_source内部, 调用后str为空, 不发生复制.
+	static body_source from_string(std::string &str)
+	{
+		body_source body;
+		body.m_string.reset(new std::string);
+		body.m_string->swap(str);
+		body.m_type = memory_body;
+		body.m_data = body.m_string->data();
+		body.m_size = body.m_string->size();
+		return body;
+	}
+
+	///使用共享的字符串作为body, 不发生复制.
+	// @param str是body数据, body_source的各个复制共同持有它, 使用期间不能修改.
+	static body_source from_string(const boost::shared_ptr<std::string> &str)
+	{
+		body_source body;
+		body.m_string = str;
+		body.m_type = memory_body;
+		body.m_data = str->data();
+		body.m_size = str->size();
+		return body;
+	}
+
+	///使用文件作为body.
+	// @param file_path是文件路径.
+	// @param offset是数据在文件中的偏移.
+	// @param length是数据长度, -1表示从offset到文件尾.
+	// @param ec在出错时保存了详细的错误信息.
+	static body_source from_file(const fs::path &file_path, boost::int64_t offset,
+		boost::int64_t length, boost::system::error_code &ec)
+	{
+		body_source body;
+		boost::shared_ptr<detail::body_file> file(new detail::body_file);
+		file->open(file_path, ec);
+		if (ec)
+			return body;
+		if (offset < 0 || offset > file->size() ||
+			(length != -1 && (length < 0 || length > file->size() - offset)))
+		{
+			ec = boost::asio::error::invalid_argument;
+			return body;
+		}
+		body.m_type = file_body;
+		body.m_file = file;
+		body.m_offset = offset;
+		body.m_size = (length == -1) ? file->size() - offset : length;
+		return body;
+	}
+
+	///使用整个文件作为body, 失败时抛出异常.
+	// @param file_path是文件路径.
+	static body_source from_file(const fs::path &file_path)
+	{
+		boost::system::error_code ec;
+		body_source body = from_file(file_path, 0, -1, ec);
+		if (ec)
+		{
+			boost::throw_exception(boost::system::system_error(ec));
+		}
+		return body;
+	}
+
+	///使用生成器作为body.
+	// @param generator是数据生成器, 参见generator_type.
+	// @param length是数据的总长度, -1表示未知, 这时使用chunked编码发送.
+	// @备注: 生成器的数据只能发送一次, 不能用于重定向后重新发送.
+	static body_source from_generator(const generator_type &generator, boost::int64_t length = -1)
+	{
+		body_source body;
+		body.m_type = generator_body;
+		body.m_generator = generator;
+		body.m_size = length;
+		return body;
+	}
+
+public:
+
+	///返回body来源的类型.
+	source_type type() const
+	{
+		return m_type;
+	}
+
+	///是否没有body.
+	bool empty() const
+	{
+		return m_type == empty_body;
+	}
+
+	///返回body的长度, -1表示未知.
+	boost::int64_t size() const
+	{
+		return m_size;
+	}
+
+	///返回内存body的数据.
+	const char* data() const
+	{
+		return m_data;
+	}
+
+	///返回文件body所在文件的偏移.
+	boost::int64_t offset() const
+	{
+		return m_offset;
+	}
+
+	///返回文件body的文件.
+	detail::body_file* file() const
+	{
+		return m_file.get();
+	}
+
+	///读取body数据.
+	// @param pos是相对body起始的位置.
+	// @param buf是读取缓冲.
+	// @param size是缓冲的大小.
+	// @param ec在出错时保存了详细的错误信息.
+	// @返回值为读取的字节数, 返回0表示body结束.
+	std::size_t read(boost::int64_t pos, char *buf, std::size_t size, boost::system::error_code &ec) const
+	{
+		ec = boost::system::error_code();
+		if (m_size != -1)
+			size = static_cast<std::size_t>((std::min)(static_cast<boost::int64_t>(size), m_size - pos));
+		if (size == 0)
+			return 0;
+
+		switch (m_type)
+		{
+		case memory_body:
+			std::memcpy(buf, m_data + pos, size);
+			return size;
+		case file_body:
+			return m_file->read(m_offset + pos, buf, size, ec);
+		case generator_body:
+			return m_generator(buf, size, ec);
+		default:
+			return 0;
+		}
+	}
+
+private:
+	source_type m_type;
+	const char *m_data;
+	boost::shared_ptr<std::string> m_string;
+	boost::shared_ptr<detail::body_file> m_file;
+	generator_type m_generator;
+	boost::int64_t m_offset;
+	boost::int64_t m_size;
+};
+
+} // namespace avhttp
+
+#endif // __BODY_SOURCE_HPP__
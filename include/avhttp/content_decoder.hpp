@@ -0,0 +1,68 @@
+//
+// content_decoder.hpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __CONTENT_DECODER_HPP__
+#define __CONTENT_DECODER_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <string>
+#include <boost/system/error_code.hpp>
+
+namespace avhttp {
+
+// 内容解码接口, 用于解码Content-Encoding编码的body数据.
+// http_stream将socket上读取的数据直接交给decode, 解码到用户的缓冲中.
+struct content_decoder
+{
+	content_decoder() {}
+	virtual ~content_decoder() {}
+
+	// 开始解码一个新的body, 同一个解码器会在长连接上被多个响应复用.
+	// @param ec在出错时保存了详细的错误信息.
+	virtual void reset(boost::system::error_code &ec) = 0;
+
+	// 解码数据.
+	// @param in是输入数据, 返回时指向未消耗的数据.
+	// @param in_size是输入数据的大小, 返回时为未消耗的数据大小.
+	// @param out是输出缓冲.
+	// @param out_size是输出缓冲的大小.
+	// @param ec在出错时保存了详细的错误信息.
+	// @返回值为写入out的字节数.
+	// @备注: 返回时必须消耗完全部输入或者填满输出, 否则http_stream无法判断是否需要
+	// 读取更多数据. body解码结束后, 剩余的输入应当全部消耗并丢弃.
+	virtual std::size_t decode(const char *&in, std::size_t &in_size,
+		char *out, std::size_t out_size, boost::system::error_code &ec) = 0;
+
+	// 解码器内部是否还有已经解码但没有输出的数据(上一次decode填满了输出).
+	// 返回true时, http_stream在输入已经全部消耗后仍然会以空的输入调用decode.
+	virtual bool output_pending() const { return false; }
+};
+
+// 重定义content_decoder创建函数指针, http_stream根据响应的Content-Encoding调用它创建
+// 解码器, encoding为小写的编码名称, 不支持的编码返回NULL, 这时body不解码直接返回.
+typedef content_decoder* (*content_decoder_constructor_type)(const std::string &encoding);
+
+///默认的解码器创建函数.
+// 启用AVHTTP_ENABLE_ZLIB时支持gzip, x-gzip和deflate, 启用AVHTTP_ENABLE_BROTLI时支持br,
+// 启用AVHTTP_ENABLE_ZSTD时支持zstd, 其它编码不解码.
+AVHTTP_DECL content_decoder* default_content_decoder_constructor(const std::string &encoding);
+
+///默认的解码器支持的编码, 用于Accept-Encoding, 如"br, zstd, gzip, deflate".
+// 只包括编译时启用的编码, 都没有启用时返回空串.
+AVHTTP_DECL std::string default_accept_encoding();
+
+}
+
+#include "avhttp/impl/content_decoder.ipp"
+
+#endif // __CONTENT_DECODER_HPP__
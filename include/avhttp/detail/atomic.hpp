@@ -0,0 +1,204 @@
+//
+// atomic.hpp
+// ~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __ATOMIC_HPP__
+#define __ATOMIC_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <boost/version.hpp>
+
+// 有boost.atomic(boost-1.53及以上)且启用线程时使用无锁原子操作;
+// 否则启用线程时使用锁, 禁用线程时直接读写.
+#if !defined(AVHTTP_DISABLE_THREAD) && (BOOST_VERSION >= 105300)
+# define AVHTTP_HAS_BOOST_ATOMIC
+# include <boost/atomic.hpp>
+#elif !defined(AVHTTP_DISABLE_THREAD)
+# include <boost/thread/mutex.hpp>
+#endif
+
+namespace avhttp {
+namespace detail {
+
+// 可以被多个io_service线程同时读写的整数或bool值.
+// 与boost::atomic不同, 它可以复制(复制时读取当前值), 所以可以放在容器或可复制的结构中.
+template <typename T>
+class atomic
+{
+public:
+	atomic(T v = T())
+		: m_value(v)
+	{}
+
+	atomic(const atomic &other)
+		: m_value(other.load())
+	{}
+
+	atomic& operator=(const atomic &other)
+	{
+		store(other.load());
+		return *this;
+	}
+
+	atomic& operator=(T v)
+	{
+		store(v);
+		return *this;
+	}
+
+	operator T() const
+	{
+		return load();
+	}
+
+#ifdef AVHTTP_HAS_BOOST_ATOMIC
+
+	T load() const
+	{
+		return m_value.load();
+	}
+
+	void store(T v)
+	{
+		m_value.store(v);
+	}
+
+	T exchange(T v)
+	{
+		return m_value.exchange(v);
+	}
+
+	// 当前值等于expected时改为desired并返回true, 否则把当前值保存到expected并返回false.
+	bool compare_exchange(T &expected, T desired)
+	{
+		return m_value.compare_exchange_strong(expected, desired);
+	}
+
+	T fetch_add(T v)
+	{
+		return m_value.fetch_add(v);
+	}
+
+	T fetch_sub(T v)
+	{
+		return m_value.fetch_sub(v);
+	}
+
+#else
+
+	T load() const
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_mutex);
+#endif
+		return m_value;
+	}
+
+	void store(T v)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_mutex);
+#endif
+		m_value = v;
+	}
+
+	T exchange(T v)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_mutex);
+#endif
+		T old = m_value;
+		m_value = v;
+		return old;
+	}
+
+	bool compare_exchange(T &expected, T desired)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_mutex);
+#endif
+		if (m_value == expected)
+		{
+			m_value = desired;
+			return true;
+		}
+		expected = m_value;
+		return false;
+	}
+
+	T fetch_add(T v)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_mutex);
+#endif
+		T old = m_value;
+		m_value += v;
+		return old;
+	}
+
+	T fetch_sub(T v)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_mutex);
+#endif
+		T old = m_value;
+		m_value -= v;
+		return old;
+	}
+
+#endif // AVHTTP_HAS_BOOST_ATOMIC
+
+	T operator+=(T v)
+	{
+		return fetch_add(v) + v;
+	}
+
+	T operator-=(T v)
+	{
+		return fetch_sub(v) - v;
+	}
+
+	T operator++()
+	{
+		return fetch_add(1) + 1;
+	}
+
+	T operator++(int)
+	{
+		return fetch_add(1);
+	}
+
+	T operator--()
+	{
+		return fetch_sub(1) - 1;
+	}
+
+	T operator--(int)
+	{
+		return fetch_sub(1);
+	}
+
+private:
+#ifdef AVHTTP_HAS_BOOST_ATOMIC
+	boost::atomic<T> m_value;
+#else
+	T m_value;
+#ifndef AVHTTP_DISABLE_THREAD
+	mutable boost::mutex m_mutex;
+#endif
+#endif // AVHTTP_HAS_BOOST_ATOMIC
+};
+
+} // namespace detail
+} // namespace avhttp
+
+#endif // __ATOMIC_HPP__
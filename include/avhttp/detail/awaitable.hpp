@@ -0,0 +1,139 @@
+//
+// awaitable.hpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __AWAITABLE_HPP__
+#define __AWAITABLE_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <boost/version.hpp>
+#include <boost/asio/detail/config.hpp>
+
+// 编译器支持C++20协程和concepts, 并且boost不低于1.70时, 定义AVHTTP_HAS_CO_AWAIT.
+// 此时http_stream, multi_download和async_read_body的异步接口除了handler之外, 还可以
+// 使用boost::asio::use_awaitable等完成令牌. 定义AVHTTP_DISABLE_CO_AWAIT可以禁用.
+#if !defined(AVHTTP_DISABLE_CO_AWAIT) && (BOOST_VERSION >= 107000) \
+	&& defined(BOOST_ASIO_HAS_CO_AWAIT) && defined(__cpp_concepts)
+# define AVHTTP_HAS_CO_AWAIT
+#endif
+
+#include <boost/type_traits/decay.hpp>
+
+#ifdef AVHTTP_HAS_CO_AWAIT
+
+#include <utility>
+#include <type_traits>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+namespace avhttp {
+namespace detail {
+
+// CompletionToken是一个完成令牌(如use_awaitable, use_future), 而不是普通的handler.
+// 普通handler的async_result::return_type为void, 仍然使用原来的异步接口.
+template <typename CompletionToken, typename Signature>
+concept completion_token = !std::is_void<typename boost::asio::async_result<
+	typename std::decay<CompletionToken>::type, Signature>::return_type>::value;
+
+// 完成令牌生成的handler只能移动, 而内部的异步操作需要复制handler(如保存到
+// boost::function中), 所以用shared_ptr包装成可以复制的handler.
+template <typename Handler>
+class shared_handler
+{
+public:
+	explicit shared_handler(Handler &&h)
+		: m_handler(boost::make_shared<Handler>(std::move(h)))
+	{}
+
+	template <typename... Args>
+	void operator()(Args&&... args)
+	{
+		(*m_handler)(std::forward<Args>(args)...);
+	}
+
+private:
+	boost::shared_ptr<Handler> m_handler;
+};
+
+template <typename Handler>
+inline shared_handler<typename std::decay<Handler>::type> make_shared_handler(Handler &&h)
+{
+	return shared_handler<typename std::decay<Handler>::type>(std::forward<Handler>(h));
+}
+
+// asio的read_op/write_op声明了复制构造函数, 但内部的handler只能移动时并不能真正复制,
+// 所以还要检查其内部的handler.
+template <typename T>
+struct is_deep_copyable : std::is_copy_constructible<T> {};
+
+template <typename Stream, typename Buffers, typename Iterator, typename Condition, typename Handler>
+struct is_deep_copyable<boost::asio::detail::read_op<Stream, Buffers, Iterator, Condition, Handler> >
+	: is_deep_copyable<Handler> {};
+
+template <typename Stream, typename Buffers, typename Iterator, typename Condition, typename Handler>
+struct is_deep_copyable<boost::asio::detail::write_op<Stream, Buffers, Iterator, Condition, Handler> >
+	: is_deep_copyable<Handler> {};
+
+// 在协程中使用asio的组合操作(如async_read)时, 传给async_read_some的handler可能只能移动,
+// 这时包装为shared_handler, 其它handler保持不变.
+template <typename Handler>
+struct copyable_handler
+{
+	typedef typename std::decay<Handler>::type handler_type;
+	typedef typename std::conditional<is_deep_copyable<handler_type>::value,
+		handler_type, shared_handler<handler_type> >::type type;
+};
+
+template <typename Handler>
+inline typename copyable_handler<Handler>::type make_copyable_handler(Handler &h)
+{
+	if constexpr (is_deep_copyable<typename std::decay<Handler>::type>::value)
+		return h;
+	else
+		return typename copyable_handler<Handler>::type(std::move(h));
+}
+
+} // namespace detail
+} // namespace avhttp
+
+#else
+
+namespace avhttp {
+namespace detail {
+
+template <typename Handler>
+struct copyable_handler
+{
+	typedef typename boost::decay<Handler>::type type;
+};
+
+template <typename Handler>
+inline typename copyable_handler<Handler>::type make_copyable_handler(Handler &h)
+{
+	return h;
+}
+
+} // namespace detail
+} // namespace avhttp
+
+#endif // AVHTTP_HAS_CO_AWAIT
+
+#endif // __AWAITABLE_HPP__
@@ -0,0 +1,113 @@
+//
+// brotli_decoder.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __BROTLI_DECODER_HPP__
+#define __BROTLI_DECODER_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <boost/noncopyable.hpp>
+#include <boost/asio/error.hpp>
+
+#include <brotli/decode.h>
+
+#include "avhttp/content_decoder.hpp"
+
+namespace avhttp {
+namespace detail {
+
+// 使用libbrotlidec解码br(RFC7932).
+class brotli_decoder
+	: public content_decoder
+	, public boost::noncopyable
+{
+public:
+	brotli_decoder()
+		: m_state(NULL)
+		, m_finished(false)
+	{}
+
+	virtual ~brotli_decoder()
+	{
+		if (m_state)
+			BrotliDecoderDestroyInstance(m_state);
+	}
+
+public:
+
+	// 开始解码一个新的body, brotli没有重置接口, 重新创建解码状态.
+	virtual void reset(boost::system::error_code &ec)
+	{
+		ec = boost::system::error_code();
+		m_finished = false;
+		if (m_state)
+			BrotliDecoderDestroyInstance(m_state);
+		m_state = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+		if (!m_state)
+			ec = boost::asio::error::no_memory;
+	}
+
+	// 解码数据.
+	virtual std::size_t decode(const char *&in, std::size_t &in_size,
+		char *out, std::size_t out_size, boost::system::error_code &ec)
+	{
+		ec = boost::system::error_code();
+
+		// body解码结束, 丢弃剩余的数据.
+		if (m_finished)
+		{
+			in += in_size;
+			in_size = 0;
+			return 0;
+		}
+
+		const uint8_t *next_in = reinterpret_cast<const uint8_t*>(in);
+		std::size_t avail_in = in_size;
+		uint8_t *next_out = reinterpret_cast<uint8_t*>(out);
+		std::size_t avail_out = out_size;
+
+		BrotliDecoderResult ret = BrotliDecoderDecompressStream(m_state,
+			&avail_in, &next_in, &avail_out, &next_out, NULL);
+
+		in = reinterpret_cast<const char*>(next_in);
+		in_size = avail_in;
+
+		if (ret == BROTLI_DECODER_RESULT_SUCCESS)
+		{
+			m_finished = true;
+			in += in_size;
+			in_size = 0;
+		}
+		else if (ret == BROTLI_DECODER_RESULT_ERROR)
+		{
+			ec = boost::asio::error::operation_not_supported;
+		}
+
+		// NEEDS_MORE_INPUT时输入已经全部消耗, NEEDS_MORE_OUTPUT时输出已经填满.
+		return out_size - avail_out;
+	}
+
+	// 输出缓冲填满时, 解码器中可能还有已经解码的数据.
+	virtual bool output_pending() const
+	{
+		return m_state && !m_finished && BrotliDecoderHasMoreOutput(m_state);
+	}
+
+private:
+	BrotliDecoderState *m_state;
+	bool m_finished;
+};
+
+} // namespace detail
+} // namespace avhttp
+
+#endif // __BROTLI_DECODER_HPP__
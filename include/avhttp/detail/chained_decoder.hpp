@@ -0,0 +1,110 @@
+//
+// chained_decoder.hpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __CHAINED_DECODER_HPP__
+#define __CHAINED_DECODER_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "avhttp/content_decoder.hpp"
+
+namespace avhttp {
+namespace detail {
+
+// 串联两个解码器, 用于多重编码(如Content-Encoding: gzip, br).
+// outer先解码输入数据到中间缓冲, inner再从中间缓冲解码到输出, 更多层的编码由inner再串联.
+class chained_decoder
+	: public content_decoder
+	, public boost::noncopyable
+{
+public:
+	// outer和inner由chained_decoder负责释放.
+	chained_decoder(content_decoder *outer, content_decoder *inner)
+		: m_outer(outer)
+		, m_inner(inner)
+		, m_buffer(16 * 1024)
+		, m_begin(0)
+		, m_end(0)
+	{}
+
+	virtual ~chained_decoder()
+	{}
+
+public:
+
+	// 开始解码一个新的body.
+	virtual void reset(boost::system::error_code &ec)
+	{
+		m_begin = m_end = 0;
+		m_outer->reset(ec);
+		if (!ec)
+			m_inner->reset(ec);
+	}
+
+	// 解码数据.
+	virtual std::size_t decode(const char *&in, std::size_t &in_size,
+		char *out, std::size_t out_size, boost::system::error_code &ec)
+	{
+		ec = boost::system::error_code();
+		std::size_t bytes_transferred = 0;
+		while (out_size != 0)
+		{
+			// 中间缓冲中有数据或者inner中还有数据时, 先由inner解码输出.
+			if (m_begin != m_end || m_inner->output_pending())
+			{
+				const char *data = &m_buffer[0] + m_begin;
+				std::size_t size = m_end - m_begin;
+				std::size_t n = m_inner->decode(data, size, out, out_size, ec);
+				m_begin = m_end - size;
+				out += n;
+				out_size -= n;
+				bytes_transferred += n;
+
+				// 没有填满输出时inner已经消耗完中间缓冲.
+				if (ec || out_size == 0)
+					break;
+			}
+
+			// 中间缓冲已经全部解码, 由outer解码更多的输入.
+			if (in_size == 0 && !m_outer->output_pending())
+				break;
+			m_begin = 0;
+			m_end = m_outer->decode(in, in_size, &m_buffer[0], m_buffer.size(), ec);
+			if (ec || m_end == 0)
+				break;
+		}
+
+		return bytes_transferred;
+	}
+
+	// 中间缓冲或者任何一层解码器中还有没有输出的数据.
+	virtual bool output_pending() const
+	{
+		return m_begin != m_end || m_outer->output_pending() || m_inner->output_pending();
+	}
+
+private:
+	boost::scoped_ptr<content_decoder> m_outer;
+	boost::scoped_ptr<content_decoder> m_inner;
+	std::vector<char> m_buffer;		// outer的输出, inner的输入.
+	std::size_t m_begin;			// 中间缓冲中未解码数据的起始位置.
+	std::size_t m_end;				// 中间缓冲中未解码数据的结束位置.
+};
+
+} // namespace detail
+} // namespace avhttp
+
+#endif // __CHAINED_DECODER_HPP__
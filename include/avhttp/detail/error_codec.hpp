@@ -72,6 +72,21 @@ enum errc_t
 	/// Invalid redirect address
 	invalid_redirect = 12,
 
+	/// Invalid piece hash manifest.
+	invalid_hash_manifest = 13,
+
+	/// The operation did not complete before its deadline.
+	timed_out = 14,
+
+	/// The HTTP/2 peer violated the protocol.
+	http2_protocol_error = 15,
+
+	/// The HTTP/2 stream was reset by the peer.
+	http2_stream_reset = 16,
+
+	/// The HTTP/2 connection was closed by GOAWAY before the stream was processed.
+	http2_refused_stream = 17,
+
 	// Server-generated status codes.
 
 	/// The server-generated status code "100 Continue".
@@ -122,6 +137,9 @@ enum errc_t
 	/// The server-generated status code "307 Temporary Redirect".
 	temporary_redirect = 307,
 
+	/// The server-generated status code "308 Permanent Redirect".
+	permanent_redirect = 308,
+
 	/// The server-generated status code "400 Bad Request".
 	bad_request = 400,
 
@@ -271,6 +289,16 @@ class error_category_impl
 			return "Invalid chunked encoding";
 		case errc::invalid_redirect:
 			return "Invalid redirect address";
+		case errc::invalid_hash_manifest:
+			return "Invalid piece hash manifest";
+		case errc::timed_out:
+			return "Operation timed out";
+		case errc::http2_protocol_error:
+			return "HTTP/2 protocol error";
+		case errc::http2_stream_reset:
+			return "HTTP/2 stream reset";
+		case errc::http2_refused_stream:
+			return "HTTP/2 stream refused";
 		case errc::continue_request:
 			return "Continue";
 		case errc::switching_protocols:
@@ -303,6 +331,8 @@ class error_category_impl
 			return "Use proxy";
 		case errc::temporary_redirect:
 			return "Temporary redirect";
+		case errc::permanent_redirect:
+			return "Permanent redirect";
 		case errc::bad_request:
 			return "Bad request";
 		case errc::unauthorized:
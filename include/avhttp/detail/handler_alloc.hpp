@@ -0,0 +1,319 @@
+//
+// handler_alloc.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __HANDLER_ALLOC_HPP__
+#define __HANDLER_ALLOC_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <new>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/aligned_storage.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/asio/detail/handler_alloc_helpers.hpp>
+#include <boost/asio/detail/handler_invoke_helpers.hpp>
+
+// 每个handler_memory中可以复用的内存大小, 超出时使用operator new分配.
+#ifndef AVHTTP_HANDLER_MEMORY_SIZE
+# define AVHTTP_HANDLER_MEMORY_SIZE 1024
+#endif
+
+namespace avhttp {
+namespace detail {
+
+// 用于异步操作的可复用内存.
+// asio在回调handler之前已经释放了操作所占用的内存, 所以对于同一时间只有一个未完成操作
+// 的handler链(如http_stream的读取循环), 一块内存就可以一直复用, 不再需要堆分配.
+// 内存正在被使用时(如同时发起了多个操作), 再次分配将使用operator new.
+class handler_memory
+	: public boost::noncopyable
+{
+public:
+	handler_memory()
+		: m_in_use(false)
+	{}
+
+	void* allocate(std::size_t size)
+	{
+		if (!m_in_use && size <= sizeof(m_storage))
+		{
+			m_in_use = true;
+			return m_storage.address();
+		}
+		return ::operator new(size);
+	}
+
+	void deallocate(void *pointer)
+	{
+		if (pointer == m_storage.address())
+		{
+			m_in_use = false;
+			return;
+		}
+		::operator delete(pointer);
+	}
+
+private:
+	boost::aligned_storage<AVHTTP_HANDLER_MEMORY_SIZE,
+		boost::alignment_of<double>::value> m_storage;
+	bool m_in_use;
+};
+
+// 只转发调用的函数对象, 不带任何asio钩子, 内存分配使用asio默认的方式.
+template <typename Function>
+class plain_function
+{
+public:
+	explicit plain_function(const Function &f)
+		: m_function(f)
+	{}
+
+	void operator()()
+	{
+		m_function();
+	}
+
+private:
+	Function m_function;
+};
+
+// 使用handler_memory分配内存的handler包装.
+// 只替换了内存分配钩子, asio_handler_invoke仍然转发到原handler, 以保持strand等语义.
+template <typename Handler>
+class custom_alloc_handler
+{
+public:
+	custom_alloc_handler(handler_memory &m, Handler h)
+		: m_memory(&m)
+		, m_handler(h)
+	{}
+
+	void operator()()
+	{
+		m_handler();
+	}
+
+	template <typename Arg1>
+	void operator()(const Arg1 &arg1)
+	{
+		m_handler(arg1);
+	}
+
+	template <typename Arg1, typename Arg2>
+	void operator()(const Arg1 &arg1, const Arg2 &arg2)
+	{
+		m_handler(arg1, arg2);
+	}
+
+	friend void* asio_handler_allocate(std::size_t size, custom_alloc_handler *h)
+	{
+		return h->m_memory->allocate(size);
+	}
+
+	friend void asio_handler_deallocate(void *pointer, std::size_t /*size*/, custom_alloc_handler *h)
+	{
+		h->m_memory->deallocate(pointer);
+	}
+
+	// 原handler是strand::wrap时, asio会把f再包装一次(rewrapped_handler)投递到strand中,
+	// 它分配内存使用f的钩子, 释放却使用原handler的钩子, 所以这里去掉f上的分配钩子.
+	template <typename Function>
+	friend void asio_handler_invoke(const Function &f, custom_alloc_handler *h)
+	{
+		plain_function<Function> function(f);
+		boost_asio_handler_invoke_helpers::invoke(function, h->m_handler);
+	}
+
+private:
+	handler_memory *m_memory;
+	Handler m_handler;
+};
+
+template <typename Handler>
+inline custom_alloc_handler<Handler> make_custom_alloc_handler(handler_memory &m, Handler h)
+{
+	return custom_alloc_handler<Handler>(m, h);
+}
+
+// 将异步完成回调转到owner的一个成员函数, 并保存buffers和上层handler.
+// 与boost::bind + boost::function不同, 它没有堆分配, 并把asio的内存分配和调用钩子
+// 转发给上层handler, 使整个handler链可以使用上层handler的分配器(如custom_alloc_handler).
+template <typename Owner, typename MutableBufferSequence, typename Handler>
+class read_op_handler
+{
+public:
+	typedef void (Owner::*function_type)(const MutableBufferSequence&, Handler,
+		const boost::system::error_code&, std::size_t);
+
+	read_op_handler(Owner *owner, function_type f, const MutableBufferSequence &buffers, Handler h)
+		: m_owner(owner)
+		, m_function(f)
+		, m_buffers(buffers)
+		, m_handler(h)
+	{}
+
+	void operator()(const boost::system::error_code &ec, std::size_t bytes_transferred)
+	{
+		(m_owner->*m_function)(m_buffers, m_handler, ec, bytes_transferred);
+	}
+
+	friend void* asio_handler_allocate(std::size_t size, read_op_handler *h)
+	{
+		return boost_asio_handler_alloc_helpers::allocate(size, h->m_handler);
+	}
+
+	friend void asio_handler_deallocate(void *pointer, std::size_t size, read_op_handler *h)
+	{
+		boost_asio_handler_alloc_helpers::deallocate(pointer, size, h->m_handler);
+	}
+
+	template <typename Function>
+	friend void asio_handler_invoke(const Function &f, read_op_handler *h)
+	{
+		boost_asio_handler_invoke_helpers::invoke(f, h->m_handler);
+	}
+
+private:
+	Owner *m_owner;
+	function_type m_function;
+	MutableBufferSequence m_buffers;
+	Handler m_handler;
+};
+
+template <typename Owner, typename MutableBufferSequence, typename Handler>
+inline read_op_handler<Owner, MutableBufferSequence, Handler> make_read_op_handler(Owner *owner,
+	void (Owner::*f)(const MutableBufferSequence&, Handler, const boost::system::error_code&, std::size_t),
+	const MutableBufferSequence &buffers, Handler h)
+{
+	return read_op_handler<Owner, MutableBufferSequence, Handler>(owner, f, buffers, h);
+}
+
+// 以context的asio钩子调用function的handler.
+// http_stream内部的各个异步步骤由boost::bind绑定, boost::bind没有asio的钩子, 用它包装后
+// 各个步骤就通过上层handler的asio_handler_invoke执行, 如上层handler是strand.wrap的结果时,
+// 整个组合操作都在这个strand中执行.
+template <typename Function, typename Context>
+class context_handler
+{
+public:
+	context_handler(const Function &f, const Context &context)
+		: m_function(f)
+		, m_context(context)
+	{}
+
+	void operator()()
+	{
+		m_function();
+	}
+
+	template <typename Arg1>
+	void operator()(const Arg1 &arg1)
+	{
+		m_function(arg1);
+	}
+
+	template <typename Arg1, typename Arg2>
+	void operator()(const Arg1 &arg1, const Arg2 &arg2)
+	{
+		m_function(arg1, arg2);
+	}
+
+	friend void* asio_handler_allocate(std::size_t size, context_handler *h)
+	{
+		return boost_asio_handler_alloc_helpers::allocate(size, h->m_context);
+	}
+
+	friend void asio_handler_deallocate(void *pointer, std::size_t size, context_handler *h)
+	{
+		boost_asio_handler_alloc_helpers::deallocate(pointer, size, h->m_context);
+	}
+
+	template <typename F>
+	friend void asio_handler_invoke(const F &f, context_handler *h)
+	{
+		boost_asio_handler_invoke_helpers::invoke(f, h->m_context);
+	}
+
+private:
+	Function m_function;
+	Context m_context;
+};
+
+template <typename Function, typename Context>
+inline context_handler<Function, Context> make_context_handler(const Function &f, const Context &context)
+{
+	return context_handler<Function, Context>(f, context);
+}
+
+// 类型擦除的完成handler, 用于http_stream内部open, request等多步骤的异步操作.
+// 与boost::function不同, 它保留了原handler的asio_handler_invoke钩子, 配合
+// make_context_handler使用, 使内部步骤也按原handler的方式(如strand)执行.
+// 原handler只在构造时复制一次, 之后各个步骤之间的复制只增加引用计数, 避免多层包装后
+// 每次复制都要深拷贝整个handler链.
+class erased_handler
+{
+	struct handler_base
+	{
+		virtual ~handler_base() {}
+		virtual void call(const boost::system::error_code &ec) = 0;
+		virtual void invoke(const boost::function<void ()> &f) = 0;
+	};
+
+	template <typename Handler>
+	struct handler_impl : public handler_base
+	{
+		explicit handler_impl(const Handler &h)
+			: handler(h)
+		{}
+
+		virtual void call(const boost::system::error_code &ec)
+		{
+			handler(ec);
+		}
+
+		virtual void invoke(const boost::function<void ()> &f)
+		{
+			boost_asio_handler_invoke_helpers::invoke(f, handler);
+		}
+
+		Handler handler;
+	};
+
+public:
+	template <typename Handler>
+	erased_handler(Handler h)
+		: m_handler(new handler_impl<Handler>(h))
+	{}
+
+	void operator()(const boost::system::error_code &ec) const
+	{
+		m_handler->call(ec);
+	}
+
+	template <typename Function>
+	friend void asio_handler_invoke(const Function &f, erased_handler *h)
+	{
+		h->m_handler->invoke(boost::function<void ()>(f));
+	}
+
+private:
+	boost::shared_ptr<handler_base> m_handler;
+};
+
+} // namespace detail
+} // namespace avhttp
+
+#endif // __HANDLER_ALLOC_HPP__
@@ -0,0 +1,626 @@
+//
+// hpack.hpp
+// ~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __HPACK_HPP__
+#define __HPACK_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include <boost/cstdint.hpp>
+
+namespace avhttp {
+namespace detail {
+
+// http/2的头部字段, 名称为小写.
+typedef std::pair<std::string, std::string> hpack_header;
+typedef std::vector<hpack_header> hpack_headers;
+
+// hpack的动态表默认大小, 也是SETTINGS_HEADER_TABLE_SIZE的默认值.
+enum { hpack_default_table_size = 4096 };
+
+// RFC 7541附录B中的huffman编码, 以符号为下标, 256为EOS.
+inline const boost::uint32_t* hpack_huffman_codes()
+{
+	static const boost::uint32_t codes[257] =
+	{
+		0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+		0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+		0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+		0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+		0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+		0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+		0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+		0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+		0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+		0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+		0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+		0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+		0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+		0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+		0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+		0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+		0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+		0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+		0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+		0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+		0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+		0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+		0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+		0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+		0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+		0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+		0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+		0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+		0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+		0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+		0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+		0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+		0x3fffffff	};
+	return codes;
+}
+
+inline const boost::uint8_t* hpack_huffman_lengths()
+{
+	static const boost::uint8_t lengths[257] =
+	{
+		13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+		28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+		6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+		5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+		13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+		7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+		15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+		6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+		20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+		24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+		22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+		21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+		26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+		19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+		20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+		26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+		30	};
+	return lengths;
+}
+
+// huffman解码表.
+// hpack的huffman编码是规范huffman编码, 同一长度的编码按符号顺序连续递增, 所以
+// 只需要每个长度的第一个编码和符号列表就可以解码.
+struct hpack_huffman_table
+{
+	hpack_huffman_table()
+	{
+		const boost::uint8_t *lengths = hpack_huffman_lengths();
+		int n = 0;
+		for (int len = 0; len <= 30; len++)
+		{
+			count[len] = 0;
+			offset[len] = n;
+			for (int sym = 0; sym < 257; sym++)
+			{
+				if (lengths[sym] != len)
+					continue;
+				symbols[n++] = sym;
+				count[len]++;
+			}
+		}
+		boost::uint32_t code = 0;
+		for (int len = 1; len <= 30; len++)
+		{
+			code = (code + count[len - 1]) << 1;
+			first[len] = code;
+		}
+		first[0] = 0;
+	}
+
+	boost::uint32_t first[31];		// 每个长度的第一个编码.
+	boost::uint16_t offset[31];		// 每个长度的第一个符号在symbols中的位置.
+	boost::uint16_t count[31];		// 每个长度的符号个数.
+	boost::uint16_t symbols[257];	// 按编码顺序排列的符号.
+};
+
+inline const hpack_huffman_table& hpack_huffman_lookup()
+{
+	static hpack_huffman_table table;
+	return table;
+}
+
+// huffman解码, 出错(包括EOS符号和不正确的填充)返回false.
+inline bool hpack_huffman_decode(const char *data, std::size_t size, std::string &out)
+{
+	const hpack_huffman_table &table = hpack_huffman_lookup();
+	boost::uint32_t code = 0;
+	int len = 0;
+	for (std::size_t i = 0; i < size; i++)
+	{
+		boost::uint8_t c = static_cast<boost::uint8_t>(data[i]);
+		for (int bit = 7; bit >= 0; bit--)
+		{
+			code = (code << 1) | ((c >> bit) & 1);
+			if (++len > 30)
+				return false;
+			boost::uint32_t index = code - table.first[len];
+			if (index < table.count[len])
+			{
+				boost::uint16_t sym = table.symbols[table.offset[len] + index];
+				if (sym == 256)
+					return false;
+				out.push_back(static_cast<char>(sym));
+				code = 0;
+				len = 0;
+			}
+		}
+	}
+	// 填充最多7位, 且全部为1(EOS的前缀).
+	return len <= 7 && code == (1u << len) - 1;
+}
+
+// huffman编码后的长度.
+inline std::size_t hpack_huffman_length(const std::string &str)
+{
+	const boost::uint8_t *lengths = hpack_huffman_lengths();
+	boost::uint64_t bits = 0;
+	for (std::size_t i = 0; i < str.size(); i++)
+		bits += lengths[static_cast<boost::uint8_t>(str[i])];
+	return static_cast<std::size_t>((bits + 7) / 8);
+}
+
+inline void hpack_huffman_encode(const std::string &str, std::string &out)
+{
+	const boost::uint32_t *codes = hpack_huffman_codes();
+	const boost::uint8_t *lengths = hpack_huffman_lengths();
+	boost::uint64_t acc = 0;
+	int bits = 0;
+	for (std::size_t i = 0; i < str.size(); i++)
+	{
+		boost::uint8_t sym = static_cast<boost::uint8_t>(str[i]);
+		acc = (acc << lengths[sym]) | codes[sym];
+		bits += lengths[sym];
+		while (bits >= 8)
+		{
+			bits -= 8;
+			out.push_back(static_cast<char>(acc >> bits));
+		}
+	}
+	// 用EOS的前缀(全1)填充最后一个字节.
+	if (bits > 0)
+		out.push_back(static_cast<char>((acc << (8 - bits)) | (0xff >> bits)));
+}
+
+// RFC 7541附录A中的静态表, 下标从1开始.
+struct hpack_static_entry
+{
+	const char *name;
+	const char *value;
+};
+
+inline const hpack_static_entry* hpack_static_table()
+{
+	static const hpack_static_entry table[61] =
+	{
+		{ ":authority", "" },
+		{ ":method", "GET" },
+		{ ":method", "POST" },
+		{ ":path", "/" },
+		{ ":path", "/index.html" },
+		{ ":scheme", "http" },
+		{ ":scheme", "https" },
+		{ ":status", "200" },
+		{ ":status", "204" },
+		{ ":status", "206" },
+		{ ":status", "304" },
+		{ ":status", "400" },
+		{ ":status", "404" },
+		{ ":status", "500" },
+		{ "accept-charset", "" },
+		{ "accept-encoding", "gzip, deflate" },
+		{ "accept-language", "" },
+		{ "accept-ranges", "" },
+		{ "accept", "" },
+		{ "access-control-allow-origin", "" },
+		{ "age", "" },
+		{ "allow", "" },
+		{ "authorization", "" },
+		{ "cache-control", "" },
+		{ "content-disposition", "" },
+		{ "content-encoding", "" },
+		{ "content-language", "" },
+		{ "content-length", "" },
+		{ "content-location", "" },
+		{ "content-range", "" },
+		{ "content-type", "" },
+		{ "cookie", "" },
+		{ "date", "" },
+		{ "etag", "" },
+		{ "expect", "" },
+		{ "expires", "" },
+		{ "from", "" },
+		{ "host", "" },
+		{ "if-match", "" },
+		{ "if-modified-since", "" },
+		{ "if-none-match", "" },
+		{ "if-range", "" },
+		{ "if-unmodified-since", "" },
+		{ "last-modified", "" },
+		{ "link", "" },
+		{ "location", "" },
+		{ "max-forwards", "" },
+		{ "proxy-authenticate", "" },
+		{ "proxy-authorization", "" },
+		{ "range", "" },
+		{ "referer", "" },
+		{ "refresh", "" },
+		{ "retry-after", "" },
+		{ "server", "" },
+		{ "set-cookie", "" },
+		{ "strict-transport-security", "" },
+		{ "transfer-encoding", "" },
+		{ "user-agent", "" },
+		{ "vary", "" },
+		{ "via", "" },
+		{ "www-authenticate", "" }
+	};
+	return table;
+}
+
+enum { hpack_static_table_size = 61 };
+
+// hpack的动态表, 新加入的字段下标最小, 超出大小限制时淘汰最早加入的字段.
+class hpack_dynamic_table
+{
+public:
+	explicit hpack_dynamic_table(std::size_t max_size = hpack_default_table_size)
+		: m_size(0)
+		, m_max_size(max_size)
+	{}
+
+	// 字段占用的大小, 名称和值的长度加上32字节的开销.
+	static std::size_t entry_size(const hpack_header &header)
+	{
+		return header.first.size() + header.second.size() + 32;
+	}
+
+	void add(const hpack_header &header)
+	{
+		std::size_t size = entry_size(header);
+		// 比整个表还大的字段使表被清空, 且不加入.
+		if (size > m_max_size)
+		{
+			m_entries.clear();
+			m_size = 0;
+			return;
+		}
+		m_entries.push_front(header);
+		m_size += size;
+		evict();
+	}
+
+	void max_size(std::size_t size)
+	{
+		m_max_size = size;
+		evict();
+	}
+
+	std::size_t max_size() const
+	{
+		return m_max_size;
+	}
+
+	std::size_t count() const
+	{
+		return m_entries.size();
+	}
+
+	// 按从0开始的下标取得字段, 0为最新加入的字段.
+	const hpack_header& at(std::size_t index) const
+	{
+		return m_entries[index];
+	}
+
+private:
+	void evict()
+	{
+		while (m_size > m_max_size && !m_entries.empty())
+		{
+			m_size -= entry_size(m_entries.back());
+			m_entries.pop_back();
+		}
+	}
+
+private:
+	std::deque<hpack_header> m_entries;
+	std::size_t m_size;
+	std::size_t m_max_size;
+};
+
+// hpack解码器, 每个http/2连接一个, 按收到的顺序解码各个头部块.
+class hpack_decoder
+{
+public:
+	// @param max_size是我们在SETTINGS_HEADER_TABLE_SIZE中通告的动态表大小上限.
+	explicit hpack_decoder(std::size_t max_size = hpack_default_table_size)
+		: m_table(max_size)
+		, m_max_size(max_size)
+	{}
+
+	///解码一个完整的头部块.
+	// @param data是头部块的数据, 由HEADERS和CONTINUATION帧中的数据拼接而成.
+	// @param headers保存解码后的字段.
+	// @返回false表示压缩错误, 这时连接不能再使用.
+	bool decode(const char *data, std::size_t size, hpack_headers &headers)
+	{
+		const char *p = data;
+		const char *end = data + size;
+		bool header_seen = false;
+		while (p != end)
+		{
+			boost::uint8_t c = static_cast<boost::uint8_t>(*p);
+			boost::uint32_t index = 0;
+			if (c & 0x80)
+			{
+				// 索引的字段.
+				if (!decode_integer(p, end, 7, index) || !lookup(index, headers))
+					return false;
+				header_seen = true;
+				continue;
+			}
+			if ((c & 0xe0) == 0x20)
+			{
+				// 动态表大小更新, 只能出现在头部块的开始.
+				if (header_seen || !decode_integer(p, end, 5, index) || index > m_max_size)
+					return false;
+				m_table.max_size(index);
+				continue;
+			}
+
+			// 字面量字段, 0x40为加入动态表, 0x00为不加入, 0x10为永不索引.
+			bool indexing = (c & 0xc0) == 0x40;
+			if (!decode_integer(p, end, indexing ? 6 : 4, index))
+				return false;
+			hpack_header header;
+			if (index != 0)
+			{
+				hpack_headers name;
+				if (!lookup(index, name))
+					return false;
+				header.first = name.back().first;
+			}
+			else if (!decode_string(p, end, header.first))
+			{
+				return false;
+			}
+			if (!decode_string(p, end, header.second))
+				return false;
+			if (indexing)
+				m_table.add(header);
+			headers.push_back(header);
+			header_seen = true;
+		}
+		return true;
+	}
+
+private:
+	bool lookup(boost::uint32_t index, hpack_headers &headers) const
+	{
+		if (index == 0)
+			return false;
+		if (index <= hpack_static_table_size)
+		{
+			const hpack_static_entry &entry = hpack_static_table()[index - 1];
+			headers.push_back(hpack_header(entry.name, entry.value));
+			return true;
+		}
+		index -= hpack_static_table_size + 1;
+		if (index >= m_table.count())
+			return false;
+		headers.push_back(m_table.at(index));
+		return true;
+	}
+
+	static bool decode_integer(const char *&p, const char *end, int prefix, boost::uint32_t &value)
+	{
+		if (p == end)
+			return false;
+		boost::uint32_t mask = (1u << prefix) - 1;
+		value = static_cast<boost::uint8_t>(*p++) & mask;
+		if (value != mask)
+			return true;
+		for (int shift = 0; p != end; shift += 7)
+		{
+			// 超过28位的整数没有意义, 视为错误, 避免溢出.
+			if (shift > 21)
+				return false;
+			boost::uint8_t c = static_cast<boost::uint8_t>(*p++);
+			value += static_cast<boost::uint32_t>(c & 0x7f) << shift;
+			if (!(c & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	static bool decode_string(const char *&p, const char *end, std::string &str)
+	{
+		if (p == end)
+			return false;
+		bool huffman = (static_cast<boost::uint8_t>(*p) & 0x80) != 0;
+		boost::uint32_t length = 0;
+		if (!decode_integer(p, end, 7, length) || length > static_cast<std::size_t>(end - p))
+			return false;
+		if (huffman)
+		{
+			if (!hpack_huffman_decode(p, length, str))
+				return false;
+		}
+		else
+		{
+			str.assign(p, length);
+		}
+		p += length;
+		return true;
+	}
+
+private:
+	hpack_dynamic_table m_table;
+	std::size_t m_max_size;
+};
+
+// hpack编码器, 每个http/2连接一个.
+// 请求之间不变的字段(如user-agent, accept)加入动态表, 同一连接上的后续请求只需要
+// 发送一个字节的索引; 每次都变化的字段(如:path, range)和敏感的字段不加入动态表.
+class hpack_encoder
+{
+public:
+	hpack_encoder()
+		: m_table(hpack_default_table_size)
+		, m_pending_size(false)
+	{}
+
+	///设置对方通过SETTINGS_HEADER_TABLE_SIZE允许的动态表大小.
+	void max_table_size(std::size_t size)
+	{
+		size = (std::min)(size, static_cast<std::size_t>(hpack_default_table_size));
+		if (size == m_table.max_size())
+			return;
+		m_table.max_size(size);
+		m_pending_size = true;
+	}
+
+	///编码一个头部块, 追加到out中.
+	void encode(const hpack_headers &headers, std::string &out)
+	{
+		// 动态表大小变化后, 在下一个头部块的开始通知对方.
+		if (m_pending_size)
+		{
+			encode_integer(m_table.max_size(), 5, 0x20, out);
+			m_pending_size = false;
+		}
+
+		for (hpack_headers::const_iterator i = headers.begin(); i != headers.end(); ++i)
+		{
+			std::size_t name_index = 0;
+			std::size_t index = find(*i, name_index);
+			if (index != 0)
+			{
+				encode_integer(index, 7, 0x80, out);
+				continue;
+			}
+
+			if (sensitive(i->first))
+			{
+				// 永不索引.
+				encode_integer(name_index, 4, 0x10, out);
+			}
+			else if (indexable(i->first))
+			{
+				encode_integer(name_index, 6, 0x40, out);
+			}
+			else
+			{
+				// 不加入动态表.
+				encode_integer(name_index, 4, 0x00, out);
+			}
+			if (name_index == 0)
+				encode_string(i->first, out);
+			encode_string(i->second, out);
+			if (!sensitive(i->first) && indexable(i->first))
+				m_table.add(*i);
+		}
+	}
+
+private:
+	// 查找完全匹配的字段, 返回其下标, 没有时返回0, name_index为名称匹配的字段下标.
+	std::size_t find(const hpack_header &header, std::size_t &name_index) const
+	{
+		name_index = 0;
+		const hpack_static_entry *table = hpack_static_table();
+		for (std::size_t i = 0; i < hpack_static_table_size; i++)
+		{
+			if (header.first != table[i].name)
+				continue;
+			if (header.second == table[i].value)
+				return i + 1;
+			if (name_index == 0)
+				name_index = i + 1;
+		}
+		for (std::size_t i = 0; i < m_table.count(); i++)
+		{
+			const hpack_header &entry = m_table.at(i);
+			if (header.first != entry.first)
+				continue;
+			if (header.second == entry.second)
+				return i + hpack_static_table_size + 1;
+			if (name_index == 0)
+				name_index = i + hpack_static_table_size + 1;
+		}
+		return 0;
+	}
+
+	static bool sensitive(const std::string &name)
+	{
+		return name == "authorization" || name == "proxy-authorization";
+	}
+
+	static bool indexable(const std::string &name)
+	{
+		return name != ":path" && name != "range" && name != "content-length" &&
+			name != "if-none-match" && name != "if-modified-since" && name != "cookie";
+	}
+
+	static void encode_integer(std::size_t value, int prefix, boost::uint8_t flags, std::string &out)
+	{
+		std::size_t mask = (1u << prefix) - 1;
+		if (value < mask)
+		{
+			out.push_back(static_cast<char>(flags | value));
+			return;
+		}
+		out.push_back(static_cast<char>(flags | mask));
+		value -= mask;
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<char>(value));
+	}
+
+	// 字符串在huffman编码更短时使用huffman编码.
+	static void encode_string(const std::string &str, std::string &out)
+	{
+		std::size_t length = hpack_huffman_length(str);
+		if (length < str.size())
+		{
+			encode_integer(length, 7, 0x80, out);
+			hpack_huffman_encode(str, out);
+		}
+		else
+		{
+			encode_integer(str.size(), 7, 0x00, out);
+			out.append(str);
+		}
+	}
+
+private:
+	hpack_dynamic_table m_table;
+	bool m_pending_size;
+};
+
+} // namespace detail
+} // namespace avhttp
+
+#endif // __HPACK_HPP__
@@ -21,10 +21,12 @@
 #include <map>
 #include <algorithm>
 #include <cctype>
+#include <cstdio>		// for std::sscanf
 #include <cstdlib>
 #include <string>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "avhttp/settings.hpp"
 #include "avhttp/detail/escape_string.hpp"
@@ -59,6 +61,55 @@ inline void check_header(const std::string &name, const std::string &value,
 		location = value;
 }
 
+// 解析http日期, 支持RFC 1123, RFC 850和asctime三种格式, 得到UTC时间.
+inline bool parse_http_date(const std::string &value, boost::posix_time::ptime &time)
+{
+	static const char *months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+		"Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	char month_name[4] = { 0 };
+	int day = 0, year = 0, hour = 0, minute = 0, second = 0;
+
+	std::string::size_type comma = value.find(',');
+	if (comma != std::string::npos)
+	{
+		const char *str = value.c_str() + comma + 1;
+		// RFC 1123: Sun, 06 Nov 1994 08:49:37 GMT
+		// RFC 850: Sunday, 06-Nov-94 08:49:37 GMT
+		if (std::sscanf(str, " %d %3s %d %d:%d:%d", &day, month_name, &year, &hour, &minute, &second) != 6 &&
+			std::sscanf(str, " %d-%3s-%d %d:%d:%d", &day, month_name, &year, &hour, &minute, &second) != 6)
+			return false;
+	}
+	else
+	{
+		// asctime: Sun Nov  6 08:49:37 1994
+		if (std::sscanf(value.c_str(), "%*s %3s %d %d:%d:%d %d",
+			month_name, &day, &hour, &minute, &second, &year) != 6)
+			return false;
+	}
+
+	int month = 0;
+	while (month < 12 && !boost::algorithm::iequals(month_name, months[month]))
+		month++;
+	if (month == 12 || hour > 23 || minute > 59 || second > 60)
+		return false;
+
+	// RFC 850的两位年份.
+	if (year < 100)
+		year += (year < 70) ? 2000 : 1900;
+
+	try
+	{
+		time = boost::posix_time::ptime(boost::gregorian::date(year, month + 1, day),
+			boost::posix_time::hours(hour) + boost::posix_time::minutes(minute) +
+			boost::posix_time::seconds(second));
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+	return true;
+}
+
 template <typename Iterator>
 bool parse_http_status_line(Iterator begin, Iterator end,
 	int& version_major, int &version_minor, int& status)
@@ -0,0 +1,405 @@
+//
+// piece_hasher.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __PIECE_HASHER_HPP__
+#define __PIECE_HASHER_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <string>
+#include <cstring>		// for std::memcpy
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/algorithm/string.hpp>
+#ifndef AVHTTP_DISABLE_THREAD
+#include <boost/thread.hpp>
+#endif
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>	// for _mm_crc32_u64/_mm_crc32_u8
+#endif
+
+#ifdef AVHTTP_ENABLE_OPENSSL
+#include <openssl/sha.h>
+#endif
+
+#include "avhttp/settings.hpp"
+#include "avhttp/detail/escape_string.hpp"
+
+namespace avhttp {
+namespace detail {
+
+// crc32c(Castagnoli)多项式的slicing-by-8查找表.
+struct crc32c_table
+{
+	crc32c_table()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			boost::uint32_t crc = i;
+			for (int j = 0; j < 8; j++)
+				crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+			t[0][i] = crc;
+		}
+		for (int i = 0; i < 256; i++)
+		{
+			for (int k = 1; k < 8; k++)
+				t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+		}
+	}
+
+	boost::uint32_t t[8][256];
+};
+
+inline const crc32c_table& crc32c_lookup()
+{
+	static crc32c_table table;
+	return table;
+}
+
+///计算crc32c.
+// @param crc上一次计算的结果, 第一次计算时为0.
+// @param data数据指针.
+// @param size数据大小.
+// @返回新的crc32c值.
+// @备注: 编译时启用了SSE4.2(如gcc的-msse4.2或-march=native)则使用硬件crc32指令,
+// 每周期可处理8字节, 否则使用slicing-by-8查表法.
+inline boost::uint32_t crc32c(boost::uint32_t crc, const char *data, std::size_t size)
+{
+	const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+	crc = ~crc;
+
+#if defined(__SSE4_2__) && (defined(__x86_64__) || defined(_M_X64))
+	boost::uint64_t crc64 = crc;
+	while (size >= 8)
+	{
+		boost::uint64_t v;
+		std::memcpy(&v, p, 8);
+		crc64 = _mm_crc32_u64(crc64, v);
+		p += 8;
+		size -= 8;
+	}
+	crc = static_cast<boost::uint32_t>(crc64);
+	while (size-- > 0)
+		crc = _mm_crc32_u8(crc, *p++);
+#else
+	const crc32c_table &table = crc32c_lookup();
+	while (size >= 8)
+	{
+		boost::uint32_t lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((boost::uint32_t)p[3] << 24));
+		boost::uint32_t hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((boost::uint32_t)p[7] << 24);
+		crc = table.t[7][lo & 0xff] ^ table.t[6][(lo >> 8) & 0xff]
+			^ table.t[5][(lo >> 16) & 0xff] ^ table.t[4][lo >> 24]
+			^ table.t[3][hi & 0xff] ^ table.t[2][(hi >> 8) & 0xff]
+			^ table.t[1][(hi >> 16) & 0xff] ^ table.t[0][hi >> 24];
+		p += 8;
+		size -= 8;
+	}
+	while (size-- > 0)
+		crc = (crc >> 8) ^ table.t[0][(crc ^ *p++) & 0xff];
+#endif
+
+	return ~crc;
+}
+
+// xxHash64的实现, 参考https://github.com/Cyan4973/xxHash.
+namespace xxh64_detail {
+
+static const boost::uint64_t prime1 = 11400714785074694791ULL;
+static const boost::uint64_t prime2 = 14029467366897019727ULL;
+static const boost::uint64_t prime3 = 1609587929392839161ULL;
+static const boost::uint64_t prime4 = 9650029242287828579ULL;
+static const boost::uint64_t prime5 = 2870177450012600261ULL;
+
+inline boost::uint64_t rotl(boost::uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+inline boost::uint64_t read64(const unsigned char *p)
+{
+	boost::uint64_t v = 0;
+	for (int i = 7; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+inline boost::uint32_t read32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((boost::uint32_t)p[3] << 24);
+}
+
+inline boost::uint64_t round64(boost::uint64_t acc, boost::uint64_t input)
+{
+	acc += input * prime2;
+	acc = rotl(acc, 31);
+	return acc * prime1;
+}
+
+inline boost::uint64_t merge_round(boost::uint64_t acc, boost::uint64_t val)
+{
+	acc ^= round64(0, val);
+	return acc * prime1 + prime4;
+}
+
+} // namespace xxh64_detail
+
+///计算xxHash64.
+// @param data数据指针.
+// @param size数据大小.
+// @param seed种子, 默认为0.
+inline boost::uint64_t xxhash64(const char *data, std::size_t size, boost::uint64_t seed = 0)
+{
+	using namespace xxh64_detail;
+
+	const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+	const unsigned char *end = p + size;
+	boost::uint64_t h;
+
+	if (size >= 32)
+	{
+		const unsigned char *limit = end - 32;
+		boost::uint64_t v1 = seed + prime1 + prime2;
+		boost::uint64_t v2 = seed + prime2;
+		boost::uint64_t v3 = seed;
+		boost::uint64_t v4 = seed - prime1;
+
+		do
+		{
+			v1 = round64(v1, read64(p)); p += 8;
+			v2 = round64(v2, read64(p)); p += 8;
+			v3 = round64(v3, read64(p)); p += 8;
+			v4 = round64(v4, read64(p)); p += 8;
+		} while (p <= limit);
+
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge_round(h, v1);
+		h = merge_round(h, v2);
+		h = merge_round(h, v3);
+		h = merge_round(h, v4);
+	}
+	else
+	{
+		h = seed + prime5;
+	}
+
+	h += static_cast<boost::uint64_t>(size);
+
+	while (p + 8 <= end)
+	{
+		h ^= round64(0, read64(p));
+		h = rotl(h, 27) * prime1 + prime4;
+		p += 8;
+	}
+
+	if (p + 4 <= end)
+	{
+		h ^= static_cast<boost::uint64_t>(read32(p)) * prime1;
+		h = rotl(h, 23) * prime2 + prime3;
+		p += 4;
+	}
+
+	while (p < end)
+	{
+		h ^= (*p++) * prime5;
+		h = rotl(h, 11) * prime1;
+	}
+
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+// 分片hash计算, 所有hash值均以小写16进制字符串表示, 以便与用户给出的值直接比较.
+class piece_hasher
+{
+public:
+	explicit piece_hasher(verify_settings::hash_type type = verify_settings::none)
+		: m_type(type)
+	{}
+
+	///返回当前编译环境是否支持指定的hash算法.
+	static bool is_supported(verify_settings::hash_type type)
+	{
+		switch (type)
+		{
+		case verify_settings::crc32c:
+		case verify_settings::xxhash64:
+			return true;
+#ifdef AVHTTP_ENABLE_OPENSSL
+		case verify_settings::sha256:
+			return true;
+#endif
+		default:
+			return false;
+		}
+	}
+
+	///返回hash算法的名称, 用于manifest和meta文件.
+	static std::string name(verify_settings::hash_type type)
+	{
+		switch (type)
+		{
+		case verify_settings::crc32c:
+			return "crc32c";
+		case verify_settings::xxhash64:
+			return "xxhash64";
+		case verify_settings::sha256:
+			return "sha256";
+		default:
+			return "";
+		}
+	}
+
+	///根据名称得到hash算法.
+	static verify_settings::hash_type from_name(std::string n)
+	{
+		boost::to_lower(n);
+		if (n == "crc32c")
+			return verify_settings::crc32c;
+		if (n == "xxhash64" || n == "xxh64")
+			return verify_settings::xxhash64;
+		if (n == "sha256" || n == "sha-256")
+			return verify_settings::sha256;
+		return verify_settings::none;
+	}
+
+	verify_settings::hash_type type() const
+	{
+		return m_type;
+	}
+
+	///计算数据的hash值.
+	// @返回小写的16进制字符串, 算法不支持时返回空串.
+	std::string digest(const char *data, std::size_t size) const
+	{
+		switch (m_type)
+		{
+		case verify_settings::crc32c:
+			return hex(crc32c(0, data, size), 4);
+		case verify_settings::xxhash64:
+			return hex(xxhash64(data, size), 8);
+#ifdef AVHTTP_ENABLE_OPENSSL
+		case verify_settings::sha256:
+			{
+				unsigned char md[SHA256_DIGEST_LENGTH];
+				SHA256(reinterpret_cast<const unsigned char*>(data), size, md);
+				return to_hex(std::string(reinterpret_cast<const char*>(md), sizeof(md)));
+			}
+#endif
+		default:
+			return "";
+		}
+	}
+
+private:
+
+	// 按大端序输出为16进制, 与常见工具(如crc32c/xxhsum)的输出格式一致.
+	static std::string hex(boost::uint64_t v, int bytes)
+	{
+		std::string s(bytes, '\0');
+		for (int i = bytes - 1; i >= 0; i--, v >>= 8)
+			s[i] = static_cast<char>(v & 0xff);
+		return to_hex(s);
+	}
+
+private:
+	verify_settings::hash_type m_type;
+};
+
+// 用于计算分片hash的线程池, 避免在io_service线程中进行大量计算.
+// 在定义了AVHTTP_DISABLE_THREAD时, 任务将在post中直接执行.
+class hash_pool : public boost::noncopyable
+{
+public:
+	///构造线程池.
+	// @param threads线程数, 小于等于0时使用CPU核心数.
+	explicit hash_pool(int threads)
+#ifndef AVHTTP_DISABLE_THREAD
+		: m_work(new boost::asio::io_service::work(m_io_service))
+#endif
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		if (threads <= 0)
+		{
+			threads = (std::max)(static_cast<int>(boost::thread::hardware_concurrency()), 1);
+		}
+		for (int i = 0; i < threads; i++)
+		{
+			m_threads.create_thread(boost::bind(&hash_pool::worker, this));
+		}
+#endif
+	}
+
+	~hash_pool()
+	{
+		stop();
+	}
+
+	///返回线程池中的线程数.
+	std::size_t size() const
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		return m_threads.size();
+#else
+		return 1;
+#endif
+	}
+
+	///投递一个hash任务, 任务将在线程池中执行.
+	template <typename Handler>
+	void post(Handler handler)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		m_io_service.post(handler);
+#else
+		handler();
+#endif
+	}
+
+	///停止线程池, 未执行的任务将被丢弃.
+	void stop()
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		m_work.reset();
+		m_io_service.stop();
+		m_threads.join_all();
+#endif
+	}
+
+private:
+
+#ifndef AVHTTP_DISABLE_THREAD
+	void worker()
+	{
+		boost::system::error_code ignore;
+		m_io_service.run(ignore);
+	}
+
+	boost::asio::io_service m_io_service;
+	boost::scoped_ptr<boost::asio::io_service::work> m_work;
+	boost::thread_group m_threads;
+#endif
+};
+
+} // namespace detail
+} // namespace avhttp
+
+#endif // __PIECE_HASHER_HPP__
@@ -30,7 +30,14 @@
 #include <boost/type_traits/add_pointer.hpp>
 #include <boost/noncopyable.hpp>
 
+#include <boost/cstdint.hpp>
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/handler_alloc_hook.hpp>
+#include <boost/asio/handler_invoke_hook.hpp>
+#include <boost/asio/detail/handler_alloc_helpers.hpp>
+#include <boost/asio/detail/handler_invoke_helpers.hpp>
+
+#include "avhttp/metrics.hpp"
 
 #define NETWORK_VARIANT_STREAM_LIMIT 5
 
@@ -399,6 +406,49 @@ namespace aux
 	};
 #endif
 
+	// -------------- count_bytes_handler -----------
+
+	// 在异步读写完成时累加传输的字节数并更新全局统计, 然后调用原handler. 转发asio的
+	// 内存分配和调用钩子, 使原handler的strand等语义保持不变.
+	template <class Handler>
+	struct count_bytes_handler
+	{
+		count_bytes_handler(Handler h, boost::uint64_t &c, metric_counter m)
+			: handler(h)
+			, counter(&c)
+			, metric(m)
+		{}
+
+		void operator()(const boost::system::error_code &ec, std::size_t bytes_transferred)
+		{
+			*counter += bytes_transferred;
+#ifndef AVHTTP_DISABLE_METRICS
+			metrics().add(metric, bytes_transferred);
+#endif
+			handler(ec, bytes_transferred);
+		}
+
+		friend void* asio_handler_allocate(std::size_t size, count_bytes_handler *h)
+		{
+			return boost_asio_handler_alloc_helpers::allocate(size, h->handler);
+		}
+
+		friend void asio_handler_deallocate(void *p, std::size_t size, count_bytes_handler *h)
+		{
+			boost_asio_handler_alloc_helpers::deallocate(p, size, h->handler);
+		}
+
+		template <class Function>
+		friend void asio_handler_invoke(const Function &f, count_bytes_handler *h)
+		{
+			boost_asio_handler_invoke_helpers::invoke(f, h->handler);
+		}
+
+		Handler handler;
+		boost::uint64_t *counter;
+		metric_counter metric;
+	};
+
 	// -------------- async_read_some -----------
 
 	template <class Mutable_Buffers, class Handler>
@@ -419,7 +469,8 @@ namespace aux
 		{}
 
 		Mutable_Buffers const &buffers;
-		Handler handler;
+		// 以非const传给socket, C++20下asio要求handler以传入的形式可调用.
+		mutable Handler handler;
 	};
 
 	// -------------- read_some -----------
@@ -485,7 +536,7 @@ namespace aux
 		{}
 
 		Const_Buffers const &buffers;
-		Handler handler;
+		mutable Handler handler;
 	};
 
 	// -------------- write_some -----------
@@ -634,7 +685,7 @@ public:
 	typedef typename lowest_layer_type::protocol_type protocol_type;
 
 	explicit variant_stream(boost::asio::io_service &ios)
-		: m_io_service(ios), m_variant(boost::blank()) {}
+		: m_io_service(ios), m_variant(boost::blank()), m_bytes_read(0), m_bytes_written(0) {}
 
 	template <class S>
 	void instantiate(boost::asio::io_service &ios)
@@ -698,10 +749,13 @@ public:
 	std::size_t read_some(Mutable_Buffers const &buffers, boost::system::error_code &ec)
 	{
 		BOOST_ASSERT(instantiated());
-		return boost::apply_visitor(
+		std::size_t bytes_transferred = boost::apply_visitor(
 			aux::read_some_visitor_ec<Mutable_Buffers>(buffers, ec)
 			, m_variant
 			);
+		m_bytes_read += bytes_transferred;
+		AVHTTP_METRIC_ADD(metric_bytes_received, bytes_transferred);
+		return bytes_transferred;
 	}
 
 #ifndef BOOST_NO_EXCEPTIONS
@@ -709,10 +763,13 @@ public:
 	std::size_t read_some(Mutable_Buffers const &buffers)
 	{
 		BOOST_ASSERT(instantiated());
-		return boost::apply_visitor(
+		std::size_t bytes_transferred = boost::apply_visitor(
 			aux::read_some_visitor<Mutable_Buffers>(buffers)
 			, m_variant
 			);
+		m_bytes_read += bytes_transferred;
+		AVHTTP_METRIC_ADD(metric_bytes_received, bytes_transferred);
+		return bytes_transferred;
 	}
 #endif
 
@@ -721,10 +778,13 @@ public:
 		boost::system::error_code &ec)
 	{
 		BOOST_ASSERT(instantiated());
-		return boost::apply_visitor(
+		std::size_t bytes_transferred = boost::apply_visitor(
 			aux::write_some_visitor_ec<ConstBufferSequence>(buffers, ec)
 			, m_variant
 			);
+		m_bytes_written += bytes_transferred;
+		AVHTTP_METRIC_ADD(metric_bytes_sent, bytes_transferred);
+		return bytes_transferred;
 	}
 
 #ifndef BOOST_NO_EXCEPTIONS
@@ -732,10 +792,13 @@ public:
 	std::size_t write_some(ConstBufferSequence const &buffers)
 	{
 		BOOST_ASSERT(instantiated());
-		return boost::apply_visitor(
+		std::size_t bytes_transferred = boost::apply_visitor(
 			aux::write_some_visitor<ConstBufferSequence>(buffers)
 			, m_variant
 			);
+		m_bytes_written += bytes_transferred;
+		AVHTTP_METRIC_ADD(metric_bytes_sent, bytes_transferred);
+		return bytes_transferred;
 	}
 #endif
 
@@ -743,8 +806,10 @@ public:
 	void async_read_some(Mutable_Buffers const &buffers, Handler handler)
 	{
 		BOOST_ASSERT(instantiated());
+		typedef aux::count_bytes_handler<Handler> counting_handler;
+		counting_handler h(handler, m_bytes_read, metric_bytes_received);
 		boost::apply_visitor(
-			aux::async_read_some_visitor<Mutable_Buffers, Handler>(buffers, handler)
+			aux::async_read_some_visitor<Mutable_Buffers, counting_handler>(buffers, h)
 			, m_variant
 			);
 	}
@@ -753,12 +818,35 @@ public:
 	void async_write_some(Const_Buffers const &buffers, Handler handler)
 	{
 		BOOST_ASSERT(instantiated());
+		typedef aux::count_bytes_handler<Handler> counting_handler;
+		counting_handler h(handler, m_bytes_written, metric_bytes_sent);
 		boost::apply_visitor(
-			aux::async_write_some_visitor<Const_Buffers, Handler>(buffers, handler)
+			aux::async_write_some_visitor<Const_Buffers, counting_handler>(buffers, h)
 			, m_variant
 			);
 	}
 
+	///统计没有经过这个stream, 直接写入socket的字节数, 如使用sendfile发送的数据.
+	void add_bytes_written(std::size_t bytes_transferred)
+	{
+		m_bytes_written += bytes_transferred;
+		AVHTTP_METRIC_ADD(metric_bytes_sent, bytes_transferred);
+	}
+
+	///返回通过这个stream读取的总字节数.
+	// @备注: ssl连接时为解密后的字节数.
+	boost::uint64_t bytes_read() const
+	{
+		return m_bytes_read;
+	}
+
+	///返回通过这个stream写入的总字节数.
+	// @备注: ssl连接时为加密前的字节数.
+	boost::uint64_t bytes_written() const
+	{
+		return m_bytes_written;
+	}
+
 	template <class Handler>
 	void async_connect(endpoint_type endpoint, Handler handler)
 	{
@@ -924,6 +1012,8 @@ public:
 private:
 	boost::asio::io_service& m_io_service;
 	variant_type m_variant;
+	boost::uint64_t m_bytes_read;
+	boost::uint64_t m_bytes_written;
 };
 
 }
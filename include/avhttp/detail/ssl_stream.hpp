@@ -16,6 +16,9 @@
 # pragma once
 #endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
 
+#include <string>
+#include <vector>
+
 #include <boost/asio/ssl.hpp>
 #include <openssl/x509v3.h>
 
@@ -76,6 +79,52 @@ public:
 		m_sock.set_verify_callback(callback, ec);
 	}
 
+	// 设置握手时发送的服务器名称(SNI).
+	void set_server_name(const std::string &host, boost::system::error_code &ec)
+	{
+		if (!SSL_set_tlsext_host_name(m_sock.native_handle(), host.c_str()))
+			ec = boost::asio::error::invalid_argument;
+	}
+
+	// 设置握手时通过ALPN协商的协议, 按优先顺序排列, 如"h2", "http/1.1", 必须在握手前调用.
+	// openssl不支持ALPN(1.0.2以前的版本)时ec为operation_not_supported.
+	void set_alpn_protocols(const std::vector<std::string> &protocols, boost::system::error_code &ec)
+	{
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+		// 协议列表的格式为每个协议名前加一个字节的长度.
+		std::string wire;
+		for (std::vector<std::string>::const_iterator i = protocols.begin(); i != protocols.end(); ++i)
+		{
+			if (i->empty() || i->size() > 255)
+			{
+				ec = boost::asio::error::invalid_argument;
+				return;
+			}
+			wire.push_back(static_cast<char>(i->size()));
+			wire.append(*i);
+		}
+		// 注意SSL_set_alpn_protos成功时返回0.
+		if (SSL_set_alpn_protos(m_sock.native_handle(),
+			reinterpret_cast<const unsigned char*>(wire.data()), static_cast<unsigned int>(wire.size())) != 0)
+			ec = boost::asio::error::invalid_argument;
+#else
+		ec = boost::asio::error::operation_not_supported;
+#endif
+	}
+
+	// 返回握手时通过ALPN协商的协议, 服务器没有选择协议时返回空串.
+	std::string alpn_protocol() const
+	{
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+		const unsigned char *data = NULL;
+		unsigned int length = 0;
+		SSL_get0_alpn_selected(const_cast<sock_type&>(m_sock).native_handle(), &data, &length);
+		if (data)
+			return std::string(reinterpret_cast<const char*>(data), length);
+#endif
+		return std::string();
+	}
+
 #ifndef BOOST_NO_EXCEPTIONS
 	void connect(endpoint_type const &endpoint)
 	{
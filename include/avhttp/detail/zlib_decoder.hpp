@@ -0,0 +1,253 @@
+//
+// zlib_decoder.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __ZLIB_DECODER_HPP__
+#define __ZLIB_DECODER_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <cstring>		// for std::memset
+#include <limits>		// for std::numeric_limits
+
+#include <boost/noncopyable.hpp>
+#include <boost/asio/error.hpp>
+
+// 定义AVHTTP_ENABLE_ZLIB_NG时使用zlib-ng的原生接口(zng_前辍), 否则使用zlib.
+// zlib-ng以zlib兼容模式编译时可以直接替换zlib, 无需定义AVHTTP_ENABLE_ZLIB_NG.
+#ifdef AVHTTP_ENABLE_ZLIB_NG
+#include <zlib-ng.h>
+# define AVHTTP_ZLIB_API(name) zng_ ## name
+#else
+extern "C"
+{
+#include "zlib.h"
+}
+# define AVHTTP_ZLIB_API(name) name
+#endif
+#ifndef z_const
+# define z_const
+#endif
+
+#include "avhttp/content_decoder.hpp"
+
+namespace avhttp {
+namespace detail {
+
+// 使用zlib解码gzip和deflate.
+class zlib_decoder
+	: public content_decoder
+	, public boost::noncopyable
+{
+public:
+#ifdef AVHTTP_ENABLE_ZLIB_NG
+	typedef zng_stream stream_type;
+#else
+	typedef z_stream stream_type;
+#endif
+
+	// 编码格式.
+	enum format_type
+	{
+		// gzip(RFC1952), 同时也接受zlib格式.
+		gzip,
+
+		// deflate, 按RFC2616应为zlib格式(RFC1950), 但很多服务器发送的是裸deflate
+		// 数据(RFC1951), 根据前两个字节自动识别.
+		deflate
+	};
+
+	explicit zlib_decoder(format_type format)
+		: m_format(format)
+		, m_initialized(false)
+		, m_detected(false)
+		, m_finished(false)
+		, m_pending(false)
+		, m_header_size(0)
+		, m_header_pos(0)
+	{
+		std::memset(&m_stream, 0, sizeof(m_stream));
+	}
+
+	virtual ~zlib_decoder()
+	{
+		if (m_initialized)
+			AVHTTP_ZLIB_API(inflateEnd)(&m_stream);
+	}
+
+public:
+
+	// 开始解码一个新的body.
+	virtual void reset(boost::system::error_code &ec)
+	{
+		ec = boost::system::error_code();
+		m_finished = false;
+		m_pending = false;
+		m_header_size = 0;
+		m_header_pos = 0;
+
+		// deflate需要根据数据识别格式后再初始化.
+		m_detected = false;
+		if (m_format == gzip)
+		{
+			init(32 + MAX_WBITS, ec);
+			m_detected = !ec;
+		}
+	}
+
+	// 解码数据.
+	virtual std::size_t decode(const char *&in, std::size_t &in_size,
+		char *out, std::size_t out_size, boost::system::error_code &ec)
+	{
+		ec = boost::system::error_code();
+		if (out_size == 0)
+			return 0;
+
+		// body解码结束, 丢弃剩余的数据.
+		if (m_finished)
+		{
+			in += in_size;
+			in_size = 0;
+			return 0;
+		}
+
+		if (!m_detected && !detect_deflate(in, in_size, ec))
+			return 0;
+
+		// 先解码识别格式时保存的头.
+		std::size_t bytes_transferred = 0;
+		if (m_header_pos < m_header_size)
+		{
+			const char *header = reinterpret_cast<const char*>(m_header) + m_header_pos;
+			std::size_t header_size = m_header_size - m_header_pos;
+			bytes_transferred = inflate_some(header, header_size, out, out_size, ec);
+			m_header_pos = m_header_size - header_size;
+			if (ec || header_size != 0)
+			{
+				m_pending = !ec;
+				return bytes_transferred;
+			}
+		}
+
+		bytes_transferred += inflate_some(in, in_size, out, out_size, ec);
+
+		// 输出填满时zlib中可能还有没有输出的数据, 下次以空输入再解码.
+		m_pending = !ec && !m_finished && out_size == 0;
+		return bytes_transferred;
+	}
+
+	// 输出缓冲填满时, 解码器中可能还有已经解码的数据.
+	virtual bool output_pending() const
+	{
+		return m_pending;
+	}
+
+private:
+
+	// 解码数据, 直到消耗完输入, 或者填满输出, 或者body结束.
+	std::size_t inflate_some(const char *&in, std::size_t &in_size,
+		char *&out, std::size_t &out_size, boost::system::error_code &ec)
+	{
+		std::size_t bytes_transferred = 0;
+		while (out_size != 0 && !m_finished)
+		{
+			// zlib的长度类型为uInt, 超过的部分分多次解码.
+			const std::size_t max_chunk = (std::numeric_limits<unsigned int>::max)();
+			std::size_t avail_in = (std::min)(in_size, max_chunk);
+			std::size_t avail_out = (std::min)(out_size, max_chunk);
+
+			m_stream.next_in = (z_const Bytef *)(in);
+			m_stream.avail_in = static_cast<unsigned int>(avail_in);
+			m_stream.next_out = reinterpret_cast<Bytef*>(out);
+			m_stream.avail_out = static_cast<unsigned int>(avail_out);
+
+			int ret = AVHTTP_ZLIB_API(inflate)(&m_stream, Z_SYNC_FLUSH);
+
+			std::size_t consumed = avail_in - m_stream.avail_in;
+			std::size_t produced = avail_out - m_stream.avail_out;
+			in += consumed;
+			in_size -= consumed;
+			out += produced;
+			out_size -= produced;
+			bytes_transferred += produced;
+
+			if (ret == Z_STREAM_END)
+			{
+				m_finished = true;
+				in += in_size;
+				in_size = 0;
+				break;
+			}
+
+			// Z_BUF_ERROR表示没有输入或者输出空间, 不是错误.
+			if (ret != Z_OK && ret != Z_BUF_ERROR)
+			{
+				ec = boost::asio::error::operation_not_supported;
+				break;
+			}
+
+			if (in_size == 0 || (consumed == 0 && produced == 0))
+				break;
+		}
+
+		return bytes_transferred;
+	}
+
+	void init(int window_bits, boost::system::error_code &ec)
+	{
+		int ret = m_initialized ?
+			AVHTTP_ZLIB_API(inflateReset2)(&m_stream, window_bits) :
+			AVHTTP_ZLIB_API(inflateInit2)(&m_stream, window_bits);
+		if (ret != Z_OK)
+		{
+			ec = boost::asio::error::operation_not_supported;
+			return;
+		}
+		m_initialized = true;
+	}
+
+	// 根据zlib头(CMF, FLG)识别deflate是否为zlib格式, 然后初始化zlib.
+	// 数据不足两个字节时保存在m_header中, 以满足必须消耗全部输入的要求.
+	bool detect_deflate(const char *&in, std::size_t &in_size, boost::system::error_code &ec)
+	{
+		while (m_header_size < 2 && in_size > 0)
+		{
+			m_header[m_header_size++] = static_cast<unsigned char>(*in++);
+			in_size--;
+		}
+		if (m_header_size < 2)
+			return false;
+
+		unsigned int cmf = m_header[0];
+		unsigned int flg = m_header[1];
+		bool zlib_format = (cmf & 0x0f) == Z_DEFLATED && ((cmf << 8) | flg) % 31 == 0;
+		init(zlib_format ? MAX_WBITS : -MAX_WBITS, ec);
+		m_detected = !ec;
+
+		return m_detected;
+	}
+
+private:
+	format_type m_format;
+	stream_type m_stream;
+	bool m_initialized;
+	bool m_detected;
+	bool m_finished;
+	bool m_pending;
+	unsigned char m_header[2];
+	std::size_t m_header_size;
+	std::size_t m_header_pos;
+};
+
+} // namespace detail
+} // namespace avhttp
+
+#endif // __ZLIB_DECODER_HPP__
@@ -0,0 +1,110 @@
+//
+// zstd_decoder.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __ZSTD_DECODER_HPP__
+#define __ZSTD_DECODER_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <boost/noncopyable.hpp>
+#include <boost/asio/error.hpp>
+
+#include <zstd.h>
+
+#include "avhttp/content_decoder.hpp"
+
+namespace avhttp {
+namespace detail {
+
+// 使用libzstd解码zstd(RFC8878), body可以由多个连续的帧组成.
+class zstd_decoder
+	: public content_decoder
+	, public boost::noncopyable
+{
+public:
+	zstd_decoder()
+		: m_context(NULL)
+		, m_pending(false)
+	{}
+
+	virtual ~zstd_decoder()
+	{
+		if (m_context)
+			ZSTD_freeDCtx(m_context);
+	}
+
+public:
+
+	// 开始解码一个新的body, 解码上下文在长连接上复用.
+	virtual void reset(boost::system::error_code &ec)
+	{
+		ec = boost::system::error_code();
+		m_pending = false;
+		if (!m_context)
+		{
+			m_context = ZSTD_createDCtx();
+			if (!m_context)
+			{
+				ec = boost::asio::error::no_memory;
+				return;
+			}
+		}
+		ZSTD_DCtx_reset(m_context, ZSTD_reset_session_only);
+	}
+
+	// 解码数据.
+	virtual std::size_t decode(const char *&in, std::size_t &in_size,
+		char *out, std::size_t out_size, boost::system::error_code &ec)
+	{
+		ec = boost::system::error_code();
+		if (out_size == 0)
+			return 0;
+
+		ZSTD_inBuffer input = { in, in_size, 0 };
+		ZSTD_outBuffer output = { out, out_size, 0 };
+
+		// 一次调用不一定消耗完输入, 循环直到输入消耗完或者输出填满.
+		while (output.pos < output.size)
+		{
+			std::size_t ret = ZSTD_decompressStream(m_context, &output, &input);
+			if (ZSTD_isError(ret))
+			{
+				ec = boost::asio::error::operation_not_supported;
+				break;
+			}
+			if (input.pos == input.size)
+				break;
+		}
+
+		in += input.pos;
+		in_size -= input.pos;
+
+		// zstd没有查询内部是否还有输出的接口, 输出填满时认为还有数据, 下次以空输入再解码.
+		m_pending = !ec && output.pos == output.size;
+		return output.pos;
+	}
+
+	// 输出缓冲填满时, 解码器中可能还有已经解码的数据.
+	virtual bool output_pending() const
+	{
+		return m_pending;
+	}
+
+private:
+	ZSTD_DCtx *m_context;
+	bool m_pending;
+};
+
+} // namespace detail
+} // namespace avhttp
+
+#endif // __ZSTD_DECODER_HPP__
@@ -0,0 +1,125 @@
+//
+// download_event.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __DOWNLOAD_EVENT_HPP__
+#define __DOWNLOAD_EVENT_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace avhttp {
+
+// multi_download产生的事件.
+struct download_event
+{
+	download_event()
+		: type(progress)
+		, bytes_download(0)
+		, file_size(-1)
+		, download_rate(0)
+		, connection(-1)
+		, state(downloading)
+		, piece(-1)
+	{}
+
+	enum event_type
+	{
+		// 下载进度, 每批事件最多一个, 包含bytes_download/file_size/download_rate.
+		progress = 1,
+		// 连接状态改变, 包含connection/state.
+		connection_state = 2,
+		// 分片下载完成(启用校验时为通过校验), 包含piece.
+		piece_completed = 4,
+		// 分片校验失败, 将被重新下载, 包含piece.
+		piece_failed = 8,
+		// 连接出错, 包含connection/ec.
+		error = 16,
+		// 下载完成.
+		completed = 32,
+		// 下载停止(未完成), 包含ec.
+		stopped = 64,
+	};
+
+	enum connection_state_type
+	{
+		// 连接已经打开, 开始下载数据.
+		downloading,
+		// 连接超时或出错, 正在重新连接.
+		reconnecting,
+		// 连接没有可下载的数据或无法继续重试, 已经关闭.
+		closed,
+	};
+
+	// 事件类型.
+	event_type type;
+
+	// 已经下载的字节数.
+	boost::int64_t bytes_download;
+
+	// 文件大小, 未知时为-1.
+	boost::int64_t file_size;
+
+	// 下载速率, 单位byte/s.
+	int download_rate;
+
+	// 连接序号.
+	int connection;
+
+	// 连接状态.
+	connection_state_type state;
+
+	// 分片序号.
+	int piece;
+
+	// 错误信息.
+	boost::system::error_code ec;
+};
+
+// 一批事件, 按发生的顺序排列.
+typedef std::vector<download_event> download_events;
+
+// 订阅所有事件.
+static const int all_download_events = download_event::progress | download_event::connection_state
+	| download_event::piece_completed | download_event::piece_failed
+	| download_event::error | download_event::completed | download_event::stopped;
+
+// 默认事件合并投递的间隔, 单位毫秒.
+static const int default_event_interval = 200;
+
+// 事件订阅设置.
+struct event_settings
+{
+	event_settings()
+		: interval(default_event_interval)
+		, max_events(1024)
+		, mask(all_download_events)
+	{}
+
+	// 事件合并投递的间隔, 单位毫秒, 同一间隔内的事件作为一批投递, 进度事件
+	// 在每次投递时生成. 为0表示每个事件立即投递, 此时不产生进度事件.
+	int interval;
+
+	// 一批事件的最大个数, 达到后立即投递, 不等待interval.
+	int max_events;
+
+	// 订阅的事件类型, 由download_event::event_type按位或组成.
+	int mask;
+};
+
+} // namespace avhttp
+
+#endif // __DOWNLOAD_EVENT_HPP__
@@ -0,0 +1,1559 @@
+//
+// http2_connection.hpp
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __HTTP2_CONNECTION_HPP__
+#define __HTTP2_CONNECTION_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <map>
+#include <set>
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstring>		// for std::memcpy
+#include <algorithm>	// for std::min
+
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "avhttp/url.hpp"
+#include "avhttp/logging.hpp"
+#include "avhttp/body_source.hpp"
+#include "avhttp/detail/hpack.hpp"
+#include "avhttp/detail/handler_alloc.hpp"
+#include "avhttp/detail/error_codec.hpp"
+#include "avhttp/detail/socket_type.hpp"
+#ifdef AVHTTP_ENABLE_OPENSSL
+#include "avhttp/detail/ssl_stream.hpp"
+#endif
+
+// 每个http/2流的接收窗口, 也是一个流最多缓冲的未读取数据.
+#ifndef AVHTTP_HTTP2_STREAM_WINDOW_SIZE
+# define AVHTTP_HTTP2_STREAM_WINDOW_SIZE (1024 * 1024)
+#endif
+
+// http/2连接的接收窗口.
+#ifndef AVHTTP_HTTP2_CONNECTION_WINDOW_SIZE
+# define AVHTTP_HTTP2_CONNECTION_WINDOW_SIZE (16 * 1024 * 1024)
+#endif
+
+namespace avhttp {
+
+class http2_connection;
+typedef boost::shared_ptr<http2_connection> http2_connection_ptr;
+
+// http/2连接上的一个流, 对应一个请求和它的响应.
+// 流由http2_pool::open_stream创建, 请求在连接建立后发送, 响应头和body数据由连接
+// 接收后保存在流中, 使用者在自己的io_service中等待和读取, 流的方法是线程安全的.
+class http2_stream
+	: public boost::enable_shared_from_this<http2_stream>
+	, public boost::noncopyable
+{
+	friend class http2_connection;
+
+public:
+	///等待的完成handler, 保留了原handler的asio钩子.
+	typedef detail::erased_handler wait_handler;
+
+	// @param io是使用这个流的io_service, async_wait的handler在这里调用.
+	// @param headers是请求头, 包括:method, :scheme, :authority和:path伪头部.
+	// @param body是请求的body.
+	http2_stream(boost::asio::io_service &io, const detail::hpack_headers &headers, const body_source &body)
+		: m_io_service(io)
+		, m_status_code(0)
+		, m_headers_ready(false)
+		, m_headers_taken(false)
+		, m_data_begin(0)
+		, m_end_stream(false)
+		, m_consumed(0)
+		, m_request(headers)
+		, m_body(body)
+		, m_body_offset(0)
+		, m_id(0)
+		, m_local_closed(false)
+		, m_remote_closed(false)
+		, m_send_window(0)
+		, m_recv_window(0)
+	{}
+
+	///等待响应.
+	// 还没有取得响应头时, 等待响应头或出错; 之后等待body数据, 流结束或出错.
+	// @param handler在等待的事件发生后在io_service中调用, 只有在收到响应头前出错时ec才不为空,
+	//  读取body时的错误由read_some返回.
+	void async_wait(const wait_handler &handler)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_waiter = handler;
+		m_work.reset(new boost::asio::io_service::work(m_io_service));
+		notify();
+	}
+
+	///取得响应的状态码和响应头, 之后async_wait等待body数据.
+	// @返回false表示还没有收到响应头.
+	bool take_response(int &status_code, detail::hpack_headers &headers)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if (!m_headers_ready)
+			return false;
+		m_headers_taken = true;
+		status_code = m_status_code;
+		headers.swap(m_headers);
+		return true;
+	}
+
+	///以非阻塞方式读取body.
+	// @param buffers一个或多个用于读取数据的缓冲区.
+	// @param ec没有数据时为would_block, body结束时为eof.
+	// @返回读取的字节数.
+	template <typename MutableBufferSequence>
+	std::size_t read_some(const MutableBufferSequence &buffers, boost::system::error_code &ec)
+	{
+		ec = boost::system::error_code();
+		std::size_t bytes_transferred = 0;
+		std::size_t window_update = 0;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			typename MutableBufferSequence::const_iterator iter = buffers.begin();
+			typename MutableBufferSequence::const_iterator end = buffers.end();
+			for (; iter != end && m_data_begin != m_data.size(); ++iter)
+			{
+				boost::asio::mutable_buffer buffer(*iter);
+				std::size_t size = (std::min)(boost::asio::buffer_size(buffer), m_data.size() - m_data_begin);
+				std::memcpy(boost::asio::buffer_cast<char*>(buffer), m_data.data() + m_data_begin, size);
+				m_data_begin += size;
+				bytes_transferred += size;
+			}
+			if (m_data_begin == m_data.size())
+			{
+				m_data.clear();
+				m_data_begin = 0;
+			}
+
+			if (bytes_transferred == 0)
+			{
+				if (m_error)
+					ec = m_error;
+				else if (m_end_stream)
+					ec = boost::asio::error::eof;
+				else
+					ec = boost::asio::error::would_block;
+				return 0;
+			}
+
+			// 读取的数据累计到窗口的一半时通知连接发送WINDOW_UPDATE.
+			m_consumed += bytes_transferred;
+			if (m_consumed >= AVHTTP_HTTP2_STREAM_WINDOW_SIZE / 2 && !m_end_stream)
+			{
+				window_update = m_consumed;
+				m_consumed = 0;
+			}
+		}
+		if (window_update != 0)
+			consumed(window_update);
+		return bytes_transferred;
+	}
+
+	///取消这个流, 向服务器发送RST_STREAM, 正在进行的async_wait以operation_aborted返回.
+	inline void reset();
+
+	///流的标识, 请求发送前为0.
+	boost::uint32_t id() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_id;
+	}
+
+private:
+	// 以下由连接在它的strand中调用.
+
+	// 收到响应头.
+	void set_response(int status_code, detail::hpack_headers &headers, bool end_stream)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_status_code = status_code;
+		m_headers.swap(headers);
+		m_headers_ready = true;
+		m_end_stream = end_stream;
+		notify();
+	}
+
+	// 收到body数据.
+	void append_data(const char *data, std::size_t size, bool end_stream)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		// 已经读取的数据较多时移动到缓冲开始.
+		if (m_data_begin > 0 && m_data_begin >= m_data.size() / 2)
+		{
+			m_data.erase(0, m_data_begin);
+			m_data_begin = 0;
+		}
+		m_data.append(data, size);
+		if (end_stream)
+			m_end_stream = true;
+		notify();
+	}
+
+	// 流结束(收到trailers).
+	void end_stream()
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_end_stream = true;
+		notify();
+	}
+
+	// 流出错.
+	void fail(const boost::system::error_code &ec)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if (!m_error)
+			m_error = ec;
+		notify();
+	}
+
+	bool headers_ready() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_headers_ready;
+	}
+
+	bool aborted() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_error == boost::asio::error::operation_aborted;
+	}
+
+	// 有等待的事件时投递handler, 调用时必须持有m_mutex.
+	void notify()
+	{
+		if (!m_waiter)
+			return;
+		bool ready = m_error || (m_headers_taken ?
+			(m_data_begin != m_data.size() || m_end_stream) : m_headers_ready);
+		if (!ready)
+			return;
+		boost::system::error_code ec;
+		if (!m_headers_ready)
+			ec = m_error;
+		m_io_service.post(boost::asio::detail::bind_handler(*m_waiter, ec));
+		m_waiter = boost::none;
+		m_work.reset();
+	}
+
+	inline void consumed(std::size_t size);
+
+private:
+	boost::asio::io_service &m_io_service;
+	mutable boost::mutex m_mutex;
+
+	// 以下受m_mutex保护.
+	boost::optional<wait_handler> m_waiter;			// 正在等待的handler.
+	boost::scoped_ptr<boost::asio::io_service::work> m_work;	// 等待时保持io_service运行.
+	int m_status_code;								// 响应的状态码.
+	detail::hpack_headers m_headers;				// 响应头, 不包括伪头部.
+	bool m_headers_ready;							// 是否已经收到响应头.
+	bool m_headers_taken;							// 响应头是否已经被取走.
+	std::string m_data;								// 收到还没有读取的body.
+	std::size_t m_data_begin;						// 未读取数据在m_data中的位置.
+	bool m_end_stream;								// 服务器已经发送完响应.
+	boost::system::error_code m_error;				// 流的错误.
+	std::size_t m_consumed;							// 已读取还没有通知连接的字节数.
+	boost::weak_ptr<http2_connection> m_connection;	// 所在的连接.
+
+	// 以下只在连接的strand中访问.
+	detail::hpack_headers m_request;				// 请求头, 发送后清除.
+	body_source m_body;								// 请求的body.
+	boost::int64_t m_body_offset;					// 已经发送的body字节数.
+	boost::uint32_t m_id;							// 流标识, 发送后不再改变(读取时加锁).
+	bool m_local_closed;							// 请求已经全部发送.
+	bool m_remote_closed;							// 响应已经全部收到.
+	boost::int64_t m_send_window;					// 发送窗口.
+	boost::int64_t m_recv_window;					// 接收窗口.
+};
+
+typedef boost::shared_ptr<http2_stream> http2_stream_ptr;
+
+// 一个http/2连接, 在它上面同时进行多个流.
+// 连接的所有收发都在它的strand中进行, 流通过http2_pool提交, 超过服务器允许的并发数时排队.
+// https连接通过ALPN协商h2, 服务器没有选择h2时连接失败, 排队的流以operation_not_supported
+// 返回, 并且http1_only()返回true; http连接直接使用h2c(prior knowledge).
+// @备注: 不支持服务器推送, 连接时通过SETTINGS_ENABLE_PUSH禁用.
+class http2_connection
+	: public boost::enable_shared_from_this<http2_connection>
+	, public boost::noncopyable
+{
+	friend class http2_stream;
+
+public:
+	// @param io是连接使用的io_service.
+	// @param origin是连接的服务器, 使用其中的协议, 主机和端口.
+	// @param check_certificate, ca_directory, ca_cert与http_stream中的对应设置相同.
+	http2_connection(boost::asio::io_service &io, const url &origin, bool check_certificate,
+		const std::string &ca_directory, const std::string &ca_cert)
+		: m_io_service(io)
+		, m_strand(io)
+		, m_resolver(io)
+		, m_sock(io)
+		, m_nossl_socket(io)
+		, m_origin(origin)
+		, m_check_certificate(check_certificate)
+		, m_ca_directory(ca_directory)
+		, m_ca_cert(ca_cert)
+		, m_closed(false)
+		, m_goaway(false)
+		, m_http1_only(false)
+		, m_connected(false)
+		, m_next_stream_id(1)
+		, m_last_stream_id(0x7fffffff)
+		, m_peer_max_concurrent(100)
+		, m_peer_initial_window(65535)
+		, m_peer_max_frame_size(16384)
+		, m_send_window(65535)
+		, m_recv_window(AVHTTP_HTTP2_CONNECTION_WINDOW_SIZE)
+		, m_recv_unacked(0)
+		, m_continuation_stream(0)
+		, m_continuation_end_stream(false)
+		, m_writing(false)
+		, m_read_buffer(64 * 1024)
+	{}
+
+	~http2_connection()
+	{}
+
+	///开始连接.
+	void start()
+	{
+		m_strand.post(boost::bind(&http2_connection::do_start, shared_from_this()));
+	}
+
+	///提交一个流, 在连接建立后发送请求.
+	void submit(const http2_stream_ptr &stream)
+	{
+		{
+			boost::mutex::scoped_lock lock(stream->m_mutex);
+			stream->m_connection = shared_from_this();
+		}
+		m_strand.post(boost::bind(&http2_connection::do_submit, shared_from_this(), stream));
+	}
+
+	///连接是否还能用于新的流.
+	bool usable() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return !m_closed && !m_goaway;
+	}
+
+	///服务器是否没有通过ALPN选择h2.
+	bool http1_only() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_http1_only;
+	}
+
+	///关闭连接, 所有的流以operation_aborted返回.
+	void close()
+	{
+		m_strand.post(boost::bind(&http2_connection::fail_connection,
+			shared_from_this(), boost::system::error_code(boost::asio::error::operation_aborted)));
+	}
+
+protected:
+
+	// 帧类型.
+	enum frame_type
+	{
+		frame_data = 0x0,
+		frame_headers = 0x1,
+		frame_priority = 0x2,
+		frame_rst_stream = 0x3,
+		frame_settings = 0x4,
+		frame_push_promise = 0x5,
+		frame_ping = 0x6,
+		frame_goaway = 0x7,
+		frame_window_update = 0x8,
+		frame_continuation = 0x9
+	};
+
+	// 帧标志.
+	enum frame_flag
+	{
+		flag_end_stream = 0x1,
+		flag_ack = 0x1,
+		flag_end_headers = 0x4,
+		flag_padded = 0x8,
+		flag_priority = 0x20
+	};
+
+	// RST_STREAM和GOAWAY中的错误码.
+	enum error_type
+	{
+		no_error = 0x0,
+		protocol_error = 0x1,
+		internal_error = 0x2,
+		flow_control_error = 0x3,
+		stream_closed = 0x5,
+		frame_size_error = 0x6,
+		refused_stream = 0x7,
+		cancel = 0x8,
+		compression_error = 0x9
+	};
+
+	// SETTINGS的参数.
+	enum settings_type
+	{
+		settings_header_table_size = 0x1,
+		settings_enable_push = 0x2,
+		settings_max_concurrent_streams = 0x3,
+		settings_initial_window_size = 0x4,
+		settings_max_frame_size = 0x5
+	};
+
+	// 我们接收的最大帧, 使用默认值, 不通过SETTINGS修改.
+	enum { max_frame_size = 16384 };
+
+	// 写入缓冲中的数据超过这个大小时暂停从body读取数据.
+	enum { write_buffer_limit = 64 * 1024 };
+
+	static boost::uint32_t read_uint32(const char *p)
+	{
+		const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+		return (static_cast<boost::uint32_t>(u[0]) << 24) | (static_cast<boost::uint32_t>(u[1]) << 16) |
+			(static_cast<boost::uint32_t>(u[2]) << 8) | u[3];
+	}
+
+	static void write_uint32(std::string &out, boost::uint32_t value)
+	{
+		out.push_back(static_cast<char>(value >> 24));
+		out.push_back(static_cast<char>(value >> 16));
+		out.push_back(static_cast<char>(value >> 8));
+		out.push_back(static_cast<char>(value));
+	}
+
+	// 以下都在m_strand中执行.
+
+	void do_start()
+	{
+		std::string port = boost::lexical_cast<std::string>(m_origin.port());
+		tcp_resolver::query query(m_origin.host(), port);
+		m_resolver.async_resolve(query,
+			m_strand.wrap(boost::bind(&http2_connection::handle_resolve, shared_from_this(),
+				boost::asio::placeholders::error, boost::asio::placeholders::iterator)));
+	}
+
+	void handle_resolve(const boost::system::error_code &ec, boost::asio::ip::tcp::resolver::iterator endpoint_iterator)
+	{
+		if (ec || m_closed)
+		{
+			fail_connection(ec ? ec : boost::system::error_code(boost::asio::error::operation_aborted));
+			return;
+		}
+
+		if (m_origin.protocol() == "http")
+		{
+			m_sock.instantiate<nossl_socket>(m_io_service);
+		}
+#ifdef AVHTTP_ENABLE_OPENSSL
+		else
+		{
+			boost::system::error_code err;
+			m_sock.instantiate<ssl_socket>(m_nossl_socket);
+			ssl_socket *ssl_sock = m_sock.get<ssl_socket>();
+			if (!m_ca_directory.empty())
+				ssl_sock->add_verify_path(m_ca_directory, err);
+			if (!err && !m_ca_cert.empty())
+				ssl_sock->load_verify_file(m_ca_cert, err);
+			if (!err && m_check_certificate)
+				ssl_sock->set_verify_callback(boost::asio::ssl::rfc2818_verification(m_origin.host()), err);
+			if (!err)
+				ssl_sock->set_server_name(m_origin.host(), err);
+			if (!err)
+			{
+				std::vector<std::string> protocols;
+				protocols.push_back("h2");
+				protocols.push_back("http/1.1");
+				ssl_sock->set_alpn_protocols(protocols, err);
+			}
+			if (err)
+			{
+				LOG_ERROR_CAT(log_tls, "HTTP/2 ssl setup \'" << m_origin.host() <<
+					"\', error message \'" << err.message() << "\'");
+				// openssl不支持ALPN, 只能使用http/1.1.
+				if (err == boost::asio::error::operation_not_supported)
+				{
+					boost::mutex::scoped_lock lock(m_mutex);
+					m_http1_only = true;
+				}
+				fail_connection(err);
+				return;
+			}
+		}
+#endif
+
+		boost::asio::async_connect(m_sock.lowest_layer(), endpoint_iterator,
+			m_strand.wrap(boost::bind(&http2_connection::handle_connect, shared_from_this(),
+				boost::asio::placeholders::error)));
+	}
+
+	void handle_connect(const boost::system::error_code &ec)
+	{
+		if (ec || m_closed)
+		{
+			fail_connection(ec ? ec : boost::system::error_code(boost::asio::error::operation_aborted));
+			return;
+		}
+
+		// 关闭Nagle算法, 小的控制帧(如WINDOW_UPDATE)不应被延迟.
+		boost::system::error_code ignore_ec;
+		m_sock.lowest_layer().set_option(boost::asio::ip::tcp::no_delay(true), ignore_ec);
+
+#ifdef AVHTTP_ENABLE_OPENSSL
+		if (ssl_socket *ssl_sock = m_sock.get<ssl_socket>())
+		{
+			ssl_sock->async_handshake(
+				m_strand.wrap(boost::bind(&http2_connection::handle_handshake, shared_from_this(),
+					boost::asio::placeholders::error)));
+			return;
+		}
+#endif
+		start_session();
+	}
+
+#ifdef AVHTTP_ENABLE_OPENSSL
+	void handle_handshake(const boost::system::error_code &ec)
+	{
+		if (ec || m_closed)
+		{
+			fail_connection(ec ? ec : boost::system::error_code(boost::asio::error::operation_aborted));
+			return;
+		}
+
+		// 服务器不支持h2, 使用者应改用http/1.1.
+		std::string protocol = m_sock.get<ssl_socket>()->alpn_protocol();
+		if (protocol != "h2")
+		{
+			LOG_DEBUG_CAT(log_tls, "Server \'" << m_origin.host() << "\' selected ALPN \'" << protocol << "\'");
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				m_http1_only = true;
+			}
+			fail_connection(boost::asio::error::operation_not_supported);
+			return;
+		}
+		start_session();
+	}
+#endif
+
+	// 发送连接前言和我们的设置, 开始接收帧和发送排队的流.
+	void start_session()
+	{
+		m_connected = true;
+		m_write_pending.append("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24);
+
+		std::string settings;
+		settings.push_back(0);
+		settings.push_back(settings_enable_push);
+		write_uint32(settings, 0);
+		settings.push_back(0);
+		settings.push_back(settings_initial_window_size);
+		write_uint32(settings, AVHTTP_HTTP2_STREAM_WINDOW_SIZE);
+		queue_frame(frame_settings, 0, 0, settings);
+
+		// 连接的接收窗口只能通过WINDOW_UPDATE增大.
+		if (AVHTTP_HTTP2_CONNECTION_WINDOW_SIZE > 65535)
+			queue_window_update(0, AVHTTP_HTTP2_CONNECTION_WINDOW_SIZE - 65535);
+
+		start_read();
+		start_pending_streams();
+		flush();
+	}
+
+	void do_submit(const http2_stream_ptr &stream)
+	{
+		if (stream->aborted())
+			return;
+		if (m_closed || m_goaway)
+		{
+			// 连接在提交前已经失败, 流可以在新的连接上重试.
+			stream->fail(m_connected ? errc::http2_refused_stream : m_error);
+			return;
+		}
+		m_pending_streams.push_back(stream);
+		if (m_connected)
+		{
+			start_pending_streams();
+			flush();
+		}
+	}
+
+	void do_reset(const http2_stream_ptr &stream)
+	{
+		std::deque<http2_stream_ptr>::iterator i =
+			std::find(m_pending_streams.begin(), m_pending_streams.end(), stream);
+		if (i != m_pending_streams.end())
+		{
+			m_pending_streams.erase(i);
+			return;
+		}
+		if (stream->m_id == 0 || m_streams.find(stream->m_id) == m_streams.end())
+			return;
+		queue_rst_stream(stream->m_id, cancel);
+		remove_stream(stream);
+		flush();
+	}
+
+	void do_consumed(const http2_stream_ptr &stream, std::size_t size)
+	{
+		if (m_closed || stream->m_remote_closed || m_streams.find(stream->m_id) == m_streams.end())
+			return;
+		stream->m_recv_window += size;
+		queue_window_update(stream->m_id, static_cast<boost::uint32_t>(size));
+		flush();
+	}
+
+	void start_read()
+	{
+		m_sock.async_read_some(boost::asio::buffer(m_read_buffer),
+			m_strand.wrap(boost::bind(&http2_connection::handle_read, shared_from_this(),
+				boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+	}
+
+	void handle_read(const boost::system::error_code &ec, std::size_t bytes_transferred)
+	{
+		if (m_closed)
+			return;
+		if (ec)
+		{
+			fail_connection(ec);
+			return;
+		}
+
+		m_input.append(&m_read_buffer[0], bytes_transferred);
+		std::size_t pos = 0;
+		while (m_input.size() - pos >= 9)
+		{
+			const char *p = m_input.data() + pos;
+			std::size_t length = (static_cast<std::size_t>(static_cast<unsigned char>(p[0])) << 16) |
+				(static_cast<std::size_t>(static_cast<unsigned char>(p[1])) << 8) | static_cast<unsigned char>(p[2]);
+			if (length > max_frame_size)
+			{
+				connection_error(frame_size_error);
+				return;
+			}
+			if (m_input.size() - pos < 9 + length)
+				break;
+			boost::uint8_t type = static_cast<boost::uint8_t>(p[3]);
+			boost::uint8_t flags = static_cast<boost::uint8_t>(p[4]);
+			boost::uint32_t stream_id = read_uint32(p + 5) & 0x7fffffff;
+			handle_frame(type, flags, stream_id, p + 9, length);
+			if (m_closed)
+				return;
+			pos += 9 + length;
+		}
+		m_input.erase(0, pos);
+
+		flush();
+		start_read();
+	}
+
+	void handle_frame(boost::uint8_t type, boost::uint8_t flags, boost::uint32_t stream_id,
+		const char *payload, std::size_t length)
+	{
+		// 头部块的CONTINUATION帧之间不能有其它帧.
+		if (m_continuation_stream != 0 && (type != frame_continuation || stream_id != m_continuation_stream))
+		{
+			connection_error(protocol_error);
+			return;
+		}
+
+		switch (type)
+		{
+		case frame_data:
+			handle_data(flags, stream_id, payload, length);
+			break;
+		case frame_headers:
+			handle_headers(flags, stream_id, payload, length);
+			break;
+		case frame_continuation:
+			if (m_continuation_stream == 0)
+			{
+				connection_error(protocol_error);
+				return;
+			}
+			m_header_block.append(payload, length);
+			if (flags & flag_end_headers)
+			{
+				m_continuation_stream = 0;
+				handle_header_block(stream_id, m_continuation_end_stream);
+			}
+			break;
+		case frame_rst_stream:
+			handle_rst_stream(stream_id, payload, length);
+			break;
+		case frame_settings:
+			handle_settings(flags, stream_id, payload, length);
+			break;
+		case frame_push_promise:
+			// 我们禁用了服务器推送.
+			connection_error(protocol_error);
+			break;
+		case frame_ping:
+			if (stream_id != 0 || length != 8)
+			{
+				connection_error(protocol_error);
+				return;
+			}
+			if (!(flags & flag_ack))
+				queue_frame(frame_ping, flag_ack, 0, std::string(payload, length));
+			break;
+		case frame_goaway:
+			handle_goaway(stream_id, payload, length);
+			break;
+		case frame_window_update:
+			handle_window_update(stream_id, payload, length);
+			break;
+		default:
+			// 忽略PRIORITY和未知类型的帧.
+			break;
+		}
+	}
+
+	// 去掉帧中的填充, 填充错误返回false.
+	static bool strip_padding(boost::uint8_t flags, const char *&payload, std::size_t &length)
+	{
+		if (!(flags & flag_padded))
+			return true;
+		if (length < 1)
+			return false;
+		std::size_t padding = static_cast<unsigned char>(payload[0]);
+		if (padding >= length)
+			return false;
+		payload++;
+		length -= padding + 1;
+		return true;
+	}
+
+	void handle_data(boost::uint8_t flags, boost::uint32_t stream_id, const char *payload, std::size_t length)
+	{
+		if (stream_id == 0)
+		{
+			connection_error(protocol_error);
+			return;
+		}
+
+		// 连接的接收窗口在收到数据时就归还, 流的窗口在数据被读取后归还.
+		std::size_t frame_length = length;
+		if (static_cast<boost::int64_t>(frame_length) > m_recv_window)
+		{
+			connection_error(flow_control_error);
+			return;
+		}
+		m_recv_window -= frame_length;
+		m_recv_unacked += frame_length;
+		if (m_recv_unacked >= AVHTTP_HTTP2_CONNECTION_WINDOW_SIZE / 2)
+		{
+			m_recv_window += m_recv_unacked;
+			queue_window_update(0, static_cast<boost::uint32_t>(m_recv_unacked));
+			m_recv_unacked = 0;
+		}
+
+		if (!strip_padding(flags, payload, length))
+		{
+			connection_error(protocol_error);
+			return;
+		}
+
+		stream_map::iterator i = m_streams.find(stream_id);
+		if (i == m_streams.end())
+		{
+			// 还没有使用的流标识是协议错误, 已经关闭的流上的数据直接丢弃.
+			if (stream_id >= m_next_stream_id)
+				connection_error(protocol_error);
+			return;
+		}
+		http2_stream_ptr stream = i->second;
+		if (stream->m_remote_closed || !stream->headers_ready())
+		{
+			reset_stream(stream, stream_closed, errc::http2_protocol_error);
+			return;
+		}
+		if (static_cast<boost::int64_t>(frame_length) > stream->m_recv_window)
+		{
+			reset_stream(stream, flow_control_error, errc::http2_protocol_error);
+			return;
+		}
+		stream->m_recv_window -= frame_length;
+
+		bool end_stream = (flags & flag_end_stream) != 0;
+		stream->append_data(payload, length, end_stream);
+
+		// 填充不会被读取, 直接归还流的窗口.
+		if (frame_length != length && !end_stream)
+		{
+			stream->m_recv_window += frame_length - length;
+			queue_window_update(stream_id, static_cast<boost::uint32_t>(frame_length - length));
+		}
+
+		if (end_stream)
+			close_remote(stream);
+	}
+
+	void handle_headers(boost::uint8_t flags, boost::uint32_t stream_id, const char *payload, std::size_t length)
+	{
+		if (stream_id == 0 || !strip_padding(flags, payload, length))
+		{
+			connection_error(protocol_error);
+			return;
+		}
+		if (flags & flag_priority)
+		{
+			if (length < 5)
+			{
+				connection_error(protocol_error);
+				return;
+			}
+			payload += 5;
+			length -= 5;
+		}
+
+		m_header_block.assign(payload, length);
+		if (flags & flag_end_headers)
+		{
+			handle_header_block(stream_id, (flags & flag_end_stream) != 0);
+		}
+		else
+		{
+			m_continuation_stream = stream_id;
+			m_continuation_end_stream = (flags & flag_end_stream) != 0;
+		}
+	}
+
+	void handle_header_block(boost::uint32_t stream_id, bool end_stream)
+	{
+		// 即使流已经关闭也必须解码, 以保持动态表的同步.
+		detail::hpack_headers headers;
+		bool ok = m_decoder.decode(m_header_block.data(), m_header_block.size(), headers);
+		std::string().swap(m_header_block);
+		if (!ok)
+		{
+			connection_error(compression_error);
+			return;
+		}
+
+		stream_map::iterator i = m_streams.find(stream_id);
+		if (i == m_streams.end())
+		{
+			if (stream_id >= m_next_stream_id)
+				connection_error(protocol_error);
+			return;
+		}
+		http2_stream_ptr stream = i->second;
+		if (stream->m_remote_closed)
+		{
+			reset_stream(stream, stream_closed, errc::http2_protocol_error);
+			return;
+		}
+
+		// 响应body之后的头部块是trailers, 必须结束流.
+		if (stream->headers_ready())
+		{
+			if (!end_stream)
+			{
+				reset_stream(stream, protocol_error, errc::http2_protocol_error);
+				return;
+			}
+			stream->end_stream();
+			close_remote(stream);
+			return;
+		}
+
+		int status_code = 0;
+		detail::hpack_headers response;
+		for (detail::hpack_headers::iterator h = headers.begin(); h != headers.end(); ++h)
+		{
+			if (h->first == ":status")
+				status_code = std::atoi(h->second.c_str());
+			else if (!h->first.empty() && h->first[0] != ':')
+				response.push_back(*h);
+		}
+		if (status_code < 100 || status_code > 999)
+		{
+			reset_stream(stream, protocol_error, errc::http2_protocol_error);
+			return;
+		}
+
+		// 忽略1xx的响应, 等待最终的响应.
+		if (status_code < 200 && !end_stream)
+			return;
+
+		stream->set_response(status_code, response, end_stream);
+		if (end_stream)
+			close_remote(stream);
+	}
+
+	void handle_rst_stream(boost::uint32_t stream_id, const char *payload, std::size_t length)
+	{
+		if (stream_id == 0 || length != 4)
+		{
+			connection_error(length != 4 ? frame_size_error : protocol_error);
+			return;
+		}
+		stream_map::iterator i = m_streams.find(stream_id);
+		if (i == m_streams.end())
+			return;
+		http2_stream_ptr stream = i->second;
+		boost::uint32_t code = read_uint32(payload);
+
+		// 服务器已经发送完响应, 只是不再接收请求的body.
+		if (code == no_error && stream->m_remote_closed)
+		{
+			remove_stream(stream);
+			return;
+		}
+		stream->fail(code == refused_stream ? errc::http2_refused_stream : errc::http2_stream_reset);
+		remove_stream(stream);
+	}
+
+	void handle_settings(boost::uint8_t flags, boost::uint32_t stream_id, const char *payload, std::size_t length)
+	{
+		if (stream_id != 0)
+		{
+			connection_error(protocol_error);
+			return;
+		}
+		if (flags & flag_ack)
+		{
+			if (length != 0)
+				connection_error(frame_size_error);
+			return;
+		}
+		if (length % 6 != 0)
+		{
+			connection_error(frame_size_error);
+			return;
+		}
+
+		for (std::size_t pos = 0; pos < length; pos += 6)
+		{
+			boost::uint16_t id = static_cast<boost::uint16_t>(
+				(static_cast<unsigned char>(payload[pos]) << 8) | static_cast<unsigned char>(payload[pos + 1]));
+			boost::uint32_t value = read_uint32(payload + pos + 2);
+			switch (id)
+			{
+			case settings_header_table_size:
+				m_encoder.max_table_size(value);
+				break;
+			case settings_max_concurrent_streams:
+				m_peer_max_concurrent = value;
+				break;
+			case settings_initial_window_size:
+				{
+					if (value > 0x7fffffff)
+					{
+						connection_error(flow_control_error);
+						return;
+					}
+					// 初始窗口的变化作用于所有打开的流.
+					boost::int64_t delta = static_cast<boost::int64_t>(value) - m_peer_initial_window;
+					m_peer_initial_window = value;
+					for (stream_map::iterator i = m_streams.begin(); i != m_streams.end(); ++i)
+						i->second->m_send_window += delta;
+				}
+				break;
+			case settings_max_frame_size:
+				if (value < 16384 || value > 16777215)
+				{
+					connection_error(protocol_error);
+					return;
+				}
+				m_peer_max_frame_size = value;
+				break;
+			default:
+				break;
+			}
+		}
+
+		queue_frame(frame_settings, flag_ack, 0, std::string());
+		start_pending_streams();
+		send_data();
+	}
+
+	void handle_goaway(boost::uint32_t stream_id, const char *payload, std::size_t length)
+	{
+		if (stream_id != 0 || length < 8)
+		{
+			connection_error(protocol_error);
+			return;
+		}
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_goaway = true;
+		}
+		m_last_stream_id = read_uint32(payload) & 0x7fffffff;
+		LOG_DEBUG_CAT(log_connect, "HTTP/2 GOAWAY from \'" << m_origin.host() << "\', last stream "
+			<< m_last_stream_id << ", error code " << read_uint32(payload + 4));
+
+		// 服务器没有处理的流可以安全地在新的连接上重试.
+		std::vector<http2_stream_ptr> refused;
+		for (stream_map::iterator i = m_streams.begin(); i != m_streams.end(); ++i)
+		{
+			if (i->first > m_last_stream_id)
+				refused.push_back(i->second);
+		}
+		refused.insert(refused.end(), m_pending_streams.begin(), m_pending_streams.end());
+		m_pending_streams.clear();
+		for (std::size_t i = 0; i < refused.size(); i++)
+		{
+			refused[i]->fail(errc::http2_refused_stream);
+			if (refused[i]->m_id != 0)
+				m_streams.erase(refused[i]->m_id);
+		}
+		close_if_idle();
+	}
+
+	void handle_window_update(boost::uint32_t stream_id, const char *payload, std::size_t length)
+	{
+		if (length != 4)
+		{
+			connection_error(frame_size_error);
+			return;
+		}
+		boost::uint32_t increment = read_uint32(payload) & 0x7fffffff;
+		if (stream_id == 0)
+		{
+			if (increment == 0 || m_send_window + increment > 0x7fffffff)
+			{
+				connection_error(increment == 0 ? protocol_error : flow_control_error);
+				return;
+			}
+			m_send_window += increment;
+		}
+		else
+		{
+			stream_map::iterator i = m_streams.find(stream_id);
+			if (i == m_streams.end())
+				return;
+			http2_stream_ptr stream = i->second;
+			if (increment == 0 || stream->m_send_window + increment > 0x7fffffff)
+			{
+				reset_stream(stream, increment == 0 ? protocol_error : flow_control_error,
+					errc::http2_protocol_error);
+				return;
+			}
+			stream->m_send_window += increment;
+		}
+		send_data();
+	}
+
+	// 在并发数限制内发送排队的流的请求头.
+	void start_pending_streams()
+	{
+		while (!m_pending_streams.empty() && !m_goaway &&
+			m_streams.size() < m_peer_max_concurrent)
+		{
+			http2_stream_ptr stream = m_pending_streams.front();
+			m_pending_streams.pop_front();
+
+			// 流标识用完后不能再创建新的流.
+			if (m_next_stream_id > 0x7fffffff)
+			{
+				stream->fail(errc::http2_refused_stream);
+				{
+					boost::mutex::scoped_lock lock(m_mutex);
+					m_goaway = true;
+				}
+				continue;
+			}
+
+			{
+				boost::mutex::scoped_lock lock(stream->m_mutex);
+				stream->m_id = m_next_stream_id;
+			}
+			m_next_stream_id += 2;
+			stream->m_send_window = m_peer_initial_window;
+			stream->m_recv_window = AVHTTP_HTTP2_STREAM_WINDOW_SIZE;
+			m_streams[stream->m_id] = stream;
+
+			// 请求头按流标识的顺序编码和发送, 超过帧大小时分成CONTINUATION帧.
+			std::string block;
+			m_encoder.encode(stream->m_request, block);
+			detail::hpack_headers().swap(stream->m_request);
+			bool end_stream = stream->m_body.empty() || stream->m_body.size() == 0;
+			stream->m_local_closed = end_stream;
+			std::size_t pos = 0;
+			do
+			{
+				std::size_t size = (std::min)(block.size() - pos, static_cast<std::size_t>(m_peer_max_frame_size));
+				bool last = (pos + size == block.size());
+				boost::uint8_t flags = last ? flag_end_headers : 0;
+				if (pos == 0 && end_stream)
+					flags |= flag_end_stream;
+				queue_frame(pos == 0 ? frame_headers : frame_continuation, flags,
+					stream->m_id, block.substr(pos, size));
+				pos += size;
+			} while (pos < block.size());
+		}
+		send_data();
+	}
+
+	// 在发送窗口内发送各个流的body.
+	void send_data()
+	{
+		if (!m_connected || m_closed)
+			return;
+
+		std::vector<http2_stream_ptr> failed;
+		for (stream_map::iterator i = m_streams.begin(); i != m_streams.end(); ++i)
+		{
+			http2_stream_ptr stream = i->second;
+			while (!stream->m_local_closed && m_write_pending.size() < write_buffer_limit &&
+				m_send_window > 0 && stream->m_send_window > 0)
+			{
+				std::size_t size = static_cast<std::size_t>((std::min)(
+					(std::min)(m_send_window, stream->m_send_window),
+					static_cast<boost::int64_t>(m_peer_max_frame_size)));
+				m_data_buffer.resize(size);
+				boost::system::error_code ec;
+				std::size_t bytes_transferred = stream->m_body.read(stream->m_body_offset,
+					&m_data_buffer[0], size, ec);
+				if (ec)
+				{
+					stream->fail(ec);
+					failed.push_back(stream);
+					break;
+				}
+				stream->m_body_offset += bytes_transferred;
+				m_send_window -= bytes_transferred;
+				stream->m_send_window -= bytes_transferred;
+				bool end_stream = bytes_transferred == 0 ||
+					stream->m_body_offset == stream->m_body.size();
+				queue_frame(frame_data, end_stream ? flag_end_stream : 0, stream->m_id,
+					std::string(&m_data_buffer[0], bytes_transferred));
+				if (end_stream)
+				{
+					stream->m_local_closed = true;
+					stream->m_body = body_source();
+				}
+			}
+		}
+		for (std::size_t i = 0; i < failed.size(); i++)
+		{
+			queue_rst_stream(failed[i]->m_id, internal_error);
+			remove_stream(failed[i]);
+		}
+
+		// 已经发送完body的流可能也已经收到了完整的响应.
+		std::vector<http2_stream_ptr> done;
+		for (stream_map::iterator i = m_streams.begin(); i != m_streams.end(); ++i)
+		{
+			if (i->second->m_local_closed && i->second->m_remote_closed)
+				done.push_back(i->second);
+		}
+		for (std::size_t i = 0; i < done.size(); i++)
+			remove_stream(done[i]);
+	}
+
+	// 服务器发送完响应.
+	void close_remote(const http2_stream_ptr &stream)
+	{
+		stream->m_remote_closed = true;
+		// 服务器提前结束响应时不再发送body.
+		if (!stream->m_local_closed)
+		{
+			queue_rst_stream(stream->m_id, no_error);
+			stream->m_local_closed = true;
+		}
+		remove_stream(stream);
+	}
+
+	// 流出错, 发送RST_STREAM.
+	void reset_stream(const http2_stream_ptr &stream, error_type code, const boost::system::error_code &ec)
+	{
+		stream->fail(ec);
+		queue_rst_stream(stream->m_id, code);
+		remove_stream(stream);
+	}
+
+	void remove_stream(const http2_stream_ptr &stream)
+	{
+		m_streams.erase(stream->m_id);
+		start_pending_streams();
+		close_if_idle();
+	}
+
+	// 收到GOAWAY后, 所有的流完成时关闭连接.
+	void close_if_idle()
+	{
+		if (m_goaway && m_streams.empty() && m_pending_streams.empty() && !m_closed)
+			fail_connection(boost::asio::error::eof);
+	}
+
+	// 连接错误, 发送GOAWAY后关闭连接.
+	void connection_error(error_type code)
+	{
+		LOG_ERROR_CAT(log_parse, "HTTP/2 connection error " << code << " from \'" << m_origin.host() << "\'");
+		std::string payload;
+		write_uint32(payload, 0);
+		write_uint32(payload, code);
+		queue_frame(frame_goaway, 0, 0, payload);
+		flush();
+		fail_streams(errc::http2_protocol_error);
+	}
+
+	// 连接失败或关闭, 所有的流以ec返回.
+	void fail_connection(const boost::system::error_code &ec)
+	{
+		fail_streams(ec);
+		boost::system::error_code ignore_ec;
+		m_resolver.cancel();
+		if (m_sock.instantiated())
+			m_sock.close(ignore_ec);
+		m_nossl_socket.close(ignore_ec);
+	}
+
+	void fail_streams(const boost::system::error_code &ec)
+	{
+		if (m_closed)
+			return;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_closed = true;
+		}
+		m_error = ec;
+
+		// 已经发送的流, 连接断开不能当作响应正常结束.
+		boost::system::error_code stream_ec = ec;
+		if (ec == boost::asio::error::eof)
+			stream_ec = boost::asio::error::connection_reset;
+		for (stream_map::iterator i = m_streams.begin(); i != m_streams.end(); ++i)
+			i->second->fail(stream_ec);
+		m_streams.clear();
+
+		// 还没有发送的流: 连接已经建立时可以重试, 否则返回连接的错误.
+		for (std::size_t i = 0; i < m_pending_streams.size(); i++)
+			m_pending_streams[i]->fail(m_connected ? errc::http2_refused_stream : ec);
+		m_pending_streams.clear();
+	}
+
+	void queue_frame(boost::uint8_t type, boost::uint8_t flags, boost::uint32_t stream_id, const std::string &payload)
+	{
+		m_write_pending.push_back(static_cast<char>(payload.size() >> 16));
+		m_write_pending.push_back(static_cast<char>(payload.size() >> 8));
+		m_write_pending.push_back(static_cast<char>(payload.size()));
+		m_write_pending.push_back(static_cast<char>(type));
+		m_write_pending.push_back(static_cast<char>(flags));
+		write_uint32(m_write_pending, stream_id);
+		m_write_pending.append(payload);
+	}
+
+	void queue_rst_stream(boost::uint32_t stream_id, error_type code)
+	{
+		std::string payload;
+		write_uint32(payload, code);
+		queue_frame(frame_rst_stream, 0, stream_id, payload);
+	}
+
+	void queue_window_update(boost::uint32_t stream_id, boost::uint32_t increment)
+	{
+		std::string payload;
+		write_uint32(payload, increment);
+		queue_frame(frame_window_update, 0, stream_id, payload);
+	}
+
+	// 写入排队的帧, 写入过程中新的帧追加到m_write_pending, 写入完成后再一起写入.
+	void flush()
+	{
+		if (m_writing || m_write_pending.empty() || !m_connected || !m_sock.instantiated())
+			return;
+		m_writing = true;
+		m_write_buffer.swap(m_write_pending);
+		m_write_pending.clear();
+		boost::asio::async_write(m_sock, boost::asio::buffer(m_write_buffer),
+			m_strand.wrap(boost::bind(&http2_connection::handle_write, shared_from_this(),
+				boost::asio::placeholders::error)));
+	}
+
+	void handle_write(const boost::system::error_code &ec)
+	{
+		m_writing = false;
+		m_write_buffer.clear();
+		if (m_closed)
+		{
+			// 发送GOAWAY后关闭连接.
+			boost::system::error_code ignore_ec;
+			m_sock.close(ignore_ec);
+			return;
+		}
+		if (ec)
+		{
+			fail_connection(ec);
+			return;
+		}
+		send_data();
+		flush();
+	}
+
+protected:
+
+	typedef boost::asio::ip::tcp::resolver tcp_resolver;
+	typedef boost::asio::ip::tcp::socket nossl_socket;
+#ifdef AVHTTP_ENABLE_OPENSSL
+	typedef detail::ssl_stream<boost::asio::ip::tcp::socket&> ssl_socket;
+#endif
+	typedef detail::variant_stream<
+		nossl_socket
+#ifdef AVHTTP_ENABLE_OPENSSL
+		, ssl_socket
+#endif
+	> socket_type;
+	typedef std::map<boost::uint32_t, http2_stream_ptr> stream_map;
+
+	boost::asio::io_service &m_io_service;			// io_service引用.
+	boost::asio::io_service::strand m_strand;		// 连接的所有操作在这个strand中执行.
+	tcp_resolver m_resolver;						// 解析HOST.
+	socket_type m_sock;								// socket.
+	nossl_socket m_nossl_socket;					// ssl连接的底层socket.
+	url m_origin;									// 连接的服务器.
+	bool m_check_certificate;						// 是否认证服务端证书.
+	std::string m_ca_directory;						// 证书路径.
+	std::string m_ca_cert;							// CA证书文件.
+	mutable boost::mutex m_mutex;					// 保护以下三个状态, 它们在http2_pool中读取.
+	bool m_closed;									// 连接已经关闭或出错.
+	bool m_goaway;									// 收到GOAWAY, 不再接受新的流.
+	bool m_http1_only;								// 服务器没有选择h2.
+	bool m_connected;								// 已经发送连接前言.
+	boost::system::error_code m_error;				// 连接的错误.
+	stream_map m_streams;							// 已经发送的流.
+	std::deque<http2_stream_ptr> m_pending_streams;	// 等待发送的流.
+	boost::uint32_t m_next_stream_id;				// 下一个流标识.
+	boost::uint32_t m_last_stream_id;				// GOAWAY中服务器处理的最后一个流.
+	boost::uint32_t m_peer_max_concurrent;			// 服务器允许的最大并发流数.
+	boost::int64_t m_peer_initial_window;			// 服务器设置的流的初始发送窗口.
+	boost::uint32_t m_peer_max_frame_size;			// 服务器接收的最大帧.
+	boost::int64_t m_send_window;					// 连接的发送窗口.
+	boost::int64_t m_recv_window;					// 连接的接收窗口.
+	std::size_t m_recv_unacked;						// 连接上收到还没有归还窗口的字节数.
+	detail::hpack_encoder m_encoder;				// 请求头的hpack编码器.
+	detail::hpack_decoder m_decoder;				// 响应头的hpack解码器.
+	std::string m_header_block;						// 正在接收的头部块.
+	boost::uint32_t m_continuation_stream;			// 等待CONTINUATION帧的流, 0表示没有.
+	bool m_continuation_end_stream;					// 正在接收的头部块是否结束流.
+	std::string m_write_pending;					// 等待写入的帧.
+	std::string m_write_buffer;						// 正在写入的帧.
+	bool m_writing;									// 是否正在写入.
+	std::vector<char> m_read_buffer;				// 读取缓冲.
+	std::string m_input;							// 已经读取还没有处理的数据.
+	std::vector<char> m_data_buffer;				// 读取body的缓冲.
+};
+
+void http2_stream::reset()
+{
+	http2_connection_ptr connection;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if (!m_error)
+			m_error = boost::asio::error::operation_aborted;
+		notify();
+		connection = m_connection.lock();
+	}
+	if (connection)
+		connection->m_strand.post(boost::bind(&http2_connection::do_reset, connection, shared_from_this()));
+}
+
+void http2_stream::consumed(std::size_t size)
+{
+	http2_connection_ptr connection;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		connection = m_connection.lock();
+	}
+	if (connection)
+		connection->m_strand.post(boost::bind(&http2_connection::do_consumed, connection, shared_from_this(), size));
+}
+
+// http/2连接池, 每个服务器(协议, 主机和端口)使用一个共享的连接, 请求作为连接上的流并发进行.
+// 连接在池的io_service中运行, 使用者(如http_stream)可以在其它的io_service中, 这时池的
+// io_service也必须在运行. 池是线程安全的.
+// @备注: 池必须在所有使用它的http_stream析构后析构. 连接在空闲时也保持读取(以响应服务器的
+//  PING和GOAWAY), 所以池的io_service.run()在池关闭(close或析构)后才会返回.
+// 以下是使用http/2访问的示例.
+// @begin example
+//  avhttp::http2_pool pool(io);
+//  avhttp::http_stream h1(io), h2(io);
+//  h1.http2(&pool);
+//  h2.http2(&pool);
+//  // 两个请求在同一个连接上同时进行.
+//  h1.async_open("https://example.com/a", handler1);
+//  h2.async_open("https://example.com/b", handler2);
+// @end example
+class http2_pool : public boost::noncopyable
+{
+public:
+	explicit http2_pool(boost::asio::io_service &io)
+		: m_io_service(io)
+		, m_prior_knowledge(false)
+		, m_check_certificate(true)
+	{}
+
+	~http2_pool()
+	{
+		close();
+	}
+
+	///设置http地址是否直接使用h2c(prior knowledge).
+	// @param enable为true时http地址也使用http/2, 服务器必须支持h2c, 默认为false, http地址
+	//  使用http/1.1. https地址总是通过ALPN协商.
+	void prior_knowledge(bool enable)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_prior_knowledge = enable;
+	}
+
+	///设置是否认证服务器证书, 与http_stream::check_certificate相同, 默认认证.
+	void check_certificate(bool is_check)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_check_certificate = is_check;
+	}
+
+	///添加证书路径.
+	void add_verify_path(const std::string &path)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_ca_directory = path;
+	}
+
+	///加载证书文件.
+	void load_verify_file(const std::string &filename)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_ca_cert = filename;
+	}
+
+	///是否使用http/2访问u.
+	// @返回false表示u的协议不支持, 或者服务器在ALPN中没有选择h2, 这时应使用http/1.1.
+	bool supports(const url &u)
+	{
+		std::string protocol = u.protocol();
+		boost::mutex::scoped_lock lock(m_mutex);
+		if (protocol == "http")
+		{
+			if (!m_prior_knowledge)
+				return false;
+		}
+#ifdef AVHTTP_ENABLE_OPENSSL
+		else if (protocol != "https")
+#else
+		else
+#endif
+		{
+			return false;
+		}
+
+		std::string key = origin(u);
+		if (m_http1_origins.find(key) != m_http1_origins.end())
+			return false;
+		connection_map::iterator i = m_connections.find(key);
+		if (i != m_connections.end() && i->second->http1_only())
+		{
+			m_connections.erase(i);
+			m_http1_origins.insert(key);
+			return false;
+		}
+		return true;
+	}
+
+	///在u所在服务器的连接上打开一个流.
+	// @param io是使用这个流的io_service.
+	// @param u是请求的地址, 用于选择连接.
+	// @param headers是请求头, 包括伪头部.
+	// @param body是请求的body.
+	// @备注: 没有可用的连接时创建新的连接, 连接失败时流以连接的错误返回.
+	http2_stream_ptr open_stream(boost::asio::io_service &io, const url &u,
+		const detail::hpack_headers &headers, const body_source &body)
+	{
+		http2_stream_ptr stream(new http2_stream(io, headers, body));
+		http2_connection_ptr connection;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			std::string key = origin(u);
+			connection_map::iterator i = m_connections.find(key);
+			if (i != m_connections.end() && i->second->usable())
+			{
+				connection = i->second;
+			}
+			else
+			{
+				connection.reset(new http2_connection(m_io_service, url::from_string(key),
+					m_check_certificate, m_ca_directory, m_ca_cert));
+				m_connections[key] = connection;
+				connection->start();
+			}
+		}
+		connection->submit(stream);
+		return stream;
+	}
+
+	///池中的连接数.
+	std::size_t connection_count() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_connections.size();
+	}
+
+	///关闭所有的连接.
+	void close()
+	{
+		connection_map connections;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			connections.swap(m_connections);
+		}
+		for (connection_map::iterator i = connections.begin(); i != connections.end(); ++i)
+			i->second->close();
+	}
+
+private:
+	// 连接的服务器, 不包括路径.
+	static std::string origin(const url &u)
+	{
+		return u.protocol() + "://" + u.host() + ":" + boost::lexical_cast<std::string>(u.port());
+	}
+
+private:
+	typedef std::map<std::string, http2_connection_ptr> connection_map;
+
+	boost::asio::io_service &m_io_service;
+	mutable boost::mutex m_mutex;
+	bool m_prior_knowledge;
+	bool m_check_certificate;
+	std::string m_ca_directory;
+	std::string m_ca_cert;
+	connection_map m_connections;
+	std::set<std::string> m_http1_origins;
+};
+
+} // namespace avhttp
+
+#endif // __HTTP2_CONNECTION_HPP__
@@ -16,29 +16,34 @@
 #endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
 
 #include <vector>
+#include <cstdio>		// for std::sprintf
 #include <cstring>		// for std::strcmp/std::strlen
 #include <streambuf>	// support streambuf.
 
 #include <boost/array.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_array.hpp>
+#include <boost/type_traits/decay.hpp>
 
 #include "avhttp/url.hpp"
 #include "avhttp/settings.hpp"
+#include "avhttp/http_timing.hpp"
+#include "avhttp/metrics.hpp"
 #include "avhttp/detail/io.hpp"
+#include "avhttp/detail/handler_alloc.hpp"
+#include "avhttp/detail/awaitable.hpp"
 #include "avhttp/detail/parsers.hpp"
 #include "avhttp/detail/error_codec.hpp"
 #ifdef AVHTTP_ENABLE_OPENSSL
 #include "avhttp/detail/ssl_stream.hpp"
 #endif
-#ifdef AVHTTP_ENABLE_ZLIB
-extern "C"
-{
-#include "zlib.h"
-#ifndef z_const
-# define z_const
-#endif
-}
-#endif
+#include "avhttp/content_decoder.hpp"
+#include "avhttp/detail/chained_decoder.hpp"
+#include "avhttp/body_source.hpp"
+#include "avhttp/redirect_cache.hpp"
+#include "avhttp/response_cache.hpp"
+#include "avhttp/http2_connection.hpp"
 
 #include "avhttp/detail/socket_type.hpp"
 #include "avhttp/detail/utf8.hpp"
@@ -428,6 +433,74 @@ public:
 	template <typename Handler>
 	void async_request(const request_opts &opt, BOOST_ASIO_MOVE_ARG(Handler) handler);
 
+	///在已经发送请求头的连接上发送body, 如果失败抛出异常.
+	// @param body是要发送的body, 长度未知时使用chunked编码发送.
+	// @备注: 一般不需要直接调用, 通过request_body设置的body由open/request自动发送.
+	AVHTTP_DECL void write_body(const body_source &body);
+
+	///在已经发送请求头的连接上发送body.
+	// @param body是要发送的body, 长度未知时使用chunked编码发送.
+	// @param ec在发生错误时, 将传回错误信息.
+	AVHTTP_DECL void write_body(const body_source &body, boost::system::error_code &ec);
+
+	///在已经发送请求头的连接上异步发送body.
+	// @param body是要发送的body, 长度未知时使用chunked编码发送.
+	// @param handler 将被调用在body发送完成时. 它必须满足以下条件:
+	// @begin code
+	//  void handler(
+	//    const boost::system::error_code &ec	// 用于返回操作状态.
+	//  );
+	// @end code
+	template <typename Handler>
+	void async_write_body(const body_source &body, BOOST_ASIO_MOVE_ARG(Handler) handler);
+
+#ifdef AVHTTP_HAS_CO_AWAIT
+	///使用完成令牌的异步接口, 如boost::asio::use_awaitable, 用于C++20协程.
+	// 与对应的handler版本行为相同, 需要定义了AVHTTP_HAS_CO_AWAIT.
+	// 使用use_awaitable时, 错误通过boost::system::system_error异常抛出, 可以使用
+	// boost::asio::redirect_error得到error_code.
+	// @begin example
+	//  boost::asio::awaitable<void> fetch(avhttp::http_stream &h)
+	//  {
+	//    co_await h.async_open("http://www.boost.org/LICENSE_1_0.txt", boost::asio::use_awaitable);
+	//    char data[1024];
+	//    boost::system::error_code ec;
+	//    while (!ec)
+	//    {
+	//      std::size_t n = co_await h.async_read_some(boost::asio::buffer(data),
+	//        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+	//      std::cout.write(data, n);
+	//    }
+	//  }
+	//  ...
+	//  boost::asio::co_spawn(io, fetch(h), boost::asio::detached);
+	// @end example
+	template <typename CompletionToken>
+		requires detail::completion_token<CompletionToken, void (boost::system::error_code)>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code))
+	async_open(const url &u, CompletionToken &&token);
+
+	template <typename MutableBufferSequence, typename CompletionToken>
+		requires detail::completion_token<CompletionToken, void (boost::system::error_code, std::size_t)>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code, std::size_t))
+	async_read_some(const MutableBufferSequence &buffers, CompletionToken &&token);
+
+	template <typename ConstBufferSequence, typename CompletionToken>
+		requires detail::completion_token<CompletionToken, void (boost::system::error_code, std::size_t)>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code, std::size_t))
+	async_write_some(const ConstBufferSequence &buffers, CompletionToken &&token);
+
+	template <typename CompletionToken>
+		requires detail::completion_token<CompletionToken, void (boost::system::error_code)>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code))
+	async_request(const request_opts &opt, CompletionToken &&token);
+
+	template <typename CompletionToken>
+		requires detail::completion_token<CompletionToken, void (boost::system::error_code)>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code))
+	async_write_body(const body_source &body, CompletionToken &&token);
+#endif // AVHTTP_HAS_CO_AWAIT
+
 	///清除读写缓冲区数据.
 	// @备注: 非线程安全! 不应在正在进行读写操作时进行该操作!
 	AVHTTP_DECL void clear();
@@ -453,8 +526,101 @@ public:
 
 	///设置最大重定向次数.
 	// @param n 指定最大重定向次数, 为0表示禁用重定向.
+	// @备注: 支持301, 302, 303, 307和308跳转. 303跳转, 以及POST请求的301和302跳转改用
+	// GET请求且不再发送body; 307和308跳转保持原来的请求方法和body, body来自生成器时无法
+	// 重新发送, 这时不跳转, 以跳转的状态码返回. 跳转到同一服务器且连接为keep-alive时, 读完
+	// 跳转响应的body后在同一连接上发送新的请求, 不重新连接.
 	AVHTTP_DECL void max_redirects(int n);
 
+	///设置永久重定向的缓存.
+	// @param cache 记录GET和HEAD请求收到的301和308跳转, 以后打开同一地址时直接请求跳转后的
+	//  地址. 默认为default_redirect_cache(), 为NULL时不使用缓存.
+	// @备注: cache必须在http_stream析构前保持有效.
+	AVHTTP_DECL void permanent_redirect_cache(redirect_cache *cache);
+
+	///设置响应缓存.
+	// @param cache 打开GET请求时先查找缓存, 新鲜的响应直接从缓存读取, 过期的响应发出条件请求
+	//  验证; 可以缓存的响应在body读取完成后保存. 默认为NULL, 不使用缓存.
+	// @备注: cache必须在http_stream析构前保持有效. 只有open/async_open打开的地址使用缓存,
+	//  跳转后的响应不保存. 参见response_cache.
+	AVHTTP_DECL void cache(response_cache *cache);
+
+	///当前的响应是否从缓存读取, 包括验证后服务器返回304的响应.
+	AVHTTP_DECL bool from_cache() const;
+
+	///设置http/2连接池.
+	// @param pool不为NULL时, async_open打开的https地址通过ALPN协商http/2, 请求作为池中共享
+	//  连接上的一个流; pool设置了prior_knowledge时http地址也使用http/2. 服务器不支持h2时
+	//  自动改用http/1.1. 默认为NULL, 只使用http/1.1.
+	// @备注: 只有异步接口使用http/2, 同步的open仍然使用http/1.1; 使用代理时不使用http/2.
+	//  pool必须在http_stream析构前保持有效. 参见http2_pool.
+	AVHTTP_DECL void http2(http2_pool *pool);
+
+	///当前的请求是否使用http/2.
+	AVHTTP_DECL bool is_http2() const;
+
+	///设置Content-Encoding解码器的创建函数.
+	// @param constructor 根据响应的Content-Encoding创建解码器, 为NULL时不解码, 直接返回
+	// 原始的body数据. 默认为default_content_decoder_constructor.
+	AVHTTP_DECL void content_decoder_constructor(content_decoder_constructor_type constructor);
+
+	///设置是否自动添加Accept-Encoding.
+	// @param enable为true时, 请求选项中没有指定Accept-Encoding则添加default_accept_encoding()
+	//  返回的编码, 即编译时启用的解码器支持的编码. 默认为false.
+	// @备注: 使用自定义的解码器创建函数时不自动添加, 需要自己设置Accept-Encoding.
+	AVHTTP_DECL void auto_accept_encoding(bool enable);
+
+	///设置解码时的输入缓冲大小.
+	// @param size 每次从socket读取待解码数据的最大字节数, 默认为default_decode_buffer_size.
+	// @备注: 解码时数据从socket直接读取到这个缓冲中, 然后解码到用户的缓冲.
+	AVHTTP_DECL void decode_buffer_size(std::size_t size);
+
+	///设置请求的body.
+	// @param body是请求的body, 在之后的open/request/async_open/async_request中发送, 直到
+	//  再次设置. 请求选项中有http_options::request_body时, 优先使用该选项.
+	// @备注: 请求选项中没有指定Content-Length和Transfer-Encoding时, body长度已知则添加
+	//  Content-Length, 否则添加Transfer-Encoding: chunked并使用chunked编码发送.
+	// @begin example
+	//  avhttp::http_stream h(io);
+	//  h.request_options(avhttp::request_opts()
+	//    (avhttp::http_options::request_method, "POST"));
+	//  h.request_body(avhttp::body_source::from_memory(data, size));
+	//  h.open("http://example.com/upload");
+	// @end example
+	AVHTTP_DECL void request_body(const body_source &body);
+
+	///设置发送body时是否使用Expect: 100-continue.
+	// @param enable为true时, 有body的请求先只发送请求头, 等待服务器返回100 Continue后再
+	//  发送body. 服务器直接返回最终状态(如401, 413)时不发送body, 这时连接不能再用于
+	//  下一个请求. 请求选项中包含Expect: 100-continue时也使用这种方式.
+	// @param timeout为等待100 Continue的时间, 超时后直接发送body.
+	// @begin example
+	//  avhttp::http_stream h(io);
+	//  h.expect_continue(true, boost::posix_time::milliseconds(500));
+	//  h.request_body(avhttp::body_source::from_file("large.bin"));
+	//  ...
+	// @end example
+	AVHTTP_DECL void expect_continue(bool enable, const boost::posix_time::time_duration &timeout
+		= boost::posix_time::seconds(default_continue_time_out));
+
+	///设置超时.
+	// @param s 指定了连接, ssl握手, 接收http头, 读取body的空闲超时和整个请求的超时, 参见
+	//  timeout_settings, 默认不限制. 超时后连接被关闭, 正在进行的操作返回errc::timed_out.
+	// @备注: 异步操作的各个超时共用一个定时器. 同步操作在设置了超时后以非阻塞方式进行
+	//  连接, 握手和读取, 等待socket就绪直到超时; 同步发送请求时不检查超时.
+	// @begin example
+	//  avhttp::http_stream h(io);
+	//  avhttp::timeout_settings s;
+	//  s.connect_timeout = boost::posix_time::seconds(5);
+	//  s.read_timeout = boost::posix_time::seconds(30);
+	//  h.timeouts(s);
+	//  h.async_open("http://example.com/", handler);
+	// @end example
+	AVHTTP_DECL void timeouts(const timeout_settings &s);
+
+	///返回超时设置.
+	AVHTTP_DECL const timeout_settings& timeouts() const;
+
 	///设置代理, 通过设置代理访问http服务器.
 	// @param s 指定了代理参数.
 	// @begin example
@@ -522,6 +688,20 @@ public:
 	// @param filename指定的证书文件名.
 	AVHTTP_DECL void load_verify_file(const std::string &filename);
 
+	///返回本次请求各个阶段的时间点.
+	// @备注: 在已经打开的连接上再次request/async_request时, 时间点从发起请求时重新记录.
+	AVHTTP_DECL const http_timing& timing() const;
+
+	///返回本次请求从socket上读取的字节数, 包括http头, chunked编码和压缩的数据.
+	// @备注: 对于https, 统计的是解密后的字节数, 不包括ssl握手和记录层的开销.
+	AVHTTP_DECL boost::uint64_t wire_bytes_read() const;
+
+	///返回本次请求向socket写入的字节数, 包括http请求头和请求的body.
+	AVHTTP_DECL boost::uint64_t wire_bytes_written() const;
+
+	///返回本次请求通过read_some/async_read_some返回给用户的body字节数(解码和解压后).
+	AVHTTP_DECL boost::int64_t decoded_bytes() const;
+
 
 protected:
 
@@ -531,6 +711,219 @@ protected:
 	std::size_t read_some_impl(const MutableBufferSequence &buffers,
 		boost::system::error_code &ec);
 
+	// 读取body数据的实现, read_some/async_read_some在此基础上统计时间和字节数.
+	template <typename MutableBufferSequence>
+	std::size_t read_some_body(const MutableBufferSequence &buffers,
+		boost::system::error_code &ec);
+
+	template <typename MutableBufferSequence, typename Handler>
+	void async_read_some_body(const MutableBufferSequence &buffers, Handler handler);
+
+	// 根据Content-Encoding准备解码器.
+	AVHTTP_DECL void setup_content_decoder(boost::system::error_code &ec);
+
+	// 开启了auto_accept_encoding时向请求选项中添加Accept-Encoding.
+	AVHTTP_DECL void add_accept_encoding(request_opts &opts) const;
+
+	// 解码输入缓冲中是否还有未解码的数据.
+	AVHTTP_DECL bool decode_pending() const;
+
+	// 准备解码输入缓冲, 返回最多max_size字节的可写入空间.
+	AVHTTP_DECL boost::asio::mutable_buffers_1 prepare_decode_buffer(std::size_t max_size);
+
+	// 提交写入解码输入缓冲的字节数.
+	AVHTTP_DECL void commit_decode_buffer(std::size_t bytes_transferred);
+
+	// 将解码输入缓冲中的数据解码到buffers中.
+	template <typename MutableBufferSequence>
+	std::size_t decode_some(const MutableBufferSequence &buffers,
+		boost::system::error_code &ec);
+
+	// 异步读取数据到解码输入缓冲, 并解码到buffers中.
+	template <typename MutableBufferSequence, typename Handler>
+	void async_read_decode(const MutableBufferSequence &buffers,
+		Handler handler, std::size_t max_size);
+
+	// 从请求选项中取出body(或使用request_body设置的body)准备发送, 返回需要添加的请求头.
+	AVHTTP_DECL std::string setup_request_body(request_opts &opts);
+
+	// 同步等待服务器对Expect: 100-continue的响应, 在超时前收到数据返回true.
+	AVHTTP_DECL bool wait_continue(boost::system::error_code &ec);
+
+	// 超时相关.
+
+	// 开始计算整个请求的截止时间.
+	AVHTTP_DECL void start_total_deadline();
+
+	// 开始一个阶段, timeout为这一阶段的超时.
+	AVHTTP_DECL void set_deadline(const boost::posix_time::time_duration &timeout);
+
+	// 当前阶段和整个请求的截止时间中较早的一个, 没有设置超时时为pos_infin.
+	AVHTTP_DECL boost::posix_time::ptime current_deadline() const;
+
+	// 异步操作开始, 按当前的截止时间设置定时器.
+	AVHTTP_DECL void arm_deadline();
+
+	// 阶段结束, 取消定时器.
+	AVHTTP_DECL void cancel_deadline();
+
+	// 定时器到期时关闭连接; 定时器被取消时http_stream可能已经析构, 所以先检查错误再访问self.
+	AVHTTP_DECL static void handle_deadline(http_stream *self, const boost::system::error_code &err);
+
+	// 关闭连接, 取消所有正在进行的操作.
+	AVHTTP_DECL void abort_connection();
+
+	// 超时后被取消的操作以errc::timed_out返回.
+	AVHTTP_DECL boost::system::error_code deadline_error(const boost::system::error_code &ec) const;
+
+	// 在deadline前等待socket可读(或可写), 就绪返回true, 超时(ec为errc::timed_out)或出错返回false.
+	AVHTTP_DECL bool wait_socket(tcp::socket::native_handle_type fd, bool read,
+		const boost::posix_time::ptime &deadline, boost::system::error_code &ec);
+
+	// 同步连接, 设置了超时时在截止时间前完成.
+	AVHTTP_DECL void connect_socket(tcp::socket::lowest_layer_type &sock,
+		const tcp::endpoint &endpoint, boost::system::error_code &ec);
+
+#ifdef AVHTTP_ENABLE_OPENSSL
+	// 同步ssl握手, 设置了超时时在截止时间前完成.
+	AVHTTP_DECL void handshake_socket(boost::system::error_code &ec);
+#endif
+
+	// 同步读取到m_response中直到遇到delim, 设置了超时时在截止时间前完成.
+	template <typename Stream>
+	std::size_t read_until_deadline(Stream &sock, const char *delim, boost::system::error_code &ec);
+
+	// 完成异步操作, 取消定时器并转换超时的错误.
+	template <typename Handler>
+	void handle_deadline_result(Handler handler, const boost::system::error_code &ec);
+
+	// 重定向相关.
+
+	// 打开的地址有缓存的永久重定向时, 将m_url替换为跳转后的地址.
+	AVHTTP_DECL void apply_cached_redirect();
+
+	// 检查响应是否需要跳转, 需要时得到跳转的地址, 并按状态码决定跳转后是否改用GET请求.
+	// 返回false且ec不为空表示跳转地址错误.
+	AVHTTP_DECL bool prepare_redirect(url &new_url, boost::system::error_code &ec);
+
+	// 跳转能否在当前连接上进行.
+	AVHTTP_DECL bool can_redirect_in_place(const url &new_url) const;
+
+	// 在当前连接上跳转, 清除上一个响应的状态.
+	AVHTTP_DECL void begin_redirect_in_place(const url &new_url);
+
+	// 跳转后改用GET请求时, 去掉请求方法和与body相关的选项.
+	AVHTTP_DECL void strip_request_body(request_opts &opts) const;
+
+	// 同步读完跳转响应的body.
+	AVHTTP_DECL void drain_body(boost::system::error_code &ec);
+
+	// 异步读取跳转响应的body, 读完后在同一连接上发送新的请求.
+	template <typename Handler>
+	void handle_redirect_drain(Handler handler, const url &new_url, std::size_t drained,
+		bool final_crlf, const boost::system::error_code &ec, std::size_t bytes_transferred);
+
+	// 响应缓存相关.
+
+	// 打开前查找缓存, 有新鲜的响应时从缓存打开并返回true, 过期的响应保存在m_cache_entry中.
+	AVHTTP_DECL bool open_from_cache();
+
+	// 有过期的缓存响应时, 添加条件请求的验证头.
+	AVHTTP_DECL void add_cache_validators(request_opts &opts) const;
+
+	// 收到响应头后, 304时改为从缓存读取, 可以缓存的200响应开始保存body.
+	AVHTTP_DECL void handle_cache_response(boost::system::error_code &ec);
+
+	// 从缓存项打开响应.
+	AVHTTP_DECL void serve_from_cache(const cached_response_ptr &entry, boost::system::error_code &ec);
+
+	// 从缓存读取body.
+	template <typename MutableBufferSequence>
+	std::size_t read_cache(const MutableBufferSequence &buffers, boost::system::error_code &ec);
+
+	// 将读取的body追加到待保存的响应中.
+	template <typename MutableBufferSequence>
+	void append_cache_data(const MutableBufferSequence &buffers, std::size_t bytes_transferred);
+
+	// body读取完成, 完整的body保存到缓存.
+	AVHTTP_DECL void finish_cache_fill(const boost::system::error_code &ec);
+
+	// 新的请求不再读取或保存上一个响应.
+	AVHTTP_DECL void stop_cache_body();
+
+	// 清除缓存相关的所有状态.
+	AVHTTP_DECL void reset_cache_state();
+
+	// 开始发送一个新的body.
+	AVHTTP_DECL void begin_write_body(const body_source &body, bool chunked);
+
+	// 准备下一次写入的数据, 包括未发送的请求头和一段body.
+	AVHTTP_DECL void prepare_body_buffers(boost::system::error_code &ec);
+
+	// 写入完成, 返回body是否已经全部发送.
+	AVHTTP_DECL bool commit_body_buffers();
+
+	// 是否使用sendfile发送body.
+	AVHTTP_DECL bool use_sendfile();
+
+	// 使用sendfile发送一些body数据, socket不可写时ec为would_block.
+	AVHTTP_DECL std::size_t sendfile_some(boost::system::error_code &ec);
+
+	// 发送m_request中的请求头和正在发送的body.
+	AVHTTP_DECL void write_body_impl(boost::system::error_code &ec);
+
+	template <typename Handler>
+	void async_write_body_impl(Handler handler);
+
+	template <typename Handler>
+	void handle_write_body(Handler handler, const boost::system::error_code &ec);
+
+	template <typename Handler>
+	void handle_sendfile(Handler handler, const boost::system::error_code &ec);
+
+	// http/2相关.
+
+	// 在连接池中打开流.
+	template <typename Handler>
+	void async_open_http2(Handler handler);
+
+	// 将请求作为一个新的流发送, timeout为等待响应头的超时.
+	template <typename Handler>
+	void async_request_http2(const request_opts &opt, Handler handler,
+		const boost::posix_time::time_duration &timeout);
+
+	template <typename Handler>
+	void handle_http2_response(Handler handler, const boost::system::error_code &err);
+
+	// 以非阻塞方式从流读取body, 没有数据时ec为would_block.
+	template <typename MutableBufferSequence>
+	std::size_t read_some_http2(const MutableBufferSequence &buffers, boost::system::error_code &ec);
+
+	// 等待流上的数据.
+	template <typename MutableBufferSequence, typename Handler>
+	void async_wait_http2(const MutableBufferSequence &buffers, Handler handler);
+
+	template <typename MutableBufferSequence, typename Handler>
+	void handle_http2_read(const MutableBufferSequence &buffers, Handler handler,
+		const boost::system::error_code &ec, std::size_t bytes_transferred);
+
+	// 取消并释放当前的流.
+	AVHTTP_DECL void reset_http2_stream();
+
+	// 计时和字节统计.
+	AVHTTP_DECL void reset_timing(bool keep_start);
+
+	AVHTTP_DECL void mark_request_start();
+
+	// 收到全部http头, 记录时间点并向metrics()报告状态码和各阶段耗时.
+	AVHTTP_DECL void record_response_metrics();
+
+	AVHTTP_DECL void record_body_read(const boost::system::error_code &ec, std::size_t bytes_transferred);
+
+	template <typename MutableBufferSequence, typename Handler>
+	void handle_body_read(const MutableBufferSequence &buffers, Handler handler,
+		const boost::system::error_code &ec, std::size_t bytes_transferred);
+
 	// 异步处理模板成员的相关实现.
 
 	template <typename Handler>
@@ -544,9 +937,16 @@ protected:
 	template <typename Handler>
 	void handle_request(Handler handler, const boost::system::error_code &err);
 
+	template <typename Handler>
+	void handle_continue_wait(Handler handler, bool is_timer,
+		const boost::system::error_code &err, std::size_t bytes_transferred);
+
 	template <typename Handler>
 	void handle_status(Handler handler, const boost::system::error_code &err);
 
+	template <typename Handler>
+	void handle_continue(Handler handler, int bytes_transferred, const boost::system::error_code &err);
+
 	template <typename Handler>
 	void handle_header(Handler handler, int bytes_transferred, const boost::system::error_code &err);
 
@@ -556,8 +956,7 @@ protected:
 
 	template <typename MutableBufferSequence, typename Handler>
 	void handle_skip_crlf(const MutableBufferSequence &buffers,
-		Handler handler, boost::shared_array<char> crlf,
-		const boost::system::error_code &ec, std::size_t bytes_transferred);
+		Handler handler, const boost::system::error_code &ec, std::size_t bytes_transferred);
 
 	template <typename MutableBufferSequence, typename Handler>
 	void handle_async_read(const MutableBufferSequence &buffers,
@@ -567,6 +966,10 @@ protected:
 	void handle_chunked_size(const MutableBufferSequence &buffers,
 		Handler handler, const boost::system::error_code &ec, std::size_t bytes_transferred);
 
+	template <typename MutableBufferSequence, typename Handler>
+	void handle_decode(const MutableBufferSequence &buffers,
+		Handler handler, const boost::system::error_code &ec, std::size_t bytes_transferred);
+
 	// 连接到socks代理, 在这一步中完成和socks的信息交换过程, 出错信息在ec中.
 	template <typename Stream>
 	void socks_proxy_connect(Stream &sock, boost::system::error_code &ec);
@@ -697,20 +1100,68 @@ private:
 	boost::int64_t m_content_length;				// 数据内容长度.
 	std::size_t m_body_size;						// body大小.
 	std::string m_location;							// 重定向的地址.
+	redirect_cache *m_redirect_cache;				// 永久重定向缓存.
+	bool m_redirect_to_get;							// 跳转后改用GET请求, 不再发送body.
+	std::vector<char> m_drain_buffer;				// 在同一连接上跳转时读取跳转响应body的缓冲.
+	response_cache *m_cache;						// 响应缓存, 为NULL时不使用.
+	bool m_cache_request;							// 当前请求可以使用缓存.
+	std::string m_cache_key;						// 当前请求在缓存中的url.
+	cached_response_ptr m_cache_entry;				// 过期的缓存响应, 用于条件请求.
+	cached_response_ptr m_cache_fill;				// 正在读取body, 等待保存的响应.
+	std::string m_cache_data;						// 等待保存的响应已读取的body.
+	bool m_cache_serving;							// 正在从缓存读取body.
+	body_source m_cache_body;						// 从缓存读取的body.
+	boost::int64_t m_cache_offset;					// 从缓存读取的位置.
 	boost::asio::streambuf m_request;				// 请求缓冲.
 	boost::asio::streambuf m_response;				// 回复缓冲.
-#ifdef AVHTTP_ENABLE_ZLIB
-	z_stream m_stream;								// zlib支持.
-	char m_zlib_buffer[1024];						// 解压缓冲.
-	std::size_t m_zlib_buffer_size;					// 输入的字节数.
-	bool m_is_gzip;									// 是否使用gz.
-#endif
+	content_decoder_constructor_type m_decoder_constructor;	// 创建解码器的函数.
+	bool m_auto_accept_encoding;					// 是否自动添加Accept-Encoding.
+	boost::scoped_ptr<content_decoder> m_decoder;	// 解码器, 在长连接上复用.
+	std::string m_decoder_encoding;					// m_decoder对应的编码.
+	bool m_is_decoding;								// 当前body是否需要解码.
+	std::vector<char> m_decode_buffer;				// 解码输入缓冲, 数据从socket直接读取到这里.
+	std::size_t m_decode_buffer_size;				// 解码输入缓冲大小.
+	std::size_t m_decode_begin;						// 未解码数据的起始位置.
+	std::size_t m_decode_end;						// 未解码数据的结束位置.
+	body_source m_body;								// 通过request_body设置的body.
+	body_source m_writing_body;						// 正在发送的body.
+	boost::int64_t m_body_written;					// 已经发送的body字节数.
+	std::size_t m_body_pending;						// 正在写入的body字节数.
+	bool m_body_chunked;							// body是否使用chunked编码发送.
+	bool m_body_end;								// body的数据已经全部交给写入.
+	std::vector<char> m_body_buffer;				// 读取文件或生成器body的缓冲.
+	char m_body_chunk_header[24];					// 发送chunked body时的chunk大小行.
+	boost::array<boost::asio::const_buffer, 4> m_body_buffers;	// 请求头和body的聚集写入缓冲.
+	bool m_expect_continue;							// 发送body时是否使用Expect: 100-continue.
+	boost::posix_time::time_duration m_continue_timeout;	// 等待100 Continue的时间.
+	boost::asio::deadline_timer m_continue_timer;	// 异步等待100 Continue的定时器.
+	bool m_continue_pending;						// 请求头已发送, body等待100 Continue后发送.
+	int m_continue_waits;							// 异步等待100 Continue未完成的操作数.
+	boost::system::error_code m_continue_error;		// 异步等待100 Continue时socket的等待结果.
+	bool m_body_rejected;							// 服务器没有接收body, 连接不能再复用.
+	timeout_settings m_timeouts;					// 超时设置.
+	boost::asio::deadline_timer m_deadline_timer;	// 异步操作的超时定时器.
+	boost::posix_time::ptime m_phase_deadline;		// 当前阶段的截止时间.
+	boost::posix_time::ptime m_total_deadline;		// 整个请求的截止时间.
+	bool m_deadline_armed;							// 定时器是否正在等待.
+	bool m_timed_out;								// 连接是否因为超时被关闭.
 	bool m_is_chunked;								// 是否使用chunked编码.
 	bool m_skip_crlf;								// 跳过crlf.
+	char m_crlf[2];									// 异步跳过chunked数据尾部crlf的缓冲.
 	bool m_is_chunked_end;							// 跳过chunked footer.
 	std::size_t m_chunked_size;						// chunked大小.
 	boost::array<char, buffer_size> m_get_buffer;	// 用于stream形式的读取缓冲.
 	boost::system::error_code m_last_error;			// 用于记录最后错误信息.
+	http_timing m_timing;							// 请求各个阶段的时间点.
+	boost::uint64_t m_wire_read_base;				// 请求开始时socket已读取的字节数.
+	boost::uint64_t m_wire_written_base;			// 请求开始时socket已写入的字节数.
+	boost::int64_t m_decoded_bytes;					// 返回给用户的body字节数.
+	detail::handler_memory m_read_handler_memory;	// async_read_some各个异步操作复用的内存.
+	http2_pool *m_http2;							// http/2连接池, 为NULL时不使用http/2.
+	http2_stream_ptr m_http2_stream;				// 当前请求的http/2流.
+	bool m_http2_mode;								// 当前请求是否使用http/2.
+	bool m_http2_retried;							// 流被拒绝后是否已经重试.
+	request_opts m_http2_request;					// 当前流的请求选项, 用于流被拒绝时重试.
 };
 
 }
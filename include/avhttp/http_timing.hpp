@@ -0,0 +1,134 @@
+//
+// http_timing.hpp
+// ~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __HTTP_TIMING_HPP__
+#define __HTTP_TIMING_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace avhttp {
+
+// http_stream一次请求在各个阶段完成时的时间点(UTC), 没有经过的阶段为not_a_date_time.
+// 使用代理时, resolved和connected是代理服务器的解析和连接时间.
+// 在已经打开的连接上再次调用request/async_request时, 只有request_start及之后的时间点有效.
+struct http_timing
+{
+	typedef boost::posix_time::ptime ptime;
+
+	// 开始打开url(open/async_open), 发生重定向时保持为第一次打开的时间.
+	ptime start;
+
+	// 域名解析完成.
+	ptime resolved;
+
+	// tcp连接建立.
+	ptime connected;
+
+	// socks代理握手或https代理的CONNECT请求完成.
+	ptime proxy_connected;
+
+	// ssl握手完成.
+	ptime tls_handshaked;
+
+	// 开始发送http请求.
+	ptime request_start;
+
+	// http请求发送完成.
+	ptime request_sent;
+
+	// 收到状态行, 即收到响应的第一个字节.
+	ptime status_received;
+
+	// 收到全部http头.
+	ptime headers_received;
+
+	// 读到第一个body字节.
+	ptime first_body_byte;
+
+	// body读取完成(eof, 读完content_length或出错).
+	ptime body_done;
+
+	///返回当前时间, 用于记录各个时间点.
+	static ptime now()
+	{
+		return boost::posix_time::microsec_clock::universal_time();
+	}
+
+	///返回两个时间点之间的间隔, 单位微秒, 任一时间点不存在时返回-1.
+	static boost::int64_t elapsed(const ptime &from, const ptime &to)
+	{
+		if (from.is_not_a_date_time() || to.is_not_a_date_time())
+			return -1;
+		return (to - from).total_microseconds();
+	}
+
+	///域名解析耗时.
+	boost::int64_t dns() const
+	{
+		return elapsed(start, resolved);
+	}
+
+	///tcp连接耗时.
+	boost::int64_t connect() const
+	{
+		return elapsed(resolved, connected);
+	}
+
+	///代理握手耗时.
+	boost::int64_t proxy() const
+	{
+		return elapsed(connected, proxy_connected);
+	}
+
+	///ssl握手耗时.
+	boost::int64_t tls() const
+	{
+		return elapsed(proxy_connected.is_not_a_date_time() ? connected : proxy_connected, tls_handshaked);
+	}
+
+	///发送请求耗时.
+	boost::int64_t send() const
+	{
+		return elapsed(request_start, request_sent);
+	}
+
+	///从请求发送完成到收到响应第一个字节的时间(time to first byte).
+	boost::int64_t ttfb() const
+	{
+		return elapsed(request_sent, status_received);
+	}
+
+	///接收http头耗时.
+	boost::int64_t headers() const
+	{
+		return elapsed(status_received, headers_received);
+	}
+
+	///body传输耗时, 从收到http头开始计算.
+	boost::int64_t transfer() const
+	{
+		return elapsed(headers_received, body_done);
+	}
+
+	///总耗时.
+	boost::int64_t total() const
+	{
+		return elapsed(start, body_done.is_not_a_date_time() ? headers_received : body_done);
+	}
+};
+
+} // namespace avhttp
+
+#endif // __HTTP_TIMING_HPP__
@@ -0,0 +1,69 @@
+//
+// content_decoder.ipp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __CONTENT_DECODER_IPP__
+#define __CONTENT_DECODER_IPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include "avhttp/content_decoder.hpp"
+#ifdef AVHTTP_ENABLE_ZLIB
+#include "avhttp/detail/zlib_decoder.hpp"
+#endif
+#ifdef AVHTTP_ENABLE_BROTLI
+#include "avhttp/detail/brotli_decoder.hpp"
+#endif
+#ifdef AVHTTP_ENABLE_ZSTD
+#include "avhttp/detail/zstd_decoder.hpp"
+#endif
+
+namespace avhttp {
+
+content_decoder* default_content_decoder_constructor(const std::string &encoding)
+{
+#ifdef AVHTTP_ENABLE_ZLIB
+	if (encoding == "gzip" || encoding == "x-gzip")
+		return new detail::zlib_decoder(detail::zlib_decoder::gzip);
+	if (encoding == "deflate")
+		return new detail::zlib_decoder(detail::zlib_decoder::deflate);
+#endif
+#ifdef AVHTTP_ENABLE_BROTLI
+	if (encoding == "br")
+		return new detail::brotli_decoder();
+#endif
+#ifdef AVHTTP_ENABLE_ZSTD
+	if (encoding == "zstd")
+		return new detail::zstd_decoder();
+#endif
+	return NULL;
+}
+
+std::string default_accept_encoding()
+{
+	std::string encodings;
+#ifdef AVHTTP_ENABLE_BROTLI
+	encodings += "br, ";
+#endif
+#ifdef AVHTTP_ENABLE_ZSTD
+	encodings += "zstd, ";
+#endif
+#ifdef AVHTTP_ENABLE_ZLIB
+	encodings += "gzip, deflate, ";
+#endif
+	if (!encodings.empty())
+		encodings.resize(encodings.size() - 2);
+	return encodings;
+}
+
+}
+
+#endif // __CONTENT_DECODER_IPP__
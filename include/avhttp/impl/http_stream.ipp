@@ -20,6 +20,13 @@
 #include "avhttp/detail/handler_type_requirements.hpp"
 #include "avhttp/detail/escape_string.hpp"
 
+#if defined(__linux__) && !defined(AVHTTP_DISABLE_SENDFILE)
+#include <sys/sendfile.h>
+#endif
+#if !defined(_WIN32)
+#include <poll.h>
+#endif
+
 namespace avhttp {
 
 http_stream::http_stream(boost::asio::io_service &io)
@@ -34,25 +41,49 @@ http_stream::http_stream(boost::asio::io_service &io)
 	, m_max_redirects(AVHTTP_MAX_REDIRECTS)
 	, m_content_length(0)
 	, m_body_size(0)
-#ifdef AVHTTP_ENABLE_ZLIB
-	, m_is_gzip(false)
-#endif
+	, m_redirect_cache(&default_redirect_cache())
+	, m_redirect_to_get(false)
+	, m_cache(NULL)
+	, m_cache_request(false)
+	, m_cache_serving(false)
+	, m_cache_offset(0)
+	, m_decoder_constructor(default_content_decoder_constructor)
+	, m_auto_accept_encoding(false)
+	, m_is_decoding(false)
+	, m_decode_buffer_size(default_decode_buffer_size)
+	, m_decode_begin(0)
+	, m_decode_end(0)
+	, m_body_written(0)
+	, m_body_pending(0)
+	, m_body_chunked(false)
+	, m_body_end(false)
+	, m_expect_continue(false)
+	, m_continue_timeout(boost::posix_time::seconds(default_continue_time_out))
+	, m_continue_timer(io)
+	, m_continue_pending(false)
+	, m_continue_waits(0)
+	, m_body_rejected(false)
+	, m_deadline_timer(io)
+	, m_phase_deadline(boost::posix_time::pos_infin)
+	, m_total_deadline(boost::posix_time::pos_infin)
+	, m_deadline_armed(false)
+	, m_timed_out(false)
 	, m_is_chunked(false)
 	, m_skip_crlf(true)
 	, m_chunked_size(0)
+	, m_wire_read_base(0)
+	, m_wire_written_base(0)
+	, m_decoded_bytes(0)
+	, m_http2(NULL)
+	, m_http2_mode(false)
+	, m_http2_retried(false)
 {
-#ifdef AVHTTP_ENABLE_ZLIB
-	memset(&m_stream, 0, sizeof(z_stream));
-#endif
 	m_proxy.type = proxy_settings::none;
 }
 
 http_stream::~http_stream()
 {
-#ifdef AVHTTP_ENABLE_ZLIB
-	if (m_stream.zalloc)
-		inflateEnd(&m_stream);
-#endif
+	reset_http2_stream();
 }
 
 void http_stream::open(const url &u)
@@ -76,7 +107,12 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 	m_protocol = u.protocol();
 	m_url = u;
 
-	LOG_DEBUG("Sync open url \'" << u.to_string() << "\'");
+	// 新的请求从原来的请求方法开始, 已知的永久重定向直接请求跳转后的地址.
+	if (m_redirects == 0)
+		m_redirect_to_get = false;
+	apply_cached_redirect();
+
+	LOG_DEBUG_CAT(log_connect, "Sync open url \'" << m_url.to_string() << "\'");
 
 	// 清空一些选项.
 	m_content_type = "";
@@ -86,7 +122,17 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 	m_content_type = "";
 	m_request.consume(m_request.size());
 	m_response.consume(m_response.size());
+	m_is_chunked = false;
 	m_skip_crlf = true;
+	m_body_rejected = false;
+
+	// 开始计时, 重定向时保留第一次打开的时间.
+	reset_timing(m_redirects != 0);
+
+	// 开始计算超时, 重定向时保留整个请求的截止时间.
+	if (m_redirects == 0)
+		start_total_deadline();
+	set_deadline(m_timeouts.connect_timeout);
 
 	// 判断获得请求的url类型.
 	if (m_protocol != "http"
@@ -95,11 +141,26 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 #endif
 		)
 	{
-		LOG_ERROR("Unsupported scheme \'" << m_protocol << "\'");
+		LOG_ERROR_CAT(log_connect, "Unsupported scheme \'" << m_protocol << "\'");
 		ec = boost::asio::error::operation_not_supported;
 		return;
 	}
 
+	// 缓存中有新鲜的响应时直接从缓存打开, 不建立连接.
+	if (open_from_cache())
+	{
+		ec = boost::system::error_code();
+		return;
+	}
+
+	// 同步打开只使用http/1.1.
+	if (m_http2_stream)
+	{
+		ec = boost::asio::error::already_open;
+		return;
+	}
+	m_http2_mode = false;
+
 	// 构造socket.
 	if (m_protocol == "http")
 	{
@@ -117,7 +178,7 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 			ssl_sock->add_verify_path(m_ca_directory, ec);
 			if (ec)
 			{
-				LOG_ERROR("Add verify path \'" << m_ca_directory <<
+				LOG_ERROR_CAT(log_tls, "Add verify path \'" << m_ca_directory <<
 					"\', error message \'" << ec.message() << "\'");
 				return;
 			}
@@ -127,7 +188,7 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 			ssl_sock->load_verify_file(m_ca_cert, ec);
 			if (ec)
 			{
-				LOG_ERROR("Load verify file \'" << m_ca_cert <<
+				LOG_ERROR_CAT(log_tls, "Load verify file \'" << m_ca_cert <<
 					"\', error message \'" << ec.message() << "\'");
 				return;
 			}
@@ -138,7 +199,7 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 				boost::asio::ssl::rfc2818_verification(m_url.host()), ec);
 			if (ec)
 			{
-				LOG_ERROR("Set verify callback \'" << m_url.host() <<
+				LOG_ERROR_CAT(log_tls, "Set verify callback \'" << m_url.host() <<
 					"\', error message \'" << ec.message() << "\'");
 				return;
 			}
@@ -162,28 +223,49 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 
 			if (ec)	// 解析域名出错, 直接返回相关错误信息.
 			{
-				LOG_ERROR("Resolve DNS error \'" << m_url.host() <<
+				LOG_ERROR_CAT(log_resolve, "Resolve DNS error \'" << m_url.host() <<
 					"\', error message \'" << ec.message() << "\'");
 				return ;
 			}
+			m_timing.resolved = http_timing::now();
 
-			// 尝试连接解析出来的服务器地址.
+			// 尝试连接解析出来的服务器地址, 只建立tcp连接, ssl握手在下面单独进行, 以便分别计时.
 			ec = boost::asio::error::host_not_found;
 			while (ec && endpoint_iterator != end)
 			{
 				m_sock.close(ec);
-				m_sock.connect(*endpoint_iterator++, ec);
+				connect_socket(m_sock.lowest_layer(), *endpoint_iterator++, ec);
 			}
 			if (ec)
 			{
-				LOG_ERROR("Connect to \'" << m_url.host() <<
+				LOG_ERROR_CAT(log_connect, "Connect to \'" << m_url.host() <<
 					"\', error message \'" << ec.message() << "\'");
 				return;
 			}
 			else
 			{
-				LOG_DEBUG("Connect to \'" << m_url.host() << "\'.");
+				LOG_DEBUG_CAT(log_connect, "Connect to \'" << m_url.host() << "\'.");
+			}
+			m_timing.connected = http_timing::now();
+#ifdef AVHTTP_ENABLE_OPENSSL
+			if (m_protocol == "https")
+			{
+				// 开始握手.
+				set_deadline(m_timeouts.handshake_timeout);
+				handshake_socket(ec);
+				if (ec)
+				{
+					LOG_ERROR_CAT(log_tls, "Handshake to \'" << m_url.host() <<
+						"\', error message \'" << ec.message() << "\'");
+					return;
+				}
+				else
+				{
+					LOG_DEBUG_CAT(log_tls, "Handshake to \'" << m_url.host() << "\'.");
+				}
+				m_timing.tls_handshaked = http_timing::now();
 			}
+#endif
 		}
 		else if (m_proxy.type == proxy_settings::socks5 ||
 			m_proxy.type == proxy_settings::socks4 ||
@@ -194,14 +276,15 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 				socks_proxy_connect(m_sock, ec);
 				if (ec)
 				{
-					LOG_ERROR("Connect to socks proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
+					LOG_ERROR_CAT(log_proxy, "Connect to socks proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
 						"\', error message \'" << ec.message() << "\'");
 					return;
 				}
 				else
 				{
-					LOG_DEBUG("Connect to socks proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
+					LOG_DEBUG_CAT(log_proxy, "Connect to socks proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
 				}
+				m_timing.proxy_connected = http_timing::now();
 			}
 #ifdef AVHTTP_ENABLE_OPENSSL
 			else if (m_protocol == "https")
@@ -209,27 +292,29 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 				socks_proxy_connect(m_nossl_socket, ec);
 				if (ec)
 				{
-					LOG_ERROR("Connect to socks proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
+					LOG_ERROR_CAT(log_proxy, "Connect to socks proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
 						"\', error message \'" << ec.message() << "\'");
 					return;
 				}
 				else
 				{
-					LOG_DEBUG("Connect to socks proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
+					LOG_DEBUG_CAT(log_proxy, "Connect to socks proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
 				}
+				m_timing.proxy_connected = http_timing::now();
 				// 开始握手.
-				ssl_socket* ssl_sock = m_sock.get<ssl_socket>();
-				ssl_sock->handshake(ec);
+				set_deadline(m_timeouts.handshake_timeout);
+				handshake_socket(ec);
 				if (ec)
 				{
-					LOG_ERROR("Handshake to \'" << m_url.host() <<
+					LOG_ERROR_CAT(log_tls, "Handshake to \'" << m_url.host() <<
 						"\', error message \'" << ec.message() << "\'");
 					return;
 				}
 				else
 				{
-					LOG_DEBUG("Handshake to \'" << m_url.host() << "\'.");
+					LOG_DEBUG_CAT(log_tls, "Handshake to \'" << m_url.host() << "\'.");
 				}
+				m_timing.tls_handshaked = http_timing::now();
 			}
 #endif
 			// 和代理服务器连接握手完成.
@@ -244,27 +329,29 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 				https_proxy_connect(m_nossl_socket, ec);
 				if (ec)
 				{
-					LOG_ERROR("Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
+					LOG_ERROR_CAT(log_proxy, "Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
 						"\', error message \'" << ec.message() << "\'");
 					return;
 				}
 				else
 				{
-					LOG_DEBUG("Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
+					LOG_DEBUG_CAT(log_proxy, "Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
 				}
+				m_timing.proxy_connected = http_timing::now();
 				// 开始握手.
-				ssl_socket *ssl_sock = m_sock.get<ssl_socket>();
-				ssl_sock->handshake(ec);
+				set_deadline(m_timeouts.handshake_timeout);
+				handshake_socket(ec);
 				if (ec)
 				{
-					LOG_ERROR("Handshake to \'" << m_url.host() <<
+					LOG_ERROR_CAT(log_tls, "Handshake to \'" << m_url.host() <<
 						"\', error message \'" << ec.message() << "\'");
 					return;
 				}
 				else
 				{
-					LOG_DEBUG("Handshake to \'" << m_url.host() << "\'.");
+					LOG_DEBUG_CAT(log_tls, "Handshake to \'" << m_url.host() << "\'.");
 				}
+				m_timing.tls_handshaked = http_timing::now();
 			}
 			else
 #endif
@@ -281,33 +368,35 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 
 				if (ec)	// 解析域名出错, 直接返回相关错误信息.
 				{
-					LOG_ERROR("Resolve DNS error \'" << m_proxy.hostname <<
+					LOG_ERROR_CAT(log_resolve, "Resolve DNS error \'" << m_proxy.hostname <<
 						"\', error message \'" << ec.message() << "\'");
 					return ;
 				}
+				m_timing.resolved = http_timing::now();
 
 				// 尝试连接解析出来的代理服务器地址.
 				ec = boost::asio::error::host_not_found;
 				while (ec && endpoint_iterator != end)
 				{
 					m_sock.close(ec);
-					m_sock.connect(*endpoint_iterator++, ec);
+					connect_socket(m_sock.lowest_layer(), *endpoint_iterator++, ec);
 				}
 				if (ec)
 				{
-					LOG_ERROR("Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
+					LOG_ERROR_CAT(log_proxy, "Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
 						"\', error message \'" << ec.message() << "\'");
 					return;
 				}
 				else
 				{
-					LOG_DEBUG("Connect to proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
+					LOG_DEBUG_CAT(log_proxy, "Connect to proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
 				}
+				m_timing.connected = http_timing::now();
 			}
 		}
 		else
 		{
-			LOG_ERROR("Unsupported proxy \'" << m_proxy.type << "\'");
+			LOG_ERROR_CAT(log_proxy, "Unsupported proxy \'" << m_proxy.type << "\'");
 			// 不支持的操作功能.
 			ec = boost::asio::error::operation_not_supported;
 			return;
@@ -317,7 +406,7 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 		m_sock.set_option(tcp::no_delay(true), ec);
 		if (ec)
 		{
-			LOG_ERROR("Set option to nodelay, error message \'" << ec.message() << "\'");
+			LOG_ERROR_CAT(log_connect, "Set option to nodelay, error message \'" << ec.message() << "\'");
 			return;
 		}
 	}
@@ -325,7 +414,7 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 	{
 		// socket已经打开.
 		ec = boost::asio::error::already_open;
-		LOG_ERROR("Open socket, error message\'" << ec.message() << "\'");
+		LOG_ERROR_CAT(log_connect, "Open socket, error message\'" << ec.message() << "\'");
 		return;
 	}
 
@@ -335,18 +424,39 @@ void http_stream::open(const url &u, boost::system::error_code &ec)
 	request(m_request_opts_priv, http_code);
 
 	// 判断是否需要跳转.
-	if (http_code == errc::moved_permanently || http_code == errc::found)
+	url new_url;
+	while (http_code == make_error_code(static_cast<errc::errc_t>(m_status_code))
+		&& prepare_redirect(new_url, ec))
 	{
-		m_sock.close(ec);
-		if (++m_redirects <= m_max_redirects)
+		// 跳转到同一服务器时, 读完跳转响应的body后在同一连接上发送新的请求.
+		if (can_redirect_in_place(new_url))
 		{
-			open(m_location, ec);
-			return;
+			drain_body(ec);
+			if (ec == errc::timed_out)
+			{
+				m_redirects = 0;
+				return;
+			}
+			if (!ec)
+			{
+				begin_redirect_in_place(new_url);
+				request(m_request_opts_priv, http_code);
+				continue;
+			}
 		}
+
+		m_sock.close(ec);
+		open(new_url, ec);
+		return;
 	}
 
 	// 清空重定向次数.
 	m_redirects = 0;
+	m_redirect_to_get = false;
+
+	// 跳转地址错误.
+	if (ec)
+		return;
 
 	// 根据http状态码来构造.
 	if (http_code)
@@ -373,7 +483,12 @@ void http_stream::async_open(const url &u, BOOST_ASIO_MOVE_ARG(Handler) handler)
 	m_protocol = u.protocol();
 	m_url = u;
 
-	LOG_DEBUG("Async open url \'" << u.to_string() << "\'");
+	// 新的请求从原来的请求方法开始, 已知的永久重定向直接请求跳转后的地址.
+	if (m_redirects == 0)
+		m_redirect_to_get = false;
+	apply_cached_redirect();
+
+	LOG_DEBUG_CAT(log_connect, "Async open url \'" << m_url.to_string() << "\'");
 
 	// 清空一些选项.
 	m_content_type = "";
@@ -383,7 +498,12 @@ void http_stream::async_open(const url &u, BOOST_ASIO_MOVE_ARG(Handler) handler)
 	m_content_type = "";
 	m_request.consume(m_request.size());
 	m_response.consume(m_response.size());
+	m_is_chunked = false;
 	m_skip_crlf = true;
+	m_body_rejected = false;
+
+	// 开始计时, 重定向时保留第一次打开的时间.
+	reset_timing(m_redirects != 0);
 
 	// 判断获得请求的url类型.
 	if (m_protocol != "http"
@@ -392,12 +512,27 @@ void http_stream::async_open(const url &u, BOOST_ASIO_MOVE_ARG(Handler) handler)
 #endif
 		)
 	{
-		LOG_ERROR("Unsupported scheme \'" << m_protocol << "\'");
+		LOG_ERROR_CAT(log_connect, "Unsupported scheme \'" << m_protocol << "\'");
 		m_io_service.post(boost::asio::detail::bind_handler(
 			handler, boost::asio::error::operation_not_supported));
 		return;
 	}
 
+	// 缓存中有新鲜的响应时直接从缓存打开, 不建立连接.
+	if (open_from_cache())
+	{
+		m_io_service.post(boost::asio::detail::bind_handler(
+			handler, boost::system::error_code()));
+		return;
+	}
+
+	// 使用http/2时请求作为连接池中共享连接上的一个流.
+	if (m_http2 && m_proxy.type == proxy_settings::none && m_http2->supports(m_url))
+	{
+		async_open_http2(detail::make_copyable_handler(handler));
+		return;
+	}
+
 	// 构造socket.
 	if (m_protocol == "http")
 	{
@@ -415,7 +550,7 @@ void http_stream::async_open(const url &u, BOOST_ASIO_MOVE_ARG(Handler) handler)
 			ssl_sock->add_verify_path(m_ca_directory, ec);
 			if (ec)
 			{
-				LOG_ERROR("Add verify path \'" << m_ca_directory <<
+				LOG_ERROR_CAT(log_tls, "Add verify path \'" << m_ca_directory <<
 					"\', error message \'" << ec.message() << "\'");
 				m_io_service.post(boost::asio::detail::bind_handler(
 					handler, ec));
@@ -427,7 +562,7 @@ void http_stream::async_open(const url &u, BOOST_ASIO_MOVE_ARG(Handler) handler)
 			ssl_sock->load_verify_file(m_ca_cert, ec);
 			if (ec)
 			{
-				LOG_ERROR("Load verify file \'" << m_ca_cert <<
+				LOG_ERROR_CAT(log_tls, "Load verify file \'" << m_ca_cert <<
 					"\', error message \'" << ec.message() << "\'");
 				m_io_service.post(boost::asio::detail::bind_handler(
 					handler, ec));
@@ -440,7 +575,7 @@ void http_stream::async_open(const url &u, BOOST_ASIO_MOVE_ARG(Handler) handler)
 				boost::asio::ssl::rfc2818_verification(m_url.host()), ec);
 			if (ec)
 			{
-				LOG_ERROR("Set verify callback \'" << m_url.host() <<
+				LOG_ERROR_CAT(log_tls, "Set verify callback \'" << m_url.host() <<
 					"\', error message \'" << ec.message() << "\'");
 				m_io_service.post(boost::asio::detail::bind_handler(
 					handler, ec));
@@ -451,13 +586,29 @@ void http_stream::async_open(const url &u, BOOST_ASIO_MOVE_ARG(Handler) handler)
 #endif
 
 	// 判断socket是否打开.
-	if (m_sock.instantiated() && m_sock.is_open())
+	if ((m_sock.instantiated() && m_sock.is_open()) || m_http2_stream)
 	{
 		ec = boost::asio::error::already_open;
-		LOG_ERROR("Open socket, error message\'" <<	ec.message() << "\'");
+		LOG_ERROR_CAT(log_connect, "Open socket, error message\'" <<	ec.message() << "\'");
 		m_io_service.post(boost::asio::detail::bind_handler(handler, ec));
 		return;
 	}
+	m_http2_mode = false;
+
+	// 开始计算超时, 重定向时保留整个请求的截止时间.
+	if (m_redirects == 0)
+		start_total_deadline();
+	m_timed_out = false;
+	set_deadline(m_timeouts.connect_timeout);
+	arm_deadline();
+
+	// 完成时取消超时定时器, 先擦除用户handler的类型, 避免boost::bind展开嵌套的bind表达式.
+	typedef detail::erased_handler HandlerWrapper;
+	HandlerWrapper h = detail::make_context_handler(
+		boost::bind(&http_stream::handle_deadline_result<HandlerWrapper>,
+			this, HandlerWrapper(handler),
+			boost::asio::placeholders::error
+		), handler);
 
 	// 异步socks代理功能处理.
 	if (m_proxy.type == proxy_settings::socks4 || m_proxy.type == proxy_settings::socks5
@@ -465,12 +616,12 @@ void http_stream::async_open(const url &u, BOOST_ASIO_MOVE_ARG(Handler) handler)
 	{
 		if (m_protocol == "http")
 		{
-			async_socks_proxy_connect(m_sock, handler);
+			async_socks_proxy_connect(m_sock, h);
 		}
 #ifdef AVHTTP_ENABLE_OPENSSL
 		else if (m_protocol == "https")
 		{
-			async_socks_proxy_connect(m_nossl_socket, handler);
+			async_socks_proxy_connect(m_nossl_socket, h);
 		}
 #endif
 		return;
@@ -484,7 +635,7 @@ void http_stream::async_open(const url &u, BOOST_ASIO_MOVE_ARG(Handler) handler)
 		if (m_protocol == "https")
 		{
 			// https代理.
-			async_https_proxy_connect(m_nossl_socket, handler);
+			async_https_proxy_connect(m_nossl_socket, h);
 			return;
 		}
 		else
@@ -506,15 +657,13 @@ void http_stream::async_open(const url &u, BOOST_ASIO_MOVE_ARG(Handler) handler)
 	tcp::resolver::query query(host, port_string.str());
 
 	// 开始异步查询HOST信息.
-	typedef boost::function<void (boost::system::error_code)> HandlerWrapper;
-	HandlerWrapper h = handler;
 	m_resolver.async_resolve(query,
-		boost::bind(&http_stream::handle_resolve<HandlerWrapper>,
+		detail::make_context_handler(boost::bind(&http_stream::handle_resolve<HandlerWrapper>,
 			this,
 			boost::asio::placeholders::error,
 			boost::asio::placeholders::iterator,
 			h
-		)
+		), h)
 	);
 }
 
@@ -533,17 +682,76 @@ std::size_t http_stream::read_some(const MutableBufferSequence &buffers)
 template <typename MutableBufferSequence>
 std::size_t http_stream::read_some(const MutableBufferSequence &buffers,
 	boost::system::error_code &ec)
+{
+	set_deadline(m_timeouts.read_timeout);
+	std::size_t bytes_transferred = 0;
+	if (m_cache_serving)
+		bytes_transferred = read_cache(buffers, ec);
+	else if (m_http2_mode)
+		bytes_transferred = read_some_http2(buffers, ec);	// 不阻塞, 没有数据时返回would_block.
+	else
+		bytes_transferred = read_some_body(buffers, ec);
+	append_cache_data(buffers, bytes_transferred);
+	record_body_read(ec, bytes_transferred);
+	return bytes_transferred;
+}
+
+template <typename MutableBufferSequence, typename Handler>
+void http_stream::async_read_some(const MutableBufferSequence &buffers, BOOST_ASIO_MOVE_ARG(Handler) handler)
+{
+	AVHTTP_READ_HANDLER_CHECK(Handler, handler) type_check;
+
+	// 从缓存读取时没有异步操作, 直接投递结果.
+	if (m_cache_serving)
+	{
+		boost::system::error_code ec;
+		std::size_t bytes_transferred = read_cache(buffers, ec);
+		record_body_read(ec, bytes_transferred);
+		m_io_service.post(boost::asio::detail::bind_handler(
+			detail::make_copyable_handler(handler), ec, bytes_transferred));
+		return;
+	}
+
+	// http/2的流先尝试直接读取已经收到的数据, 没有数据时等待.
+	if (m_http2_mode)
+	{
+		boost::system::error_code ec;
+		std::size_t bytes_transferred = read_some_http2(buffers, ec);
+		if (ec == boost::asio::error::would_block)
+		{
+			async_wait_http2(buffers, detail::make_copyable_handler(handler));
+			return;
+		}
+		append_cache_data(buffers, bytes_transferred);
+		record_body_read(ec, bytes_transferred);
+		m_io_service.post(boost::asio::detail::bind_handler(
+			detail::make_copyable_handler(handler), ec, bytes_transferred));
+		return;
+	}
+
+	// 读取的空闲超时.
+	set_deadline(m_timeouts.read_timeout);
+	arm_deadline();
+
+	// 整个读取过程中的异步操作都使用m_read_handler_memory分配内存, 稳定读取时没有堆分配.
+	typedef detail::custom_alloc_handler<typename detail::copyable_handler<Handler>::type> alloc_handler;
+	async_read_some_body(buffers,
+		detail::make_read_op_handler(this, &http_stream::handle_body_read<MutableBufferSequence, alloc_handler>,
+			buffers, detail::make_custom_alloc_handler(m_read_handler_memory,
+				detail::make_copyable_handler(handler))));
+}
+
+template <typename MutableBufferSequence>
+std::size_t http_stream::read_some_body(const MutableBufferSequence &buffers,
+	boost::system::error_code &ec)
 {
 	std::size_t bytes_transferred = 0;
 	if (m_is_chunked)	// 如果启用了分块传输模式, 则解析块大小, 并读取小于块大小的数据.
 	{
 		char crlf[2] = { '\r', '\n' };
-		// chunked_size大小为0, 读取下一个块头大小.
-		if (m_chunked_size == 0
-#ifdef AVHTTP_ENABLE_ZLIB
-			&& m_stream.avail_in == 0
-#endif
-			)
+		// chunked_size大小为0, 读取下一个块头大小, 如果需要解码, 则必须解码了所有数据才
+		// 读取下一个chunk头.
+		if (m_chunked_size == 0 && !decode_pending())
 		{
 			// 是否跳过CRLF, 除第一次读取第一段数据外, 后面的每个chunked都需要将
 			// 末尾的CRLF跳过.
@@ -606,22 +814,7 @@ std::size_t http_stream::read_some(const MutableBufferSequence &buffers,
 			m_skip_crlf = false;
 		}
 
-#ifdef AVHTTP_ENABLE_ZLIB
-		if (m_chunked_size == 0 && m_is_gzip)
-		{
-			if (m_stream.avail_in == 0)
-			{
-				if (!m_keep_alive)
-					ec = boost::asio::error::eof;
-				return 0;
-			}
-		}
-#endif
-		if (m_chunked_size != 0
-#ifdef AVHTTP_ENABLE_ZLIB
-			|| m_stream.avail_in != 0
-#endif
-			)	// 开始读取chunked中的数据, 如果是压缩, 则解压到用户接受缓冲.
+		if (m_chunked_size != 0 || decode_pending())	// 开始读取chunked中的数据, 如果需要解码, 则解码到用户接受缓冲.
 		{
 			std::size_t max_length = 0;
 			{
@@ -637,81 +830,41 @@ std::size_t http_stream::read_some(const MutableBufferSequence &buffers,
 				max_length = (std::min)(max_length, m_chunked_size);
 			}
 
-#ifdef AVHTTP_ENABLE_ZLIB
-			if (!m_is_gzip)	// 如果没有启用gzip, 则直接读取数据后返回.
-#endif
+			if (!m_is_decoding)	// 如果不需要解码, 则直接读取数据后返回.
 			{
 				bytes_transferred = read_some_impl(boost::asio::buffer(buffers, max_length), ec);
 				m_chunked_size -= bytes_transferred;
 				return bytes_transferred;
 			}
-#ifdef AVHTTP_ENABLE_ZLIB
-			else					// 否则读取数据到解压缓冲中.
-			{
-				if (m_stream.avail_in == 0)
-				{
-					std::size_t buf_size = (std::min)(m_chunked_size, std::size_t(1024));
-					bytes_transferred = read_some_impl(boost::asio::buffer(m_zlib_buffer, buf_size), ec);
-					m_chunked_size -= bytes_transferred;
-					m_zlib_buffer_size = bytes_transferred;
-					m_stream.avail_in = (uInt)m_zlib_buffer_size;
-					m_stream.next_in = (z_const Bytef *)&m_zlib_buffer[0];
-				}
-
-				bytes_transferred = 0;
-				std::size_t buffer_size = 0;
-
-				{
-					typename MutableBufferSequence::const_iterator iter = buffers.begin();
-					typename MutableBufferSequence::const_iterator end = buffers.end();
-					// 计算得到用户buffer_size总大小.
-					for (; iter != end; ++iter)
-					{
-						boost::asio::mutable_buffer buffer(*iter);
-						m_stream.next_in = (z_const Bytef *)(&m_zlib_buffer[0] + m_zlib_buffer_size - m_stream.avail_in);
-						m_stream.avail_out = boost::asio::buffer_size(buffer);
-						if (m_stream.avail_out == 0)
-						{
-							break; // 如果用户提供的缓冲大小为0, 则直接返回.
-						}
-						buffer_size += m_stream.avail_out;
-						m_stream.next_out = boost::asio::buffer_cast<Bytef*>(buffer);
-						int ret = inflate(&m_stream, Z_SYNC_FLUSH);
-						if (ret < 0)
-						{
-							ec = boost::asio::error::operation_not_supported;
-							return 0;
-						}
 
-						bytes_transferred += (boost::asio::buffer_size(buffer) - m_stream.avail_out);
-						if (bytes_transferred != boost::asio::buffer_size(buffer))
-						{
-							break;
-						}
-					}
-				}
+			// 否则读取数据到解码输入缓冲中.
+			if (!decode_pending())
+			{
+				bytes_transferred = read_some_impl(prepare_decode_buffer(m_chunked_size), ec);
+				m_chunked_size -= bytes_transferred;
+				commit_decode_buffer(bytes_transferred);
+			}
 
-				// 没有解压出数据, 说明解压缓冲太小, 继续读取数据, 以保证有数据返回.
-				if (buffer_size != 0 && bytes_transferred == 0)
-				{
-					return read_some(buffers, ec);
-				}
+			boost::system::error_code decode_ec;
+			bytes_transferred = decode_some(buffers, decode_ec);
+			if (decode_ec)
+			{
+				ec = decode_ec;
+				return 0;
+			}
 
-				return bytes_transferred;
+			// 没有解码出数据, 说明输入数据不足, 继续读取数据, 以保证有数据返回.
+			if (boost::asio::buffer_size(buffers) != 0 && bytes_transferred == 0 && !ec)
+			{
+				return read_some_body(buffers, ec);
 			}
-#endif
+
+			return bytes_transferred;
 		}
 
 		if (m_chunked_size == 0)
 		{
 			m_is_chunked_end = true;
-#ifdef AVHTTP_ENABLE_ZLIB	// 如果遇到chunk结尾, 则释放m_stream, 因为下一个chunked块需要重新初始化.
-			if (m_stream.zalloc)
-			{
-				inflateEnd(&m_stream);
-				m_stream.zalloc = NULL;
-			}
-#endif
 			if (!m_keep_alive)
 			{
 				ec = boost::asio::error::eof;
@@ -721,69 +874,43 @@ std::size_t http_stream::read_some(const MutableBufferSequence &buffers,
 		}
 	}
 
-	// 如果没有启用chunked.
-#ifdef AVHTTP_ENABLE_ZLIB
-	if (m_is_gzip && !m_is_chunked)
+	// 如果没有启用chunked, 需要解码时, 读取数据到解码输入缓冲中.
+	if (m_is_decoding)
 	{
-		if (m_stream.avail_in == 0)	// 上一块解压完成.
+		if (!decode_pending())	// 上一块解码完成.
 		{
-			if (m_keep_alive)
+			std::size_t max_size = std::size_t(-1);
+			if (m_keep_alive && m_content_length != -1)
 			{
-				if (m_content_length != -1 && m_body_size == m_content_length)
+				if (m_body_size == m_content_length)
 				{
 					return 0;
 				}
+				max_size = static_cast<std::size_t>(m_content_length - m_body_size);
 			}
 
-			bytes_transferred = read_some_impl(boost::asio::buffer(m_zlib_buffer, 1024), ec);
+			bytes_transferred = read_some_impl(prepare_decode_buffer(max_size), ec);
 			m_body_size += bytes_transferred;
-			m_zlib_buffer_size = bytes_transferred;
-			m_stream.avail_in = (uInt)m_zlib_buffer_size;
-			m_stream.next_in = (z_const Bytef *)&m_zlib_buffer[0];
+			commit_decode_buffer(bytes_transferred);
 		}
 
-		bytes_transferred = 0;
-		std::size_t buffer_size = 0;
-
+		boost::system::error_code decode_ec;
+		bytes_transferred = decode_some(buffers, decode_ec);
+		if (decode_ec)
 		{
-			typename MutableBufferSequence::const_iterator iter = buffers.begin();
-			typename MutableBufferSequence::const_iterator end = buffers.end();
-			// 计算得到用户buffer_size总大小.
-			for (; iter != end; ++iter)
-			{
-				boost::asio::mutable_buffer buffer(*iter);
-				m_stream.next_in = (z_const Bytef *)(&m_zlib_buffer[0] + m_zlib_buffer_size - m_stream.avail_in);
-				m_stream.avail_out = boost::asio::buffer_size(buffer);
-				if (m_stream.avail_out == 0)
-				{
-					break; // 如果用户提供的缓冲大小为0, 则直接返回.
-				}
-				buffer_size += m_stream.avail_out;
-				m_stream.next_out = boost::asio::buffer_cast<Bytef*>(buffer);
-				int ret = inflate(&m_stream, Z_SYNC_FLUSH);
-				if (ret < 0)
-				{
-					ec = boost::asio::error::operation_not_supported;
-					return 0;
-				}
-
-				bytes_transferred += (boost::asio::buffer_size(buffer) - m_stream.avail_out);
-				if (bytes_transferred != boost::asio::buffer_size(buffer))
-				{
-					break;
-				}
-			}
+			ec = decode_ec;
+			return 0;
 		}
 
-		// 没有解压出数据, 说明解压缓冲太小, 继续读取数据, 以保证有数据返回.
-		if (buffer_size != 0 && bytes_transferred == 0)
+		// 没有解码出数据, 说明输入数据不足, 继续读取数据, 以保证有数据返回.
+		// 读取出错(如连接关闭时的eof)则直接返回, 否则将无限递归.
+		if (boost::asio::buffer_size(buffers) != 0 && bytes_transferred == 0 && !ec)
 		{
-			return read_some(buffers, ec);
+			return read_some_body(buffers, ec);
 		}
 
 		return bytes_transferred;
 	}
-#endif
 
 	// 如果启用了keep_alive, 则计算是否读取body完成, 如果完成, 则直接返回0而不是去读取.
 	if (m_keep_alive)
@@ -803,21 +930,15 @@ std::size_t http_stream::read_some(const MutableBufferSequence &buffers,
 }
 
 template <typename MutableBufferSequence, typename Handler>
-void http_stream::async_read_some(const MutableBufferSequence &buffers, BOOST_ASIO_MOVE_ARG(Handler) handler)
+void http_stream::async_read_some_body(const MutableBufferSequence &buffers, Handler handler)
 {
-	AVHTTP_READ_HANDLER_CHECK(Handler, handler) type_check;
-
 	boost::system::error_code ec;
 
 	if (m_is_chunked)	// 如果启用了分块传输模式, 则解析块大小, 并读取小于块大小的数据.
 	{
-		// chunked_size大小为0, 读取下一个块头大小, 如果启用了gzip, 则必须解压了所有数据才
+		// chunked_size大小为0, 读取下一个块头大小, 如果需要解码, 则必须解码了所有数据才
 		// 读取下一个chunk头.
-		if (m_chunked_size == 0
-#ifdef AVHTTP_ENABLE_ZLIB
-			&& m_stream.avail_in == 0
-#endif
-			)
+		if (m_chunked_size == 0 && !decode_pending())
 		{
 			int bytes_transferred = 0;
 			int response_size = m_response.size();
@@ -826,25 +947,18 @@ void http_stream::async_read_some(const MutableBufferSequence &buffers, BOOST_AS
 			// 末尾的CRLF跳过.
 			if (!m_skip_crlf)
 			{
-				boost::shared_array<char> crlf(new char[2]);
-				memset((void*)crlf.get(), 0, 2);
+				memset(m_crlf, 0, 2);
 
 				if (response_size > 0)	// 从m_response缓冲中跳过.
 				{
 					bytes_transferred = m_response.sgetn(
-						crlf.get(), (std::min)(response_size, 2));
+						m_crlf, (std::min)(response_size, 2));
 					if (bytes_transferred == 1)
 					{
 						// 继续异步读取下一个LF字节.
-						typedef boost::function<void (boost::system::error_code, std::size_t)> HandlerWrapper;
-						HandlerWrapper h(handler);
-						m_sock.async_read_some(boost::asio::buffer(&crlf.get()[1], 1),
-							boost::bind(&http_stream::handle_skip_crlf<MutableBufferSequence, HandlerWrapper>,
-								this, buffers, h, crlf,
-								boost::asio::placeholders::error,
-								boost::asio::placeholders::bytes_transferred
-							)
-						);
+						m_sock.async_read_some(boost::asio::buffer(&m_crlf[1], 1),
+							detail::make_read_op_handler(this, &http_stream::handle_skip_crlf<MutableBufferSequence, Handler>,
+								buffers, handler));
 						return;
 					}
 					else
@@ -860,9 +974,9 @@ void http_stream::async_read_some(const MutableBufferSequence &buffers, BOOST_AS
 						// 读取到CRLF, so, 这里只能是2!!! 然后开始处理chunked size.
 						BOOST_ASSERT(bytes_transferred == 2);
 						// 不是CRLF? 不知道是啥情况, 断言调试bug.
-						BOOST_ASSERT(crlf.get()[0] == '\r' && crlf.get()[1] == '\n');
+						BOOST_ASSERT(m_crlf[0] == '\r' && m_crlf[1] == '\n');
 						// 在release下, 不确定是不是服务器的回复错误, 假设是服务器的回复错误!!!
-						if(crlf.get()[0] != '\r' || crlf.get()[1] != '\n')
+						if(m_crlf[0] != '\r' || m_crlf[1] != '\n')
 						{
 							ec = errc::invalid_chunked_encoding;
 							m_io_service.post(
@@ -874,33 +988,28 @@ void http_stream::async_read_some(const MutableBufferSequence &buffers, BOOST_AS
 				else
 				{
 					// 异步读取CRLF.
-					typedef boost::function<void (boost::system::error_code, std::size_t)> HandlerWrapper;
-					HandlerWrapper h(handler);
-					m_sock.async_read_some(boost::asio::buffer(&crlf.get()[0], 2),
-						boost::bind(&http_stream::handle_skip_crlf<MutableBufferSequence, HandlerWrapper>,
-							this, buffers, h, crlf,
-							boost::asio::placeholders::error,
-							boost::asio::placeholders::bytes_transferred
-						)
-					);
+					m_sock.async_read_some(boost::asio::buffer(m_crlf, 2),
+						detail::make_read_op_handler(this, &http_stream::handle_skip_crlf<MutableBufferSequence, Handler>,
+							buffers, handler));
 					return;
 				}
 			}
 
 			// 跳过CRLF, 开始读取chunked size.
-			typedef boost::function<void (boost::system::error_code, std::size_t)> HandlerWrapper;
-			HandlerWrapper h(handler);
 			boost::asio::async_read_until(m_sock, m_response, "\r\n",
-				boost::bind(&http_stream::handle_chunked_size<MutableBufferSequence, HandlerWrapper>,
-					this, buffers, h,
-					boost::asio::placeholders::error,
-					boost::asio::placeholders::bytes_transferred
-				)
-			);
+				detail::make_read_op_handler(this, &http_stream::handle_chunked_size<MutableBufferSequence, Handler>,
+					buffers, handler));
 			return;
 		}
 		else
 		{
+			// 需要解码时, 数据读取到解码输入缓冲中再解码.
+			if (m_is_decoding)
+			{
+				async_read_decode(buffers, handler, m_chunked_size);
+				return;
+			}
+
 			std::size_t max_length = 0;
 
 			// 这里为0是直接读取m_response中的数据, 而不再从socket读取数据, 避免
@@ -921,44 +1030,52 @@ void http_stream::async_read_some(const MutableBufferSequence &buffers, BOOST_AS
 				max_length = (std::min)(max_length, m_chunked_size);
 			}
 
-			// 读取数据到m_response, 如果有压缩, 需要在handle_async_read中解压.
+			// 读取数据到m_response, 在handle_async_read中复制到用户缓冲.
 			boost::asio::streambuf::mutable_buffers_type bufs = m_response.prepare(max_length);
-			typedef boost::function<void (boost::system::error_code, std::size_t)> HandlerWrapper;
-			HandlerWrapper h(handler);
 			m_sock.async_read_some(boost::asio::buffer(bufs),
-				boost::bind(&http_stream::handle_async_read<MutableBufferSequence, HandlerWrapper>,
-					this, buffers, h,
-					boost::asio::placeholders::error,
-					boost::asio::placeholders::bytes_transferred
-				)
-			);
+				detail::make_read_op_handler(this, &http_stream::handle_async_read<MutableBufferSequence, Handler>,
+					buffers, handler));
 			return;
 		}
 	}
 
+	// 需要解码时, 数据读取到解码输入缓冲中再解码.
+	if (m_is_decoding)
+	{
+		std::size_t max_size = std::size_t(-1);
+		if (m_keep_alive && m_content_length != -1)
+		{
+			// 在keep-alive模式下, body已经读取并解码完成, 则回调长度为0, 并保持连接.
+			if (m_body_size == m_content_length && !decode_pending())
+			{
+				m_io_service.post(
+					boost::asio::detail::bind_handler(handler, ec, 0));
+				return;
+			}
+			max_size = static_cast<std::size_t>(m_content_length - m_body_size);
+		}
+
+		async_read_decode(buffers, handler, max_size);
+		return;
+	}
+
 	if (m_response.size() > 0)
 	{
-		std::size_t bytes_transferred = read_some(buffers, ec);
+		std::size_t bytes_transferred = read_some_body(buffers, ec);
 		m_io_service.post(
 			boost::asio::detail::bind_handler(handler, ec, bytes_transferred));
 		return;
 	}
 
 	{
-#ifdef AVHTTP_ENABLE_ZLIB
-		// 如果没有启用gzip, 则判断在keep-alive模式下, 用户读取是否
-		// 完整了, 如果读取完整了, 则回调长度为0, 并保持连接.
-		if (!m_is_gzip)
-#endif // AVHTTP_ENABLE_ZLIB
+		// 判断在keep-alive模式下, 用户读取是否完整了, 如果读取完整了, 则回调长度为0, 并保持连接.
+		if (m_keep_alive)
 		{
-			if (m_keep_alive)
+			if (m_content_length != -1 && m_body_size == m_content_length)
 			{
-				if (m_content_length != -1 && m_body_size == m_content_length)
-				{
-					m_io_service.post(
-						boost::asio::detail::bind_handler(handler, ec, 0));
-					return;
-				}
+				m_io_service.post(
+					boost::asio::detail::bind_handler(handler, ec, 0));
+				return;
 			}
 		}
 
@@ -983,17 +1100,11 @@ void http_stream::async_read_some(const MutableBufferSequence &buffers, BOOST_AS
 				(boost::int64_t)max_length, m_content_length == -1 ? 1024 : m_content_length);
 		}
 
-		// 读取数据到m_response, 如果有压缩, 需要在handle_read中解压.
+		// 读取数据到m_response, 在handle_read中复制到用户缓冲.
 		boost::asio::streambuf::mutable_buffers_type bufs = m_response.prepare(max_length);
-		typedef boost::function<void (boost::system::error_code, std::size_t)> HandlerWrapper;
-		HandlerWrapper h(handler);
 		m_sock.async_read_some(boost::asio::buffer(bufs),
-			boost::bind(&http_stream::handle_read<MutableBufferSequence, HandlerWrapper>,
-				this, buffers, h,
-				boost::asio::placeholders::error,
-				boost::asio::placeholders::bytes_transferred
-			)
-		);
+			detail::make_read_op_handler(this, &http_stream::handle_read<MutableBufferSequence, Handler>,
+				buffers, handler));
 	}
 }
 
@@ -1013,6 +1124,12 @@ template <typename ConstBufferSequence>
 std::size_t http_stream::write_some(const ConstBufferSequence &buffers,
 	boost::system::error_code &ec)
 {
+	// http/2的请求body只能通过request_body设置.
+	if (m_http2_mode)
+	{
+		ec = boost::asio::error::operation_not_supported;
+		return 0;
+	}
 	std::size_t bytes_transferred = m_sock.write_some(buffers, ec);
 	if (ec == boost::asio::error::shut_down)
 		ec = boost::asio::error::eof;
@@ -1024,7 +1141,13 @@ void http_stream::async_write_some(const ConstBufferSequence &buffers, BOOST_ASI
 {
 	AVHTTP_WRITE_HANDLER_CHECK(Handler, handler) type_check;
 
-	m_sock.async_write_some(buffers, handler);
+	if (m_http2_mode)
+	{
+		m_io_service.post(boost::asio::detail::bind_handler(detail::make_copyable_handler(handler),
+			boost::asio::error::operation_not_supported, 0));
+		return;
+	}
+	m_sock.async_write_some(buffers, detail::make_copyable_handler(handler));
 }
 
 void http_stream::request(request_opts &opt)
@@ -1039,6 +1162,12 @@ void http_stream::request(request_opts &opt)
 
 void http_stream::request(request_opts &opt, boost::system::error_code &ec)
 {
+	// http/2只用于异步接口.
+	if (m_http2_mode)
+	{
+		ec = boost::asio::error::operation_not_supported;
+		return;
+	}
 	request_impl<socket_type>(m_sock, opt, ec);
 }
 
@@ -1049,21 +1178,57 @@ void http_stream::async_request(const request_opts &opt, BOOST_ASIO_MOVE_ARG(Han
 
 	boost::system::error_code ec;
 
+	// http/2时在同一连接上打开新的流.
+	if (m_http2_mode)
+	{
+		m_http2_retried = false;
+		async_request_http2(opt, detail::make_copyable_handler(handler), m_timeouts.header_timeout);
+		return;
+	}
+
+	// 服务器没有接收上一个请求的body, 连接不能再复用.
+	if (m_body_rejected)
+	{
+		m_sock.close(ec);
+		m_body_rejected = false;
+	}
+
 	// 判断socket是否打开.
 	if (!m_sock.is_open())
 	{
 		ec = boost::asio::error::network_reset;
-		LOG_ERROR("Socket is open, error message\'" << ec.message() << "\'");
+		LOG_ERROR_CAT(log_connect, "Socket is open, error message\'" << ec.message() << "\'");
 		handler(ec);
 		return;
 	}
 
+	// 开始计时.
+	mark_request_start();
+
+	// 等待http头的超时.
+	m_timed_out = false;
+	set_deadline(m_timeouts.header_timeout);
+	arm_deadline();
+
+	// 新的响应不再从缓存读取.
+	stop_cache_body();
+
 	// 保存到一个新的opts中操作.
 	request_opts opts = opt;
-	// 清空.
+	// 跳转后改用GET请求, 不再发送body.
+	if (m_redirect_to_get)
+		strip_request_body(opts);
+	// 有过期的缓存响应时发出条件请求.
+	if (m_cache_entry)
+		add_cache_validators(opts);
+	// 清空, 在复用的连接上上一个响应的状态不再有效.
 	m_request_opts.clear();
 	m_is_chunked_end = false;
+	m_is_chunked = false;
+	m_skip_crlf = true;
+	m_is_decoding = false;
 	m_keep_alive = true;
+	m_content_length = -1;
 	m_body_size = 0;
 
 	// 得到url选项.
@@ -1102,6 +1267,9 @@ void http_stream::async_request(const request_opts &opt, BOOST_ASIO_MOVE_ARG(Han
 		opts.remove(http_options::accept);	// 删除处理过的选项.
 	m_request_opts.insert(http_options::accept, accept);
 
+	// 自动添加Accept-Encoding.
+	add_accept_encoding(opts);
+
 	// 添加user_agent.
 	std::string user_agent = AVHTTP_VERSION_MIME;
 	if (opts.find(http_options::user_agent, user_agent))
@@ -1144,11 +1312,8 @@ void http_stream::async_request(const request_opts &opt, BOOST_ASIO_MOVE_ARG(Han
 		m_request_opts.insert(http_options::connection, connection);
 	}
 
-	// 是否带有body选项.
-	std::string body;
-	if (opts.find(http_options::request_body, body))
-		opts.remove(http_options::request_body);	// 删除处理过的选项.
-	m_request_opts.insert(http_options::request_body, body);
+	// 准备发送的body, 得到Content-Length或Transfer-Encoding请求头.
+	std::string body_header = setup_request_body(opts);
 
 	// 循环构造其它选项.
 	std::string other_option_string;
@@ -1165,6 +1330,7 @@ void http_stream::async_request(const request_opts &opt, BOOST_ASIO_MOVE_ARG(Han
 		other_option_string += (val->first + ": " + val->second + "\r\n");
 		m_request_opts.insert(val->first, val->second);
 	}
+	other_option_string += body_header;
 
 	// 整合各选项到Http请求字符串中.
 	std::string request_string;
@@ -1202,30 +1368,134 @@ void http_stream::async_request(const request_opts &opt, BOOST_ASIO_MOVE_ARG(Han
 		request_stream << "Connection: " << connection << "\r\n";
 	}
 	request_stream << other_option_string << "\r\n";
-	if (!body.empty())
-	{
-		request_stream << body;
-	}
 
 #if defined(DEBUG) || defined(_DEBUG)
 	{
 		int request_size = m_request.size();
 		boost::asio::streambuf::const_buffers_type::const_iterator begin(m_request.data().begin());
 		const char* ptr = boost::asio::buffer_cast<const char*>(*begin);
-		LOG_DEBUG("Request Header:\n" << std::string(ptr, request_size));
+		LOG_DEBUG_CAT(log_connect, "Request Header:\n" << std::string(ptr, request_size));
 	}
 #endif
 
-	// 异步发送请求.
-	typedef boost::function<void (boost::system::error_code)> HandlerWrapper;
-	boost::asio::async_write(m_sock, m_request, boost::asio::transfer_exactly(m_request.size()),
+	// 完成时取消超时定时器, 先擦除用户handler的类型, 避免boost::bind展开嵌套的bind表达式.
+	typedef detail::erased_handler HandlerWrapper;
+	HandlerWrapper h = detail::make_context_handler(
+		boost::bind(&http_stream::handle_deadline_result<HandlerWrapper>,
+			this, HandlerWrapper(handler),
+			boost::asio::placeholders::error
+		), handler);
+
+	// 使用100-continue时只发送请求头, body在收到100 Continue或超时后发送.
+	if (m_continue_pending)
+	{
+		boost::asio::async_write(m_sock, m_request, boost::asio::transfer_exactly(m_request.size()),
+			detail::make_context_handler(boost::bind(&http_stream::handle_request<HandlerWrapper>,
+				this, h,
+				boost::asio::placeholders::error
+			), h)
+		);
+		return;
+	}
+
+	// 异步发送请求头和body.
+	async_write_body_impl(detail::make_context_handler(
 		boost::bind(&http_stream::handle_request<HandlerWrapper>,
+			this, h,
+			boost::asio::placeholders::error
+		), h)
+	);
+}
+
+template <typename Handler>
+void http_stream::async_write_body(const body_source &body, BOOST_ASIO_MOVE_ARG(Handler) handler)
+{
+	AVHTTP_REQUEST_HANDLER_CHECK(Handler, handler) type_check;
+
+	if (m_http2_mode)
+	{
+		m_io_service.post(boost::asio::detail::bind_handler(
+			detail::make_copyable_handler(handler), boost::asio::error::operation_not_supported));
+		return;
+	}
+	begin_write_body(body, body.size() == -1);
+
+	// 发送body只受整个请求的超时限制.
+	set_deadline(boost::posix_time::pos_infin);
+	arm_deadline();
+	typedef detail::erased_handler HandlerWrapper;
+	async_write_body_impl(detail::make_context_handler(
+		boost::bind(&http_stream::handle_deadline_result<HandlerWrapper>,
 			this, HandlerWrapper(handler),
 			boost::asio::placeholders::error
-		)
+		), handler)
 	);
 }
 
+#ifdef AVHTTP_HAS_CO_AWAIT
+
+template <typename CompletionToken>
+	requires detail::completion_token<CompletionToken, void (boost::system::error_code)>
+BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code))
+http_stream::async_open(const url &u, CompletionToken &&token)
+{
+	return boost::asio::async_initiate<CompletionToken, void (boost::system::error_code)>(
+		[this](auto handler, const url &u)
+		{
+			async_open(u, detail::make_shared_handler(std::move(handler)));
+		}, token, u);
+}
+
+template <typename MutableBufferSequence, typename CompletionToken>
+	requires detail::completion_token<CompletionToken, void (boost::system::error_code, std::size_t)>
+BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code, std::size_t))
+http_stream::async_read_some(const MutableBufferSequence &buffers, CompletionToken &&token)
+{
+	return boost::asio::async_initiate<CompletionToken, void (boost::system::error_code, std::size_t)>(
+		[this](auto handler, const MutableBufferSequence &buffers)
+		{
+			async_read_some(buffers, detail::make_shared_handler(std::move(handler)));
+		}, token, buffers);
+}
+
+template <typename ConstBufferSequence, typename CompletionToken>
+	requires detail::completion_token<CompletionToken, void (boost::system::error_code, std::size_t)>
+BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code, std::size_t))
+http_stream::async_write_some(const ConstBufferSequence &buffers, CompletionToken &&token)
+{
+	return boost::asio::async_initiate<CompletionToken, void (boost::system::error_code, std::size_t)>(
+		[this](auto handler, const ConstBufferSequence &buffers)
+		{
+			async_write_some(buffers, detail::make_shared_handler(std::move(handler)));
+		}, token, buffers);
+}
+
+template <typename CompletionToken>
+	requires detail::completion_token<CompletionToken, void (boost::system::error_code)>
+BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code))
+http_stream::async_request(const request_opts &opt, CompletionToken &&token)
+{
+	return boost::asio::async_initiate<CompletionToken, void (boost::system::error_code)>(
+		[this](auto handler, const request_opts &opt)
+		{
+			async_request(opt, detail::make_shared_handler(std::move(handler)));
+		}, token, opt);
+}
+
+template <typename CompletionToken>
+	requires detail::completion_token<CompletionToken, void (boost::system::error_code)>
+BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code))
+http_stream::async_write_body(const body_source &body, CompletionToken &&token)
+{
+	return boost::asio::async_initiate<CompletionToken, void (boost::system::error_code)>(
+		[this](auto handler, const body_source &body)
+		{
+			async_write_body(body, detail::make_shared_handler(std::move(handler)));
+		}, token, body);
+}
+
+#endif // AVHTTP_HAS_CO_AWAIT
+
 void http_stream::clear()
 {
 	m_request.consume(m_request.size());
@@ -1250,6 +1520,11 @@ void http_stream::close(boost::system::error_code &ec)
 	{
 		// 关闭socket.
 		m_sock.close(ec);
+		reset_http2_stream();
+		m_http2_mode = false;
+		boost::system::error_code ignore_ec;
+		m_continue_timer.cancel(ignore_ec);
+		cancel_deadline();
 
 		// 清空内部的各种缓冲信息.
 		m_request.consume(m_request.size());
@@ -1257,12 +1532,14 @@ void http_stream::close(boost::system::error_code &ec)
 		m_content_type.clear();
 		m_location.clear();
 		m_protocol.clear();
+		reset_cache_state();
 	}
 }
 
 bool http_stream::is_open() const
 {
-	return m_sock.is_open();
+	// 从缓存打开时没有连接, http/2时只有共享连接上的一个流.
+	return m_sock.is_open() || m_cache_serving || m_http2_stream;
 }
 
 boost::asio::io_service& http_stream::get_io_service()
@@ -1275,121 +1552,1816 @@ void http_stream::max_redirects(int n)
 	m_max_redirects = n;
 }
 
-void http_stream::proxy(const proxy_settings &s)
+void http_stream::permanent_redirect_cache(redirect_cache *cache)
+{
+	m_redirect_cache = cache;
+}
+
+void http_stream::cache(response_cache *cache)
+{
+	m_cache = cache;
+	reset_cache_state();
+}
+
+bool http_stream::from_cache() const
+{
+	return m_cache_serving;
+}
+
+void http_stream::http2(http2_pool *pool)
+{
+	m_http2 = pool;
+}
+
+bool http_stream::is_http2() const
+{
+	return m_http2_mode;
+}
+
+void http_stream::content_decoder_constructor(content_decoder_constructor_type constructor)
+{
+	m_decoder_constructor = constructor;
+	m_decoder.reset();
+	m_decoder_encoding = "";
+}
+
+void http_stream::auto_accept_encoding(bool enable)
+{
+	m_auto_accept_encoding = enable;
+}
+
+void http_stream::decode_buffer_size(std::size_t size)
+{
+	m_decode_buffer_size = (std::max)(size, std::size_t(1024));
+}
+
+void http_stream::request_body(const body_source &body)
+{
+	m_body = body;
+}
+
+void http_stream::expect_continue(bool enable, const boost::posix_time::time_duration &timeout)
+{
+	m_expect_continue = enable;
+	m_continue_timeout = timeout;
+}
+
+void http_stream::timeouts(const timeout_settings &s)
+{
+	m_timeouts = s;
+}
+
+const timeout_settings& http_stream::timeouts() const
+{
+	return m_timeouts;
+}
+
+void http_stream::write_body(const body_source &body)
+{
+	boost::system::error_code ec;
+	write_body(body, ec);
+	if (ec)
+	{
+		boost::throw_exception(boost::system::system_error(ec));
+	}
+}
+
+void http_stream::write_body(const body_source &body, boost::system::error_code &ec)
+{
+	if (m_http2_mode)
+	{
+		ec = boost::asio::error::operation_not_supported;
+		return;
+	}
+	begin_write_body(body, body.size() == -1);
+	write_body_impl(ec);
+}
+
+void http_stream::proxy(const proxy_settings &s)
 {
 	m_proxy = s;
 }
 
-void http_stream::request_options(const request_opts &options)
-{
-	m_request_opts_priv = options;
-}
+void http_stream::request_options(const request_opts &options)
+{
+	m_request_opts_priv = options;
+}
+
+request_opts http_stream::request_options(void) const
+{
+	if (m_request_opts.size() == 0)
+		return m_request_opts_priv;
+	return m_request_opts;
+}
+
+response_opts http_stream::response_options(void) const
+{
+	return m_response_opts;
+}
+
+const std::string& http_stream::location() const
+{
+	return m_location;
+}
+
+const std::string http_stream::final_url() const
+{
+	return m_url.to_string();
+}
+
+const std::string http_stream::entry_url() const
+{
+	return m_entry_url.to_string();
+}
+
+boost::int64_t http_stream::content_length()
+{
+	return m_content_length;
+}
+
+void http_stream::check_certificate(bool is_check)
+{
+#ifdef AVHTTP_ENABLE_OPENSSL
+	m_check_certificate = is_check;
+#endif
+}
+
+void http_stream::add_verify_path(const std::string &path)
+{
+	m_ca_directory = path;
+	return;
+}
+
+void http_stream::load_verify_file(const std::string &filename)
+{
+	m_ca_cert = filename;
+	return;
+}
+
+
+const http_timing& http_stream::timing() const
+{
+	return m_timing;
+}
+
+boost::uint64_t http_stream::wire_bytes_read() const
+{
+	return m_sock.bytes_read() - m_wire_read_base;
+}
+
+boost::uint64_t http_stream::wire_bytes_written() const
+{
+	return m_sock.bytes_written() - m_wire_written_base;
+}
+
+boost::int64_t http_stream::decoded_bytes() const
+{
+	return m_decoded_bytes;
+}
+
+// 以下为内部相关实现, 非接口.
+
+template <typename MutableBufferSequence>
+std::size_t http_stream::read_some_impl(const MutableBufferSequence &buffers,
+	boost::system::error_code &ec)
+{
+	// 如果还有数据在m_response中, 先读取m_response中的数据.
+	if (m_response.size() > 0)
+	{
+		std::size_t bytes_transferred = 0;
+		typename MutableBufferSequence::const_iterator iter = buffers.begin();
+		typename MutableBufferSequence::const_iterator end = buffers.end();
+		for (; iter != end && m_response.size() > 0; ++iter)
+		{
+			boost::asio::mutable_buffer buffer(*iter);
+			std::size_t length = boost::asio::buffer_size(buffer);
+			if (length > 0)
+			{
+				bytes_transferred += m_response.sgetn(
+					boost::asio::buffer_cast<char*>(buffer), length);
+			}
+		}
+		ec = boost::system::error_code();
+		return bytes_transferred;
+	}
+
+	// 再从socket中读取数据.
+	std::size_t bytes_transferred = 0;
+	boost::posix_time::ptime deadline = current_deadline();
+	if (deadline.is_pos_infinity())
+	{
+		bytes_transferred = m_sock.read_some(buffers, ec);
+	}
+	else
+	{
+		// 以非阻塞方式读取, 没有数据时等待socket可读直到超时.
+		tcp::socket::lowest_layer_type &sock = m_sock.lowest_layer();
+		sock.non_blocking(true, ec);
+		while (!ec)
+		{
+			bytes_transferred = m_sock.read_some(buffers, ec);
+			if (ec != boost::asio::error::would_block && ec != boost::asio::error::try_again)
+				break;
+			wait_socket(sock.native_handle(), true, deadline, ec);
+		}
+		boost::system::error_code ignore_ec;
+		sock.non_blocking(false, ignore_ec);
+		if (ec == errc::timed_out)
+			abort_connection();
+	}
+	if (ec == boost::asio::error::shut_down)
+		ec = boost::asio::error::eof;
+	return bytes_transferred;
+}
+
+template <typename MutableBufferSequence>
+std::size_t http_stream::decode_some(const MutableBufferSequence &buffers,
+	boost::system::error_code &ec)
+{
+	std::size_t bytes_transferred = 0;
+	typename MutableBufferSequence::const_iterator iter = buffers.begin();
+	typename MutableBufferSequence::const_iterator end = buffers.end();
+	for (; iter != end && decode_pending(); ++iter)
+	{
+		boost::asio::mutable_buffer buffer(*iter);
+		std::size_t length = boost::asio::buffer_size(buffer);
+		if (length == 0)
+			continue;
+
+		const char *in = &m_decode_buffer[m_decode_begin];
+		std::size_t in_size = m_decode_end - m_decode_begin;
+		std::size_t n = m_decoder->decode(in, in_size,
+			boost::asio::buffer_cast<char*>(buffer), length, ec);
+		m_decode_begin = m_decode_end - in_size;
+		bytes_transferred += n;
+
+		// 出错, 或者没有填满这个缓冲(输入已经全部消耗).
+		if (ec || n != length)
+			break;
+	}
+
+	return bytes_transferred;
+}
+
+template <typename MutableBufferSequence, typename Handler>
+void http_stream::async_read_decode(const MutableBufferSequence &buffers,
+	Handler handler, std::size_t max_size)
+{
+	// 还有未解码的数据, 直接解码, 不能再等待socket上的数据, 因为数据可能已经全部读取完成.
+	if (decode_pending())
+	{
+		m_io_service.post(boost::asio::detail::bind_handler(
+			detail::make_read_op_handler(this, &http_stream::handle_decode<MutableBufferSequence, Handler>,
+				buffers, handler), boost::system::error_code(), 0));
+		return;
+	}
+
+	// 读取http头时已经读取到m_response中的数据, 先复制到解码输入缓冲中.
+	if (m_response.size() > 0)
+	{
+		boost::system::error_code ec;
+		std::size_t bytes_transferred = read_some_impl(prepare_decode_buffer(max_size), ec);
+		m_io_service.post(boost::asio::detail::bind_handler(
+			detail::make_read_op_handler(this, &http_stream::handle_decode<MutableBufferSequence, Handler>,
+				buffers, handler), ec, bytes_transferred));
+		return;
+	}
+
+	// 从socket直接读取到解码输入缓冲中.
+	m_sock.async_read_some(prepare_decode_buffer(max_size),
+		detail::make_read_op_handler(this, &http_stream::handle_decode<MutableBufferSequence, Handler>,
+			buffers, handler));
+}
+
+void http_stream::setup_content_decoder(boost::system::error_code &ec)
+{
+	m_is_decoding = false;
+	m_decode_begin = m_decode_end = 0;
+
+	std::string value = m_response_opts.find(http_options::content_encoding);
+	if (value.empty() || !m_decoder_constructor)
+		return;
+
+	// 多重编码按使用的顺序列出, 如"gzip, br", 去掉identity后规范为逗号分隔的小写名称.
+	std::vector<std::string> encodings;
+	boost::split(encodings, value, boost::is_any_of(","));
+	std::string encoding;
+	for (std::vector<std::string>::iterator i = encodings.begin(); i != encodings.end();)
+	{
+		*i = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(*i));
+		if (i->empty() || *i == "identity")
+		{
+			i = encodings.erase(i);
+			continue;
+		}
+		encoding += (encoding.empty() ? "" : ",") + *i;
+		++i;
+	}
+	if (encoding.empty())
+		return;
+
+	// 编码相同时复用解码器, 长连接上的多个响应不需要重新创建.
+	if (!m_decoder || m_decoder_encoding != encoding)
+	{
+		// 最后使用的编码最先解码, 每一层的输出作为下一层的输入.
+		m_decoder.reset();
+		m_decoder_encoding = "";
+		content_decoder *decoder = NULL;
+		for (std::vector<std::string>::iterator i = encodings.begin(); i != encodings.end(); ++i)
+		{
+			content_decoder *layer = m_decoder_constructor(*i);
+			if (!layer)
+			{
+				delete decoder;
+				LOG_WARNING_CAT(log_parse, "Unsupported content encoding \'" << *i << "\', read raw data");
+				return;
+			}
+			decoder = decoder ? new detail::chained_decoder(layer, decoder) : layer;
+		}
+		m_decoder.reset(decoder);
+		m_decoder_encoding = encoding;
+	}
+
+	m_decoder->reset(ec);
+	if (ec)
+	{
+		LOG_ERROR_CAT(log_parse, "Init content decoder \'" << encoding
+			<< "\' error, error message: \'" << ec.message() << "\'");
+		return;
+	}
+
+	m_is_decoding = true;
+}
+
+void http_stream::add_accept_encoding(request_opts &opts) const
+{
+	if (!m_auto_accept_encoding || m_decoder_constructor != default_content_decoder_constructor)
+		return;
+	std::string accept_encoding;
+	if (opts.find(http_options::accept_encoding, accept_encoding))
+		return;
+	accept_encoding = default_accept_encoding();
+	if (!accept_encoding.empty())
+		opts.insert(http_options::accept_encoding, accept_encoding);
+}
+
+bool http_stream::decode_pending() const
+{
+	return m_decode_begin != m_decode_end || (m_is_decoding && m_decoder && m_decoder->output_pending());
+}
+
+boost::asio::mutable_buffers_1 http_stream::prepare_decode_buffer(std::size_t max_size)
+{
+	if (m_decode_buffer.size() < m_decode_buffer_size)
+		m_decode_buffer.resize(m_decode_buffer_size);
+
+	// 将未解码的数据移动到缓冲头部.
+	if (m_decode_begin != 0)
+	{
+		std::size_t pending = m_decode_end - m_decode_begin;
+		if (pending != 0)
+			std::memmove(&m_decode_buffer[0], &m_decode_buffer[m_decode_begin], pending);
+		m_decode_begin = 0;
+		m_decode_end = pending;
+	}
+
+	std::size_t size = (std::min)(m_decode_buffer.size() - m_decode_end, max_size);
+	return boost::asio::buffer(&m_decode_buffer[m_decode_end], size);
+}
+
+void http_stream::commit_decode_buffer(std::size_t bytes_transferred)
+{
+	m_decode_end += bytes_transferred;
+	AVHTTP_METRIC_ADD(metric_gzip_input_bytes, bytes_transferred);
+}
+
+template <typename Handler>
+void http_stream::async_write_body_impl(Handler handler)
+{
+	boost::system::error_code ec;
+
+	// 先发送请求头, 然后等待socket可写时使用sendfile发送文件数据.
+	if (use_sendfile())
+	{
+		if (m_request.size() != 0)
+		{
+			boost::asio::async_write(m_sock, boost::asio::buffer(m_request.data()),
+				detail::make_context_handler(boost::bind(&http_stream::handle_write_body<Handler>,
+					this, handler,
+					boost::asio::placeholders::error
+				), handler)
+			);
+			return;
+		}
+
+		m_sock.get<nossl_socket>()->async_write_some(boost::asio::null_buffers(),
+			detail::make_context_handler(boost::bind(&http_stream::handle_sendfile<Handler>,
+				this, handler,
+				boost::asio::placeholders::error
+			), handler)
+		);
+		return;
+	}
+
+	prepare_body_buffers(ec);
+	if (ec)
+	{
+		LOG_ERROR_CAT(log_connect, "Read request body, error message: \'" << ec.message() <<"\'");
+		m_io_service.post(boost::asio::detail::bind_handler(handler, ec));
+		return;
+	}
+
+	// 请求头和body聚集写入.
+	boost::asio::async_write(m_sock, m_body_buffers,
+		detail::make_context_handler(boost::bind(&http_stream::handle_write_body<Handler>,
+			this, handler,
+			boost::asio::placeholders::error
+		), handler)
+	);
+}
+
+std::string http_stream::setup_request_body(request_opts &opts)
+{
+	// http_options::request_body中的数据交换到body_source中, 不发生复制.
+	body_source body = m_redirect_to_get ? body_source() : m_body;
+	request_opts::option_item_list &list = opts.option_all();
+	for (request_opts::option_item_list::iterator i = list.begin(); i != list.end(); i++)
+	{
+		if (i->first == http_options::request_body)
+		{
+			if (!i->second.empty())
+				body = body_source::from_string(i->second);
+			list.erase(i);
+			break;
+		}
+	}
+
+	// 用户指定了Content-Length或Transfer-Encoding时, 按用户指定的方式发送.
+	std::string header;
+	std::string value;
+	bool chunked = false;
+	if (opts.find(http_options::transfer_encoding, value))
+	{
+		chunked = boost::algorithm::icontains(value, "chunked");
+	}
+	else if (!body.empty() && !opts.find(http_options::content_length, value))
+	{
+		chunked = (body.size() == -1);
+		if (chunked)
+		{
+			m_request_opts.insert(http_options::transfer_encoding, "chunked");
+			header = http_options::transfer_encoding + ": chunked\r\n";
+		}
+		else
+		{
+			value = boost::str(boost::format("%d") % body.size());
+			m_request_opts.insert(http_options::content_length, value);
+			header = http_options::content_length + ": " + value + "\r\n";
+		}
+	}
+
+	// 有body时使用100-continue, 先等待服务器确认.
+	m_continue_pending = false;
+	if (!body.empty() && body.size() != 0)
+	{
+		if (opts.find(http_options::expect, value))
+		{
+			m_continue_pending = boost::algorithm::iequals(value, "100-continue");
+		}
+		else if (m_expect_continue)
+		{
+			m_continue_pending = true;
+			m_request_opts.insert(http_options::expect, "100-continue");
+			header += http_options::expect + ": 100-continue\r\n";
+		}
+	}
+
+	begin_write_body(body, chunked);
+	return header;
+}
+
+bool http_stream::wait_continue(boost::system::error_code &ec)
+{
+	ec = boost::system::error_code();
+	tcp::socket::lowest_layer_type &sock = m_sock.lowest_layer();
+	boost::posix_time::ptime deadline =
+		boost::asio::deadline_timer::traits_type::now() + m_continue_timeout;
+
+	while (wait_socket(sock.native_handle(), true, deadline, ec))
+	{
+		// socket可读不一定有响应数据(如ssl连接上的会话票据), 以非阻塞方式读取到m_response中,
+		// 没有读到数据时继续等待.
+		sock.non_blocking(true, ec);
+		if (ec)
+			return false;
+		std::size_t bytes_transferred = m_sock.read_some(m_response.prepare(1024), ec);
+		boost::system::error_code ignore_ec;
+		sock.non_blocking(false, ignore_ec);
+		m_response.commit(bytes_transferred);
+		if (bytes_transferred != 0)
+		{
+			ec = boost::system::error_code();
+			return true;
+		}
+		if (ec != boost::asio::error::would_block && ec != boost::asio::error::try_again)
+			return false;
+		ec = boost::system::error_code();
+	}
+
+	// 超时.
+	if (ec == errc::timed_out)
+		ec = boost::system::error_code();
+	return false;
+}
+
+void http_stream::start_total_deadline()
+{
+	m_total_deadline = boost::asio::deadline_timer::traits_type::now() + m_timeouts.total_timeout;
+}
+
+void http_stream::set_deadline(const boost::posix_time::time_duration &timeout)
+{
+	m_phase_deadline = boost::asio::deadline_timer::traits_type::now() + timeout;
+}
+
+boost::posix_time::ptime http_stream::current_deadline() const
+{
+	return (std::min)(m_phase_deadline, m_total_deadline);
+}
+
+void http_stream::arm_deadline()
+{
+	boost::posix_time::ptime deadline = current_deadline();
+	if (deadline.is_pos_infinity())
+		return;
+
+	// 定时器已经在等待同一个截止时间.
+	if (m_deadline_armed && m_deadline_timer.expires_at() == deadline)
+		return;
+
+	m_deadline_armed = true;
+	boost::system::error_code ignore_ec;
+	m_deadline_timer.expires_at(deadline, ignore_ec);
+	m_deadline_timer.async_wait(boost::bind(&http_stream::handle_deadline,
+		this, boost::asio::placeholders::error));
+}
+
+void http_stream::cancel_deadline()
+{
+	m_phase_deadline = boost::posix_time::pos_infin;
+	if (m_deadline_armed)
+	{
+		m_deadline_armed = false;
+		boost::system::error_code ignore_ec;
+		m_deadline_timer.cancel(ignore_ec);
+	}
+}
+
+void http_stream::handle_deadline(http_stream *self, const boost::system::error_code &err)
+{
+	// 定时器被取消或者重新设置.
+	if (err == boost::asio::error::operation_aborted)
+		return;
+
+	// 操作已经完成, 或者定时器已经重新设置为更晚的时间.
+	if (!self->m_deadline_armed ||
+		self->m_deadline_timer.expires_at() > boost::asio::deadline_timer::traits_type::now())
+		return;
+
+	LOG_WARNING_CAT(log_connect, "Operation timed out, url \'" << self->m_url.to_string() << "\'");
+
+	// 关闭连接, 被取消的操作在完成时以errc::timed_out通知用户.
+	self->m_deadline_armed = false;
+	self->m_timed_out = true;
+	self->abort_connection();
+}
+
+void http_stream::abort_connection()
+{
+	boost::system::error_code ignore_ec;
+	m_resolver.cancel();
+	m_continue_timer.cancel(ignore_ec);
+	m_sock.close(ignore_ec);
+	m_nossl_socket.close(ignore_ec);
+
+	// 取消http/2的流, 正在等待的操作以operation_aborted完成.
+	if (m_http2_stream)
+		m_http2_stream->reset();
+}
+
+boost::system::error_code http_stream::deadline_error(const boost::system::error_code &ec) const
+{
+	if (ec && m_timed_out)
+		return errc::timed_out;
+	return ec;
+}
+
+bool http_stream::wait_socket(tcp::socket::native_handle_type fd, bool read,
+	const boost::posix_time::ptime &deadline, boost::system::error_code &ec)
+{
+	ec = boost::system::error_code();
+	for (;;)
+	{
+		// 计算剩余的时间, -1表示不限制.
+		int timeout = -1;
+		if (!deadline.is_pos_infinity())
+		{
+			boost::posix_time::time_duration remain =
+				deadline - boost::asio::deadline_timer::traits_type::now();
+			timeout = remain.is_negative() ? 0 : static_cast<int>(remain.total_milliseconds());
+		}
+#if defined(_WIN32)
+		// windows在连接失败时通过exceptfds通知.
+		fd_set fds;
+		fd_set except_fds;
+		FD_ZERO(&fds);
+		FD_ZERO(&except_fds);
+		FD_SET(fd, &fds);
+		FD_SET(fd, &except_fds);
+		timeval tv = { timeout / 1000, (timeout % 1000) * 1000 };
+		int ret = ::select(0, read ? &fds : NULL, read ? NULL : &fds,
+			&except_fds, timeout < 0 ? NULL : &tv);
+		if (ret < 0)
+		{
+			ec = boost::system::error_code(::WSAGetLastError(), boost::system::system_category());
+			return false;
+		}
+#else
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = read ? POLLIN : POLLOUT;
+		pfd.revents = 0;
+		int ret = ::poll(&pfd, 1, timeout);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			ec = boost::system::error_code(errno, boost::system::system_category());
+			return false;
+		}
+#endif
+		if (ret > 0)
+			return true;
+		ec = errc::timed_out;
+		return false;
+	}
+}
+
+void http_stream::connect_socket(tcp::socket::lowest_layer_type &sock,
+	const tcp::endpoint &endpoint, boost::system::error_code &ec)
+{
+	boost::posix_time::ptime deadline = current_deadline();
+	if (deadline.is_pos_infinity())
+	{
+		sock.connect(endpoint, ec);
+		return;
+	}
+
+	if (deadline <= boost::asio::deadline_timer::traits_type::now())
+	{
+		ec = errc::timed_out;
+		return;
+	}
+
+	// 以非阻塞方式连接, 等待socket可写直到超时.
+	ec = boost::system::error_code();
+	if (!sock.is_open())
+		sock.open(endpoint.protocol(), ec);
+	if (!ec)
+		sock.non_blocking(true, ec);
+	if (ec)
+		return;
+	// asio的同步connect忽略非阻塞模式, 这里直接调用connect.
+	if (::connect(sock.native_handle(), endpoint.data(), static_cast<int>(endpoint.size())) != 0)
+	{
+#if defined(_WIN32)
+		ec = boost::system::error_code(::WSAGetLastError(), boost::asio::error::get_system_category());
+#else
+		ec = boost::system::error_code(errno, boost::asio::error::get_system_category());
+#endif
+	}
+	if (ec == boost::asio::error::in_progress || ec == boost::asio::error::would_block)
+	{
+		if (wait_socket(sock.native_handle(), false, deadline, ec))
+		{
+			// 取得连接的结果.
+			int connect_error = 0;
+#if defined(_WIN32)
+			int len = sizeof(connect_error);
+#else
+			socklen_t len = sizeof(connect_error);
+#endif
+			if (::getsockopt(sock.native_handle(), SOL_SOCKET, SO_ERROR,
+				reinterpret_cast<char*>(&connect_error), &len) != 0)
+				ec = boost::asio::error::fault;
+			else
+				ec = boost::system::error_code(connect_error, boost::asio::error::get_system_category());
+		}
+	}
+	boost::system::error_code ignore_ec;
+	sock.non_blocking(false, ignore_ec);
+	if (ec == errc::timed_out)
+		sock.close(ignore_ec);
+}
+
+#ifdef AVHTTP_ENABLE_OPENSSL
+void http_stream::handshake_socket(boost::system::error_code &ec)
+{
+	ssl_socket *ssl_sock = m_sock.get<ssl_socket>();
+	boost::posix_time::ptime deadline = current_deadline();
+	if (deadline.is_pos_infinity())
+	{
+		ssl_sock->handshake(ec);
+		return;
+	}
+
+	// 以非阻塞方式握手, 需要等待服务器的数据时等待socket可读直到超时.
+	tcp::socket::lowest_layer_type &sock = m_sock.lowest_layer();
+	sock.non_blocking(true, ec);
+	while (!ec)
+	{
+		ssl_sock->handshake(ec);
+		if (ec != boost::asio::error::would_block && ec != boost::asio::error::try_again)
+			break;
+		wait_socket(sock.native_handle(), true, deadline, ec);
+	}
+	boost::system::error_code ignore_ec;
+	sock.non_blocking(false, ignore_ec);
+	if (ec == errc::timed_out)
+		abort_connection();
+}
+#endif
+
+void http_stream::apply_cached_redirect()
+{
+	if (!m_redirect_cache)
+		return;
+
+	// 只有GET和HEAD请求使用缓存的永久重定向.
+	std::string method = "GET";
+	if (!m_redirect_to_get)
+		m_request_opts_priv.find(http_options::request_method, method);
+	if (!boost::algorithm::iequals(method, "GET") && !boost::algorithm::iequals(method, "HEAD"))
+		return;
+
+	// 沿着缓存的跳转链查找, 最多跳转m_max_redirects次, 避免循环跳转.
+	std::string location = m_url.to_string();
+	std::string target;
+	for (std::size_t i = 0; i < m_max_redirects && m_redirect_cache->find(location, target); i++)
+		location = target;
+	if (location == m_url.to_string())
+		return;
+
+	boost::system::error_code ec;
+	url new_url = url::from_string(location, ec);
+	if (ec)
+		return;
+
+	LOG_DEBUG_CAT(log_connect, "Cached permanent redirect \'" << m_url.to_string()
+		<< "\' to \'" << location << "\'");
+	m_protocol = new_url.protocol();
+	m_url = new_url;
+}
+
+bool http_stream::prepare_redirect(url &new_url, boost::system::error_code &ec)
+{
+	if (m_status_code != errc::moved_permanently &&
+		m_status_code != errc::found &&
+		m_status_code != errc::see_other &&
+		m_status_code != errc::temporary_redirect &&
+		m_status_code != errc::permanent_redirect)
+		return false;
+
+	if (m_location.empty() || ++m_redirects > m_max_redirects)
+		return false;
+
+	// 307和308跳转需要重新发送原来的body, 生成器的数据只能发送一次.
+	std::string method = m_request_opts.find(http_options::request_method);
+	bool keep_method = (m_status_code == errc::temporary_redirect ||
+		m_status_code == errc::permanent_redirect);
+	if (keep_method && !m_redirect_to_get && m_body.type() == body_source::generator_body)
+	{
+		LOG_WARNING_CAT(log_connect, "Request body can't be sent again, redirect "
+			<< m_status_code << " not followed");
+		return false;
+	}
+
+	// location可以是相对地址, 相对于当前的url.
+	std::string location = m_location;
+	if (location.find("://") == std::string::npos)
+	{
+		std::string prefix = m_url.to_string(
+			url::protocol_component | url::host_component | url::port_component);
+		std::string path = m_url.to_string(url::path_component);
+		if (path.empty())
+			path = "/";
+		if (location.compare(0, 2, "//") == 0)
+			location = m_url.protocol() + ":" + location;
+		else if (location[0] == '/')
+			location = prefix + location;
+		else if (location[0] == '?')
+			location = prefix + path + location;
+		else
+			location = prefix + path.substr(0, path.rfind('/') + 1) + location;
+	}
+	new_url = url::from_string(location, ec);
+	if (ec)
+	{
+		// 向用户报告跳转地址错误.
+		ec = errc::invalid_redirect;
+		LOG_ERROR_CAT(log_parse, "Location url invalid, error message: \'" << ec.message() << "\'");
+		return false;
+	}
+
+	// 303跳转, 以及POST请求的301和302跳转, 改用GET请求.
+	if ((m_status_code == errc::see_other && !boost::algorithm::iequals(method, "HEAD")) ||
+		(!keep_method && boost::algorithm::iequals(method, "POST")))
+		m_redirect_to_get = true;
+
+	// 记录GET和HEAD请求的永久重定向, 以后直接请求跳转后的地址.
+	if (m_redirect_cache &&
+		(m_status_code == errc::moved_permanently || m_status_code == errc::permanent_redirect) &&
+		(boost::algorithm::iequals(method, "GET") || boost::algorithm::iequals(method, "HEAD")))
+		m_redirect_cache->insert(m_url.to_string(), new_url.to_string());
+
+	AVHTTP_METRIC_ADD(metric_redirects, 1);
+	LOG_DEBUG_CAT(log_connect, "Redirect " << m_status_code << " to \'" << new_url.to_string() << "\'");
+	return true;
+}
+
+bool http_stream::can_redirect_in_place(const url &new_url) const
+{
+	// 连接将被关闭, 或者服务器没有接收body, 连接不能再复用.
+	if (!m_keep_alive || m_body_rejected || !m_sock.is_open())
+		return false;
+
+	// 只在同一服务器上复用连接.
+	if (new_url.protocol() != m_url.protocol() ||
+		!boost::algorithm::iequals(new_url.host(), m_url.host()) ||
+		new_url.port() != m_url.port())
+		return false;
+
+	// body以连接关闭结束, 或者body太长时重新连接.
+	if (boost::algorithm::iequals(m_request_opts.find(http_options::request_method), "HEAD"))
+		return true;
+	if (m_is_chunked)
+		return true;
+	return m_content_length != -1 && m_content_length <= AVHTTP_REDIRECT_DRAIN_LIMIT;
+}
+
+void http_stream::begin_redirect_in_place(const url &new_url)
+{
+	LOG_DEBUG_CAT(log_connect, "Redirect on the same connection to \'" << new_url.to_string() << "\'");
+
+	m_url = new_url;
+	m_content_type = "";
+	m_status_code = 0;
+	m_content_length = -1;
+	m_body_size = 0;
+	m_is_chunked = false;
+	m_skip_crlf = true;
+}
+
+void http_stream::strip_request_body(request_opts &opts) const
+{
+	request_opts::option_item_list &list = opts.option_all();
+	for (request_opts::option_item_list::iterator i = list.begin(); i != list.end();)
+	{
+		if (i->first == http_options::request_method ||
+			i->first == http_options::request_body ||
+			boost::algorithm::iequals(i->first, http_options::content_length) ||
+			boost::algorithm::iequals(i->first, http_options::content_type) ||
+			boost::algorithm::iequals(i->first, http_options::transfer_encoding) ||
+			boost::algorithm::iequals(i->first, http_options::expect))
+			i = list.erase(i);
+		else
+			++i;
+	}
+}
+
+void http_stream::drain_body(boost::system::error_code &ec)
+{
+	ec = boost::system::error_code();
+
+	// HEAD请求的响应没有body.
+	if (boost::algorithm::iequals(m_request_opts.find(http_options::request_method), "HEAD"))
+		return;
+
+	// 跳转响应的body直接丢弃, 不需要解码.
+	m_is_decoding = false;
+	set_deadline(m_timeouts.read_timeout);
+
+	char buf[1024];
+	std::size_t drained = 0;
+	bool final_crlf = false;
+	for (;;)
+	{
+		std::size_t bytes_transferred = read_some_body(boost::asio::buffer(buf), ec);
+		if (ec)
+			return;
+		// body读完时返回0, chunked的body在读到最后一个块时返回0, 还需要再读一次跳过结尾的CRLF.
+		if (bytes_transferred == 0)
+		{
+			if (!m_is_chunked || final_crlf)
+				return;
+			final_crlf = true;
+		}
+		drained += bytes_transferred;
+		if (drained > AVHTTP_REDIRECT_DRAIN_LIMIT)
+		{
+			ec = boost::asio::error::message_size;
+			return;
+		}
+	}
+}
+
+bool http_stream::open_from_cache()
+{
+	reset_cache_state();
+
+	// 只在打开时查找缓存, 跳转后的地址不使用缓存.
+	if (!m_cache || m_redirects != 0)
+		return false;
+
+	// 只缓存没有body的完整GET请求.
+	const request_opts &opts = m_request_opts_priv;
+	std::string method = "GET";
+	opts.find(http_options::request_method, method);
+	if (!boost::algorithm::iequals(method, "GET") ||
+		!opts.find(http_options::range).empty() ||
+		!opts.find(http_options::request_body).empty() || !m_body.empty() ||
+		detail::find_cache_directive(opts.option_all(), "no-store"))
+		return false;
+
+	m_cache_request = true;
+	m_cache_key = m_url.to_string();
+	cached_response_ptr entry = m_cache->find(m_cache_key, opts);
+	if (!entry)
+		return false;
+
+	// 请求中有Cache-Control: no-cache时总是验证.
+	if (entry->fresh() && !detail::find_cache_directive(opts.option_all(), "no-cache"))
+	{
+		boost::system::error_code ec;
+		serve_from_cache(entry, ec);
+		if (!ec)
+		{
+			LOG_DEBUG_CAT(log_connect, "Open \'" << m_cache_key << "\' from cache");
+			m_cache_request = false;
+			m_keep_alive = false;
+			AVHTTP_METRIC_ADD(metric_cache_hits, 1);
+			return true;
+		}
+
+		// 缓存的body已经不能读取.
+		m_cache->remove(m_cache_key);
+		return false;
+	}
+
+	if (entry->has_validator())
+		m_cache_entry = entry;
+	return false;
+}
+
+void http_stream::add_cache_validators(request_opts &opts) const
+{
+	// 用户自己发出条件请求时不添加.
+	if (!opts.find("If-None-Match").empty() || !opts.find("If-Modified-Since").empty())
+		return;
+
+	if (!m_cache_entry->etag().empty())
+		opts.insert("If-None-Match", m_cache_entry->etag());
+	if (!m_cache_entry->last_modified().empty())
+		opts.insert("If-Modified-Since", m_cache_entry->last_modified());
+}
+
+void http_stream::handle_cache_response(boost::system::error_code &ec)
+{
+	if (!m_cache_request)
+		return;
+
+	// 每次打开只处理第一个响应.
+	m_cache_request = false;
+	cached_response_ptr entry;
+	entry.swap(m_cache_entry);
+
+	// 验证通过, 用304的响应头更新缓存项, body从缓存读取.
+	if (entry && m_status_code == errc::not_modified)
+	{
+		cached_response_ptr refreshed = entry->refresh(m_response_opts,
+			m_timing.request_start, m_timing.headers_received);
+		boost::system::error_code cache_ec;
+		serve_from_cache(refreshed, cache_ec);
+		if (cache_ec)
+		{
+			m_cache->remove(m_cache_key);
+			return;
+		}
+
+		LOG_DEBUG_CAT(log_connect, "Revalidated \'" << m_cache_key << "\' from cache");
+		m_cache->update(m_cache_key, entry, refreshed);
+		AVHTTP_METRIC_ADD(metric_cache_revalidations, 1);
+		ec = boost::system::error_code();
+		return;
+	}
+
+	if (m_status_code != errc::ok)
+		return;
+
+	// 响应不能缓存时, 原来的缓存也不再使用.
+	m_cache_fill = cached_response::create(m_request_opts_priv, m_response_opts,
+		m_timing.request_start, m_timing.headers_received);
+	if (!m_cache_fill)
+	{
+		if (entry)
+			m_cache->remove(m_cache_key);
+		return;
+	}
+
+	// body太大时不保存.
+	if (m_content_length > static_cast<boost::int64_t>(m_cache->max_entry_size()))
+		m_cache_fill.reset();
+	else if (m_content_length > 0)
+		m_cache_data.reserve(static_cast<std::size_t>(m_content_length));
+}
+
+void http_stream::serve_from_cache(const cached_response_ptr &entry, boost::system::error_code &ec)
+{
+	m_cache_body = entry->body(ec);
+	if (ec)
+		return;
+
+	m_cache_serving = true;
+	m_cache_offset = 0;
+	m_response_opts = entry->headers();
+	m_status_code = errc::ok;
+	m_content_length = entry->size();
+	m_content_type = m_response_opts.find(http_options::content_type);
+	m_location.clear();
+	m_body_size = 0;
+	m_is_chunked = false;
+	m_is_decoding = false;
+	if (m_timing.headers_received.is_not_a_date_time())
+		m_timing.headers_received = http_timing::now();
+}
+
+void http_stream::finish_cache_fill(const boost::system::error_code &ec)
+{
+	if (!m_cache_fill)
+		return;
+
+	cached_response_ptr entry;
+	entry.swap(m_cache_fill);
+
+	// 只保存完整的body, 没有长度的body以连接关闭结束.
+	bool complete = false;
+	if (!ec || ec == boost::asio::error::eof)
+	{
+		if (m_is_chunked)
+			complete = m_is_chunked_end;
+		else if (m_content_length != -1)
+			complete = m_body_size == m_content_length && !decode_pending();
+		else
+			complete = ec == boost::asio::error::eof;
+	}
+
+	if (complete)
+		m_cache->insert(m_cache_key, entry, m_cache_data);
+	std::string().swap(m_cache_data);
+}
+
+void http_stream::stop_cache_body()
+{
+	m_cache_serving = false;
+	m_cache_body = body_source();
+	m_cache_offset = 0;
+	m_cache_fill.reset();
+	std::string().swap(m_cache_data);
+}
+
+void http_stream::reset_cache_state()
+{
+	stop_cache_body();
+	m_cache_request = false;
+	m_cache_entry.reset();
+}
+
+void http_stream::begin_write_body(const body_source &body, bool chunked)
+{
+	m_writing_body = body;
+	m_body_written = 0;
+	m_body_pending = 0;
+	m_body_chunked = chunked;
+	m_body_end = false;
+}
+
+void http_stream::prepare_body_buffers(boost::system::error_code &ec)
+{
+	ec = boost::system::error_code();
+	m_body_pending = 0;
+	for (std::size_t i = 0; i < m_body_buffers.size(); i++)
+		m_body_buffers[i] = boost::asio::const_buffer();
+	std::size_t n = 0;
+
+	// 还没有发送的请求头与body一起写入.
+	if (m_request.size() != 0)
+		m_body_buffers[n++] = boost::asio::buffer(m_request.data());
+
+	if (m_writing_body.empty())
+	{
+		m_body_end = true;
+		return;
+	}
+
+	// 内存中的body直接写入, 不需要复制.
+	if (m_writing_body.type() == body_source::memory_body && !m_body_chunked)
+	{
+		m_body_pending = static_cast<std::size_t>(m_writing_body.size() - m_body_written);
+		m_body_buffers[n++] = boost::asio::buffer(m_writing_body.data() + m_body_written, m_body_pending);
+		m_body_end = true;
+		return;
+	}
+
+	if (m_body_buffer.size() != default_body_buffer_size)
+		m_body_buffer.resize(default_body_buffer_size);
+	std::size_t bytes_transferred = m_writing_body.read(m_body_written,
+		&m_body_buffer[0], m_body_buffer.size(), ec);
+	if (ec)
+		return;
+
+	if (bytes_transferred == 0)
+	{
+		// body的数据比指定的长度少.
+		if (m_writing_body.size() != -1 && m_body_written != m_writing_body.size())
+		{
+			ec = boost::asio::error::eof;
+			return;
+		}
+		m_body_end = true;
+		if (m_body_chunked)
+			m_body_buffers[n++] = boost::asio::buffer("0\r\n\r\n", 5);
+		return;
+	}
+
+	m_body_pending = bytes_transferred;
+	if (m_body_chunked)
+	{
+		int size = std::sprintf(m_body_chunk_header, "%lx\r\n",
+			static_cast<unsigned long>(bytes_transferred));
+		m_body_buffers[n++] = boost::asio::buffer(m_body_chunk_header, size);
+		m_body_buffers[n++] = boost::asio::buffer(&m_body_buffer[0], bytes_transferred);
+		m_body_buffers[n++] = boost::asio::buffer("\r\n", 2);
+	}
+	else
+	{
+		m_body_buffers[n++] = boost::asio::buffer(&m_body_buffer[0], bytes_transferred);
+		if (m_body_written + static_cast<boost::int64_t>(bytes_transferred) == m_writing_body.size())
+			m_body_end = true;
+	}
+}
+
+bool http_stream::commit_body_buffers()
+{
+	m_request.consume(m_request.size());
+	m_body_written += m_body_pending;
+	m_body_pending = 0;
+	return m_body_end;
+}
+
+bool http_stream::use_sendfile()
+{
+#if defined(__linux__) && !defined(AVHTTP_DISABLE_SENDFILE)
+	return m_writing_body.type() == body_source::file_body && !m_body_chunked
+		&& m_sock.get<nossl_socket>() != NULL;
+#else
+	return false;
+#endif
+}
+
+std::size_t http_stream::sendfile_some(boost::system::error_code &ec)
+{
+	ec = boost::system::error_code();
+#if defined(__linux__) && !defined(AVHTTP_DISABLE_SENDFILE)
+	nossl_socket *sock = m_sock.get<nossl_socket>();
+	off_t offset = static_cast<off_t>(m_writing_body.offset() + m_body_written);
+	std::size_t count = static_cast<std::size_t>((std::min)(
+		m_writing_body.size() - m_body_written, boost::int64_t(0x7ffff000)));
+	for (;;)
+	{
+		ssize_t ret = ::sendfile(sock->native_handle(),
+			m_writing_body.file()->native_handle(), &offset, count);
+		if (ret > 0)
+		{
+			m_body_written += ret;
+			m_sock.add_bytes_written(ret);
+			return static_cast<std::size_t>(ret);
+		}
+		if (ret == 0)
+		{
+			// 文件比指定的长度短.
+			ec = boost::asio::error::eof;
+			return 0;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			ec = boost::asio::error::would_block;
+		else
+			ec = boost::system::error_code(errno, boost::system::system_category());
+		return 0;
+	}
+#else
+	ec = boost::asio::error::operation_not_supported;
+	return 0;
+#endif
+}
+
+void http_stream::write_body_impl(boost::system::error_code &ec)
+{
+	for (;;)
+	{
+		// 先发送请求头, 然后使用sendfile发送文件数据.
+		if (use_sendfile())
+		{
+			if (m_request.size() != 0)
+			{
+				boost::asio::write(m_sock, m_request, ec);
+				if (ec)
+					return;
+			}
+			while (m_body_written != m_writing_body.size())
+			{
+				sendfile_some(ec);
+				// 等待socket可写.
+				if (ec == boost::asio::error::would_block)
+					m_sock.get<nossl_socket>()->write_some(boost::asio::null_buffers(), ec);
+				if (ec)
+					return;
+			}
+			return;
+		}
+
+		prepare_body_buffers(ec);
+		if (ec)
+		{
+			LOG_ERROR_CAT(log_connect, "Read request body, error message: \'" << ec.message() <<"\'");
+			return;
+		}
+
+		// 请求头和body聚集写入.
+		boost::asio::write(m_sock, m_body_buffers, ec);
+		if (ec)
+			return;
+		if (commit_body_buffers())
+			return;
+	}
+}
+
+void http_stream::reset_timing(bool keep_start)
+{
+	boost::posix_time::ptime start = m_timing.start;
+	m_timing = http_timing();
+	m_timing.start = (keep_start && !start.is_not_a_date_time()) ? start : http_timing::now();
+	if (!keep_start)
+	{
+		m_wire_read_base = m_sock.bytes_read();
+		m_wire_written_base = m_sock.bytes_written();
+	}
+	m_decoded_bytes = 0;
+}
+
+void http_stream::mark_request_start()
+{
+	// 在已经打开的连接上发起新的请求, 从这里重新开始计时.
+	if (!m_timing.request_start.is_not_a_date_time())
+	{
+		reset_timing(false);
+		AVHTTP_METRIC_ADD(metric_connections_reused, 1);
+	}
+	else
+	{
+		AVHTTP_METRIC_ADD(metric_connections_opened, 1);
+	}
+	m_timing.request_start = http_timing::now();
+}
+
+void http_stream::record_response_metrics()
+{
+	m_timing.headers_received = http_timing::now();
+
+	AVHTTP_METRIC_STATUS(m_status_code);
+	AVHTTP_METRIC_OBSERVE(metric_dns_time, m_timing.dns());
+	AVHTTP_METRIC_OBSERVE(metric_connect_time, m_timing.connect());
+	AVHTTP_METRIC_OBSERVE(metric_tls_time, m_timing.tls());
+	AVHTTP_METRIC_OBSERVE(metric_ttfb, m_timing.ttfb());
+}
+
+void http_stream::record_body_read(const boost::system::error_code &ec, std::size_t bytes_transferred)
+{
+	if (bytes_transferred > 0)
+	{
+		if (m_timing.first_body_byte.is_not_a_date_time())
+			m_timing.first_body_byte = http_timing::now();
+		m_decoded_bytes += bytes_transferred;
+		AVHTTP_METRIC_ADD(metric_bytes_decoded, bytes_transferred);
+		if (m_is_decoding)
+			AVHTTP_METRIC_ADD(metric_gzip_output_bytes, bytes_transferred);
+	}
+
+	if (!m_timing.body_done.is_not_a_date_time())
+		return;
+
+	// 出错(包括eof), 或者在keep-alive时返回0, 表示body已经读取完成.
+	bool done = ec || bytes_transferred == 0;
+	if (!m_is_decoding)
+	{
+		// 未压缩时, 读完content_length即完成, 用户不一定会再发起一次读取.
+		if (m_content_length != -1 && m_body_size == m_content_length)
+			done = true;
+	}
+	if (done)
+	{
+		// 请求已经完成, 不再检查整个请求的超时.
+		m_total_deadline = boost::posix_time::pos_infin;
+		m_timing.body_done = http_timing::now();
+		AVHTTP_METRIC_OBSERVE(metric_request_time, m_timing.total());
+		finish_cache_fill(ec);
+	}
+}
+
+template <typename MutableBufferSequence, typename Handler>
+void http_stream::handle_body_read(const MutableBufferSequence &buffers, Handler handler,
+	const boost::system::error_code &ec, std::size_t bytes_transferred)
+{
+	cancel_deadline();
+	append_cache_data(buffers, bytes_transferred);
+	record_body_read(ec, bytes_transferred);
+	handler(deadline_error(ec), bytes_transferred);
+}
+
+template <typename MutableBufferSequence>
+std::size_t http_stream::read_cache(const MutableBufferSequence &buffers, boost::system::error_code &ec)
+{
+	ec = boost::system::error_code();
+	std::size_t bytes_transferred = 0;
+	typename MutableBufferSequence::const_iterator iter = buffers.begin();
+	typename MutableBufferSequence::const_iterator end = buffers.end();
+	for (; iter != end; ++iter)
+	{
+		boost::asio::mutable_buffer buffer(*iter);
+		std::size_t size = boost::asio::buffer_size(buffer);
+		std::size_t n = m_cache_body.read(m_cache_offset,
+			boost::asio::buffer_cast<char*>(buffer), size, ec);
+		m_cache_offset += n;
+		bytes_transferred += n;
+		if (ec || n < size)
+			break;
+	}
+	m_body_size += bytes_transferred;
+
+	// 与从连接读取一样, 读完后连接不保持时返回eof.
+	if (bytes_transferred == 0 && !ec && !m_keep_alive)
+		ec = boost::asio::error::eof;
+	return bytes_transferred;
+}
+
+template <typename MutableBufferSequence>
+void http_stream::append_cache_data(const MutableBufferSequence &buffers, std::size_t bytes_transferred)
+{
+	if (!m_cache_fill || bytes_transferred == 0)
+		return;
+
+	// 解码后的body超出大小限制时放弃保存.
+	if (m_cache_data.size() + bytes_transferred > m_cache->max_entry_size())
+	{
+		m_cache_fill.reset();
+		std::string().swap(m_cache_data);
+		return;
+	}
+
+	typename MutableBufferSequence::const_iterator iter = buffers.begin();
+	typename MutableBufferSequence::const_iterator end = buffers.end();
+	for (; iter != end && bytes_transferred != 0; ++iter)
+	{
+		boost::asio::const_buffer buffer(*iter);
+		std::size_t size = (std::min)(boost::asio::buffer_size(buffer), bytes_transferred);
+		m_cache_data.append(boost::asio::buffer_cast<const char*>(buffer), size);
+		bytes_transferred -= size;
+	}
+}
+
+template <typename Handler>
+void http_stream::async_open_http2(Handler handler)
+{
+	// 判断是否已经打开.
+	if ((m_sock.instantiated() && m_sock.is_open()) || m_http2_stream)
+	{
+		boost::system::error_code ec = boost::asio::error::already_open;
+		LOG_ERROR_CAT(log_connect, "Open socket, error message\'" << ec.message() << "\'");
+		m_io_service.post(boost::asio::detail::bind_handler(handler, ec));
+		return;
+	}
+
+	m_http2_mode = true;
+	m_http2_retried = false;
+
+	// 开始计算超时, 重定向时保留整个请求的截止时间.
+	if (m_redirects == 0)
+		start_total_deadline();
+
+	// 连接由连接池建立, 等待响应头的超时包括连接和握手的时间, 只累加设置了超时的阶段.
+	boost::posix_time::time_duration timeout = boost::posix_time::pos_infin;
+	const boost::posix_time::time_duration phases[] = {
+		m_timeouts.connect_timeout, m_timeouts.handshake_timeout, m_timeouts.header_timeout };
+	for (std::size_t i = 0; i < sizeof(phases) / sizeof(phases[0]); i++)
+	{
+		if (phases[i].is_special())
+			continue;
+		timeout = timeout.is_special() ? phases[i] : timeout + phases[i];
+	}
+	async_request_http2(m_request_opts_priv, handler, timeout);
+}
+
+template <typename Handler>
+void http_stream::async_request_http2(const request_opts &opt, Handler handler,
+	const boost::posix_time::time_duration &timeout)
+{
+	// 上一个响应不再读取.
+	reset_http2_stream();
+	m_http2_request = opt;
+
+	// 开始计时.
+	mark_request_start();
+
+	// 等待http头的超时.
+	m_timed_out = false;
+	set_deadline(timeout);
+	arm_deadline();
+
+	// 新的响应不再从缓存读取.
+	stop_cache_body();
+
+	// 保存到一个新的opts中操作.
+	request_opts opts = opt;
+	// 跳转后改用GET请求, 不再发送body.
+	if (m_redirect_to_get)
+		strip_request_body(opts);
+	// 有过期的缓存响应时发出条件请求.
+	if (m_cache_entry)
+		add_cache_validators(opts);
+	// 清空.
+	m_request_opts.clear();
+	m_response.consume(m_response.size());
+	m_is_chunked = false;
+	m_is_chunked_end = false;
+	m_is_decoding = false;
+	m_keep_alive = true;
+	m_body_size = 0;
+
+	// 得到url选项.
+	std::string new_url;
+	if (opts.find(http_options::url, new_url))
+		opts.remove(http_options::url);		// 删除处理过的选项.
+	if (!new_url.empty())
+	{
+		m_url = new_url;
+		m_request_opts.insert(http_options::url, new_url);
+	}
+
+	// 得到request_method.
+	std::string request_method = "GET";
+	if (opts.find(http_options::request_method, request_method))
+		opts.remove(http_options::request_method);	// 删除处理过的选项.
+	m_request_opts.insert(http_options::request_method, request_method);
+
+	// 版本总是HTTP/2.
+	opts.remove(http_options::http_version);
+	m_request_opts.insert(http_options::http_version, "HTTP/2");
+
+	// 得到Host信息, 作为:authority发送.
+	std::string host = m_url.to_string(url::host_component | url::port_component);
+	if (opts.find(http_options::host, host))
+		opts.remove(http_options::host);	// 删除处理过的选项.
+	m_request_opts.insert(http_options::host, host);
+
+	// 得到Accept信息.
+	std::string accept = "text/html, application/xhtml+xml, */*";
+	if (opts.find(http_options::accept, accept))
+		opts.remove(http_options::accept);	// 删除处理过的选项.
+	m_request_opts.insert(http_options::accept, accept);
+
+	// 自动添加Accept-Encoding.
+	add_accept_encoding(opts);
+
+	// 添加user_agent.
+	std::string user_agent = AVHTTP_VERSION_MIME;
+	if (opts.find(http_options::user_agent, user_agent))
+		opts.remove(http_options::user_agent);	// 删除处理过的选项.
+	m_request_opts.insert(http_options::user_agent, user_agent);
+
+	// http/2没有Connection头, 只用于决定body结束时返回eof还是0.
+	std::string connection = "close";
+	if (opts.find(http_options::connection, connection))
+		opts.remove(http_options::connection);		// 删除处理过的选项.
+	m_request_opts.insert(http_options::connection, connection);
+	if (connection == "close")
+		m_keep_alive = false;
+
+	// 准备发送的body, body由连接按流量控制窗口以DATA帧发送, 不使用chunked和100-continue.
+	setup_request_body(opts);
+	body_source body = m_writing_body;
+	begin_write_body(body_source(), false);
+	m_continue_pending = false;
+
+	// 请求的路径, 不包括fragment.
+	std::string path = m_url.to_string(url::path_component | url::query_component);
+	if (path.empty())
+		path = "/";
+	m_request_opts.insert(http_options::path, path);
+
+	detail::hpack_headers headers;
+	headers.push_back(detail::hpack_header(":method", request_method));
+	headers.push_back(detail::hpack_header(":scheme", m_url.protocol()));
+	headers.push_back(detail::hpack_header(":authority", host));
+	headers.push_back(detail::hpack_header(":path", path));
+	headers.push_back(detail::hpack_header("accept", accept));
+	headers.push_back(detail::hpack_header("user-agent", user_agent));
+	std::string content_length;
+	if (m_request_opts.find(http_options::content_length, content_length))
+		headers.push_back(detail::hpack_header("content-length", content_length));
+
+	// 循环构造其它选项, 头部名称使用小写, 去掉http/2中不允许的连接相关的头部.
+	request_opts::option_item_list &list = opts.option_all();
+	for (request_opts::option_item_list::iterator val = list.begin(); val != list.end(); val++)
+	{
+		if (val->first == http_options::path ||
+			val->first == http_options::request_body ||
+			val->first == http_options::status_code)
+			continue;
+		std::string name = boost::algorithm::to_lower_copy(val->first);
+		if (name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+			name == "transfer-encoding" || name == "upgrade" || name == "expect" || name == "te")
+			continue;
+		headers.push_back(detail::hpack_header(name, val->second));
+		m_request_opts.insert(val->first, val->second);
+	}
+
+	LOG_DEBUG_CAT(log_connect, "HTTP/2 request \'" << request_method << " " << m_url.to_string() << "\'");
+
+	// 完成时取消超时定时器, 先擦除用户handler的类型, 避免boost::bind展开嵌套的bind表达式.
+	typedef detail::erased_handler HandlerWrapper;
+	HandlerWrapper h = detail::make_context_handler(
+		boost::bind(&http_stream::handle_deadline_result<HandlerWrapper>,
+			this, HandlerWrapper(handler),
+			boost::asio::placeholders::error
+		), handler);
+
+	// 在连接池中打开流, 等待响应头.
+	m_http2_stream = m_http2->open_stream(m_io_service, m_url, headers, body);
+	m_http2_stream->async_wait(
+		detail::make_context_handler(boost::bind(&http_stream::handle_http2_response<HandlerWrapper>,
+			this, h,
+			boost::asio::placeholders::error
+		), h)
+	);
+}
+
+template <typename Handler>
+void http_stream::handle_http2_response(Handler handler, const boost::system::error_code &err)
+{
+	boost::system::error_code ec = err;
+	if (!ec && !m_http2_stream)
+		ec = boost::asio::error::operation_aborted;	// 等待时流已经被关闭.
+	if (ec)
+	{
+		reset_http2_stream();
+
+		// 服务器不支持h2, 连接池已经记录下来, 改用http/1.1重新打开.
+		if (ec == boost::asio::error::operation_not_supported && !m_timed_out)
+		{
+			LOG_DEBUG_CAT(log_connect, "HTTP/2 not supported by \'" << m_url.host() << "\', use HTTP/1.1");
+			m_http2_mode = false;
+			async_open(m_url, handler);
+			return;
+		}
+
+		// 服务器没有处理这个流(如连接被GOAWAY关闭), 在新的连接上重试一次.
+		if (ec == errc::http2_refused_stream && !m_http2_retried && !m_timed_out)
+		{
+			LOG_DEBUG_CAT(log_connect, "HTTP/2 stream refused, retry \'" << m_url.to_string() << "\'");
+			m_http2_retried = true;
+			request_opts opts = m_http2_request;
+			async_request_http2(opts, handler, m_timeouts.header_timeout);
+			return;
+		}
+
+		LOG_ERROR_CAT(log_connect, "HTTP/2 request error, error message: \'" << ec.message() << "\'");
+		handler(ec);
+		return;
+	}
+
+	int status_code = 0;
+	detail::hpack_headers headers;
+	m_http2_stream->take_response(status_code, headers);
+	if (m_timing.status_received.is_not_a_date_time())
+		m_timing.status_received = http_timing::now();
 
-request_opts http_stream::request_options(void) const
-{
-	if (m_request_opts.size() == 0)
-		return m_request_opts_priv;
-	return m_request_opts;
-}
+	// 保存响应头.
+	m_status_code = status_code;
+	m_content_type.clear();
+	m_content_length = -1;
+	m_location.clear();
+	m_response_opts.clear();
+	m_response_opts.insert("_status_code", boost::str(boost::format("%d") % m_status_code));
+	for (detail::hpack_headers::iterator i = headers.begin(); i != headers.end(); ++i)
+	{
+		detail::check_header(i->first, i->second, m_content_type, m_content_length, m_location);
+		m_response_opts.insert(i->first, i->second);
+	}
+	record_response_metrics();
 
-response_opts http_stream::response_options(void) const
-{
-	return m_response_opts;
-}
+	LOG_DEBUG_CAT(log_parse, "HTTP/2 status code: " << m_status_code);
 
-const std::string& http_stream::location() const
-{
-	return m_location;
+	// 304时从缓存读取, 不再需要流, 或者开始保存可以缓存的响应.
+	handle_cache_response(ec);
+	if (m_cache_serving)
+		reset_http2_stream();
+
+	// 判断是否需要跳转, 新的请求作为一个新的流, 不需要读取跳转响应的body.
+	url new_url;
+	if (prepare_redirect(new_url, ec))
+	{
+		reset_http2_stream();
+		async_open(new_url, handler);
+		return;
+	}
+
+	// 清空重定向次数.
+	m_redirects = 0;
+	m_redirect_to_get = false;
+
+	// 跳转地址错误.
+	if (ec)
+	{
+		handler(ec);
+		return;
+	}
+
+	if (m_status_code != errc::ok && m_status_code != errc::partial_content)
+		ec = make_error_code(static_cast<errc::errc_t>(m_status_code));
+
+	// 根据Content-Encoding准备解码器.
+	boost::system::error_code decoder_ec;
+	setup_content_decoder(decoder_ec);
+	if (decoder_ec)
+	{
+		handler(decoder_ec);
+		return;
+	}
+
+	// 回调通知.
+	handler(ec);
 }
 
-const std::string http_stream::final_url() const
+template <typename MutableBufferSequence>
+std::size_t http_stream::read_some_http2(const MutableBufferSequence &buffers, boost::system::error_code &ec)
 {
-	return m_url.to_string();
-}
+	ec = boost::system::error_code();
+	if (!m_http2_stream)
+	{
+		ec = boost::asio::error::bad_descriptor;
+		return 0;
+	}
+	if (boost::asio::buffer_size(buffers) == 0)
+		return 0;
 
-const std::string http_stream::entry_url() const
-{
-	return m_entry_url.to_string();
-}
+	std::size_t bytes_transferred = 0;
+	if (m_is_decoding)
+	{
+		// 解码出数据, 或者流上暂时没有数据为止.
+		for (;;)
+		{
+			if (!decode_pending())
+			{
+				std::size_t size = m_http2_stream->read_some(prepare_decode_buffer(std::size_t(-1)), ec);
+				if (size == 0)
+					break;
+				m_body_size += size;
+				commit_decode_buffer(size);
+			}
 
-boost::int64_t http_stream::content_length()
-{
-	return m_content_length;
+			bytes_transferred = decode_some(buffers, ec);
+			if (ec)
+				return 0;
+			if (bytes_transferred != 0)
+				break;
+		}
+	}
+	else
+	{
+		bytes_transferred = m_http2_stream->read_some(buffers, ec);
+		m_body_size += bytes_transferred;
+	}
+
+	// 与http/1.1相同, keep-alive时body结束返回0, 否则返回eof.
+	if (ec == boost::asio::error::eof && m_keep_alive)
+		ec = boost::system::error_code();
+
+	return bytes_transferred;
 }
 
-void http_stream::check_certificate(bool is_check)
+template <typename MutableBufferSequence, typename Handler>
+void http_stream::async_wait_http2(const MutableBufferSequence &buffers, Handler handler)
 {
-#ifdef AVHTTP_ENABLE_OPENSSL
-	m_check_certificate = is_check;
-#endif
+	// 读取的空闲超时.
+	set_deadline(m_timeouts.read_timeout);
+	arm_deadline();
+
+	typedef detail::read_op_handler<http_stream, MutableBufferSequence, Handler> read_handler;
+	read_handler h = detail::make_read_op_handler(this,
+		&http_stream::handle_http2_read<MutableBufferSequence, Handler>, buffers, handler);
+	m_http2_stream->async_wait(detail::make_context_handler(
+		boost::bind<void>(h, boost::asio::placeholders::error, std::size_t(0)), h));
 }
 
-void http_stream::add_verify_path(const std::string &path)
+template <typename MutableBufferSequence, typename Handler>
+void http_stream::handle_http2_read(const MutableBufferSequence &buffers, Handler handler,
+	const boost::system::error_code &, std::size_t)
 {
-	m_ca_directory = path;
-	return;
+	// 流的错误由read_some返回.
+	boost::system::error_code ec;
+	std::size_t bytes_transferred = read_some_http2(buffers, ec);
+	if (ec == boost::asio::error::would_block)
+	{
+		async_wait_http2(buffers, handler);
+		return;
+	}
+	handle_body_read(buffers, handler, ec, bytes_transferred);
 }
 
-void http_stream::load_verify_file(const std::string &filename)
+void http_stream::reset_http2_stream()
 {
-	m_ca_cert = filename;
-	return;
+	if (m_http2_stream)
+	{
+		m_http2_stream->reset();
+		m_http2_stream.reset();
+	}
 }
 
-
-// 以下为内部相关实现, 非接口.
-
-template <typename MutableBufferSequence>
-std::size_t http_stream::read_some_impl(const MutableBufferSequence &buffers,
+template <typename Stream>
+std::size_t http_stream::read_until_deadline(Stream &sock, const char *delim,
 	boost::system::error_code &ec)
 {
-	// 如果还有数据在m_response中, 先读取m_response中的数据.
-	if (m_response.size() > 0)
+	boost::posix_time::ptime deadline = current_deadline();
+	if (deadline.is_pos_infinity())
+		return boost::asio::read_until(sock, m_response, delim, ec);
+
+	// 以非阻塞方式读取, 没有数据时等待socket可读直到超时, 已经读取的数据保留在m_response中.
+	std::size_t bytes_transferred = 0;
+	tcp::socket::lowest_layer_type &lowest = sock.lowest_layer();
+	lowest.non_blocking(true, ec);
+	while (!ec)
 	{
-		std::size_t bytes_transferred = 0;
-		typename MutableBufferSequence::const_iterator iter = buffers.begin();
-		typename MutableBufferSequence::const_iterator end = buffers.end();
-		for (; iter != end && m_response.size() > 0; ++iter)
-		{
-			boost::asio::mutable_buffer buffer(*iter);
-			std::size_t length = boost::asio::buffer_size(buffer);
-			if (length > 0)
-			{
-				bytes_transferred += m_response.sgetn(
-					boost::asio::buffer_cast<char*>(buffer), length);
-			}
-		}
-		ec = boost::system::error_code();
-		return bytes_transferred;
+		bytes_transferred = boost::asio::read_until(sock, m_response, delim, ec);
+		if (ec != boost::asio::error::would_block && ec != boost::asio::error::try_again)
+			break;
+		wait_socket(lowest.native_handle(), true, deadline, ec);
 	}
-
-	// 再从socket中读取数据.
-	std::size_t bytes_transferred = m_sock.read_some(buffers, ec);
-	if (ec == boost::asio::error::shut_down)
-		ec = boost::asio::error::eof;
+	boost::system::error_code ignore_ec;
+	lowest.non_blocking(false, ignore_ec);
+	if (ec == errc::timed_out)
+		abort_connection();
 	return bytes_transferred;
 }
 
+template <typename Handler>
+void http_stream::handle_deadline_result(Handler handler, const boost::system::error_code &ec)
+{
+	cancel_deadline();
+	handler(deadline_error(ec));
+}
+
 template <typename Handler>
 void http_stream::handle_resolve(const boost::system::error_code &err,
 	tcp::resolver::iterator endpoint_iterator, Handler handler)
 {
 	if (!err)
 	{
+		m_timing.resolved = http_timing::now();
+
 		// 发起异步连接.
-		// !!!备注: 由于m_sock可能是ssl, 那么连接的握手相关实现被封装到ssl_stream
-		// 了, 所以, 如果需要使用boost::asio::async_connect的话, 需要在http_stream
-		// 中实现握手操作, 否则将会得到一个错误.
-		m_sock.async_connect(tcp::endpoint(*endpoint_iterator),
-			boost::bind(&http_stream::handle_connect<Handler>,
+		// !!!备注: 这里只在最底层的socket上建立tcp连接, 如果m_sock是ssl, 握手在
+		// handle_connect中单独发起, 以便分别统计连接和握手的时间.
+		m_sock.lowest_layer().async_connect(tcp::endpoint(*endpoint_iterator),
+			detail::make_context_handler(boost::bind(&http_stream::handle_connect<Handler>,
 				this, handler, endpoint_iterator,
 				boost::asio::placeholders::error
-			)
+			), handler)
 		);
 	}
 	else
 	{
-		LOG_ERROR("Resolve DNS error, \'" << m_url.host() <<
+		LOG_ERROR_CAT(log_resolve, "Resolve DNS error, \'" << m_url.host() <<
 			"\', error message \'" << err.message() << "\'");
 		// 出错回调.
 		handler(err);
@@ -1402,30 +3374,47 @@ void http_stream::handle_connect(Handler handler,
 {
 	if (!err)
 	{
-		LOG_DEBUG("Connect to \'" << m_url.host() << "\'.");
+		LOG_DEBUG_CAT(log_connect, "Connect to \'" << m_url.host() << "\'.");
+		m_timing.connected = http_timing::now();
+#ifdef AVHTTP_ENABLE_OPENSSL
+		if (m_protocol == "https")
+		{
+			// 开始异步握手, 握手完成后在handle_https_proxy_handshake中发起请求.
+			// ssl握手的超时.
+			set_deadline(m_timeouts.handshake_timeout);
+			arm_deadline();
+			ssl_socket *ssl_sock = m_sock.get<ssl_socket>();
+			ssl_sock->async_handshake(
+				detail::make_context_handler(boost::bind(&http_stream::handle_https_proxy_handshake<nossl_socket, Handler>,
+					this,
+					boost::ref(m_nossl_socket),
+					handler,
+					boost::asio::placeholders::error
+				), handler)
+			);
+			return;
+		}
+#endif
 		// 发起异步请求.
 		async_request(m_request_opts_priv, handler);
 	}
 	else
 	{
 		// 检查是否已经尝试了endpoint列表中的所有endpoint.
-		if (++endpoint_iterator == tcp::resolver::iterator())
+		if (++endpoint_iterator == tcp::resolver::iterator() || m_timed_out)
 		{
-			LOG_ERROR("Connect to \'" << m_url.host() <<
+			LOG_ERROR_CAT(log_connect, "Connect to \'" << m_url.host() <<
 				"\', error message \'" << err.message() << "\'");
 			handler(err);
 		}
 		else
 		{
 			// 继续发起异步连接.
-			// !!!备注: 由于m_sock可能是ssl, 那么连接的握手相关实现被封装到ssl_stream
-			// 了, 所以, 如果需要使用boost::asio::async_connect的话, 需要在http_stream
-			// 中实现握手操作, 否则将会得到一个错误.
-			m_sock.async_connect(tcp::endpoint(*endpoint_iterator),
-				boost::bind(&http_stream::handle_connect<Handler>,
+			m_sock.lowest_layer().async_connect(tcp::endpoint(*endpoint_iterator),
+				detail::make_context_handler(boost::bind(&http_stream::handle_connect<Handler>,
 					this, handler, endpoint_iterator,
 					boost::asio::placeholders::error
-				)
+				), handler)
 			);
 		}
 	}
@@ -1437,17 +3426,91 @@ void http_stream::handle_request(Handler handler, const boost::system::error_cod
 	// 发生错误.
 	if (err)
 	{
-		LOG_ERROR("Send request, error message: \'" << err.message() <<"\'");
+		LOG_ERROR_CAT(log_connect, "Send request, error message: \'" << err.message() <<"\'");
 		handler(err);
 		return;
 	}
+	m_timing.request_sent = http_timing::now();
+
+	// 使用100-continue时, 等待服务器返回数据或者超时.
+	if (m_continue_pending)
+	{
+		m_continue_waits = 2;
+		m_continue_timer.expires_from_now(m_continue_timeout);
+		m_continue_timer.async_wait(
+			detail::make_context_handler(boost::bind(&http_stream::handle_continue_wait<Handler>,
+				this, handler, true,
+				boost::asio::placeholders::error, 0
+			), handler)
+		);
+		m_sock.async_read_some(m_response.prepare(1024),
+			detail::make_context_handler(boost::bind(&http_stream::handle_continue_wait<Handler>,
+				this, handler, false,
+				boost::asio::placeholders::error,
+				boost::asio::placeholders::bytes_transferred
+			), handler)
+		);
+		return;
+	}
 
 	// 异步读取Http status.
 	boost::asio::async_read_until(m_sock, m_response, "\r\n",
-		boost::bind(&http_stream::handle_status<Handler>,
+		detail::make_context_handler(boost::bind(&http_stream::handle_status<Handler>,
 			this, handler,
 			boost::asio::placeholders::error
-		)
+		), handler)
+	);
+}
+
+template <typename Handler>
+void http_stream::handle_continue_wait(Handler handler, bool is_timer,
+	const boost::system::error_code &err, std::size_t bytes_transferred)
+{
+	// 两个等待操作先完成的一个取消另一个.
+	boost::system::error_code ignore_ec;
+	if (is_timer)
+	{
+		if (!err)
+			m_sock.lowest_layer().cancel(ignore_ec);
+	}
+	else
+	{
+		m_response.commit(bytes_transferred);
+		m_continue_error = bytes_transferred != 0 ? boost::system::error_code() : err;
+		if (err != boost::asio::error::operation_aborted)
+			m_continue_timer.cancel(ignore_ec);
+	}
+
+	if (--m_continue_waits != 0)
+		return;
+
+	// 等待socket时出错.
+	if (m_continue_error && m_continue_error != boost::asio::error::operation_aborted)
+	{
+		LOG_ERROR_CAT(log_connect, "Wait continue, error message: \'" << m_continue_error.message() <<"\'");
+		handler(m_continue_error);
+		return;
+	}
+
+	// 超时前没有收到服务器的响应, 直接发送body.
+	if (m_continue_error)
+	{
+		m_continue_pending = false;
+		async_write_body_impl(detail::make_context_handler(
+			boost::bind(&http_stream::handle_request<Handler>,
+				this, handler,
+				boost::asio::placeholders::error
+			), handler)
+		);
+		return;
+	}
+
+	// 服务器已经返回了数据(已读取到m_response中), 读取Http status.
+	boost::asio::async_read_until(m_sock, m_response, "\r\n",
+		detail::make_context_handler(boost::bind(&http_stream::handle_status<Handler>,
+			this, handler,
+			boost::asio::placeholders::error
+		), handler)
 	);
 }
 
@@ -1457,10 +3520,13 @@ void http_stream::handle_status(Handler handler, const boost::system::error_code
 	// 发生错误.
 	if (err)
 	{
-		LOG_ERROR("Read status line, error message: \'" << err.message() <<"\'");
+		LOG_ERROR_CAT(log_parse, "Read status line, error message: \'" << err.message() <<"\'");
 		handler(err);
 		return;
 	}
+	// 对于100 continue, 只记录第一个状态行的时间.
+	if (m_timing.status_received.is_not_a_date_time())
+		m_timing.status_received = http_timing::now();
 
 	// 复制到新的streambuf中处理首行http状态, 如果不是http状态行, 那么将保持m_response中的内容,
 	// 这主要是为了兼容非标准http服务器直接向客户端发送文件的需要, 但是依然需要以malformed_status_line
@@ -1482,39 +3548,80 @@ void http_stream::handle_status(Handler handler, const boost::system::error_code
 		std::istreambuf_iterator<char>(),
 		version_major, version_minor, m_status_code))
 	{
-		LOG_ERROR("Malformed status line");
+		LOG_ERROR_CAT(log_parse, "Malformed status line");
 		handler(errc::malformed_status_line);
 		return;
 	}
 
-	// 处理掉状态码所占用的字节数.
-	m_response.consume(response_size - tempbuf.size());
-
-	// "continue"表示我们需要继续等待接收状态.
+	// "continue"表示我们需要继续等待接收状态, 先读取完整的100 Continue响应.
 	if (m_status_code == errc::continue_request)
 	{
-		boost::asio::async_read_until(m_sock, m_response, "\r\n",
-			boost::bind(&http_stream::handle_status<Handler>,
+		boost::asio::async_read_until(m_sock, m_response, "\r\n\r\n",
+			detail::make_context_handler(boost::bind(&http_stream::handle_continue<Handler>,
 				this, handler,
+				boost::asio::placeholders::bytes_transferred,
 				boost::asio::placeholders::error
-			)
+			), handler)
 		);
 	}
 	else
 	{
+		// 处理掉状态码所占用的字节数.
+		m_response.consume(response_size - tempbuf.size());
+
+		// 服务器在发送body前返回了最终状态, 放弃发送body.
+		if (m_continue_pending)
+		{
+			m_continue_pending = false;
+			m_body_rejected = true;
+			LOG_WARNING_CAT(log_connect, "Request body rejected, status code: " << m_status_code);
+		}
+
 		// 清除原有的返回选项.
 		m_response_opts.clear();
 		// 添加状态码.
 		m_response_opts.insert("_status_code", boost::str(boost::format("%d") % m_status_code));
 		// 异步读取所有Http header部分.
 		boost::asio::async_read_until(m_sock, m_response, "\r\n\r\n",
-			boost::bind(&http_stream::handle_header<Handler>,
+			detail::make_context_handler(boost::bind(&http_stream::handle_header<Handler>,
 				this, handler,
 				boost::asio::placeholders::bytes_transferred,
 				boost::asio::placeholders::error
-			)
+			), handler)
+		);
+	}
+}
+
+template <typename Handler>
+void http_stream::handle_continue(Handler handler, int bytes_transferred, const boost::system::error_code &err)
+{
+	if (err)
+	{
+		LOG_ERROR_CAT(log_parse, "Read continue response, error message: \'" << err.message() << "\'");
+		handler(err);
+		return;
+	}
+	m_response.consume(bytes_transferred);
+
+	// 服务器同意接收body, 发送body后再读取状态.
+	if (m_continue_pending)
+	{
+		m_continue_pending = false;
+		async_write_body_impl(detail::make_context_handler(
+			boost::bind(&http_stream::handle_request<Handler>,
+				this, handler,
+				boost::asio::placeholders::error
+			), handler)
 		);
+		return;
 	}
+
+	boost::asio::async_read_until(m_sock, m_response, "\r\n",
+		detail::make_context_handler(boost::bind(&http_stream::handle_status<Handler>,
+			this, handler,
+			boost::asio::placeholders::error
+		), handler)
+	);
 }
 
 template <typename Handler>
@@ -1522,17 +3629,18 @@ void http_stream::handle_header(Handler handler, int bytes_transferred, const bo
 {
 	if (err)
 	{
-		LOG_ERROR("Header error, error message: \'" << err.message() << "\'");
+		LOG_ERROR_CAT(log_parse, "Header error, error message: \'" << err.message() << "\'");
 		handler(err);
 		return;
 	}
+	record_response_metrics();
 
 	std::string header_string;
 	header_string.resize(bytes_transferred);
 	m_response.sgetn(&header_string[0], bytes_transferred);
 
-	LOG_DEBUG("Status code: " << m_status_code);
-	LOG_DEBUG("Http header:\n" << header_string);
+	LOG_DEBUG_CAT(log_parse, "Status code: " << m_status_code);
+	LOG_DEBUG_CAT(log_parse, "Http header:\n" << header_string);
 
 	boost::system::error_code ec;
 
@@ -1541,78 +3649,131 @@ void http_stream::handle_header(Handler handler, int bytes_transferred, const bo
 		m_content_type, m_content_length, m_location, m_response_opts.option_all()))
 	{
 		ec = errc::malformed_response_headers;
-		LOG_ERROR("Parse header error, error message: \'" << ec.message() << "\'");
+		LOG_ERROR_CAT(log_parse, "Parse header error, error message: \'" << ec.message() << "\'");
 		handler(ec);
 		return;
 	}
 
+	// 是否启用了chunked.
+	std::string opt_str = m_response_opts.find(http_options::transfer_encoding);
+	if (opt_str == "chunked")
+		m_is_chunked = true;
+	// 是否在请求完成后关闭socket.
+	opt_str = m_request_opts.find(http_options::connection);
+	if (opt_str == "close")
+		m_keep_alive = false;
+	opt_str = m_response_opts.find(http_options::connection);
+	if (opt_str == "close")
+		m_keep_alive = false;
+
+	// 304时从缓存读取, 或者开始保存可以缓存的响应.
+	handle_cache_response(ec);
+
 	// 判断是否需要跳转.
-	if (m_status_code == errc::moved_permanently || m_status_code == errc::found)
+	url new_url;
+	if (prepare_redirect(new_url, ec))
 	{
-		m_sock.close(ec);
-		if (++m_redirects <= m_max_redirects)
+		// 跳转到同一服务器时, 读完跳转响应的body后在同一连接上发送新的请求.
+		if (can_redirect_in_place(new_url))
 		{
-			// 查询location中是否有协议相关标识, 如果没有http或https前辍, 则添加.
-			std::size_t found = m_location.find("://");
-			if (found == std::string::npos)
-			{
-				// 添加头.
-				std::string prefix = m_url.to_string(
-					url::protocol_component|url::host_component|url::port_component);
-				m_location = prefix + "/" + m_location;
-			}
-			url new_url = url::from_string(m_location, ec);
-			if (ec == boost::system::errc::invalid_argument)
+			// HEAD请求的响应没有body.
+			if (boost::algorithm::iequals(m_request_opts.find(http_options::request_method), "HEAD"))
 			{
-				// 向用户报告跳转地址错误.
-				ec = errc::invalid_redirect;
-				LOG_ERROR("Location url invalid, error message: \'" << ec.message() << "\'");
-				handler(ec);
+				begin_redirect_in_place(new_url);
+				async_request(m_request_opts_priv, handler);
 				return;
 			}
-			async_open(new_url, handler);
+
+			// 跳转响应的body直接丢弃, 不需要解码.
+			m_is_decoding = false;
+			m_drain_buffer.resize(1024);
+			set_deadline(m_timeouts.read_timeout);
+			arm_deadline();
+			async_read_some_body(boost::asio::buffer(m_drain_buffer),
+				detail::make_context_handler(boost::bind(&http_stream::handle_redirect_drain<Handler>,
+					this, handler, new_url, std::size_t(0), false,
+					boost::asio::placeholders::error,
+					boost::asio::placeholders::bytes_transferred
+				), handler)
+			);
 			return;
 		}
+
+		m_sock.close(ec);
+		async_open(new_url, handler);
+		return;
 	}
 
 	// 清空重定向次数.
 	m_redirects = 0;
+	m_redirect_to_get = false;
+
+	// 跳转地址错误.
+	if (ec)
+	{
+		handler(ec);
+		return;
+	}
 
 	if (m_status_code != errc::ok && m_status_code != errc::partial_content)
 		ec = make_error_code(static_cast<errc::errc_t>(m_status_code));
 
-	// 解析是否启用了gz压缩.
-	std::string opt_str = m_response_opts.find(http_options::content_encoding);
-#ifdef AVHTTP_ENABLE_ZLIB
-	if (opt_str == "gzip" || opt_str == "x-gzip")
+	// 根据Content-Encoding准备解码器.
+	boost::system::error_code decoder_ec;
+	setup_content_decoder(decoder_ec);
+	if (decoder_ec)
+	{
+		handler(decoder_ec);
+		return;
+	}
+
+	// 回调通知.
+	handler(ec);
+}
+
+template <typename Handler>
+void http_stream::handle_redirect_drain(Handler handler, const url &new_url, std::size_t drained,
+	bool final_crlf, const boost::system::error_code &ec, std::size_t bytes_transferred)
+{
+	drained += bytes_transferred;
+
+	// 超时的错误直接返回给用户.
+	if (ec && m_timed_out)
+	{
+		m_redirects = 0;
+		handler(ec);
+		return;
+	}
+
+	if (!ec)
 	{
-		m_is_gzip = true;
-		if (!m_stream.zalloc)
+		// body读完时返回0, chunked的body在读到最后一个块时返回0, 还需要再读一次跳过结尾的CRLF.
+		if (bytes_transferred == 0 && (!m_is_chunked || final_crlf))
 		{
-			if (inflateInit2(&m_stream, 32+15 ) != Z_OK)	// 初始化ZLIB库, 每次解压每个chunked的时候, 不需要重新初始化.
-			{
-				ec = boost::asio::error::operation_not_supported;
-				LOG_ERROR("Init zlib invalid, error message: \'" << ec.message() << "\'");
-				handler(ec);
-				return;
-			}
+			begin_redirect_in_place(new_url);
+			async_request(m_request_opts_priv, handler);
+			return;
+		}
+		if (bytes_transferred == 0)
+			final_crlf = true;
+
+		if (drained <= AVHTTP_REDIRECT_DRAIN_LIMIT)
+		{
+			async_read_some_body(boost::asio::buffer(m_drain_buffer),
+				detail::make_context_handler(boost::bind(&http_stream::handle_redirect_drain<Handler>,
+					this, handler, new_url, drained, final_crlf,
+					boost::asio::placeholders::error,
+					boost::asio::placeholders::bytes_transferred
+				), handler)
+			);
+			return;
 		}
 	}
-#endif
-	// 是否启用了chunked.
-	opt_str = m_response_opts.find(http_options::transfer_encoding);
-	if (opt_str == "chunked")
-		m_is_chunked = true;
-	// 是否在请求完成后关闭socket.
-	opt_str = m_request_opts.find(http_options::connection);
-	if (opt_str == "close")
-		m_keep_alive = false;
-	opt_str = m_response_opts.find(http_options::connection);
-	if (opt_str == "close")
-		m_keep_alive = false;
 
-	// 回调通知.
-	handler(ec);
+	// 读取出错或body太长, 关闭连接后重新连接.
+	boost::system::error_code ignore_ec;
+	m_sock.close(ignore_ec);
+	async_open(new_url, handler);
 }
 
 template <typename MutableBufferSequence, typename Handler>
@@ -1620,104 +3781,24 @@ void http_stream::handle_read(const MutableBufferSequence &buffers, Handler hand
 	const boost::system::error_code &ec, std::size_t bytes_transferred)
 {
 	boost::system::error_code err;
-	if (!ec || m_response.size() > 0
-#ifdef AVHTTP_ENABLE_ZLIB
-		|| (m_is_gzip && m_stream.avail_in > 0)	// 启用了压缩并未解压完缓冲区中的数据.
-#endif
-		)
+	if (!ec || m_response.size() > 0)
 	{
 		// 提交缓冲.
 		m_response.commit(bytes_transferred);
 
-#ifdef AVHTTP_ENABLE_ZLIB
-		if (!m_is_gzip)	// 如果没有启用gzip, 则直接读取数据后返回.
-#endif
+		if (bytes_transferred <= 0 && m_response.size() == 0)
 		{
-			if (bytes_transferred <= 0 && m_response.size() == 0)
-			{
-				handler(ec, bytes_transferred);
-				return;
-			}
-			else
-			{
-				bytes_transferred = read_some_impl(buffers, err);	// 这里其实都是从m_response中读取数据.
-				BOOST_ASSERT(!err);
-				m_body_size += bytes_transferred;					// 统计读取body的字节数.
-				handler(ec, bytes_transferred);
-				return;
-			}
+			handler(ec, bytes_transferred);
+			return;
 		}
-#ifdef AVHTTP_ENABLE_ZLIB
-		else					// 否则读取数据到解压缓冲中.
+		else
 		{
-			if (m_stream.avail_in == 0)
-			{
-				if (bytes_transferred <= 0 && m_response.size() == 0)
-				{
-					handler(ec, bytes_transferred);
-					return;
-				}
-				else
-				{
-					bytes_transferred = read_some_impl(boost::asio::buffer(m_zlib_buffer, 1024), err);
-					m_body_size -= bytes_transferred;				// 统计读取body的字节数.
-					m_zlib_buffer_size = bytes_transferred;
-					m_stream.avail_in = (uInt)m_zlib_buffer_size;
-					m_stream.next_in = (z_const Bytef *)&m_zlib_buffer[0];
-				}
-			}
-
-			bytes_transferred = 0;
-			std::size_t buffer_size = 0;
-
-			{
-				typename MutableBufferSequence::const_iterator iter = buffers.begin();
-				typename MutableBufferSequence::const_iterator end = buffers.end();
-				// 计算得到用户buffer_size总大小.
-				for (; iter != end; ++iter)
-				{
-					boost::asio::mutable_buffer buffer(*iter);
-					m_stream.next_in = (z_const Bytef *)(&m_zlib_buffer[0] + m_zlib_buffer_size - m_stream.avail_in);
-					m_stream.avail_out = boost::asio::buffer_size(buffer);
-					if (m_stream.avail_out == 0)
-					{
-						break; // 如果用户提供的缓冲大小为0, 则直接返回.
-					}
-					buffer_size += m_stream.avail_out;
-					m_stream.next_out = boost::asio::buffer_cast<Bytef*>(buffer);
-					int ret = inflate(&m_stream, Z_SYNC_FLUSH);
-					if (ret < 0)
-					{
-						err = boost::asio::error::operation_not_supported;
-						// 解压发生错误, 通知用户并放弃处理.
-						handler(err, 0);
-						return;
-					}
-
-					bytes_transferred += (boost::asio::buffer_size(buffer) - m_stream.avail_out);
-					if (bytes_transferred != boost::asio::buffer_size(buffer))
-					{
-						break;
-					}
-				}
-			}
-
-			// 没有解压出东西, 说明压缩数据过少, 继续读取, 以保证能够解压.
-			if (buffer_size != 0 && bytes_transferred == 0)
-			{
-				async_read_some(buffers, handler);
-				return;
-			}
-
-			if (m_stream.avail_in == 0)
-			{
-				err = ec;	// FIXME!!!
-			}
-
-			handler(err, bytes_transferred);
+			bytes_transferred = read_some_impl(buffers, err);	// 这里其实都是从m_response中读取数据.
+			BOOST_ASSERT(!err);
+			m_body_size += bytes_transferred;					// 统计读取body的字节数.
+			handler(ec, bytes_transferred);
 			return;
 		}
-#endif
 	}
 	else
 	{
@@ -1727,8 +3808,7 @@ void http_stream::handle_read(const MutableBufferSequence &buffers, Handler hand
 
 template <typename MutableBufferSequence, typename Handler>
 void http_stream::handle_skip_crlf(const MutableBufferSequence &buffers,
-	Handler handler, boost::shared_array<char> crlf,
-	const boost::system::error_code &ec, std::size_t bytes_transferred)
+	Handler handler, const boost::system::error_code &ec, std::size_t bytes_transferred)
 {
 	if (!ec)
 	{
@@ -1742,10 +3822,10 @@ void http_stream::handle_skip_crlf(const MutableBufferSequence &buffers,
 		}
 
 		// 不是CRLF? 不知道是啥情况, 断言调试bug.
-		BOOST_ASSERT(crlf.get()[0] == '\r' && crlf.get()[1] == '\n');
+		BOOST_ASSERT(m_crlf[0] == '\r' && m_crlf[1] == '\n');
 
 		// 在release下, 不确定是不是服务器的回复错误, 暂时假设是服务器的回复错误!!!
-		if(crlf.get()[0] != '\r' || crlf.get()[1] != '\n')
+		if(m_crlf[0] != '\r' || m_crlf[1] != '\n')
 		{
 			boost::system::error_code err = errc::invalid_chunked_encoding;
 			handler(err, bytes_transferred);
@@ -1753,15 +3833,9 @@ void http_stream::handle_skip_crlf(const MutableBufferSequence &buffers,
 		}
 
 		// 跳过CRLF, 开始读取chunked size.
-		typedef boost::function<void (boost::system::error_code, std::size_t)> HandlerWrapper;
-		HandlerWrapper h(handler);
 		boost::asio::async_read_until(m_sock, m_response, "\r\n",
-			boost::bind(&http_stream::handle_chunked_size<MutableBufferSequence, HandlerWrapper>,
-				this, buffers, h,
-				boost::asio::placeholders::error,
-				boost::asio::placeholders::bytes_transferred
-			)
-		);
+			detail::make_read_op_handler(this, &http_stream::handle_chunked_size<MutableBufferSequence, Handler>,
+				buffers, handler));
 		return;
 	}
 	else
@@ -1781,79 +3855,10 @@ void http_stream::handle_async_read(const MutableBufferSequence &buffers,
 		// 提交缓冲.
 		m_response.commit(bytes_transferred);
 
-#ifdef AVHTTP_ENABLE_ZLIB
-		if (!m_is_gzip)	// 如果没有启用gzip, 则直接读取数据后返回.
-#endif
-		{
-			bytes_transferred = read_some_impl(boost::asio::buffer(buffers, m_chunked_size), err);
-			m_chunked_size -= bytes_transferred;
-			handler(err, bytes_transferred);
-			return;
-		}
-#ifdef AVHTTP_ENABLE_ZLIB
-		else					// 否则读取数据到解压缓冲中.
-		{
-			if (m_stream.avail_in == 0)
-			{
-				std::size_t buf_size = (std::min)(m_chunked_size, std::size_t(1024));
-				bytes_transferred = read_some_impl(boost::asio::buffer(m_zlib_buffer, buf_size), err);
-				m_chunked_size -= bytes_transferred;
-				m_zlib_buffer_size = bytes_transferred;
-				m_stream.avail_in = (uInt)m_zlib_buffer_size;
-				m_stream.next_in = (z_const Bytef *)&m_zlib_buffer[0];
-			}
-
-			bytes_transferred = 0;
-			std::size_t buffer_size = 0;
-
-			{
-				typename MutableBufferSequence::const_iterator iter = buffers.begin();
-				typename MutableBufferSequence::const_iterator end = buffers.end();
-				// 计算得到用户buffer_size总大小.
-				for (; iter != end; ++iter)
-				{
-					boost::asio::mutable_buffer buffer(*iter);
-					m_stream.next_in = (z_const Bytef *)(&m_zlib_buffer[0] + m_zlib_buffer_size - m_stream.avail_in);
-					m_stream.avail_out = boost::asio::buffer_size(buffer);
-					if (m_stream.avail_out == 0)
-					{
-						break; // 如果用户提供的缓冲大小为0, 则直接返回.
-					}
-					buffer_size += m_stream.avail_out;
-					m_stream.next_out = boost::asio::buffer_cast<Bytef*>(buffer);
-					int ret = inflate(&m_stream, Z_SYNC_FLUSH);
-					if (ret < 0)
-					{
-						err = boost::asio::error::operation_not_supported;
-						// 解压发生错误, 通知用户并放弃处理.
-						handler(err, 0);
-						return;
-					}
-
-					bytes_transferred += (boost::asio::buffer_size(buffer) - m_stream.avail_out);
-					if (bytes_transferred != boost::asio::buffer_size(buffer))
-					{
-						break;
-					}
-				}
-			}
-
-			// 如果用户缓冲区空间不为空, 但没解压出数据, 则继续发起异步读取数据, 以保证能正确返回数据给用户.
-			if (buffer_size != 0 && bytes_transferred == 0)
-			{
-				async_read_some(buffers, handler);
-				return;
-			}
-
-			if (m_chunked_size == 0 && m_stream.avail_in == 0)
-			{
-				err = ec;	// FIXME!!!
-			}
-
-			handler(err, bytes_transferred);
-			return;
-		}
-#endif
+		bytes_transferred = read_some_impl(boost::asio::buffer(buffers, m_chunked_size), err);
+		m_chunked_size -= bytes_transferred;
+		handler(err, bytes_transferred);
+		return;
 	}
 	else
 	{
@@ -1891,22 +3896,16 @@ void http_stream::handle_chunked_size(const MutableBufferSequence &buffers,
 		ss << std::hex << hex_chunked_size;
 		ss >> m_chunked_size;
 
-#ifdef AVHTTP_ENABLE_ZLIB
-		if (m_chunked_size == 0 && m_is_gzip)
-		{
-			if (m_stream.avail_in == 0)
-			{
-				boost::system::error_code err;
-				if (!m_keep_alive)
-					err = boost::asio::error::eof;
-				handler(err, 0);
-				return;
-			}
-		}
-#endif
 		// chunked_size不包括数据尾的crlf, 所以置数据尾的crlf为false状态.
 		m_skip_crlf = false;
 
+		// 需要解码时, 块中的数据读取到解码输入缓冲中再解码.
+		if (m_is_decoding && m_chunked_size != 0)
+		{
+			async_read_decode(buffers, handler, m_chunked_size);
+			return;
+		}
+
 		// 读取数据.
 		if (m_chunked_size != 0)	// 开始读取chunked中的数据, 如果是压缩, 则解压到用户接受缓冲.
 		{
@@ -1928,17 +3927,11 @@ void http_stream::handle_chunked_size(const MutableBufferSequence &buffers,
 				max_length = (std::min)(max_length, m_chunked_size);
 			}
 
-			// 读取数据到m_response, 如果有压缩, 需要在handle_async_read中解压.
+			// 读取数据到m_response, 在handle_async_read中复制到用户缓冲.
 			boost::asio::streambuf::mutable_buffers_type bufs = m_response.prepare(max_length);
-			typedef boost::function<void (boost::system::error_code, std::size_t)> HandlerWrapper;
-			HandlerWrapper h(handler);
 			m_sock.async_read_some(boost::asio::buffer(bufs),
-				boost::bind(&http_stream::handle_async_read<MutableBufferSequence, HandlerWrapper>,
-					this, buffers, h,
-					boost::asio::placeholders::error,
-					boost::asio::placeholders::bytes_transferred
-				)
-			);
+				detail::make_read_op_handler(this, &http_stream::handle_async_read<MutableBufferSequence, Handler>,
+					buffers, handler));
 			return;
 		}
 
@@ -1946,13 +3939,6 @@ void http_stream::handle_chunked_size(const MutableBufferSequence &buffers,
 		{
 			boost::system::error_code err;
 			m_is_chunked_end = true;
-#ifdef AVHTTP_ENABLE_ZLIB
-					if (m_stream.zalloc)
-					{
-						inflateEnd(&m_stream);
-						m_stream.zalloc = NULL;
-					}
-#endif
 			if (!m_keep_alive)
 				err = boost::asio::error::eof;
 			handler(err, 0);
@@ -1964,6 +3950,96 @@ void http_stream::handle_chunked_size(const MutableBufferSequence &buffers,
 	handler(ec, 0);
 }
 
+template <typename MutableBufferSequence, typename Handler>
+void http_stream::handle_decode(const MutableBufferSequence &buffers,
+	Handler handler, const boost::system::error_code &ec, std::size_t bytes_transferred)
+{
+	// 统计读取的body字节数.
+	if (m_is_chunked)
+		m_chunked_size -= bytes_transferred;
+	else
+		m_body_size += bytes_transferred;
+	commit_decode_buffer(bytes_transferred);
+
+	if (!decode_pending())
+	{
+		handler(ec, 0);
+		return;
+	}
+
+	boost::system::error_code err;
+	bytes_transferred = decode_some(buffers, err);
+	if (err)
+	{
+		// 解码发生错误, 通知用户并放弃处理.
+		handler(err, 0);
+		return;
+	}
+
+	// 用户缓冲区空间不为空, 但没有解码出数据, 说明输入数据不足, 继续读取.
+	if (boost::asio::buffer_size(buffers) != 0 && bytes_transferred == 0 && !ec)
+	{
+		async_read_some_body(buffers, handler);
+		return;
+	}
+
+	// 输入数据全部解码后才报告读取时的错误(如eof).
+	if (!decode_pending())
+		err = ec;
+
+	handler(err, bytes_transferred);
+}
+
+template <typename Handler>
+void http_stream::handle_write_body(Handler handler, const boost::system::error_code &ec)
+{
+	if (ec)
+	{
+		handler(ec);
+		return;
+	}
+
+	// body已经全部发送.
+	if (commit_body_buffers())
+	{
+		handler(ec);
+		return;
+	}
+
+	async_write_body_impl(handler);
+}
+
+template <typename Handler>
+void http_stream::handle_sendfile(Handler handler, const boost::system::error_code &ec)
+{
+	if (ec)
+	{
+		handler(ec);
+		return;
+	}
+
+	boost::system::error_code err;
+	while (m_body_written != m_writing_body.size())
+	{
+		sendfile_some(err);
+		// socket缓冲已满, 等待可写时继续发送.
+		if (err == boost::asio::error::would_block)
+		{
+			m_sock.get<nossl_socket>()->async_write_some(boost::asio::null_buffers(),
+				detail::make_context_handler(boost::bind(&http_stream::handle_sendfile<Handler>,
+					this, handler,
+					boost::asio::placeholders::error
+				), handler)
+			);
+			return;
+		}
+		if (err)
+			break;
+	}
+
+	handler(err);
+}
+
 template <typename Stream>
 void http_stream::socks_proxy_connect(Stream &sock, boost::system::error_code &ec)
 {
@@ -1982,22 +4058,24 @@ void http_stream::socks_proxy_connect(Stream &sock, boost::system::error_code &e
 
 	if (ec)	// 解析域名出错, 直接返回相关错误信息.
 	{
-		LOG_ERROR("Resolve DNS error \'" << s.hostname <<
+		LOG_ERROR_CAT(log_resolve, "Resolve DNS error \'" << s.hostname <<
 			"\', error message \'" << ec.message() << "\'");
 		return ;
 	}
+	m_timing.resolved = http_timing::now();
 
 	// 尝试连接解析出来的服务器地址.
 	ec = boost::asio::error::host_not_found;
 	while (ec && endpoint_iterator != end)
 	{
 		sock.close(ec);
-		sock.connect(*endpoint_iterator++, ec);
+		connect_socket(sock.lowest_layer(), *endpoint_iterator++, ec);
 	}
 	if (ec)
 	{
 		return;
 	}
+	m_timing.connected = http_timing::now();
 
 	if (s.type == proxy_settings::socks5 || s.type == proxy_settings::socks5_pw)
 	{
@@ -2155,7 +4233,7 @@ void http_stream::socks_proxy_handshake(Stream &sock, boost::system::error_code
 		tcp::resolver::iterator endpoint_iterator = resolver.resolve(query, ec);
 		if (ec)	// 解析域名出错, 直接返回相关错误信息.
 		{
-			LOG_ERROR("Resolve DNS error \'" << host <<
+			LOG_ERROR_CAT(log_resolve, "Resolve DNS error \'" << host <<
 				"\', error message \'" << ec.message() << "\'");
 			return;
 		}
@@ -2310,14 +4388,14 @@ void http_stream::async_socks_proxy_connect(Stream &sock, Handler handler)
 	m_proxy_status = socks_proxy_resolve;
 
 	// 开始异步解析代理的端口和主机名.
-	typedef boost::function<void (boost::system::error_code)> HandlerWrapper;
+	typedef detail::erased_handler HandlerWrapper;
 	m_resolver.async_resolve(query,
-		boost::bind(&http_stream::async_socks_proxy_resolve<Stream, HandlerWrapper>,
+		detail::make_context_handler(boost::bind(&http_stream::async_socks_proxy_resolve<Stream, HandlerWrapper>,
 			this,
 			boost::asio::placeholders::error,
 			boost::asio::placeholders::iterator,
 			boost::ref(sock), HandlerWrapper(handler)
-		)
+		), handler)
 	);
 }
 
@@ -2328,7 +4406,7 @@ void http_stream::async_socks_proxy_resolve(const boost::system::error_code &err
 {
 	if (err)
 	{
-		LOG_ERROR("Resolve socks server error, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+		LOG_ERROR_CAT(log_resolve, "Resolve socks server error, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 			"\', error message \'" << err.message() << "\'");
 		handler(err);
 		return;
@@ -2336,13 +4414,14 @@ void http_stream::async_socks_proxy_resolve(const boost::system::error_code &err
 
 	if (m_proxy_status == socks_proxy_resolve)
 	{
+		m_timing.resolved = http_timing::now();
 		m_proxy_status = socks_connect_proxy;
 		// 开始异步连接代理.
 		boost::asio::async_connect(sock.lowest_layer(), endpoint_iterator,
-			boost::bind(&http_stream::handle_connect_socks<Stream, Handler>,
+			detail::make_context_handler(boost::bind(&http_stream::handle_connect_socks<Stream, Handler>,
 				this, boost::ref(sock), handler,
 				endpoint_iterator, boost::asio::placeholders::error
-			)
+			), handler)
 		);
 
 		return;
@@ -2368,9 +4447,9 @@ void http_stream::handle_connect_socks(Stream &sock, Handler handler,
 	if (err)
 	{
 		tcp::resolver::iterator end;
-		if (endpoint_iterator == end)
+		if (endpoint_iterator == end || m_timed_out)
 		{
-			LOG_ERROR("Connect to socks proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+			LOG_ERROR_CAT(log_proxy, "Connect to socks proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 				"\', error message \'" << err.message() << "\'");
 			handler(err);
 			return;
@@ -2379,15 +4458,17 @@ void http_stream::handle_connect_socks(Stream &sock, Handler handler,
 		// 继续尝试连接下一个IP.
 		endpoint_iterator++;
 		boost::asio::async_connect(sock.lowest_layer(), endpoint_iterator,
-			boost::bind(&http_stream::handle_connect_socks<Stream, Handler>,
+			detail::make_context_handler(boost::bind(&http_stream::handle_connect_socks<Stream, Handler>,
 				this, boost::ref(sock), handler,
 				endpoint_iterator, boost::asio::placeholders::error
-			)
+			), handler)
 		);
 
 		return;
 	}
 
+	m_timing.connected = http_timing::now();
+
 	// 连接成功, 发送协议版本号.
 	if (m_proxy.type == proxy_settings::socks5 || m_proxy.type == proxy_settings::socks5_pw)
 	{
@@ -2414,13 +4495,13 @@ void http_stream::handle_connect_socks(Stream &sock, Handler handler,
 
 		m_request.commit(bytes_to_write);
 
-		typedef boost::function<void (boost::system::error_code)> HandlerWrapper;
+		typedef detail::erased_handler HandlerWrapper;
 		boost::asio::async_write(sock, m_request, boost::asio::transfer_exactly(bytes_to_write),
-			boost::bind(&http_stream::handle_socks_process<Stream, HandlerWrapper>,
+			detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, HandlerWrapper>,
 				this, boost::ref(sock), HandlerWrapper(handler),
 				boost::asio::placeholders::bytes_transferred,
 				boost::asio::placeholders::error
-			)
+			), handler)
 		);
 
 		return;
@@ -2437,13 +4518,13 @@ void http_stream::handle_connect_socks(Stream &sock, Handler handler,
 		tcp::resolver::query query(m_url.host(), port_string.str());
 
 		// 开始异步解析代理的端口和主机名.
-		typedef boost::function<void (boost::system::error_code)> HandlerWrapper;
+		typedef detail::erased_handler HandlerWrapper;
 		m_resolver.async_resolve(query,
-			boost::bind(&http_stream::async_socks_proxy_resolve<Stream, HandlerWrapper>,
+			detail::make_context_handler(boost::bind(&http_stream::async_socks_proxy_resolve<Stream, HandlerWrapper>,
 				this,
 				boost::asio::placeholders::error, boost::asio::placeholders::iterator,
 				boost::ref(sock), HandlerWrapper(handler)
-			)
+			), handler)
 		);
 	}
 }
@@ -2456,7 +4537,7 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 
 	if (err)
 	{
-		LOG_ERROR("Socks proxy process error, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+		LOG_ERROR_CAT(log_proxy, "Socks proxy process error, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 			"\', error message \'" << err.message() << "\'");
 		handler(err);
 		return;
@@ -2480,11 +4561,11 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 
 				m_response.consume(m_response.size());
 				boost::asio::async_read(sock, m_response, boost::asio::transfer_exactly(bytes_to_read),
-					boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
+					detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
 						this, boost::ref(sock), handler,
 						boost::asio::placeholders::bytes_transferred,
 						boost::asio::placeholders::error
-					)
+					), handler)
 				);
 
 				return;
@@ -2497,11 +4578,11 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 				// 读取版本信息.
 				m_response.consume(m_response.size());
 				boost::asio::async_read(sock, m_response, boost::asio::transfer_exactly(2),
-					boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
+					detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
 						this, boost::ref(sock), handler,
 						boost::asio::placeholders::bytes_transferred,
 						boost::asio::placeholders::error
-					)
+					), handler)
 				);
 
 				return;
@@ -2537,10 +4618,10 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			m_request.commit(bytes_to_write);
 
 			boost::asio::async_write(sock, m_request, boost::asio::transfer_exactly(bytes_to_write),
-				boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
+				detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
 					this, boost::ref(sock), handler,
 					boost::asio::placeholders::bytes_transferred, boost::asio::placeholders::error
-				)
+				), handler)
 			);
 
 			return;
@@ -2552,11 +4633,11 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			// 读取认证状态.
 			m_response.consume(m_response.size());
 			boost::asio::async_read(sock, m_response, boost::asio::transfer_exactly(2),
-				boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
+				detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
 					this, boost::ref(sock), handler,
 					boost::asio::placeholders::bytes_transferred,
 					boost::asio::placeholders::error
-				)
+				), handler)
 			);
 			return;
 		}
@@ -2583,10 +4664,10 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			write_uint16(m_url.port(), wp);				// port.
 			m_request.commit(bytes_to_write);
 			boost::asio::async_write(sock, m_request, boost::asio::transfer_exactly(bytes_to_write),
-				boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
+				detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
 					this, boost::ref(sock), handler,
 					boost::asio::placeholders::bytes_transferred, boost::asio::placeholders::error
-				)
+				), handler)
 			);
 
 			return;
@@ -2598,11 +4679,11 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			std::size_t bytes_to_read = 10;
 			m_response.consume(m_response.size());
 			boost::asio::async_read(sock, m_response, boost::asio::transfer_exactly(bytes_to_read),
-				boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
+				detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
 					this, boost::ref(sock), handler,
 					boost::asio::placeholders::bytes_transferred,
 					boost::asio::placeholders::error
-				)
+				), handler)
 			);
 		}
 		break;
@@ -2621,19 +4702,23 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			if (response == 90)	// access granted.
 			{
 				m_response.consume(m_response.size());	// 没有发生错误, 开始异步发送请求.
+				m_timing.proxy_connected = http_timing::now();
 
 #ifdef AVHTTP_ENABLE_OPENSSL
 				if (m_protocol == "https")
 				{
-					LOG_DEBUG("Connect to socks proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
+					LOG_DEBUG_CAT(log_proxy, "Connect to socks proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
 
 					// 开始握手.
 					m_proxy_status = ssl_handshake;
+					// ssl握手的超时.
+					set_deadline(m_timeouts.handshake_timeout);
+					arm_deadline();
 					ssl_socket* ssl_sock = m_sock.get<ssl_socket>();
-					ssl_sock->async_handshake(boost::bind(&http_stream::handle_socks_process<Stream, Handler>, this,
+					ssl_sock->async_handshake(detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, Handler>, this,
 						boost::ref(sock), handler,
 						0,
-						boost::asio::placeholders::error));
+						boost::asio::placeholders::error), handler));
 					return;
 				}
 				else
@@ -2651,7 +4736,7 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 				case 93: ec = errc::socks_identd_error; break;
 				}
 
-				LOG_ERROR("Socks4 proxy process error, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+				LOG_ERROR_CAT(log_proxy, "Socks4 proxy process error, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 					"\', error message \'" << ec.message() << "\'");
 				handler(ec);
 				return;
@@ -2661,8 +4746,9 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 #ifdef AVHTTP_ENABLE_OPENSSL
 	case ssl_handshake:
 		{
-			LOG_DEBUG("Handshake to \'" << m_url.host() <<
+			LOG_DEBUG_CAT(log_tls, "Handshake to \'" << m_url.host() <<
 				"\', error message \'" << err.message() << "\'");
+			m_timing.tls_handshaked = http_timing::now();
 
 			async_request(m_request_opts_priv, handler);
 		}
@@ -2677,7 +4763,7 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			if (version != 5)	// 版本不等于5, 不支持socks5.
 			{
 				boost::system::error_code ec = errc::socks_unsupported_version;
-				LOG_ERROR("Socks5 response version, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+				LOG_ERROR_CAT(log_proxy, "Socks5 response version, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 					"\', error message \'" << ec.message() << "\'");
 				handler(ec);
 				return;
@@ -2690,7 +4776,7 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 				if (s.username.empty())
 				{
 					boost::system::error_code ec = errc::socks_username_required;
-					LOG_ERROR("Socks5 response version, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+					LOG_ERROR_CAT(log_proxy, "Socks5 response version, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 						"\', error message \'" << ec.message() << "\'");
 					handler(ec);
 					return;
@@ -2713,10 +4799,10 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 
 				// 发送用户密码信息.
 				boost::asio::async_write(sock, m_request, boost::asio::transfer_exactly(bytes_to_write),
-					boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
+					detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
 						this, boost::ref(sock), handler,
 						boost::asio::placeholders::bytes_transferred, boost::asio::placeholders::error
-					)
+					), handler)
 				);
 
 				return;
@@ -2725,7 +4811,7 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			if (method == 0)
 			{
 				m_proxy_status = socks5_connect_request;
-				LOG_DEBUG("Socks5 response version, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+				LOG_DEBUG_CAT(log_proxy, "Socks5 response version, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 					"\', error message \'" << err.message() << "\'");
 				handle_socks_process(sock, handler, 0, err);
 				return;
@@ -2743,7 +4829,7 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			if (version != 1)	// 不支持的版本.
 			{
 				boost::system::error_code ec = errc::socks_unsupported_authentication_version;
-				LOG_ERROR("Socks5 auth status, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+				LOG_ERROR_CAT(log_proxy, "Socks5 auth status, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 					"\', error message \'" << ec.message() << "\'");
 				handler(ec);
 				return;
@@ -2752,7 +4838,7 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			if (status != 0)	// 认证错误.
 			{
 				boost::system::error_code ec = errc::socks_authentication_error;
-				LOG_ERROR("Socks5 auth status, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+				LOG_ERROR_CAT(log_proxy, "Socks5 auth status, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 					"\', error message \'" << ec.message() << "\'");
 				handler(ec);
 				return;
@@ -2774,7 +4860,7 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			if (version != 5)
 			{
 				boost::system::error_code ec = errc::socks_general_failure;
-				LOG_ERROR("Socks5 result, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+				LOG_ERROR_CAT(log_proxy, "Socks5 result, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 					"\', error message \'" << ec.message() << "\'");
 				handler(ec);
 				return;
@@ -2794,7 +4880,7 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 				case 7: ec = errc::socks_command_not_supported; break;
 				case 8: ec = boost::asio::error::address_family_not_supported; break;
 				}
-				LOG_ERROR("Socks5 result, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+				LOG_ERROR_CAT(log_proxy, "Socks5 result, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 					"\', error message \'" << ec.message() << "\'");
 				handler(ec);
 				return;
@@ -2806,23 +4892,27 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			if (atyp == 1)		// address / port 形式返回.
 			{
 				m_response.consume(m_response.size());
+				m_timing.proxy_connected = http_timing::now();
 
 #ifdef AVHTTP_ENABLE_OPENSSL
 				if (m_protocol == "https")
 				{
 					// 开始握手.
 					m_proxy_status = ssl_handshake;
+					// ssl握手的超时.
+					set_deadline(m_timeouts.handshake_timeout);
+					arm_deadline();
 					ssl_socket* ssl_sock = m_sock.get<ssl_socket>();
-					ssl_sock->async_handshake(boost::bind(&http_stream::handle_socks_process<Stream, Handler>, this,
+					ssl_sock->async_handshake(detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, Handler>, this,
 						boost::ref(sock), handler,
 						0,
-						boost::asio::placeholders::error));
+						boost::asio::placeholders::error), handler));
 					return;
 				}
 				else
 #endif
 				{
-					LOG_DEBUG("Connect to socks5 proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
+					LOG_DEBUG_CAT(log_proxy, "Connect to socks5 proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
 					// 没有发生错误, 开始异步发送请求.
 					async_request(m_request_opts_priv, handler);
 					return;
@@ -2837,11 +4927,11 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 
 				m_response.consume(m_response.size());
 				boost::asio::async_read(sock, m_response, boost::asio::transfer_exactly(bytes_to_read),
-					boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
+					detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, Handler>,
 						this, boost::ref(sock), handler,
 						boost::asio::placeholders::bytes_transferred,
 						boost::asio::placeholders::error
-					)
+					), handler)
 				);
 
 				return;
@@ -2854,7 +4944,7 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 			else
 			{
 				boost::system::error_code ec = boost::asio::error::address_family_not_supported;
-				LOG_ERROR("Socks5 result, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+				LOG_ERROR_CAT(log_proxy, "Socks5 result, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 					"\', error message \'" << ec.message() << "\'");
 				handler(ec);
 				return;
@@ -2864,24 +4954,28 @@ void http_stream::handle_socks_process(Stream &sock, Handler handler,
 	case socks5_read_domainname:
 		{
 			m_response.consume(m_response.size());
+			m_timing.proxy_connected = http_timing::now();
 
 #ifdef AVHTTP_ENABLE_OPENSSL
 			if (m_protocol == "https")
 			{
-				LOG_DEBUG("Connect to socks5 proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
+				LOG_DEBUG_CAT(log_proxy, "Connect to socks5 proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
 				// 开始握手.
 				m_proxy_status = ssl_handshake;
+				// ssl握手的超时.
+				set_deadline(m_timeouts.handshake_timeout);
+				arm_deadline();
 				ssl_socket *ssl_sock = m_sock.get<ssl_socket>();
-				ssl_sock->async_handshake(boost::bind(&http_stream::handle_socks_process<Stream, Handler>, this,
+				ssl_sock->async_handshake(detail::make_context_handler(boost::bind(&http_stream::handle_socks_process<Stream, Handler>, this,
 					boost::ref(sock), handler,
 					0,
-					boost::asio::placeholders::error));
+					boost::asio::placeholders::error), handler));
 				return;
 			}
 			else
 #endif
 			{
-				LOG_DEBUG("Connect to socks5 proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
+				LOG_DEBUG_CAT(log_proxy, "Connect to socks5 proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
 				// 没有发生错误, 开始异步发送请求.
 				async_request(m_request_opts_priv, handler);
 			}
@@ -2905,14 +4999,14 @@ void http_stream::async_https_proxy_connect(Stream &sock, Handler handler)
 	tcp::resolver::query query(m_proxy.hostname, port_string.str());
 
 	// 开始异步解析代理的端口和主机名.
-	typedef boost::function<void (boost::system::error_code)> HandlerWrapper;
+	typedef detail::erased_handler HandlerWrapper;
 	m_resolver.async_resolve(query,
-		boost::bind(&http_stream::async_https_proxy_resolve<Stream, HandlerWrapper>,
+		detail::make_context_handler(boost::bind(&http_stream::async_https_proxy_resolve<Stream, HandlerWrapper>,
 			this, boost::asio::placeholders::error,
 			boost::asio::placeholders::iterator,
 			boost::ref(sock),
 			HandlerWrapper(handler)
-		)
+		), handler)
 	);
 }
 
@@ -2922,17 +5016,19 @@ void http_stream::async_https_proxy_resolve(const boost::system::error_code &err
 {
 	if (err)
 	{
-		LOG_ERROR("Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
+		LOG_ERROR_CAT(log_proxy, "Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
 			"\', error message \'" << err.message() << "\'");
 		handler(err);
 		return;
 	}
+	m_timing.resolved = http_timing::now();
+
 	// 开始异步连接代理.
 	boost::asio::async_connect(sock.lowest_layer(), endpoint_iterator,
-		boost::bind(&http_stream::handle_connect_https_proxy<Stream, Handler>,
+		detail::make_context_handler(boost::bind(&http_stream::handle_connect_https_proxy<Stream, Handler>,
 			this, boost::ref(sock), handler,
 			endpoint_iterator, boost::asio::placeholders::error
-		)
+		), handler)
 	);
 	return;
 }
@@ -2944,9 +5040,9 @@ void http_stream::handle_connect_https_proxy(Stream &sock, Handler handler,
 	if (err)
 	{
 		tcp::resolver::iterator end;
-		if (endpoint_iterator == end)
+		if (endpoint_iterator == end || m_timed_out)
 		{
-			LOG_ERROR("Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
+			LOG_ERROR_CAT(log_proxy, "Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
 				"\', error message \'" << err.message() << "\'");
 			handler(err);
 			return;
@@ -2955,14 +5051,15 @@ void http_stream::handle_connect_https_proxy(Stream &sock, Handler handler,
 		// 继续尝试连接下一个IP.
 		endpoint_iterator++;
 		boost::asio::async_connect(sock.lowest_layer(), endpoint_iterator,
-			boost::bind(&http_stream::handle_connect_https_proxy<Stream, Handler>,
+			detail::make_context_handler(boost::bind(&http_stream::handle_connect_https_proxy<Stream, Handler>,
 				this, boost::ref(sock), handler,
 				endpoint_iterator, boost::asio::placeholders::error
-			)
+			), handler)
 		);
 
 		return;
 	}
+	m_timing.connected = http_timing::now();
 
 	// 发起CONNECT请求.
 	request_opts opts = m_request_opts;
@@ -3022,18 +5119,18 @@ void http_stream::handle_connect_https_proxy(Stream &sock, Handler handler,
 		int request_size = m_request.size();
 		boost::asio::streambuf::const_buffers_type::const_iterator begin(m_request.data().begin());
 		const char* ptr = boost::asio::buffer_cast<const char*>(*begin);
-		LOG_DEBUG("Http proxy request Header:\n" << std::string(ptr, request_size));
+		LOG_DEBUG_CAT(log_proxy, "Http proxy request Header:\n" << std::string(ptr, request_size));
 	}
 #endif
 
 	// 异步发送请求.
-	typedef boost::function<void (boost::system::error_code)> HandlerWrapper;
+	typedef detail::erased_handler HandlerWrapper;
 	boost::asio::async_write(sock, m_request, boost::asio::transfer_exactly(m_request.size()),
-		boost::bind(&http_stream::handle_https_proxy_request<Stream, HandlerWrapper>,
+		detail::make_context_handler(boost::bind(&http_stream::handle_https_proxy_request<Stream, HandlerWrapper>,
 			this,
 			boost::ref(sock), HandlerWrapper(handler),
 			boost::asio::placeholders::error
-		)
+		), handler)
 	);
 }
 
@@ -3044,7 +5141,7 @@ void http_stream::handle_https_proxy_request(Stream &sock, Handler handler,
 	// 发生错误.
 	if (err)
 	{
-		LOG_ERROR("Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
+		LOG_ERROR_CAT(log_proxy, "Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port <<
 			"\', error message \'" << err.message() << "\'");
 		handler(err);
 		return;
@@ -3052,11 +5149,11 @@ void http_stream::handle_https_proxy_request(Stream &sock, Handler handler,
 
 	// 异步读取Http status.
 	boost::asio::async_read_until(sock, m_response, "\r\n",
-		boost::bind(&http_stream::handle_https_proxy_status<Stream, Handler>,
+		detail::make_context_handler(boost::bind(&http_stream::handle_https_proxy_status<Stream, Handler>,
 			this,
 			boost::ref(sock), handler,
 			boost::asio::placeholders::error
-		)
+		), handler)
 	);
 }
 
@@ -3067,7 +5164,7 @@ void http_stream::handle_https_proxy_status(Stream &sock, Handler handler,
 	// 发生错误.
 	if (err)
 	{
-		LOG_ERROR("Connect to http proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+		LOG_ERROR_CAT(log_proxy, "Connect to http proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 			"\', error message \'" << err.message() << "\'");
 		handler(err);
 		return;
@@ -3085,7 +5182,7 @@ void http_stream::handle_https_proxy_status(Stream &sock, Handler handler,
 		version_major, version_minor, m_status_code))
 	{
 		ec = errc::malformed_status_line;
-		LOG_ERROR("Connect to http proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+		LOG_ERROR_CAT(log_proxy, "Connect to http proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 			"\', error message \'" << ec.message() << "\'");
 		handler(ec);
 		return;
@@ -3095,11 +5192,11 @@ void http_stream::handle_https_proxy_status(Stream &sock, Handler handler,
 	if (m_status_code == errc::continue_request)
 	{
 		boost::asio::async_read_until(sock, m_response, "\r\n",
-			boost::bind(&http_stream::handle_https_proxy_status<Stream, Handler>,
+			detail::make_context_handler(boost::bind(&http_stream::handle_https_proxy_status<Stream, Handler>,
 				this,
 				boost::ref(sock), handler,
 				boost::asio::placeholders::error
-			)
+			), handler)
 		);
 	}
 	else
@@ -3112,12 +5209,12 @@ void http_stream::handle_https_proxy_status(Stream &sock, Handler handler,
 
 		// 异步读取所有Http header部分.
 		boost::asio::async_read_until(sock, m_response, "\r\n\r\n",
-			boost::bind(&http_stream::handle_https_proxy_header<Stream, Handler>,
+			detail::make_context_handler(boost::bind(&http_stream::handle_https_proxy_header<Stream, Handler>,
 				this,
 				boost::ref(sock), handler,
 				boost::asio::placeholders::bytes_transferred,
 				boost::asio::placeholders::error
-			)
+			), handler)
 		);
 	}
 }
@@ -3128,7 +5225,7 @@ void http_stream::handle_https_proxy_header(Stream &sock, Handler handler,
 {
 	if (err)
 	{
-		LOG_ERROR("Connect to http proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+		LOG_ERROR_CAT(log_proxy, "Connect to http proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 			"\', error message \'" << err.message() << "\'");
 		handler(err);
 		return;
@@ -3144,7 +5241,7 @@ void http_stream::handle_https_proxy_header(Stream &sock, Handler handler,
 		m_content_type, m_content_length, m_location, m_response_opts.option_all()))
 	{
 		ec = errc::malformed_response_headers;
-		LOG_ERROR("Connect to http proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+		LOG_ERROR_CAT(log_proxy, "Connect to http proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 			"\', error message \'" << ec.message() << "\'");
 		handler(ec);
 		return;
@@ -3153,24 +5250,28 @@ void http_stream::handle_https_proxy_header(Stream &sock, Handler handler,
 	if (m_status_code != errc::ok)
 	{
 		ec = make_error_code(static_cast<errc::errc_t>(m_status_code));
-		LOG_ERROR("Connect to http proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
+		LOG_ERROR_CAT(log_proxy, "Connect to http proxy, \'" << m_proxy.hostname << ":" << m_proxy.port <<
 			"\', error message \'" << ec.message() << "\'");
 		// 回调通知.
 		handler(ec);
 		return;
 	}
 
-	LOG_DEBUG("Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
+	LOG_DEBUG_CAT(log_proxy, "Connect to http proxy \'" << m_proxy.hostname << ":" << m_proxy.port << "\'.");
+	m_timing.proxy_connected = http_timing::now();
 
 	// 开始异步握手.
+	// ssl握手的超时.
+	set_deadline(m_timeouts.handshake_timeout);
+	arm_deadline();
 	ssl_socket *ssl_sock = m_sock.get<ssl_socket>();
 	ssl_sock->async_handshake(
-		boost::bind(&http_stream::handle_https_proxy_handshake<Stream, Handler>,
+		detail::make_context_handler(boost::bind(&http_stream::handle_https_proxy_handshake<Stream, Handler>,
 			this,
 			boost::ref(sock),
 			handler,
 			boost::asio::placeholders::error
-		)
+		), handler)
 	);
 	return;
 }
@@ -3181,14 +5282,15 @@ void http_stream::handle_https_proxy_handshake(Stream &sock, Handler handler,
 {
 	if (err)
 	{
-		LOG_ERROR("Handshake to \'" << m_url.host() <<
+		LOG_ERROR_CAT(log_tls, "Handshake to \'" << m_url.host() <<
 			"\', error message \'" << err.message() << "\'");
 		// 回调通知.
 		handler(err);
 		return;
 	}
 
-	LOG_DEBUG("Handshake to \'" << m_url.host() << "\'.");
+	LOG_DEBUG_CAT(log_tls, "Handshake to \'" << m_url.host() << "\'.");
+	m_timing.tls_handshaked = http_timing::now();
 
 	// 清空接收缓冲区.
 	m_response.consume(m_response.size());
@@ -3212,22 +5314,24 @@ void http_stream::https_proxy_connect(Stream &sock, boost::system::error_code &e
 
 	if (ec)	// 解析域名出错, 直接返回相关错误信息.
 	{
-		LOG_ERROR("Resolve DNS error \'" << m_proxy.hostname <<
+		LOG_ERROR_CAT(log_resolve, "Resolve DNS error \'" << m_proxy.hostname <<
 			"\', error message \'" << ec.message() << "\'");
 		return ;
 	}
+	m_timing.resolved = http_timing::now();
 
 	// 尝试连接解析出来的代理服务器地址.
 	ec = boost::asio::error::host_not_found;
 	while (ec && endpoint_iterator != end)
 	{
 		sock.close(ec);
-		sock.connect(*endpoint_iterator++, ec);
+		connect_socket(sock.lowest_layer(), *endpoint_iterator++, ec);
 	}
 	if (ec)
 	{
 		return;
 	}
+	m_timing.connected = http_timing::now();
 
 	// 发起CONNECT请求.
 	request_opts opts = m_request_opts;
@@ -3274,7 +5378,7 @@ void http_stream::https_proxy_connect(Stream &sock, boost::system::error_code &e
 	// 循环读取.
 	for (;;)
 	{
-		boost::asio::read_until(sock, m_response, "\r\n", ec);
+		read_until_deadline(sock, "\r\n", ec);
 		if (ec)
 		{
 			return;
@@ -3312,7 +5416,7 @@ void http_stream::https_proxy_connect(Stream &sock, boost::system::error_code &e
 
 	// 接收掉所有Http Header.
 	boost::system::error_code read_err;
-	std::size_t bytes_transferred = boost::asio::read_until(sock, m_response, "\r\n\r\n", read_err);
+	std::size_t bytes_transferred = read_until_deadline(sock, "\r\n\r\n", read_err);
 	if (read_err)
 	{
 		// 说明读到了结束还没有得到Http header, 返回错误的文件头信息而不返回eof.
@@ -3345,20 +5449,46 @@ void http_stream::https_proxy_connect(Stream &sock, boost::system::error_code &e
 template <typename Stream>
 void http_stream::request_impl(Stream &sock, request_opts &opt, boost::system::error_code &ec)
 {
+	// 服务器没有接收上一个请求的body, 连接不能再复用.
+	if (m_body_rejected)
+	{
+		sock.close(ec);
+		m_body_rejected = false;
+	}
+
 	// 判断socket是否打开.
 	if (!sock.is_open())
 	{
 		ec = boost::asio::error::network_reset;
-		LOG_ERROR("Socket is open, error message\'" << ec.message() << "\'");
+		LOG_ERROR_CAT(log_connect, "Socket is open, error message\'" << ec.message() << "\'");
 		return;
 	}
 
+	// 开始计时.
+	mark_request_start();
+
+	// 等待http头的超时.
+	set_deadline(m_timeouts.header_timeout);
+
+	// 新的响应不再从缓存读取.
+	stop_cache_body();
+
 	// 保存到一个新的opts中操作.
 	request_opts opts = opt;
-	// 清空.
+	// 跳转后改用GET请求, 不再发送body.
+	if (m_redirect_to_get)
+		strip_request_body(opts);
+	// 有过期的缓存响应时发出条件请求.
+	if (m_cache_entry)
+		add_cache_validators(opts);
+	// 清空, 在复用的连接上上一个响应的状态不再有效.
 	m_request_opts.clear();
 	m_is_chunked_end = false;
+	m_is_chunked = false;
+	m_skip_crlf = true;
+	m_is_decoding = false;
 	m_keep_alive = true;
+	m_content_length = -1;
 	m_body_size = 0;
 
 	// 得到url选项.
@@ -3397,6 +5527,9 @@ void http_stream::request_impl(Stream &sock, request_opts &opt, boost::system::e
 		opts.remove(http_options::accept);	// 删除处理过的选项.
 	m_request_opts.insert(http_options::accept, accept);
 
+	// 自动添加Accept-Encoding.
+	add_accept_encoding(opts);
+
 	// 添加user_agent.
 	std::string user_agent = AVHTTP_VERSION_MIME;
 	if (opts.find(http_options::user_agent, user_agent))
@@ -3437,11 +5570,8 @@ void http_stream::request_impl(Stream &sock, request_opts &opt, boost::system::e
 		m_request_opts.insert(http_options::connection, connection);
 	}
 
-	// 是否带有body选项.
-	std::string body;
-	if (opts.find(http_options::request_body, body))
-		opts.remove(http_options::request_body);	// 删除处理过的选项.
-	m_request_opts.insert(http_options::request_body, body);
+	// 准备发送的body, 得到Content-Length或Transfer-Encoding请求头.
+	std::string body_header = setup_request_body(opts);
 
 	// 循环构造其它选项.
 	std::string other_option_string;
@@ -3458,6 +5588,7 @@ void http_stream::request_impl(Stream &sock, request_opts &opt, boost::system::e
 		other_option_string += (val->first + ": " + val->second + "\r\n");
 		m_request_opts.insert(val->first, val->second);
 	}
+	other_option_string += body_header;
 
 	// 整合各选项到Http请求字符串中.
 	std::string request_string;
@@ -3495,37 +5626,53 @@ void http_stream::request_impl(Stream &sock, request_opts &opt, boost::system::e
 		request_stream << "Proxy-Authorization: " << auth << "\r\n";
 	}
 	request_stream << other_option_string << "\r\n";
-	if (!body.empty())
-	{
-		request_stream << body;
-	}
 
 #if defined(DEBUG) || defined(_DEBUG)
 	{
 		int request_size = m_request.size();
 		boost::asio::streambuf::const_buffers_type::const_iterator begin(m_request.data().begin());
 		const char* ptr = boost::asio::buffer_cast<const char*>(*begin);
-		LOG_DEBUG("Request Header:\n" << std::string(ptr, request_size));
+		LOG_DEBUG_CAT(log_connect, "Request Header:\n" << std::string(ptr, request_size));
 	}
 #endif
 
-	// 发送请求.
-	boost::asio::write(sock, m_request, ec);
+	// 发送请求头和body, 使用100-continue时只发送请求头.
+	if (m_continue_pending)
+		boost::asio::write(sock, m_request, ec);
+	else
+		write_body_impl(ec);
 	if (ec)
 	{
-		LOG_ERROR("Send request, error message: \'" << ec.message() <<"\'");
+		LOG_ERROR_CAT(log_connect, "Send request, error message: \'" << ec.message() <<"\'");
 		return;
 	}
+	m_timing.request_sent = http_timing::now();
+
+	// 超时前没有收到服务器的响应, 直接发送body.
+	if (m_continue_pending && !wait_continue(ec))
+	{
+		m_continue_pending = false;
+		if (!ec)
+			write_body_impl(ec);
+		if (ec)
+		{
+			LOG_ERROR_CAT(log_connect, "Send request body, error message: \'" << ec.message() <<"\'");
+			return;
+		}
+	}
 
 	// 循环读取.
 	for (;;)
 	{
-		boost::asio::read_until(sock, m_response, "\r\n", ec);
+		read_until_deadline(sock, "\r\n", ec);
 		if (ec)
 		{
-			LOG_ERROR("Read status line, error message: \'" << ec.message() <<"\'");
+			LOG_ERROR_CAT(log_parse, "Read status line, error message: \'" << ec.message() <<"\'");
 			return;
 		}
+		// 对于100 continue, 只记录第一个状态行的时间.
+		if (m_timing.status_received.is_not_a_date_time())
+			m_timing.status_received = http_timing::now();
 
 		// 复制到新的streambuf中处理首行http状态, 如果不是http状态行, 那么将保持m_response中的内容,
 		// 这主要是为了兼容非标准http服务器直接向客户端发送文件的需要, 但是依然需要以malformed_status_line
@@ -3548,10 +5695,35 @@ void http_stream::request_impl(Stream &sock, request_opts &opt, boost::system::e
 			version_major, version_minor, m_status_code))
 		{
 			ec = errc::malformed_status_line;
-			LOG_ERROR("Malformed status line");
+			LOG_ERROR_CAT(log_parse, "Malformed status line");
 			return;
 		}
 
+		// "continue"表示我们需要继续等待接收状态, 先读取完整的100 Continue响应.
+		if (m_status_code == errc::continue_request)
+		{
+			std::size_t bytes_transferred = read_until_deadline(sock, "\r\n\r\n", ec);
+			if (ec)
+			{
+				LOG_ERROR_CAT(log_parse, "Read continue response, error message: \'" << ec.message() <<"\'");
+				return;
+			}
+			m_response.consume(bytes_transferred);
+
+			// 服务器同意接收body.
+			if (m_continue_pending)
+			{
+				m_continue_pending = false;
+				write_body_impl(ec);
+				if (ec)
+				{
+					LOG_ERROR_CAT(log_connect, "Send request body, error message: \'" << ec.message() <<"\'");
+					return;
+				}
+			}
+			continue;
+		}
+
 		// 处理掉状态码所占用的字节数.
 		m_response.consume(response_size - tempbuf.size());
 
@@ -3563,12 +5735,17 @@ void http_stream::request_impl(Stream &sock, request_opts &opt, boost::system::e
 		{
 			ec = make_error_code(static_cast<errc::errc_t>(m_status_code));
 		}
-
-		// "continue"表示我们需要继续等待接收状态.
-		if (m_status_code != errc::continue_request)
-			break;
+		break;
 	} // end for.
 
+	// 服务器在发送body前返回了最终状态, 放弃发送body.
+	if (m_continue_pending)
+	{
+		m_continue_pending = false;
+		m_body_rejected = true;
+		LOG_WARNING_CAT(log_connect, "Request body rejected, status code: " << m_status_code);
+	}
+
 	// 清除原有的返回选项.
 	m_response_opts.clear();
 	// 添加状态码.
@@ -3576,7 +5753,7 @@ void http_stream::request_impl(Stream &sock, request_opts &opt, boost::system::e
 
 	// 接收掉所有Http Header.
 	boost::system::error_code read_err;
-	std::size_t bytes_transferred = boost::asio::read_until(sock, m_response, "\r\n\r\n", read_err);
+	std::size_t bytes_transferred = read_until_deadline(sock, "\r\n\r\n", read_err);
 	if (read_err)
 	{
 		// 说明读到了结束还没有得到Http header, 返回错误的文件头信息而不返回eof.
@@ -3584,45 +5761,38 @@ void http_stream::request_impl(Stream &sock, request_opts &opt, boost::system::e
 			ec = errc::malformed_response_headers;
 		else
 			ec = read_err;
-		LOG_ERROR("Header error, error message: \'" << ec.message() << "\'");
+		LOG_ERROR_CAT(log_parse, "Header error, error message: \'" << ec.message() << "\'");
 		return;
 	}
+	record_response_metrics();
 
 	std::string header_string;
 	header_string.resize(bytes_transferred);
 	m_response.sgetn(&header_string[0], bytes_transferred);
 
-	LOG_DEBUG("Status code: " << m_status_code);
-	LOG_DEBUG("Http header:\n" << header_string);
+	LOG_DEBUG_CAT(log_parse, "Status code: " << m_status_code);
+	LOG_DEBUG_CAT(log_parse, "Http header:\n" << header_string);
 
 	// 解析Http Header.
 	if (!detail::parse_http_headers(header_string.begin(), header_string.end(),
 		m_content_type, m_content_length, m_location, m_response_opts.option_all()))
 	{
 		ec = errc::malformed_response_headers;
-		LOG_ERROR("Parse header error, error message: \'" << ec.message() << "\'");
+		LOG_ERROR_CAT(log_parse, "Parse header error, error message: \'" << ec.message() << "\'");
 		return;
 	}
 
-	// 解析是否启用了gz压缩.
-	std::string opt_str = m_response_opts.find(http_options::content_encoding);
-#ifdef AVHTTP_ENABLE_ZLIB
-	if (opt_str == "gzip" || opt_str == "x-gzip")
+	// 根据Content-Encoding准备解码器, ec中可能已经保存了http状态码, 不能被覆盖.
+	boost::system::error_code decoder_ec;
+	setup_content_decoder(decoder_ec);
+	if (decoder_ec)
 	{
-		m_is_gzip = true;
-		if (!m_stream.zalloc)	// 初始化ZLIB库, 每次解压每个chunked的时候, 不需要重新初始化.
-		{
-			if (inflateInit2(&m_stream, 32+15 ) != Z_OK)
-			{
-				ec = boost::asio::error::operation_not_supported;
-				LOG_ERROR("Init zlib invalid, error message: \'" << ec.message() << "\'");
-				return;
-			}
-		}
+		ec = decoder_ec;
+		return;
 	}
-#endif
+
 	// 是否启用了chunked.
-	opt_str = m_response_opts.find(http_options::transfer_encoding);
+	std::string opt_str = m_response_opts.find(http_options::transfer_encoding);
 	if (opt_str == "chunked")
 		m_is_chunked = true;
 	// 是否在请求完成后关闭socket.
@@ -3631,12 +5801,15 @@ void http_stream::request_impl(Stream &sock, request_opts &opt, boost::system::e
 	opt_str = m_response_opts.find(http_options::connection);
 	if (opt_str == "close")
 		m_keep_alive = false;
+
+	// 304时从缓存读取, 或者开始保存可以缓存的响应.
+	handle_cache_response(ec);
 }
 
 std::streambuf::int_type http_stream::underflow()
 {
-	if (gptr() < egptr())	// 缓冲区未读完.
-	{
+	if (gptr() < egptr())	// 缓冲区未读完.
+	{
 		return traits_type::to_int_type(*gptr());
 	}
 	if (gptr() == egptr())	// 到了读取缓冲尾.
@@ -3672,9 +5845,9 @@ std::streambuf::int_type http_stream::underflow()
 			// 因为末尾有数据, 保存当前错误状态, 并不返回错误.
 			m_last_error = ec;
 		}
-
-		// 设置各缓冲指针.
-		setg(m_get_buffer.begin(), m_get_buffer.begin() + putback_max,
+
+		// 设置各缓冲指针.
+		setg(m_get_buffer.begin(), m_get_buffer.begin() + putback_max,
 			m_get_buffer.begin() + putback_max + bytes_transferred);
 
 		return traits_type::to_int_type(*gptr());
@@ -0,0 +1,306 @@
+//
+// io_service_pool.hpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __IO_SERVICE_POOL_HPP__
+#define __IO_SERVICE_POOL_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <vector>
+#include <algorithm>	// for std::max
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/thread.hpp>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "avhttp/detail/atomic.hpp"
+
+namespace avhttp {
+
+// io_service池, 每个io_service由一个线程运行(一般每个CPU核心一个).
+// 与在多个线程中运行同一个io_service相比, 各个io_service之间没有锁竞争, 连接的
+// 数据也只在一个核心的缓存中. multi_download使用io_service_pool构造时, 各个连接
+// 按分配策略分布到不同的io_service上.
+//
+// 以下是使用io_service_pool的示例:
+// @begin example
+//  avhttp::io_service_pool pool;	// 每个CPU核心一个io_service.
+//  pool.start();
+//  avhttp::multi_download d(pool);
+//  d.start("http://www.boost.org/LICENSE_1_0.txt");
+//  d.wait_for_complete();
+//  pool.stop();
+// @end example
+class io_service_pool : public boost::noncopyable
+{
+public:
+
+	// 为连接选择io_service的策略.
+	enum distribution_type
+	{
+		// 依次轮流选择.
+		round_robin,
+
+		// 选择当前连接数最少的.
+		least_loaded
+	};
+
+	// 一个连接对io_service的占用, 在销毁时释放占用, 用于按负载分配.
+	class shard : public boost::noncopyable
+	{
+	public:
+		shard(io_service_pool &pool, std::size_t index)
+			: m_pool(pool)
+			, m_index(index)
+		{}
+
+		~shard()
+		{
+			m_pool.release(m_index);
+		}
+
+		///返回分配到的io_service.
+		boost::asio::io_service& get_io_service() const
+		{
+			return m_pool.get_io_service(m_index);
+		}
+
+		///返回分配到的io_service在池中的序号.
+		std::size_t index() const
+		{
+			return m_index;
+		}
+
+	private:
+		io_service_pool &m_pool;
+		std::size_t m_index;
+	};
+	typedef boost::shared_ptr<shard> shard_ptr;
+
+public:
+
+	///构造io_service池.
+	// @param pool_size io_service的个数, 为0时使用CPU核心数.
+	// @param distribution为连接选择io_service的策略.
+	// @param pin_threads是否将第i个线程绑定到第i个CPU核心上, 只在linux和windows上有效.
+	AVHTTP_DECL explicit io_service_pool(std::size_t pool_size = 0,
+		distribution_type distribution = least_loaded, bool pin_threads = false)
+		: m_distribution(distribution)
+		, m_pin_threads(pin_threads)
+		, m_next(0)
+	{
+		if (pool_size == 0)
+		{
+			pool_size = (std::max)(boost::thread::hardware_concurrency(), 1u);
+		}
+
+		for (std::size_t i = 0; i < pool_size; i++)
+		{
+			io_service_ptr io(new boost::asio::io_service(1));
+			m_io_services.push_back(io);
+			m_loads.push_back(detail::atomic<int>(0));
+		}
+	}
+
+	AVHTTP_DECL ~io_service_pool()
+	{
+		stop();
+	}
+
+	///在后台线程中运行所有io_service, 直到调用stop.
+	AVHTTP_DECL void start()
+	{
+		if (m_threads.size() != 0)
+		{
+			return;
+		}
+
+		for (std::size_t i = 0; i < m_io_services.size(); i++)
+		{
+			m_io_services[i]->reset();
+			m_works.push_back(work_ptr(new boost::asio::io_service::work(*m_io_services[i])));
+		}
+
+		for (std::size_t i = 0; i < m_io_services.size(); i++)
+		{
+			m_threads.push_back(thread_ptr(new boost::thread(
+				boost::bind(&io_service_pool::worker, this, i))));
+		}
+	}
+
+	///运行所有io_service, 阻塞直到调用stop.
+	AVHTTP_DECL void run()
+	{
+		start();
+		join();
+	}
+
+	///停止所有io_service, 并等待线程退出, 未执行的handler将被丢弃.
+	// @备注: 不能在池中的线程里调用.
+	AVHTTP_DECL void stop()
+	{
+		m_works.clear();
+		for (std::size_t i = 0; i < m_io_services.size(); i++)
+		{
+			m_io_services[i]->stop();
+		}
+		join();
+	}
+
+	///等待所有线程退出.
+	AVHTTP_DECL void join()
+	{
+		for (std::size_t i = 0; i < m_threads.size(); i++)
+		{
+			m_threads[i]->join();
+		}
+		m_threads.clear();
+	}
+
+	///返回池中io_service的个数.
+	AVHTTP_DECL std::size_t size() const
+	{
+		return m_io_services.size();
+	}
+
+	///依次轮流返回一个io_service.
+	AVHTTP_DECL boost::asio::io_service& get_io_service()
+	{
+		return *m_io_services[next_index()];
+	}
+
+	///返回指定序号的io_service.
+	AVHTTP_DECL boost::asio::io_service& get_io_service(std::size_t index)
+	{
+		return *m_io_services[index];
+	}
+
+	///按分配策略为一个连接选择io_service, 返回的shard在销毁时释放占用.
+	// @备注: 负载计数使用原子操作, 可以在任意线程中调用.
+	AVHTTP_DECL shard_ptr acquire()
+	{
+		std::size_t index = 0;
+		if (m_distribution == round_robin)
+		{
+			index = next_index();
+		}
+		else
+		{
+			// 从轮流的位置开始查找, 负载相同时也能分散到各个io_service.
+			std::size_t start = next_index();
+			int min_load = m_loads[start];
+			index = start;
+			for (std::size_t i = 1; i < m_loads.size(); i++)
+			{
+				std::size_t n = (start + i) % m_loads.size();
+				int load = m_loads[n];
+				if (load < min_load)
+				{
+					min_load = load;
+					index = n;
+				}
+			}
+		}
+
+		m_loads[index]++;
+		return shard_ptr(new shard(*this, index));
+	}
+
+	///返回指定io_service上的连接数.
+	AVHTTP_DECL int load(std::size_t index) const
+	{
+		return m_loads[index];
+	}
+
+private:
+
+	void release(std::size_t index)
+	{
+		m_loads[index]--;
+	}
+
+	std::size_t next_index()
+	{
+		return static_cast<std::size_t>(m_next++) % m_io_services.size();
+	}
+
+	void worker(std::size_t index)
+	{
+		if (m_pin_threads)
+		{
+			pin_thread(index);
+		}
+
+		boost::system::error_code ignore;
+		m_io_services[index]->run(ignore);
+	}
+
+	// 将当前线程绑定到一个CPU核心上, 绑定失败时忽略.
+	void pin_thread(std::size_t index)
+	{
+		unsigned int cores = (std::max)(boost::thread::hardware_concurrency(), 1u);
+		unsigned int core = static_cast<unsigned int>(index % cores);
+#if defined(__linux__)
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(core, &cpuset);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+#elif defined(_WIN32)
+		if (core < sizeof(DWORD_PTR) * 8)
+		{
+			SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+		}
+#else
+		(void)core;
+#endif
+	}
+
+private:
+	typedef boost::shared_ptr<boost::asio::io_service> io_service_ptr;
+	typedef boost::shared_ptr<boost::asio::io_service::work> work_ptr;
+	typedef boost::shared_ptr<boost::thread> thread_ptr;
+
+	// 每个io_service上的连接数.
+	// 必须在m_io_services之前声明, io_service析构时未执行的handler中的shard仍会访问它.
+	std::vector<detail::atomic<int> > m_loads;
+
+	// 所有io_service.
+	std::vector<io_service_ptr> m_io_services;
+
+	// 保持io_service在没有任务时继续运行.
+	std::vector<work_ptr> m_works;
+
+	// 运行io_service的线程, 与m_io_services一一对应.
+	std::vector<thread_ptr> m_threads;
+
+	// 分配策略.
+	distribution_type m_distribution;
+
+	// 是否绑定线程到CPU核心.
+	bool m_pin_threads;
+
+	// 轮流分配的位置.
+	detail::atomic<unsigned int> m_next;
+};
+
+} // namespace avhttp
+
+#endif // __IO_SERVICE_POOL_HPP__
@@ -15,95 +15,393 @@
 # pragma once
 #endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
 
+#include <ctime>
+#include <cstdio>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <fstream>
 
+#include <boost/version.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+
+// 有boost.atomic(boost-1.53及以上)且启用线程时, 日志记录写入无锁环形缓冲区, 由后台线程
+// 负责格式化和输出; 否则在调用线程中加锁同步输出.
+#if !defined(AVHTTP_DISABLE_THREAD) && (BOOST_VERSION >= 105300)
+# define AVHTTP_ASYNC_LOGGER
+# include <boost/atomic.hpp>
+# include <boost/scoped_array.hpp>
+# include <boost/thread/thread.hpp>
+# include <boost/thread/condition_variable.hpp>
+#endif
+
+// 环形缓冲区可以容纳的日志记录数, 必须是2的幂. 缓冲区满时新的记录被丢弃并计数.
+#ifndef AVHTTP_LOG_RING_SIZE
+# define AVHTTP_LOG_RING_SIZE 8192
+#endif
 
 namespace avhttp {
 
 namespace fs = boost::filesystem;
 
-///内部使用的简易日志类.
+///内部使用的日志模块.
 // 使用说明:
 //	在程序入口(如:main)函数调用 INIT_LOGGER 宏, 它有两个参数, 第一个参数指定了日志文件保存
 //	的路径, 第二个参数指定了日志文件保存的文件名, 详细见INIT_LOGGER.
-//	然后就可以使用LOG_DEBUG/LOG_INFO/LOG_WARNING/LOG_ERROR这几个宏来输出日志信息.
+//	然后就可以使用LOG_DEBUG/LOG_INFO/LOG_WARNING/LOG_ERROR这几个宏来输出日志信息, 或者使用
+//	LOG_DEBUG_CAT等宏输出指定分类的日志.
+//	日志级别在运行时按分类过滤, 未启用的日志不会格式化消息, 所以可以在生产环境中保持开启.
+//	INIT_LOGGER之前所有日志都是关闭的, INIT_LOGGER之后调试版本默认输出debug及以上级别,
+//	发布版本默认输出info及以上级别, 可以用set_log_level修改.
+//	定义AVHTTP_DISABLE_LOGGING则所有日志宏在编译时被去掉.
 // @begin example
 //  #include "avhttp.hpp" // avhttp.hpp 已经包含 logging.hpp, 也可单独包含logging.hpp.
 //  int main()
 //  {
 //     INIT_LOGGER(".", "example.log");	// 在当前目录创建日志文件为example.log.
 //     // 也可 INIT_LOGGER("", ""); 空串为参数来禁止输出日志到文件, 仅输出到控制台.
+//     avhttp::set_log_level(avhttp::log_proxy, avhttp::log_debug);	// 只输出代理相关的调试信息.
 //     LOG_DEBUG("Initialized.");
 //     std::string result = do_something();
 //     LOG_DEBUG("do_something return : " << result);	// 输出do_something返回结果到日志.
 //     ...
-//     UNINIT_LOGGER();	// 卸载日志模块.
+//     UNINIT_LOGGER();	// 卸载日志模块, 输出缓冲区中剩余的日志.
 //  }
 // @end example
 
+///日志级别.
+enum log_level
+{
+	log_debug = 0,
+	log_info,
+	log_warning,
+	log_error,
+	// 用于关闭日志.
+	log_off,
+};
+
+///日志分类.
+enum log_category
+{
+	// 未分类.
+	log_general = 0,
+	// 域名解析.
+	log_resolve,
+	// 连接和收发请求.
+	log_connect,
+	// ssl握手和证书校验.
+	log_tls,
+	// socks/http代理.
+	log_proxy,
+	// 状态行和http头的解析.
+	log_parse,
+	// 文件存储和分片校验.
+	log_storage,
+	// 分类的个数.
+	log_category_num,
+};
+
+inline const char* log_level_name(log_level level)
+{
+	static const char* names[] = { "DEBUG", "INFO", "WARNING", "ERROR", "OFF" };
+	return names[level];
+}
+
+inline const char* log_category_name(log_category category)
+{
+	static const char* names[] = { "general", "resolve", "connect", "tls", "proxy", "parse", "storage" };
+	return names[category];
+}
+
+///一条日志记录.
+struct log_record
+{
+	log_record()
+		: time(0)
+		, level(log_debug)
+		, category(log_general)
+		, file(0)
+		, line(0)
+	{}
+
+	void swap(log_record &r)
+	{
+		std::swap(time, r.time);
+		std::swap(level, r.level);
+		std::swap(category, r.category);
+		std::swap(file, r.file);
+		std::swap(line, r.line);
+		message.swap(r.message);
+	}
+
+	// 产生日志的时间, 1970-01-01以来的UTC微秒数.
+	boost::int64_t time;
+
+	// 日志级别.
+	log_level level;
+
+	// 日志分类.
+	log_category category;
+
+	// 产生日志的源文件和行号.
+	const char* file;
+	int line;
+
+	// 日志消息.
+	std::string message;
+};
+
+// 日志处理函数, 在输出线程中调用.
+typedef boost::function<void (const log_record&)> log_handler;
+
+namespace aux {
+
+inline boost::posix_time::ptime log_epoch()
+{
+	return boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1));
+}
+
+inline boost::int64_t log_time_now()
+{
+	return (boost::posix_time::microsec_clock::universal_time() - log_epoch()).total_microseconds();
+}
+
+// 各分类当前的日志级别, 在模板中定义以便只有一份实例.
+template <class T = void>
+struct log_levels
+{
+	static volatile int levels[log_category_num];
+};
+
+template <class T>
+volatile int log_levels<T>::levels[log_category_num] =
+	{ log_off, log_off, log_off, log_off, log_off, log_off, log_off };
+
+} // namespace aux
+
+///检查指定级别和分类的日志是否启用.
+inline bool log_enabled(log_level level, log_category category)
+{
+	return level >= aux::log_levels<>::levels[category];
+}
+
+///设置一个分类的日志级别, 低于此级别的日志被忽略.
+inline void set_log_level(log_category category, log_level level)
+{
+	aux::log_levels<>::levels[category] = level;
+}
+
+///设置所有分类的日志级别.
+inline void set_log_level(log_level level)
+{
+	for (int i = 0; i < log_category_num; i++)
+		aux::log_levels<>::levels[i] = level;
+}
+
+///获得一个分类的日志级别.
+inline log_level get_log_level(log_category category)
+{
+	return static_cast<log_level>(aux::log_levels<>::levels[category]);
+}
+
+///格式化一条日志记录为一行文本.
+inline std::string format_log_record(const log_record &r)
+{
+	using namespace boost::posix_time;
+	ptime t = aux::log_epoch() + microseconds(r.time);
+	// c_local_adjustor使用线程安全的localtime_r/localtime_s.
+	t = boost::date_time::c_local_adjustor<ptime>::utc_to_local(t);
+	std::tm timeinfo = to_tm(t);
+	char str[200];
+	std::size_t n = std::strftime(str, sizeof(str), " %b %d %X", &timeinfo);
+	std::sprintf(str + n, ".%06d ", static_cast<int>(t.time_of_day().fractional_seconds()
+		* 1000000 / time_duration::ticks_per_second()));
+
+	std::string text(str);
+	text += "[";
+	text += log_level_name(r.level);
+	if (r.category != log_general)
+	{
+		text += "][";
+		text += log_category_name(r.category);
+	}
+	text += "]: ";
+	text += r.message;
+	text += "\n";
+	return text;
+}
+
+#ifdef AVHTTP_ASYNC_LOGGER
+
+namespace aux {
+
+// 多生产者单消费者的有界无锁环形缓冲区, 每个槽用序号标识其状态.
+class log_ring : public boost::noncopyable
+{
+	struct slot
+	{
+		boost::atomic<std::size_t> seq;
+		log_record record;
+	};
+
+public:
+	explicit log_ring(std::size_t size)
+		: m_slots(new slot[size])
+		, m_mask(size - 1)
+		, m_head(0)
+		, m_tail(0)
+	{
+		BOOST_ASSERT((size & m_mask) == 0);
+		for (std::size_t i = 0; i < size; i++)
+			m_slots[i].seq.store(i, boost::memory_order_relaxed);
+	}
+
+	///写入一条记录, 成功时r的内容被取走, 缓冲区满时返回false.
+	bool push(log_record &r)
+	{
+		std::size_t pos = m_head.load(boost::memory_order_relaxed);
+		slot *s = 0;
+		for (;;)
+		{
+			s = &m_slots[pos & m_mask];
+			std::size_t seq = s->seq.load(boost::memory_order_acquire);
+			std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+			if (diff == 0)
+			{
+				if (m_head.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = m_head.load(boost::memory_order_relaxed);
+			}
+		}
+		s->record.swap(r);
+		s->seq.store(pos + 1, boost::memory_order_release);
+		return true;
+	}
+
+	///取出一条记录, 只能在一个线程中调用, 没有记录时返回false.
+	bool pop(log_record &r)
+	{
+		slot &s = m_slots[m_tail & m_mask];
+		if (s.seq.load(boost::memory_order_acquire) != m_tail + 1)
+			return false;
+		r.swap(s.record);
+		s.record.message.clear();
+		s.seq.store(m_tail + m_mask + 1, boost::memory_order_release);
+		m_tail++;
+		return true;
+	}
+
+private:
+	boost::scoped_array<slot> m_slots;
+	std::size_t m_mask;
+	boost::atomic<std::size_t> m_head;
+	std::size_t m_tail;
+};
+
+} // namespace aux
+
+#endif // AVHTTP_ASYNC_LOGGER
+
 class logger : public boost::noncopyable
 {
 public:
 	logger(fs::path const& logpath, fs::path const& filename, bool append = true, bool inited = false)
+		: m_inited(inited)
+#ifdef AVHTTP_ASYNC_LOGGER
+		, m_ring(inited ? AVHTTP_LOG_RING_SIZE : 1)
+		, m_dropped(0)
+		, m_stop(false)
+#endif
 	{
+		if (!inited)
+			return;
 		try
 		{
-			m_inited = inited;
-			if (!inited)
-				return;
-			if (filename.empty())
-				return;
-			if (!fs::exists(logpath)) fs::create_directories(logpath);
-			m_file.open((logpath / filename).string().c_str(),
-				std::ios_base::out | (append ? std::ios_base::app : std::ios_base::out));
+			if (!filename.empty())
+			{
+				if (!fs::exists(logpath)) fs::create_directories(logpath);
+				m_file.open((logpath / filename).string().c_str(),
+					std::ios_base::out | (append ? std::ios_base::app : std::ios_base::out));
+			}
 			*this << "\n\n\n*** starting log ***\n\n\n";
 		}
 		catch (std::exception& e)
 		{
 			std::cerr << "failed to create log '" << filename.string() << "': " << e.what() << std::endl;
 		}
+#ifdef AVHTTP_ASYNC_LOGGER
+		m_thread = boost::thread(boost::bind(&logger::flush_thread, this));
+#endif
+	}
+
+	~logger()
+	{
+#ifdef AVHTTP_ASYNC_LOGGER
+		if (m_thread.joinable())
+		{
+			{
+				boost::mutex::scoped_lock lock(m_wait_mutex);
+				m_stop = true;
+			}
+			m_wait.notify_one();
+			m_thread.join();
+		}
+#endif
 	}
-	~logger() {}
 
 public:
 
+	///直接输出文本, 不经过缓冲区.
 	template <class T>
 	logger& operator<<(T const& v)
 	{
 		if (!m_inited)
 			return *this;
 
-		std::cout << v;
-		std::cout.flush();
-
-		if (m_file.is_open())
-		{
-			m_file << v;
-			m_file.flush();
-		}
-
-#if defined(WIN32) && defined(LOGGER_DBG_VIEW)
 		std::ostringstream oss;
 		oss << v;
-		m_dbg_view += oss.str();
-#endif
+		output(oss.str());
+		flush();
 		return *this;
 	}
 
-	const std::string& dbg_view() const
+	///写入一条日志记录.
+	// @param r日志记录, 异步模式下内容被取走.
+	void write(log_record &r)
 	{
-		return m_dbg_view;
+		if (!m_inited)
+			return;
+#ifdef AVHTTP_ASYNC_LOGGER
+		if (!m_ring.push(r))
+			m_dropped++;
+#else
+		output(r);
+		flush();
+#endif
 	}
 
-	void clear_dbg_view()
+	///设置日志处理函数, 每条日志记录输出后调用.
+	void set_handler(const log_handler &handler)
 	{
-		m_dbg_view = "";
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_output_mutex);
+#endif
+		m_handler = handler;
 	}
 
 	bool inited() const
@@ -111,18 +409,109 @@ public:
 		return m_inited;
 	}
 
+private:
+	void output(const std::string &text)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_output_mutex);
+#endif
+		write_text(text);
+	}
+
+	void output(const log_record &r)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_output_mutex);
+#endif
+		write_text(format_log_record(r));
+		if (m_handler)
+			m_handler(r);
+	}
+
+	void write_text(const std::string &text)
+	{
+		std::cout << text;
+		if (m_file.is_open())
+			m_file << text;
+#if defined(WIN32) && defined(LOGGER_DBG_VIEW)
+		OutputDebugStringA(text.c_str());
+#endif
+	}
+
+	void flush()
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_output_mutex);
+#endif
+		std::cout.flush();
+		if (m_file.is_open())
+			m_file.flush();
+	}
+
+#ifdef AVHTTP_ASYNC_LOGGER
+	void flush_thread()
+	{
+		bool stop = false;
+		while (!stop)
+		{
+			{
+				boost::mutex::scoped_lock lock(m_wait_mutex);
+				if (!m_stop)
+					m_wait.timed_wait(lock, boost::posix_time::milliseconds(10));
+				stop = m_stop;
+			}
+			drain();
+		}
+	}
+
+	// 输出缓冲区中所有的日志记录, 每批只刷新一次.
+	void drain()
+	{
+		bool written = false;
+		std::size_t dropped = m_dropped.exchange(0);
+		if (dropped != 0)
+		{
+			std::ostringstream oss;
+			oss << "*** " << dropped << " log records dropped ***\n";
+			output(oss.str());
+			written = true;
+		}
+		log_record r;
+		while (m_ring.pop(r))
+		{
+			output(r);
+			written = true;
+		}
+		if (written)
+			flush();
+	}
+#endif // AVHTTP_ASYNC_LOGGER
+
 private:
 	std::ofstream m_file;
-	std::string m_dbg_view;
 	bool m_inited;
+	log_handler m_handler;
+#ifndef AVHTTP_DISABLE_THREAD
+	boost::mutex m_output_mutex;
+#endif
+#ifdef AVHTTP_ASYNC_LOGGER
+	aux::log_ring m_ring;
+	boost::atomic<std::size_t> m_dropped;
+	boost::thread m_thread;
+	boost::mutex m_wait_mutex;
+	boost::condition_variable m_wait;
+	bool m_stop;
+#endif
 };
 
-inline char const* time_now_string()
+inline std::string time_now_string()
 {
 	time_t t = std::time(0);
-	tm* timeinfo = std::localtime(&t);
-	static char str[200];
-	std::strftime(str, 200, " %b %d %X ", timeinfo);
+	std::tm timeinfo = boost::posix_time::to_tm(
+		boost::date_time::c_local_adjustor<boost::posix_time::ptime>::utc_to_local(
+		boost::posix_time::from_time_t(t)));
+	char str[200];
+	std::strftime(str, 200, " %b %d %X ", &timeinfo);
 	return str;
 }
 
@@ -164,15 +553,35 @@ Logger_ptr& logger_single(std::string path = ".",
 #define _LOCKS_() ((void)0)
 #endif // LOGGER_THREAD_SAFE
 
-#if defined(WIN32) && defined(LOGGER_DBG_VIEW)
-#define _DBG_VIEW_() do { OutputDebugStringA(_LOGS_.dbg_view().c_str()); _LOGS_.clear_dbg_view(); } while (0)
-#else
-#define _DBG_VIEW_() ((void)0)
-#endif // WIN32 && LOGGER_DEBUG_VIEW
+///写入一条日志记录, 由AVHTTP_LOG调用.
+inline void log_write(log_level level, log_category category,
+	const char* file, int line, std::string message)
+{
+	log_record r;
+	r.time = aux::log_time_now();
+	r.level = level;
+	r.category = category;
+	r.file = file;
+	r.line = line;
+	r.message.swap(message);
+	_LOGS_.write(r);
+}
+
+///设置日志处理函数, 可以用于获得结构化的日志记录, 需要在INIT_LOGGER之后调用.
+inline void set_log_handler(const log_handler &handler)
+{
+	_LOGS_.set_handler(handler);
+}
 
 //////////////////////////////////////////////////////////////////////////
 // 日志相关外部接口定义.
 
+#if defined(DEBUG) || defined(_DEBUG)
+#define _LOG_DEFAULT_LEVEL_ avhttp::log_debug
+#else
+#define _LOG_DEFAULT_LEVEL_ avhttp::log_info
+#endif
+
 ///初始化日志接口.
 // @param path指定了日志文件保存的路径.
 // @param file指定了日志文件名.
@@ -180,45 +589,41 @@ Logger_ptr& logger_single(std::string path = ".",
 #define INIT_LOGGER(path, file) do {\
 	_LOCKS_();\
 	avhttp::aux::logger_single<avhttp::logger, boost::shared_ptr<avhttp::logger> >(path, file, true, true);\
+	avhttp::set_log_level(_LOG_DEFAULT_LEVEL_);\
 } while (0)
 
 ///卸载日志模块接口.
 #define UNINIT_LOGGER() do {\
 	_LOCKS_();\
+	avhttp::set_log_level(avhttp::log_off);\
 	avhttp::aux::logger_single<avhttp::logger, boost::shared_ptr<avhttp::logger> >().reset();\
 } while (0)
 
-#if defined(DEBUG) || defined(_DEBUG)
-#define LOG_DEBUG(message) do { \
-	_LOCKS_(); \
-	_LOGS_ << avhttp::time_now_string() << "[DEBUG]: " << message << "\n"; \
-	_DBG_VIEW_(); \
-} while (0)
+#ifndef AVHTTP_DISABLE_LOGGING
 
-#define LOG_INFO(message) do { \
-	_LOCKS_(); \
-	_LOGS_ << avhttp::time_now_string() << "[INFO]: " << message << "\n"; \
-	_DBG_VIEW_(); \
-} while (0)
-
-#define LOG_WARNING(message) do { \
-	_LOCKS_(); \
-	_LOGS_ << avhttp::time_now_string() << "[WARNING]: " << message << "\n"; \
-	_DBG_VIEW_(); \
-} while (0)
-
-#define LOG_ERROR(message) do { \
-	_LOCKS_(); \
-	_LOGS_ << avhttp::time_now_string() << "[ERROR]: " << message << "\n"; \
-	_DBG_VIEW_(); \
+///输出指定级别和分类的日志, 只有启用时才会格式化message.
+#define AVHTTP_LOG(level, category, message) do { \
+	if (avhttp::log_enabled(level, category)) { \
+		std::ostringstream avhttp_log_stream_; \
+		avhttp_log_stream_ << message; \
+		avhttp::log_write(level, category, __FILE__, __LINE__, avhttp_log_stream_.str()); \
+	} \
 } while (0)
 
 #else
-#define LOG_DEBUG(message) ((void)0)
-#define LOG_INFO(message) ((void)0)
-#define LOG_WARNING(message) ((void)0)
-#define LOG_ERROR(message) ((void)0)
-#endif
+#define AVHTTP_LOG(level, category, message) ((void)0)
+#endif // AVHTTP_DISABLE_LOGGING
+
+#define LOG_DEBUG(message) AVHTTP_LOG(avhttp::log_debug, avhttp::log_general, message)
+#define LOG_INFO(message) AVHTTP_LOG(avhttp::log_info, avhttp::log_general, message)
+#define LOG_WARNING(message) AVHTTP_LOG(avhttp::log_warning, avhttp::log_general, message)
+#define LOG_ERROR(message) AVHTTP_LOG(avhttp::log_error, avhttp::log_general, message)
+
+// 输出指定分类的日志, category为log_category中去掉avhttp::限定的枚举值, 如log_proxy.
+#define LOG_DEBUG_CAT(category, message) AVHTTP_LOG(avhttp::log_debug, avhttp::category, message)
+#define LOG_INFO_CAT(category, message) AVHTTP_LOG(avhttp::log_info, avhttp::category, message)
+#define LOG_WARNING_CAT(category, message) AVHTTP_LOG(avhttp::log_warning, avhttp::category, message)
+#define LOG_ERROR_CAT(category, message) AVHTTP_LOG(avhttp::log_error, avhttp::category, message)
 
 }
 
@@ -0,0 +1,622 @@
+//
+// metrics.hpp
+// ~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __METRICS_HPP__
+#define __METRICS_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <map>
+#include <cstdio>
+#include <string>
+#include <sstream>
+
+#include <boost/version.hpp>
+#include <boost/config.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+// 有boost.atomic(boost-1.53及以上)且启用线程时, 计数器按线程分片并使用无锁原子操作;
+// 否则启用线程时使用一个全局锁, 禁用线程时直接读写.
+#if !defined(AVHTTP_DISABLE_THREAD) && (BOOST_VERSION >= 105300)
+# define AVHTTP_ATOMIC_METRICS
+# include <boost/atomic.hpp>
+# if defined(BOOST_NO_CXX11_THREAD_LOCAL)
+#  include <boost/thread/tss.hpp>
+# endif
+#elif !defined(AVHTTP_DISABLE_THREAD)
+# include <boost/thread/mutex.hpp>
+#endif
+
+// 计数器分片的个数, 必须是2的幂. 每个线程固定使用其中一个分片, 避免多个线程在同一个
+// cache line上竞争.
+#ifndef AVHTTP_METRICS_SHARDS
+# define AVHTTP_METRICS_SHARDS 16
+#endif
+
+namespace avhttp {
+
+///进程内所有avhttp活动的统计信息.
+// 使用说明:
+//	http_stream和multi_download在运行过程中自动更新metrics()中的计数器, 仪表和直方图.
+//	使用metrics().snapshot()得到当前所有统计值, 然后可以用format_prometheus输出为
+//	Prometheus的文本格式, 或者用format_statsd输出为StatsD的格式.
+//	定义AVHTTP_DISABLE_METRICS则库内部的统计在编译时被去掉.
+// @begin example
+//  avhttp::metrics_snapshot s = avhttp::metrics().snapshot();
+//  std::cout << s.counter(avhttp::metric_bytes_received) << std::endl;
+//  std::cout << avhttp::format_prometheus(s);
+// @end example
+
+///计数器, 只增不减.
+enum metric_counter
+{
+	// 新建立并成功发出请求的连接数.
+	metric_connections_opened = 0,
+	// 在已打开的连接上再次发出请求的次数.
+	metric_connections_reused,
+	// 跟随重定向的次数.
+	metric_redirects,
+	// 从socket读取的字节数.
+	metric_bytes_received,
+	// 向socket写入的字节数.
+	metric_bytes_sent,
+	// 返回给用户的body字节数(解码和解压后).
+	metric_bytes_decoded,
+	// 送入解压的压缩数据字节数.
+	metric_gzip_input_bytes,
+	// 解压得到的字节数.
+	metric_gzip_output_bytes,
+	// multi_download重新建立连接的次数.
+	metric_retries,
+	// multi_download因超时而重新建立连接的次数.
+	metric_timeouts,
+	// 直接从缓存读取, 没有发出请求的响应数.
+	metric_cache_hits,
+	// 条件请求验证后(304)从缓存读取的响应数.
+	metric_cache_revalidations,
+	// 计数器的个数.
+	metric_counter_num,
+};
+
+///仪表, 可增可减的当前值.
+enum metric_gauge
+{
+	// multi_download中未完成的异步操作个数.
+	metric_pending_operations = 0,
+	// 等待写入和正在写入存储的数据块个数.
+	metric_write_queue_depth,
+	// 仪表的个数.
+	metric_gauge_num,
+};
+
+///延迟直方图, 单位微秒.
+enum metric_histogram
+{
+	// 域名解析耗时.
+	metric_dns_time = 0,
+	// tcp连接耗时.
+	metric_connect_time,
+	// ssl握手耗时.
+	metric_tls_time,
+	// 从请求发送完成到收到响应第一个字节的时间.
+	metric_ttfb,
+	// 从打开url到body读取完成的总耗时.
+	metric_request_time,
+	// 直方图的个数.
+	metric_histogram_num,
+};
+
+inline const char* metric_counter_name(metric_counter c)
+{
+	static const char* names[] = { "connections_opened", "connections_reused", "redirects",
+		"bytes_received", "bytes_sent", "bytes_decoded", "gzip_input_bytes", "gzip_output_bytes",
+		"retries", "timeouts", "cache_hits", "cache_revalidations" };
+	return names[c];
+}
+
+inline const char* metric_gauge_name(metric_gauge g)
+{
+	static const char* names[] = { "pending_operations", "write_queue_depth" };
+	return names[g];
+}
+
+inline const char* metric_histogram_name(metric_histogram h)
+{
+	static const char* names[] = { "dns_seconds", "connect_seconds", "tls_seconds",
+		"ttfb_seconds", "request_seconds" };
+	return names[h];
+}
+
+///直方图的桶, 每个桶的上界(微秒), 最后一个桶为+Inf.
+enum { metric_bucket_num = 17 };
+
+inline boost::int64_t metric_bucket_bound(int i)
+{
+	static const boost::int64_t bounds[metric_bucket_num - 1] = {
+		100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+		100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000 };
+	return bounds[i];
+}
+
+///直方图的快照.
+struct histogram_snapshot
+{
+	histogram_snapshot()
+		: count(0)
+		, sum(0)
+	{
+		for (int i = 0; i < metric_bucket_num; i++)
+			buckets[i] = 0;
+	}
+
+	// 每个桶中的观察次数(不累积).
+	boost::uint64_t buckets[metric_bucket_num];
+	// 观察次数.
+	boost::uint64_t count;
+	// 观察值之和, 单位微秒.
+	boost::uint64_t sum;
+};
+
+///所有统计值的快照.
+struct metrics_snapshot
+{
+	metrics_snapshot()
+	{
+		for (int i = 0; i < metric_counter_num; i++)
+			counters[i] = 0;
+		for (int i = 0; i < metric_gauge_num; i++)
+			gauges[i] = 0;
+	}
+
+	boost::uint64_t counter(metric_counter c) const
+	{
+		return counters[c];
+	}
+
+	boost::int64_t gauge(metric_gauge g) const
+	{
+		return gauges[g];
+	}
+
+	const histogram_snapshot& histogram(metric_histogram h) const
+	{
+		return histograms[h];
+	}
+
+	///解压比, 解压得到的字节数/压缩数据字节数, 没有压缩数据时为0.
+	double decompression_ratio() const
+	{
+		if (counters[metric_gzip_input_bytes] == 0)
+			return 0.0;
+		return static_cast<double>(counters[metric_gzip_output_bytes]) /
+			static_cast<double>(counters[metric_gzip_input_bytes]);
+	}
+
+	boost::uint64_t counters[metric_counter_num];
+	boost::int64_t gauges[metric_gauge_num];
+	histogram_snapshot histograms[metric_histogram_num];
+	// http状态码的计数, 只包含出现过的状态码, 无效的状态码记为0.
+	std::map<int, boost::uint64_t> status_codes;
+};
+
+namespace aux {
+
+#ifdef AVHTTP_ATOMIC_METRICS
+
+typedef boost::atomic<boost::uint64_t> metric_cell;
+typedef boost::atomic<boost::int64_t> metric_signed_cell;
+
+template <class Cell, class T>
+inline void metric_add(Cell &c, T n)
+{
+	c.fetch_add(n, boost::memory_order_relaxed);
+}
+
+inline boost::uint64_t metric_load(const metric_cell &c)
+{
+	return c.load(boost::memory_order_relaxed);
+}
+
+inline boost::int64_t metric_load(const metric_signed_cell &c)
+{
+	return c.load(boost::memory_order_relaxed);
+}
+
+template <class Cell>
+inline void metric_clear(Cell &c)
+{
+	c.store(0, boost::memory_order_relaxed);
+}
+
+#else
+
+template <class T>
+struct plain_metric_cell
+{
+	plain_metric_cell() : value(0) {}
+	T value;
+};
+
+typedef plain_metric_cell<boost::uint64_t> metric_cell;
+typedef plain_metric_cell<boost::int64_t> metric_signed_cell;
+
+#ifndef AVHTTP_DISABLE_THREAD
+template <class T = void>
+struct metric_lock
+{
+	static boost::mutex mutex;
+};
+
+template <class T>
+boost::mutex metric_lock<T>::mutex;
+
+# define AVHTTP_METRIC_LOCK() boost::mutex::scoped_lock metric_lock_(aux::metric_lock<>::mutex)
+#else
+# define AVHTTP_METRIC_LOCK() ((void)0)
+#endif
+
+template <class Cell, class T>
+inline void metric_add(Cell &c, T n)
+{
+	AVHTTP_METRIC_LOCK();
+	c.value += n;
+}
+
+template <class T>
+inline T metric_load(const plain_metric_cell<T> &c)
+{
+	AVHTTP_METRIC_LOCK();
+	return c.value;
+}
+
+template <class Cell>
+inline void metric_clear(Cell &c)
+{
+	AVHTTP_METRIC_LOCK();
+	c.value = 0;
+}
+
+#undef AVHTTP_METRIC_LOCK
+
+#endif // AVHTTP_ATOMIC_METRICS
+
+// 一个分片中的计数器, 分片之间用一个cache line隔开, 避免相邻分片之间的伪共享.
+struct metric_shard
+{
+	metric_cell counters[metric_counter_num];
+	char padding[64];
+};
+
+struct metric_histogram_cells
+{
+	metric_cell buckets[metric_bucket_num];
+	metric_cell count;
+	metric_cell sum;
+};
+
+#ifdef AVHTTP_ATOMIC_METRICS
+
+template <class T = void>
+struct metric_shard_counter
+{
+	static boost::atomic<std::size_t> next;
+};
+
+template <class T>
+boost::atomic<std::size_t> metric_shard_counter<T>::next(0);
+
+// 为新线程按顺序分配一个分片.
+inline std::size_t metric_new_shard()
+{
+	return metric_shard_counter<>::next.fetch_add(1, boost::memory_order_relaxed)
+		& (AVHTTP_METRICS_SHARDS - 1);
+}
+
+# if defined(BOOST_NO_CXX11_THREAD_LOCAL)
+
+template <class T = void>
+struct metric_shard_tss
+{
+	static boost::thread_specific_ptr<std::size_t> index;
+};
+
+template <class T>
+boost::thread_specific_ptr<std::size_t> metric_shard_tss<T>::index;
+
+inline std::size_t metric_shard_index()
+{
+	std::size_t *p = metric_shard_tss<>::index.get();
+	if (!p)
+	{
+		p = new std::size_t(metric_new_shard());
+		metric_shard_tss<>::index.reset(p);
+	}
+	return *p;
+}
+
+# else
+
+inline std::size_t metric_shard_index()
+{
+	static thread_local std::size_t index = metric_new_shard();
+	return index;
+}
+
+# endif
+
+enum { metric_shard_num = AVHTTP_METRICS_SHARDS };
+
+#else
+
+inline std::size_t metric_shard_index()
+{
+	return 0;
+}
+
+enum { metric_shard_num = 1 };
+
+#endif // AVHTTP_ATOMIC_METRICS
+
+} // namespace aux
+
+///统计信息注册表.
+// 计数器按线程分片, 更新时只有一次relaxed原子加, 读取时累加所有分片. 直方图和状态码
+// 在每个请求中只更新少数几次, 不分片.
+class metrics_registry : public boost::noncopyable
+{
+public:
+	// 状态码计数表的大小, 不在[100, status_code_num)范围内的状态码记到0.
+	enum { status_code_num = 600 };
+
+	///增加一个计数器.
+	void add(metric_counter c, boost::uint64_t n = 1)
+	{
+		aux::metric_add(m_shards[aux::metric_shard_index()].counters[c], n);
+	}
+
+	///增加或减少一个仪表.
+	void gauge_add(metric_gauge g, boost::int64_t n)
+	{
+		aux::metric_add(m_gauges[g], n);
+	}
+
+	///记录一次延迟观察, 单位微秒, 小于0的值(没有经过的阶段)被忽略.
+	void observe(metric_histogram h, boost::int64_t microseconds)
+	{
+		if (microseconds < 0)
+			return;
+
+		int i = 0;
+		while (i < metric_bucket_num - 1 && microseconds > metric_bucket_bound(i))
+			i++;
+
+		aux::metric_histogram_cells &cells = m_histograms[h];
+		aux::metric_add(cells.buckets[i], 1);
+		aux::metric_add(cells.count, 1);
+		aux::metric_add(cells.sum, static_cast<boost::uint64_t>(microseconds));
+	}
+
+	///记录一个http状态码.
+	void count_status(int status)
+	{
+		if (status < 100 || status >= status_code_num)
+			status = 0;
+		aux::metric_add(m_status_codes[status], 1);
+	}
+
+	///得到所有统计值的快照.
+	// @备注: 各个值分别读取, 快照不是一个原子的整体.
+	metrics_snapshot snapshot() const
+	{
+		metrics_snapshot s;
+
+		for (int i = 0; i < aux::metric_shard_num; i++)
+		{
+			for (int c = 0; c < metric_counter_num; c++)
+				s.counters[c] += aux::metric_load(m_shards[i].counters[c]);
+		}
+
+		for (int g = 0; g < metric_gauge_num; g++)
+			s.gauges[g] = aux::metric_load(m_gauges[g]);
+
+		for (int h = 0; h < metric_histogram_num; h++)
+		{
+			const aux::metric_histogram_cells &cells = m_histograms[h];
+			histogram_snapshot &hs = s.histograms[h];
+			for (int i = 0; i < metric_bucket_num; i++)
+				hs.buckets[i] = aux::metric_load(cells.buckets[i]);
+			hs.count = aux::metric_load(cells.count);
+			hs.sum = aux::metric_load(cells.sum);
+		}
+
+		for (int i = 0; i < status_code_num; i++)
+		{
+			boost::uint64_t n = aux::metric_load(m_status_codes[i]);
+			if (n != 0)
+				s.status_codes[i] = n;
+		}
+
+		return s;
+	}
+
+	///清零所有计数器和直方图, 仪表表示当前状态, 不清零.
+	void reset()
+	{
+		for (int i = 0; i < aux::metric_shard_num; i++)
+		{
+			for (int c = 0; c < metric_counter_num; c++)
+				aux::metric_clear(m_shards[i].counters[c]);
+		}
+
+		for (int h = 0; h < metric_histogram_num; h++)
+		{
+			aux::metric_histogram_cells &cells = m_histograms[h];
+			for (int i = 0; i < metric_bucket_num; i++)
+				aux::metric_clear(cells.buckets[i]);
+			aux::metric_clear(cells.count);
+			aux::metric_clear(cells.sum);
+		}
+
+		for (int i = 0; i < status_code_num; i++)
+			aux::metric_clear(m_status_codes[i]);
+	}
+
+private:
+	aux::metric_shard m_shards[aux::metric_shard_num];
+	aux::metric_signed_cell m_gauges[metric_gauge_num];
+	aux::metric_histogram_cells m_histograms[metric_histogram_num];
+	aux::metric_cell m_status_codes[status_code_num];
+};
+
+namespace aux {
+
+template <class T = void>
+struct metrics_instance
+{
+	static metrics_registry registry;
+};
+
+template <class T>
+metrics_registry metrics_instance<T>::registry;
+
+inline void format_metric_seconds(std::ostream &os, boost::uint64_t microseconds)
+{
+	os << microseconds / 1000000;
+	boost::uint64_t frac = microseconds % 1000000;
+	if (frac != 0)
+	{
+		char buf[8];
+		std::sprintf(buf, "%06u", static_cast<unsigned>(frac));
+		std::string s(buf);
+		s.erase(s.find_last_not_of('0') + 1);
+		os << "." << s;
+	}
+}
+
+} // namespace aux
+
+///返回进程内唯一的统计信息注册表.
+inline metrics_registry& metrics()
+{
+	return aux::metrics_instance<>::registry;
+}
+
+///将快照格式化为Prometheus文本格式(text/plain; version=0.0.4).
+// @param s统计值快照.
+// @param prefix指标名前缀.
+// 计数器输出为<prefix>_<name>_total, 状态码输出为<prefix>_responses_total{code="200"},
+// 直方图的单位为秒.
+inline std::string format_prometheus(const metrics_snapshot &s, const std::string &prefix = "avhttp")
+{
+	std::ostringstream os;
+	os.imbue(std::locale("C"));
+
+	for (int c = 0; c < metric_counter_num; c++)
+	{
+		std::string name = prefix + "_" + metric_counter_name(static_cast<metric_counter>(c)) + "_total";
+		os << "# TYPE " << name << " counter\n";
+		os << name << " " << s.counters[c] << "\n";
+	}
+
+	for (int g = 0; g < metric_gauge_num; g++)
+	{
+		std::string name = prefix + "_" + metric_gauge_name(static_cast<metric_gauge>(g));
+		os << "# TYPE " << name << " gauge\n";
+		os << name << " " << s.gauges[g] << "\n";
+	}
+
+	{
+		std::string name = prefix + "_responses_total";
+		os << "# TYPE " << name << " counter\n";
+		for (std::map<int, boost::uint64_t>::const_iterator i = s.status_codes.begin();
+			i != s.status_codes.end(); ++i)
+		{
+			os << name << "{code=\"" << i->first << "\"} " << i->second << "\n";
+		}
+	}
+
+	for (int h = 0; h < metric_histogram_num; h++)
+	{
+		const histogram_snapshot &hs = s.histograms[h];
+		std::string name = prefix + "_" + metric_histogram_name(static_cast<metric_histogram>(h));
+		os << "# TYPE " << name << " histogram\n";
+		boost::uint64_t cumulative = 0;
+		for (int i = 0; i < metric_bucket_num; i++)
+		{
+			cumulative += hs.buckets[i];
+			os << name << "_bucket{le=\"";
+			if (i == metric_bucket_num - 1)
+				os << "+Inf";
+			else
+				aux::format_metric_seconds(os, metric_bucket_bound(i));
+			os << "\"} " << cumulative << "\n";
+		}
+		os << name << "_sum ";
+		aux::format_metric_seconds(os, hs.sum);
+		os << "\n";
+		os << name << "_count " << hs.count << "\n";
+	}
+
+	return os.str();
+}
+
+///将快照格式化为StatsD格式.
+// @param s统计值快照.
+// @param prefix指标名前缀.
+// 快照中是累计值, 所以计数器也以gauge(|g)输出; 直方图输出观察次数和平均值(毫秒).
+inline std::string format_statsd(const metrics_snapshot &s, const std::string &prefix = "avhttp")
+{
+	std::ostringstream os;
+	os.imbue(std::locale("C"));
+
+	for (int c = 0; c < metric_counter_num; c++)
+		os << prefix << "." << metric_counter_name(static_cast<metric_counter>(c)) << ":" << s.counters[c] << "|g\n";
+
+	for (int g = 0; g < metric_gauge_num; g++)
+		os << prefix << "." << metric_gauge_name(static_cast<metric_gauge>(g)) << ":" << s.gauges[g] << "|g\n";
+
+	for (std::map<int, boost::uint64_t>::const_iterator i = s.status_codes.begin();
+		i != s.status_codes.end(); ++i)
+	{
+		os << prefix << ".responses." << i->first << ":" << i->second << "|g\n";
+	}
+
+	for (int h = 0; h < metric_histogram_num; h++)
+	{
+		const histogram_snapshot &hs = s.histograms[h];
+		std::string name = metric_histogram_name(static_cast<metric_histogram>(h));
+		name.erase(name.rfind("_seconds"));
+		os << prefix << "." << name << ".count:" << hs.count << "|g\n";
+		if (hs.count != 0)
+			os << prefix << "." << name << ".mean:" << (hs.sum / hs.count) / 1000.0 << "|g\n";
+	}
+
+	return os.str();
+}
+
+} // namespace avhttp
+
+// 库内部更新统计信息使用的宏, 定义AVHTTP_DISABLE_METRICS时被去掉.
+#ifndef AVHTTP_DISABLE_METRICS
+# define AVHTTP_METRIC_ADD(counter, n) avhttp::metrics().add(avhttp::counter, (n))
+# define AVHTTP_METRIC_GAUGE(gauge, n) avhttp::metrics().gauge_add(avhttp::gauge, (n))
+# define AVHTTP_METRIC_OBSERVE(histogram, us) avhttp::metrics().observe(avhttp::histogram, (us))
+# define AVHTTP_METRIC_STATUS(status) avhttp::metrics().count_status(status)
+#else
+# define AVHTTP_METRIC_ADD(counter, n) ((void)0)
+# define AVHTTP_METRIC_GAUGE(gauge, n) ((void)0)
+# define AVHTTP_METRIC_OBSERVE(histogram, us) ((void)0)
+# define AVHTTP_METRIC_STATUS(status) ((void)0)
+#endif
+
+#endif // __METRICS_HPP__
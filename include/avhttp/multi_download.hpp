@@ -1,1981 +1,3993 @@
-//
-// multi_download.hpp
-// ~~~~~~~~~~~~~~~~~~
-//
-// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
-//
-// Distributed under the Boost Software License, Version 1.0. (See accompanying
-// path LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
-//
-
-#ifndef MULTI_DOWNLOAD_HPP__
-#define MULTI_DOWNLOAD_HPP__
-
-#if defined(_MSC_VER) && (_MSC_VER >= 1200)
-# pragma once
-#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
-
-#include <vector>
-#include <list>
-#include <algorithm>    // for std::min/std::max
-
-#include <boost/assert.hpp>
-#include <boost/noncopyable.hpp>
-#include <boost/cstdint.hpp>
-#include <boost/shared_ptr.hpp>
-#include <boost/thread.hpp>
-#include <boost/thread/condition.hpp>
-#include <boost/lexical_cast.hpp>
-#include <boost/date_time.hpp>
-#include <boost/format.hpp>
-#include <boost/filesystem/fstream.hpp>
-#include <boost/crc.hpp>  // for boost::crc_32_type
-
-#include "avhttp/file.hpp"
-#include "avhttp/http_stream.hpp"
-#include "avhttp/rangefield.hpp"
-#include "avhttp/entry.hpp"
-#include "avhttp/settings.hpp"
-
-
-namespace avhttp
-{
-
-// multi_download类的具体实现.
-class multi_download : public boost::noncopyable
-{
-	// 重定义http_stream_ptr指针.
-	typedef boost::shared_ptr<http_stream> http_stream_ptr;
-
-	// 定义http_stream_obj.
-	struct http_stream_object
-	{
-		http_stream_object()
-			: request_range(0, 0)
-			, bytes_transferred(0)
-			, bytes_downloaded(0)
-			, request_count(0)
-			, done(false)
-			, direct_reconnect(false)
-		{}
-
-		// http_stream对象.
-		http_stream_ptr stream;
-
-		// 数据缓冲, 下载时的缓冲.
-		boost::array<char, default_buffer_size> buffer;
-
-		// 请求的数据范围, 每次由multi_download分配一个下载范围, stream按这个范围去下载.
-		range request_range;
-
-		// 本次请求已经下载的数据, 相对于request_range, 当一个request_range下载完成后,
-		// bytes_transferred自动置为0.
-		boost::int64_t bytes_transferred;
-
-		// 当前对象下载的数据统计.
-		boost::int64_t bytes_downloaded;
-
-		// 当前对象发起请求的次数.
-		int request_count;
-
-		// 最后请求的时间.
-		boost::posix_time::ptime last_request_time;
-
-		// 最后的错误信息.
-		boost::system::error_code ec;
-
-		// 是否操作功能完成.
-		bool done;
-
-		// 立即重新尝试连接.
-		bool direct_reconnect;
-	};
-
-	// 重定义http_object_ptr指针.
-	typedef boost::shared_ptr<http_stream_object> http_object_ptr;
-
-	// 用于计算下载速率.
-	struct byte_rate
-	{
-		byte_rate()
-			: seconds(5)
-			, index(0)
-			, current_byte_rate(0)
-		{
-			last_byte_rate.resize(seconds);
-			for (int i = 0; i < seconds; i++)
-			{
-				last_byte_rate[i] = 0;
-			}
-		}
-
-		// 用于统计速率的时间.
-		const int seconds;
-
-		// 最后的byte_rate.
-		std::vector<int> last_byte_rate;
-
-		// last_byte_rate的下标.
-		int index;
-
-		// 当前byte_rate.
-		int current_byte_rate;
-	};
-
-public:
-	AVHTTP_DECL explicit multi_download(boost::asio::io_service &io)
-		: m_io_service(io)
-		, m_accept_multi(false)
-		, m_keep_alive(false)
-		, m_file_size(-1)
-		, m_timer(io)
-		, m_number_of_connections(0)
-		, m_time_total(0)
-		, m_download_point(0)
-		, m_drop_size(-1)
-		, m_outstanding(0)
-		, m_abort(true)
-	{}
-	AVHTTP_DECL ~multi_download()
-	{}
-
-public:
-
-	///开始multi_download开始下载.
-	// @param u指定的url.
-	// @param ec当发生错误时, 包含详细的错误信息.
-	// @备注: 直接使用内部的file.hpp下载数据到文件, 若想自己指定数据下载到指定的地方
-	// 可以通过调用另一个open来完成, 具体见另一个open的详细说明.
-	AVHTTP_DECL void start(const std::string &u, boost::system::error_code &ec)
-	{
-		settings s;
-		start(u, s, ec);
-	}
-
-	///开始multi_download开始下载, 打开失败抛出一个异常.
-	// @param u指定的url.
-	// @备注: 直接使用内部的file.hpp下载数据到文件, 若想自己指定数据下载到指定的地方
-	// 可以通过调用另一个open来完成, 具体见另一个open的详细说明.
-	AVHTTP_DECL void start(const std::string &u)
-	{
-		settings s;
-		boost::system::error_code ec;
-		start(u, s, ec);
-		if (ec)
-		{
-			boost::throw_exception(boost::system::system_error(ec));
-		}
-	}
-
-	///开始multi_download开始下载.
-	// @param u指定的url.
-	// @param s指定的设置信息.
-	// @失败抛出一个boost::system::system_error异常, 包含详细的错误信息.
-	AVHTTP_DECL void start(const std::string &u, const settings &s)
-	{
-		boost::system::error_code ec;
-		start(u, s, ec);
-		if (ec)
-		{
-			boost::throw_exception(boost::system::system_error(ec));
-		}
-	}
-
-	///开始multi_download开始下载.
-	// @param u指定的url.
-	// @param s指定的设置信息.
-	// @返回error_code, 包含详细的错误信息.
-	AVHTTP_DECL void start(const std::string &u, const settings &s, boost::system::error_code &ec)
-	{
-		// 清空所有连接.
-		{
-#ifndef AVHTTP_DISABLE_THREAD
-			boost::mutex::scoped_lock lock(m_streams_mutex);
-#endif
-			m_streams.clear();
-		}
-
-		// 默认文件大小为-1.
-		m_file_size = -1;
-
-		// 保存设置.
-		m_settings = s;
-
-		// 将url转换成utf8编码.
-		std::string utf8 = detail::ansi_utf8(u);
-		utf8 = detail::escape_path(utf8);
-		m_final_url = utf8;
-		m_file_name = "";
-
-		// 创建一个http_stream对象.
-		http_object_ptr obj(new http_stream_object);
-
-		request_opts req_opt = m_settings.opts;
-		req_opt.insert(http_options::range, "bytes=0-");
-		req_opt.insert(http_options::connection, "keep-alive");
-
-		// 创建http_stream并同步打开, 检查返回状态码是否为206, 如果非206则表示该http服务器不支持多点下载.
-		obj->stream.reset(new http_stream(m_io_service));
-		http_stream &h = *obj->stream;
-		// 添加代理设置.
-		h.proxy(m_settings.proxy);
-		// 添加请求设置.
-		h.request_options(req_opt);
-		// 如果是ssl连接, 默认为检查证书.
-		h.check_certificate(m_settings.check_certificate);
-		// 打开http_stream.
-		h.open(m_final_url, ec);
-		// 打开失败则退出.
-		if (ec)
-		{
-			return;
-		}
-
-		// 保存最终url信息.
-		std::string location = h.location();
-		if (!location.empty())
-		{
-			m_final_url = location;
-		}
-
-		// 判断是否支持多点下载.
-		std::string status_code;
-		h.response_options().find(http_options::status_code, status_code);
-		if (status_code != "206")
-		{
-			m_accept_multi = false;
-		}
-		else
-		{
-			m_accept_multi = true;
-		}
-
-		// 禁用并发模式下载.
-		if (m_settings.disable_multi_download)
-		{
-			m_accept_multi = false;
-		}
-
-		// 得到文件大小.
-		std::string length;
-		h.response_options().find(http_options::content_length, length);
-		if (length.empty())
-		{
-			h.response_options().find(http_options::content_length, length);
-			std::string::size_type f = length.find('/');
-			if (f++ != std::string::npos)
-			{
-				length = length.substr(f);
-			}
-			else
-			{
-				length = "";
-			}
-
-			if (length.empty())
-			{
-				// 得到不文件长度, 设置为不支持多下载模式.
-				m_accept_multi = false;
-			}
-		}
-
-		boost::int64_t file_size = -1;
-		if (!length.empty())
-		{
-			try
-			{
-				file_size = boost::lexical_cast<boost::int64_t>(length);
-			}
-			catch (boost::bad_lexical_cast &)
-			{
-				// 得不到正确的文件长度, 设置为不支持多下载模式.
-				m_accept_multi = false;
-			}
-		}
-
-		// 按文件大小重新分配rangefield.
-		if (file_size != -1 && file_size != m_file_size)
-		{
-			m_file_size = file_size;
-			m_rangefield.reset(m_file_size);
-			m_downlaoded_field.reset(m_file_size);
-		}
-
-		// 是否支持长连接模式, 不支持多点下载, 长连接也没有意义.
-		if (m_accept_multi)
-		{
-			std::string keep_alive;
-			h.response_options().find(http_options::connection, keep_alive);
-			boost::to_lower(keep_alive);
-			if (keep_alive == "keep-alive")
-			{
-				m_keep_alive = true;
-			}
-			else
-			{
-				m_keep_alive = false;
-			}
-
-			// 如果未指定meta文件名, 则使用最终url生成meta文件名.
-			if (m_settings.meta_file.empty())
-			{
-				// 没有指定meta文件名, 自动修正meta文件名.
-				m_settings.meta_file = meta_name(m_final_url.to_string());
-			}
-
-			// 打开meta文件, 如果打开成功, 则表示解析出相应的位图了.
-			if (!open_meta(m_settings.meta_file))
-			{
-				// 位图打开失败, 无所谓, 下载过程中会创建新的位图, 删除meta文件.
-				m_file_meta.close();
-				boost::system::error_code ignore;
-				fs::remove(m_settings.meta_file, ignore);
-			}
-		}
-
-		// 判断文件是否已经下载完成, 完成则直接返回.
-		if (m_downlaoded_field.is_full())
-		{
-			return;
-		}
-
-		// 创建存储对象.
-		if (!s.storage)
-		{
-			m_storage.reset(default_storage_constructor());
-		}
-		else
-		{
-			m_storage.reset(s.storage());
-		}
-		BOOST_ASSERT(m_storage);
-
-		// 打开文件, 构造文件名.
-		m_storage->open(boost::filesystem::path(file_name()), ec);
-		if (ec)
-		{
-			return;
-		}
-
-		// 保存限速大小.
-		m_drop_size = s.download_rate_limit;
-
-		// 处理默认设置.
-		if (m_settings.connections_limit == -1)
-		{
-			m_settings.connections_limit = default_connections_limit;
-		}
-		if (m_settings.piece_size == -1 && m_file_size != -1)
-		{
-			m_settings.piece_size = default_piece_size(m_file_size);
-		}
-
-		// 根据第1个连接返回的信息, 重新设置请求选项.
-		req_opt = m_settings.opts;
-		if (m_keep_alive)
-		{
-			req_opt.insert(http_options::connection, "keep-alive");
-		}
-		else
-		{
-			req_opt.insert(http_options::connection, "close");
-		}
-
-		// 修改终止状态.
-		m_abort = false;
-
-		// 连接计数置为1.
-		m_number_of_connections = 1;
-
-		// 添加第一个连接到连接容器.
-		{
-#ifndef AVHTTP_DISABLE_THREAD
-			boost::mutex::scoped_lock lock(m_streams_mutex);
-#endif
-			m_streams.push_back(obj);
-		}
-
-		// 为第1个连接请求的buffer大小.
-		int available_bytes = default_buffer_size;
-
-		// 设置第1个连接下载范围.
-		if (m_accept_multi)
-		{
-			range req_range;
-			bool need_reopen = false;
-
-			// 从文件区间中获得一段空间, 这是第一次分配给obj下载的任务.
-			if (allocate_range(req_range))
-			{
-				// 分配到的起始边界不是0, 需要重新open这个obj.
-				if (req_range.left != 0)
-				{
-					need_reopen = true;
-				}
-
-				// 保存请求区间.
-				obj->request_range = req_range;
-
-				// 设置请求区间到请求选项中.
-				req_opt.remove(http_options::range);
-				req_opt.insert(http_options::range, boost::str(
-					boost::format("bytes=%lld-%lld", std::locale("C")) % req_range.left % req_range.right));
-
-				// 保存最后请求时间, 用于检查超时重置.
-				obj->last_request_time = boost::posix_time::microsec_clock::local_time();
-
-				// 添加代理设置.
-				h.proxy(m_settings.proxy);
-				// 设置请求选项.
-				h.request_options(req_opt);
-				// 如果是ssl连接, 默认为检查证书.
-				h.check_certificate(m_settings.check_certificate);
-				// 禁用重定向.
-				h.max_redirects(0);
-
-				if (need_reopen)
-				{
-					h.close(ec);	// 关闭原来的连接, 需要请求新的区间.
-					if (ec)
-					{
-						return;
-					}
-
-					change_outstranding(true);
-					// 开始异步打开.
-					h.async_open(m_final_url,
-						boost::bind(&multi_download::handle_open,
-							this,
-							0, obj,
-							boost::asio::placeholders::error
-						)
-					);
-				}
-				else
-				{
-					// 发起数据读取请求.
-					change_outstranding(true);
-					// 传入指针obj, 以确保多线程安全.
-					h.async_read_some(boost::asio::buffer(obj->buffer, available_bytes),
-						boost::bind(&multi_download::handle_read,
-							this,
-							0, obj,
-							boost::asio::placeholders::bytes_transferred,
-							boost::asio::placeholders::error
-						)
-					);
-				}
-			}
-			else
-			{
-				// 分配空间失败, 说明可能已经没有空闲的空间提供
-				// 给这个stream进行下载了直接跳过好了.
-				obj->done = true;
-			}
-		}
-		else	// 服务器不支持多点下载模式, 继续从第1个连接下载.
-		{
-			// 发起数据读取请求.
-			change_outstranding(true);
-			// 传入指针obj, 以确保多线程安全.
-			h.async_read_some(boost::asio::buffer(obj->buffer, available_bytes),
-				boost::bind(&multi_download::handle_read,
-					this,
-					0, obj,
-					boost::asio::placeholders::bytes_transferred,
-					boost::asio::placeholders::error
-				)
-			);
-		}
-
-		// 如果支持多点下载, 按设置创建其它http_stream.
-		if (m_accept_multi)
-		{
-			for (int i = 1; i < m_settings.connections_limit; i++)
-			{
-				http_object_ptr p(new http_stream_object());
-				http_stream_ptr ptr(new http_stream(m_io_service));
-				range req_range;
-
-				// 从文件间区中得到一段空间.
-				if (!allocate_range(req_range))
-				{
-					// 分配空间失败, 说明可能已经没有空闲的空间提供给这个stream进行下载了直接跳过好了.
-					p->done = true;
-					continue;
-				}
-
-				// 保存请求区间.
-				p->request_range = req_range;
-
-				// 设置请求区间到请求选项中.
-				req_opt.remove(http_options::range);
-				req_opt.insert(http_options::range, boost::str(
-					boost::format("bytes=%lld-%lld", std::locale("C")) % req_range.left % req_range.right));
-
-				// 设置请求选项.
-				ptr->request_options(req_opt);
-				// 如果是ssl连接, 默认为检查证书.
-				ptr->check_certificate(m_settings.check_certificate);
-				// 禁用重定向.
-				ptr->max_redirects(0);
-				// 添加代理设置.
-				ptr->proxy(m_settings.proxy);
-
-				// 将连接添加到容器中.
-				p->stream = ptr;
-
-				{
-#ifndef AVHTTP_DISABLE_THREAD
-					boost::mutex::scoped_lock lock(m_streams_mutex);
-#endif
-					m_streams.push_back(p);
-				}
-
-				// 保存最后请求时间, 方便检查超时重置.
-				p->last_request_time = boost::posix_time::microsec_clock::local_time();
-
-				m_number_of_connections++;
-				change_outstranding(true);
-
-				// 开始异步打开, 传入指针http_object_ptr, 以确保多线程安全.
-				p->stream->async_open(m_final_url,
-					boost::bind(&multi_download::handle_open,
-						this,
-						i, p,
-						boost::asio::placeholders::error
-					)
-				);
-			}
-		}
-
-		change_outstranding(true);
-		// 开启定时器, 执行任务.
-		m_timer.expires_from_now(boost::posix_time::seconds(1));
-		m_timer.async_wait(boost::bind(&multi_download::on_tick, this, boost::asio::placeholders::error));
-
-		return;
-	}
-
-	///异步启动下载, 启动完成将回调对应的Handler.
-	// @param u 将要下载的URL.
-	// @param handler 将被调用在启动完成时. 它必须满足以下条件:
-	// @begin code
-	//  void handler(
-	//    const boost::system::error_code &ec // 用于返回操作状态.
-	//  );
-	// @end code
-	// @begin example
-	//  void start_handler(const boost::system::error_code &ec)
-	//  {
-	//    if (!ec)
-	//    {
-	//      // 启动下载成功!
-	//    }
-	//  }
-	//  ...
-	//  avhttp::multi_download h(io_service);
-	//  h.async_open("http://www.boost.org", start_handler);
-	// @end example
-	// @备注: handler也可以使用boost.bind来绑定一个符合规定的函数作
-	// 为async_start的参数handler.
-	template <typename Handler>
-	void async_start(const std::string &u, Handler handler)
-	{
-		settings s;
-		async_start(u, s, handler);
-	}
-
-	///异步启动下载, 启动完成将回调对应的Handler.
-	// @param u 将要下载的URL.
-	// @param s 下载设置参数信息.
-	// @param handler 将被调用在启动完成时. 它必须满足以下条件:
-	// @begin code
-	//  void handler(
-	//    const boost::system::error_code &ec // 用于返回操作状态.
-	//  );
-	// @end code
-	// @begin example
-	//  void start_handler(const boost::system::error_code &ec)
-	//  {
-	//    if (!ec)
-	//    {
-	//      // 启动下载成功!
-	//    }
-	//  }
-	//  ...
-	//  avhttp::multi_download h(io_service);
-	//  settings s;
-	//  h.async_open("http://www.boost.org", s, start_handler);
-	// @end example
-	// @备注: handler也可以使用boost.bind来绑定一个符合规定的函数作
-	// 为async_start的参数handler.
-	template <typename Handler>
-	void async_start(const std::string &u, const settings &s, Handler handler)
-	{
-		// 清空所有连接.
-		{
-#ifndef AVHTTP_DISABLE_THREAD
-			boost::mutex::scoped_lock lock(m_streams_mutex);
-#endif
-			m_streams.clear();
-		}
-
-		// 清空文件大小.
-		m_file_size = -1;
-
-		// 保存参数.
-		std::string utf8 = detail::ansi_utf8(u);
-		utf8 = detail::escape_path(utf8);
-		m_final_url = utf8;
-		m_file_name = "";
-		m_settings = s;
-
-		// 设置状态.
-		m_abort = false;
-
-		// 创建一个http_stream对象.
-		http_object_ptr obj(new http_stream_object);
-
-		request_opts req_opt = m_settings.opts;
-		req_opt.insert(http_options::range, "bytes=0-");
-		req_opt.insert(http_options::connection, "keep-alive");
-
-		// 创建http_stream并同步打开, 检查返回状态码是否为206, 如果非206则表示该http服务器不支持多点下载.
-		obj->stream.reset(new http_stream(m_io_service));
-		http_stream &h = *obj->stream;
-
-		// 设置请求选项.
-		h.request_options(req_opt);
-		// 添加代理设置.
-		h.proxy(m_settings.proxy);
-		// 如果是ssl连接, 默认为检查证书.
-		h.check_certificate(m_settings.check_certificate);
-
-		change_outstranding(true);
-		typedef boost::function<void (boost::system::error_code)> HandlerWrapper;
-		h.async_open(m_final_url,
-			boost::bind(&multi_download::handle_start<HandlerWrapper>,
-				this,
-				HandlerWrapper(handler), obj,
-				boost::asio::placeholders::error
-			)
-		);
-
-		return;
-	}
-
-	// stop当前所有连接, 停止工作.
-	AVHTTP_DECL void stop()
-	{
-		m_abort = true;
-
-		boost::system::error_code ignore;
-		m_timer.cancel(ignore);
-
-#ifndef AVHTTP_DISABLE_THREAD
-		boost::mutex::scoped_lock lock(m_streams_mutex);
-#endif
-		for (std::size_t i = 0; i < m_streams.size(); i++)
-		{
-			const http_object_ptr &ptr = m_streams[i];
-			if (ptr && ptr->stream)
-			{
-				ptr->stream->close(ignore);
-			}
-		}
-	}
-
-	///获取指定的数据, 并改变下载点的位置.
-	// @param buffers 指定的数据缓冲. 这个类型必须满足MutableBufferSequence的定义,
-	//          MutableBufferSequence的定义在boost.asio文档中.
-	// @param offset 读取数据的指定偏移位置, 注意: offset影响内部下载位置从offset开始下载.
-	// 返回读取数据的大小.
-	template <typename MutableBufferSequence>
-	std::size_t fetch_data(const MutableBufferSequence &buffers,
-		boost::int64_t offset)
-	{
-		if (!m_storage) // 没有存储设备, 无法获得数据.
-		{
-			return 0;
-		}
-
-		// 更新下载点位置.
-		m_download_point = offset;
-
-		// 得到用户缓冲大小, 以确定最大读取字节数.
-		std::size_t buffer_length = 0;
-		{
-			typename MutableBufferSequence::const_iterator iter = buffers.begin();
-			typename MutableBufferSequence::const_iterator end = buffers.end();
-			// 计算得到用户buffers的总大小.
-			for (; iter != end; ++iter)
-			{
-				boost::asio::mutable_buffer buffer(*iter);
-				buffer_length += boost::asio::buffer_size(buffer);
-			}
-		}
-
-		// 得到offset后面可读取的数据大小, 使用折半法来获得可读空间大小.
-		while (buffer_length != 0)
-		{
-			if (m_downlaoded_field.check_range(offset, buffer_length))
-			{
-				break;
-			}
-			buffer_length /= 2;
-		}
-
-		// 读取数据.
-		if (buffer_length != 0)
-		{
-			std::size_t available_length = buffer_length;
-			boost::int64_t offset_for_read = offset;
-
-			typename MutableBufferSequence::const_iterator iter = buffers.begin();
-			typename MutableBufferSequence::const_iterator end = buffers.end();
-			// 计算得到用户buffers的总大小.
-			for (; iter != end; ++iter)
-			{
-				boost::asio::mutable_buffer buffer(*iter);
-
-				char* buffer_ptr = boost::asio::buffer_cast<char*>(buffer);
-				std::size_t buffer_size = boost::asio::buffer_size(buffer);
-
-				if ((boost::int64_t)available_length - (boost::int64_t)buffer_size < 0)
-					buffer_size = available_length;
-
-				std::size_t length = m_storage->read(buffer_ptr, offset_for_read, buffer_size);
-				BOOST_ASSERT(length == buffer_size);
-				offset_for_read += length;
-				available_length -= length;
-
-				if (available_length == 0)
-				{
-					break;
-				}
-			}
-			// 计算实际读取的字节数.
-			buffer_length = offset_for_read - offset;
-		}
-
-		return buffer_length;
-	}
-
-	///返回当前设置信息.
-	AVHTTP_DECL const settings& set() const
-	{
-		return m_settings;
-	}
-
-	///是否停止下载.
-	AVHTTP_DECL bool stopped() const
-	{
-		if (m_abort)
-		{
-#ifndef AVHTTP_DISABLE_THREAD
-			boost::mutex::scoped_lock lock(m_outstanding_mutex);
-#endif
-			if (m_outstanding == 0)
-			{
-				return true;
-			}
-		}
-		return false;
-	}
-
-	///等待直接下载完成.
-	// @完成返回true, 否则返回false.
-	AVHTTP_DECL bool wait_for_complete()
-	{
-		while (!stopped())
-		{
-			if (!m_abort)
-			{
-				boost::mutex::scoped_lock l(m_quit_mtx);
-				m_quit_cond.wait(l);
-			}
-		}
-		// 检查是否下载完成, 完成返回true, 否则返回false.
-		boost::int64_t fs = file_size();
-		if (fs != -1)
-		{
-			if (fs != bytes_download())
-			{
-				return false;	// 未下载完成.
-			}
-		}
-
-		return true; // 下载完成.
-	}
-
-	///设置是否检查证书, 默认检查证书.
-	// @param check指定是否检查ssl证书.
-	AVHTTP_DECL void check_certificate(bool check)
-	{
-		m_settings.check_certificate = check;
-	}
-
-	///返回当前下载的文件大小.
-	// @如果服务器不支持多点下载, 则可能文件大小为-1.
-	AVHTTP_DECL boost::int64_t file_size() const
-	{
-		return m_file_size;
-	}
-
-	///根据url计算出对应的meta文件名.
-	// @param url是指定的url地址.
-	// @返回一串由crc32编码url后的16进制字符串meta文件名.
-	AVHTTP_DECL std::string meta_name(const std::string &url) const
-	{
-		// 使用url的crc作为文件名, 这样只要url是确定的, 那么就不会找错meta文件.
-		boost::crc_32_type result;
-		result.process_bytes(url.c_str(), url.size());
-		std::stringstream ss;
-		ss.imbue(std::locale("C"));
-		ss << std::hex << result.checksum() << ".meta";
-		return ss.str();
-	}
-
-	///得到当前下载的文件名.
-	// @如果请求的url不太规则, 则可能返回错误的文件名.
-	AVHTTP_DECL std::string file_name() const
-	{
-		if (m_file_name.empty())
-		{
-			m_file_name = fs::path(detail::utf8_ansi(m_final_url.path())).leaf().string();
-			if (m_file_name == "/" || m_file_name == "")
-				m_file_name = fs::path(m_final_url.query()).leaf().string();
-			if (m_file_name == "/" || m_file_name == "" || m_file_name == ".")
-				m_file_name = "index.html";
-			if (!m_settings.save_path.empty())
-			{
-				if (fs::is_directory(m_settings.save_path))
-				{
-					fs::path p = m_settings.save_path / m_file_name;
-					m_file_name = p.string();
-				}
-				else
-				{
-					m_file_name = m_settings.save_path.string();
-				}
-			}
-			return m_file_name;
-		}
-		return m_file_name;
-	}
-
-	///当前已经下载的字节总数.
-	AVHTTP_DECL boost::int64_t bytes_download() const
-	{
-		if (m_file_size != -1)
-		{
-			return m_downlaoded_field.range_size();
-		}
-
-		boost::int64_t bytes_transferred = 0;
-
-		{
-#ifndef AVHTTP_DISABLE_THREAD
-			boost::mutex::scoped_lock l(m_streams_mutex);
-#endif
-
-			for (std::size_t i = 0; i < m_streams.size(); i++)
-			{
-				const http_object_ptr &ptr = m_streams[i];
-				if (ptr)
-				{
-					bytes_transferred += ptr->bytes_downloaded;
-				}
-			}
-		}
-
-		return bytes_transferred;
-	}
-
-	///当前下载速率, 单位byte/s.
-	AVHTTP_DECL int download_rate() const
-	{
-		return m_byte_rate.current_byte_rate;
-	}
-
-	///设置下载速率, -1为无限制, 单位byte/s.
-	AVHTTP_DECL void download_rate_limit(int rate)
-	{
-		m_settings.download_rate_limit = rate;
-	}
-
-	///返回当前限速.
-	AVHTTP_DECL int download_rate_limit() const
-	{
-		return m_settings.download_rate_limit;
-	}
-
-protected:
-
-	void handle_open(const int index,
-		http_object_ptr object_ptr, const boost::system::error_code &ec)
-	{
-		change_outstranding(false);
-		http_stream_object &object = *object_ptr;
-		if (ec || m_abort)
-		{
-			// 保存最后的错误信息, 避免一些过期无效或没有允可的链接不断的尝试.
-			object.ec = ec;
-
-			// 单连接模式, 表示下载停止, 终止下载.
-			if (!m_accept_multi)
-			{
-				m_abort = true;
-				boost::system::error_code ignore;
-				m_timer.cancel(ignore);
-			}
-
-			return;
-		}
-
-		if (!m_accept_multi)
-		{
-			// 当不支持断点续传时, 有时请求到的文件大小和start请求到的文件大小不一至, 则需要新file_size.
-			if (object.stream->content_length() != -1 &&
-				object.stream->content_length() != m_file_size)
-			{
-				m_file_size = object.stream->content_length();
-				m_rangefield.reset(m_file_size);
-				m_downlaoded_field.reset(m_file_size);
-			}
-		}
-
-		// 保存最后请求时间, 方便检查超时重置.
-		object.last_request_time = boost::posix_time::microsec_clock::local_time();
-
-		// 计算可请求的字节数.
-		int available_bytes = default_buffer_size;
-		if (m_drop_size != -1)
-		{
-			available_bytes = (std::min)(m_drop_size, default_buffer_size);
-			m_drop_size -= available_bytes;
-			if (available_bytes == 0)
-			{
-				// 避免空请求占用大量CPU, 让出CPU资源.
-				boost::this_thread::sleep(boost::posix_time::millisec(1));
-			}
-		}
-
-		// 发起数据读取请求.
-		http_stream_ptr &stream_ptr = object.stream;
-
-		change_outstranding(true);
-		// 传入指针http_object_ptr, 以确保多线程安全.
-		stream_ptr->async_read_some(boost::asio::buffer(object.buffer, available_bytes),
-			boost::bind(&multi_download::handle_read,
-				this,
-				index, object_ptr,
-				boost::asio::placeholders::bytes_transferred,
-				boost::asio::placeholders::error
-			)
-		);
-	}
-
-	void handle_read(const int index,
-		http_object_ptr object_ptr, int bytes_transferred, const boost::system::error_code &ec)
-	{
-		change_outstranding(false);
-		http_stream_object &object = *object_ptr;
-
-		// 保存数据, 当远程服务器断开时, ec为eof, 保证数据全部写入.
-		if (m_storage && bytes_transferred != 0 && (!ec || ec == boost::asio::error::eof))
-		{
-			// 计算offset.
-			boost::int64_t offset = object.request_range.left + object.bytes_transferred;
-
-			// 更新完成下载区间位图.
-			if (m_file_size != -1)
-			{
-				m_downlaoded_field.update(offset, offset + bytes_transferred);
-			}
-
-			// 使用m_storage写入.
-			m_storage->write(object.buffer.c_array(), offset, bytes_transferred);
-		}
-
-		// 如果发生错误或终止.
-		if (ec || m_abort)
-		{
-			// 单连接模式, 表示下载停止, 终止下载.
-			if (!m_accept_multi)
-			{
-				m_abort = true;
-				boost::system::error_code ignore;
-				m_timer.cancel(ignore);
-			}
-
-			return;
-		}
-
-		// 统计本次已经下载的总字节数.
-		object.bytes_transferred += bytes_transferred;
-
-		// 统计总下载字节数.
-		object.bytes_downloaded += bytes_transferred;
-
-		// 用于计算下载速率.
-		m_byte_rate.last_byte_rate[m_byte_rate.index] += bytes_transferred;
-
-		// 判断请求区间的数据已经下载完成, 如果下载完成, 则分配新的区间, 发起新的请求.
-		if (m_accept_multi && object.bytes_transferred >= object.request_range.size())
-		{
-			// 不支持长连接, 则创建新的连接.
-			// 如果是第1个连接, 请求范围是0-文件尾, 也需要断开重新连接.
-			if (!m_keep_alive || (object.request_range.left == 0 && index == 0))
-			{
-				// 新建新的http_stream对象.
-				object.direct_reconnect = true;
-				return;
-			}
-
-			http_stream &stream = *object.stream;
-
-			// 配置请求选项.
-			request_opts req_opt = m_settings.opts;
-
-			// 设置是否为长连接.
-			if (m_keep_alive)
-			{
-				req_opt.insert(http_options::connection, "keep-alive");
-			}
-
-			// 如果分配空闲空间失败, 则跳过这个socket, 并立即尝试连接这个socket.
-			if (!allocate_range(object.request_range))
-			{
-				object.direct_reconnect = true;
-				return;
-			}
-
-			// 清空计数.
-			object.bytes_transferred = 0;
-
-			// 插入新的区间请求.
-			req_opt.insert(http_options::range,
-				boost::str(boost::format("bytes=%lld-%lld", std::locale("C")) %
-				object.request_range.left % object.request_range.right));
-
-			// 添加代理设置.
-			stream.proxy(m_settings.proxy);
-			// 设置到请求选项中.
-			stream.request_options(req_opt);
-			// 如果是ssl连接, 默认为检查证书.
-			stream.check_certificate(m_settings.check_certificate);
-			// 禁用重定向.
-			stream.max_redirects(0);
-
-			// 保存最后请求时间, 方便检查超时重置.
-			object.last_request_time = boost::posix_time::microsec_clock::local_time();
-
-			change_outstranding(true);
-
-			// 发起异步http数据请求, 传入指针http_object_ptr, 以确保多线程安全.
-			if (!m_keep_alive)
-			{
-				stream.async_open(m_final_url,
-					boost::bind(&multi_download::handle_open,
-						this,
-						index, object_ptr,
-						boost::asio::placeholders::error
-					)
-				);
-			}
-			else
-			{
-				stream.async_request(req_opt,
-					boost::bind(&multi_download::handle_request,
-						this,
-						index, object_ptr,
-						boost::asio::placeholders::error
-					)
-				);
-			}
-		}
-		else
-		{
-			// 服务器不支持多点下载, 说明数据已经下载完成.
-			if (!m_accept_multi &&
-				(m_file_size != -1 && object.bytes_downloaded == m_file_size))
-			{
-				m_abort = true;
-				boost::system::error_code ignore;
-				m_timer.cancel(ignore);
-				return;
-			}
-
-			// 保存最后请求时间, 方便检查超时重置.
-			object.last_request_time = boost::posix_time::microsec_clock::local_time();
-
-			// 计算可请求的字节数.
-			int available_bytes = default_buffer_size;
-			if (m_drop_size != -1)
-			{
-				available_bytes = (std::min)(m_drop_size, default_buffer_size);
-				m_drop_size -= available_bytes;
-				if (available_bytes == 0)
-				{
-					// 避免空请求占用大量CPU, 让出CPU资源.
-					boost::this_thread::sleep(boost::posix_time::millisec(1));
-				}
-			}
-
-			change_outstranding(true);
-			// 继续读取数据, 传入指针http_object_ptr, 以确保多线程安全.
-			object.stream->async_read_some(boost::asio::buffer(object.buffer, available_bytes),
-				boost::bind(&multi_download::handle_read,
-					this,
-					index, object_ptr,
-					boost::asio::placeholders::bytes_transferred,
-					boost::asio::placeholders::error
-				)
-			);
-		}
-	}
-
-	void handle_request(const int index,
-		http_object_ptr object_ptr, const boost::system::error_code &ec)
-	{
-		change_outstranding(false);
-		http_stream_object &object = *object_ptr;
-		object.request_count++;
-		if (ec || m_abort)
-		{
-			// 保存最后的错误信息, 避免一些过期无效或没有允可的链接不断的尝试.
-			object.ec = ec;
-
-			// 单连接模式, 表示下载停止, 终止下载.
-			if (!m_accept_multi)
-			{
-				m_abort = true;
-				boost::system::error_code ignore;
-				m_timer.cancel(ignore);
-			}
-
-			return;
-		}
-
-		// 保存最后请求时间, 方便检查超时重置.
-		object.last_request_time = boost::posix_time::microsec_clock::local_time();
-
-		// 计算可请求的字节数.
-		int available_bytes = default_buffer_size;
-		if (m_drop_size != -1)
-		{
-			available_bytes = (std::min)(m_drop_size, default_buffer_size);
-			m_drop_size -= available_bytes;
-			if (available_bytes == 0)
-			{
-				// 避免空请求占用大量CPU, 让出CPU资源.
-				boost::this_thread::sleep(boost::posix_time::millisec(1));
-			}
-		}
-
-		change_outstranding(true);
-		// 发起数据读取请求, 传入指针http_object_ptr, 以确保多线程安全.
-		object_ptr->stream->async_read_some(boost::asio::buffer(object.buffer, available_bytes),
-			boost::bind(&multi_download::handle_read,
-				this,
-				index, object_ptr,
-				boost::asio::placeholders::bytes_transferred,
-				boost::asio::placeholders::error
-			)
-		);
-	}
-
-	template <typename Handler>
-	void handle_start(Handler handler, http_object_ptr object_ptr, const boost::system::error_code &ec)
-	{
-		change_outstranding(false);
-
-		// 打开失败则退出.
-		if (ec)
-		{
-			handler(ec);
-			return;
-		}
-
-		boost::system::error_code err;
-
-		// 下面使用引用http_stream_object对象.
-		http_stream_object &object = *object_ptr;
-
-		// 同样引用http_stream对象.
-		http_stream &h = *object.stream;
-
-		// 保存最终url信息.
-		std::string location = h.location();
-		if (!location.empty())
-		{
-			m_final_url = location;
-		}
-
-		// 判断是否支持多点下载.
-		std::string status_code;
-		h.response_options().find(http_options::status_code, status_code);
-		if (status_code != "206")
-		{
-			m_accept_multi = false;
-		}
-		else
-		{
-			m_accept_multi = true;
-		}
-
-		// 禁用并发模式下载.
-		if (m_settings.disable_multi_download)
-		{
-			m_accept_multi = false;
-		}
-
-		// 得到文件大小.
-		std::string length;
-		h.response_options().find(http_options::content_length, length);
-		if (length.empty())
-		{
-			h.response_options().find(http_options::content_range, length);
-			std::string::size_type f = length.find('/');
-			if (f++ != std::string::npos)
-			{
-				length = length.substr(f);
-			}
-			else
-			{
-				length = "";
-			}
-
-			if (length.empty())
-			{
-				// 得到不文件长度, 设置为不支持多下载模式.
-				m_accept_multi = false;
-			}
-		}
-
-		boost::int64_t file_size = -1;
-		if (!length.empty())
-		{
-			try
-			{
-				file_size = boost::lexical_cast<boost::int64_t>(length);
-			}
-			catch (boost::bad_lexical_cast &)
-			{
-				// 得不到正确的文件长度, 设置为不支持多下载模式.
-				m_accept_multi = false;
-			}
-		}
-
-		// 按文件大小分配rangefield.
-		if (file_size != -1 && file_size != m_file_size)
-		{
-			m_file_size = file_size;
-			m_rangefield.reset(m_file_size);
-			m_downlaoded_field.reset(m_file_size);
-		}
-
-		// 是否支持长连接模式, 不支持多点下载, 长连接也没有意义.
-		if (m_accept_multi)
-		{
-			std::string keep_alive;
-			h.response_options().find(http_options::connection, keep_alive);
-			boost::to_lower(keep_alive);
-			if (keep_alive == "keep-alive")
-			{
-				m_keep_alive = true;
-			}
-			else
-			{
-				m_keep_alive = false;
-			}
-
-			// 如果未指定meta文件名, 则使用最终url生成meta文件名.
-			if (m_settings.meta_file.empty())
-			{
-				// 没有指定meta文件名, 自动修正meta文件名.
-				m_settings.meta_file = meta_name(m_final_url.to_string());
-			}
-
-			// 打开meta文件, 如果打开成功, 则表示解析出相应的位图了.
-			if (!open_meta(m_settings.meta_file))
-			{
-				// 位图打开失败, 无所谓, 下载过程中会创建新的位图, 删除meta文件.
-				m_file_meta.close();
-				fs::remove(m_settings.meta_file, err);
-			}
-		}
-
-		// 判断文件是否已经下载完成, 完成则直接返回.
-		if (m_downlaoded_field.is_full())
-		{
-			handler(err);
-			return;
-		}
-
-		// 创建存储对象.
-		if (!m_settings.storage)
-		{
-			m_storage.reset(default_storage_constructor());
-		}
-		else
-		{
-			m_storage.reset(m_settings.storage());
-		}
-		BOOST_ASSERT(m_storage);
-
-		// 打开文件, 构造文件名.
-		m_storage->open(boost::filesystem::path(file_name()), err);
-		if (err)
-		{
-			handler(err);
-			return;
-		}
-
-		// 处理默认设置.
-		if (m_settings.connections_limit == -1)
-		{
-			m_settings.connections_limit = default_connections_limit;
-		}
-		if (m_settings.piece_size == -1 && m_file_size != -1)
-		{
-			m_settings.piece_size = default_piece_size(m_file_size);
-		}
-
-		// 根据第1个连接返回的信息, 设置请求选项.
-		request_opts req_opt = m_settings.opts;
-		if (m_keep_alive)
-		{
-			req_opt.insert(http_options::connection, "keep-alive");
-		}
-		else
-		{
-			req_opt.insert(http_options::connection, "close");
-		}
-
-		// 修改终止状态.
-		m_abort = false;
-
-		// 连接计数置为1.
-		m_number_of_connections = 1;
-
-		// 添加第一个连接到连接容器.
-		{
-#ifndef AVHTTP_DISABLE_THREAD
-			boost::mutex::scoped_lock lock(m_streams_mutex);
-#endif
-			m_streams.push_back(object_ptr);
-		}
-
-		// 为第1个连接请求的buffer大小.
-		int available_bytes = default_buffer_size;
-
-		// 设置第1个连接下载范围.
-		if (m_accept_multi)
-		{
-			range req_range;
-			bool need_reopen = false;
-
-			// 从文件区间中获得一段空间, 这是第一次分配给obj下载的任务.
-			if (allocate_range(req_range))
-			{
-				// 分配到的起始边界不是0, 需要重新open这个obj.
-				if (req_range.left != 0)
-				{
-					need_reopen = true;
-				}
-
-				// 保存请求区间.
-				object_ptr->request_range = req_range;
-
-				// 设置请求区间到请求选项中.
-				req_opt.remove(http_options::range);
-				req_opt.insert(http_options::range, boost::str(
-					boost::format("bytes=%lld-%lld", std::locale("C")) % req_range.left % req_range.right));
-
-				// 保存最后请求时间, 用于检查超时重置.
-				object_ptr->last_request_time = boost::posix_time::microsec_clock::local_time();
-
-				// 添加代理设置.
-				h.proxy(m_settings.proxy);
-				// 设置请求选项.
-				h.request_options(req_opt);
-				// 如果是ssl连接, 默认为检查证书.
-				h.check_certificate(m_settings.check_certificate);
-				// 禁用重定向.
-				h.max_redirects(0);
-
-				if (need_reopen)
-				{
-					h.close(err);	// 关闭原来的连接, 需要请求新的区间.
-					if (err)
-					{
-						handler(err);
-						return;
-					}
-
-					change_outstranding(true);
-					// 开始异步打开.
-					h.async_open(m_final_url,
-						boost::bind(&multi_download::handle_open,
-							this,
-							0, object_ptr,
-							boost::asio::placeholders::error
-						)
-					);
-				}
-				else
-				{
-					// 发起数据读取请求.
-					change_outstranding(true);
-					// 传入指针obj, 以确保多线程安全.
-					h.async_read_some(boost::asio::buffer(object_ptr->buffer, available_bytes),
-						boost::bind(&multi_download::handle_read,
-							this,
-							0, object_ptr,
-							boost::asio::placeholders::bytes_transferred,
-							boost::asio::placeholders::error
-						)
-					);
-				}
-			}
-			else
-			{
-				// 分配空间失败, 说明可能已经没有空闲的空间提供
-				// 给这个stream进行下载了直接跳过好了.
-				object_ptr->done = true;
-			}
-		}
-		else	// 服务器不支持多点下载模式, 继续从第1个连接下载.
-		{
-			// 发起数据读取请求.
-			change_outstranding(true);
-			// 传入指针obj, 以确保多线程安全.
-			h.async_read_some(boost::asio::buffer(object_ptr->buffer, available_bytes),
-				boost::bind(&multi_download::handle_read,
-					this,
-					0, object_ptr,
-					boost::asio::placeholders::bytes_transferred,
-					boost::asio::placeholders::error
-				)
-			);
-		}
-
-		// 如果支持多点下载, 按设置创建其它http_stream.
-		if (m_accept_multi)
-		{
-			for (int i = 1; i < m_settings.connections_limit; i++)
-			{
-				http_object_ptr p(new http_stream_object());
-				http_stream_ptr ptr(new http_stream(m_io_service));
-				range req_range;
-
-				// 从文件间区中得到一段空间.
-				if (!allocate_range(req_range))
-				{
-					// 分配空间失败, 说明可能已经没有空闲的空间提供给这个stream进行下载了直接跳过好了.
-					p->done = true;
-					continue;
-				}
-
-				// 保存请求区间.
-				p->request_range = req_range;
-
-				// 设置请求区间到请求选项中.
-				req_opt.remove(http_options::range);
-				req_opt.insert(http_options::range, boost::str(
-					boost::format("bytes=%lld-%lld", std::locale("C")) % req_range.left % req_range.right));
-
-				// 设置请求选项.
-				ptr->request_options(req_opt);
-				// 添加代理设置.
-				ptr->proxy(m_settings.proxy);
-				// 如果是ssl连接, 默认为检查证书.
-				ptr->check_certificate(m_settings.check_certificate);
-				// 禁用重定向.
-				ptr->max_redirects(0);
-
-				// 将连接添加到容器中.
-				p->stream = ptr;
-
-				{
-#ifndef AVHTTP_DISABLE_THREAD
-					boost::mutex::scoped_lock lock(m_streams_mutex);
-#endif
-					m_streams.push_back(p);
-				}
-
-				// 保存最后请求时间, 方便检查超时重置.
-				p->last_request_time = boost::posix_time::microsec_clock::local_time();
-
-				m_number_of_connections++;
-				change_outstranding(true);
-
-				// 开始异步打开, 传入指针http_object_ptr, 以确保多线程安全.
-				p->stream->async_open(m_final_url,
-					boost::bind(&multi_download::handle_open,
-						this,
-						i, p,
-						boost::asio::placeholders::error
-					)
-				);
-			}
-		}
-
-		change_outstranding(true);
-
-		// 开启定时器, 执行任务.
-		m_timer.expires_from_now(boost::posix_time::seconds(1));
-		m_timer.async_wait(boost::bind(&multi_download::on_tick, this, boost::asio::placeholders::error));
-
-		// 回调通知用户, 已经成功启动下载.
-		handler(ec);
-
-		return;
-	}
-
-	void on_tick(const boost::system::error_code &e)
-	{
-		change_outstranding(false);
-		m_time_total++;
-
-		// 在这里更新位图.
-		if (m_accept_multi)
-		{
-			update_meta();
-		}
-
-		// 每隔1秒进行一次on_tick.
-		if (!m_abort && !e)
-		{
-			change_outstranding(true);
-			m_timer.expires_from_now(boost::posix_time::seconds(1));
-			m_timer.async_wait(boost::bind(&multi_download::on_tick,
-				this, boost::asio::placeholders::error));
-		}
-		else
-		{
-			// 已经终止.
-			return;
-		}
-
-		// 用于计算动态下载速率.
-		{
-			int bytes_count = 0;
-
-			for (int i = 0; i < m_byte_rate.seconds; i++)
-				bytes_count += m_byte_rate.last_byte_rate[i];
-
-			m_byte_rate.current_byte_rate = (double)bytes_count / m_byte_rate.seconds;
-
-			if (m_byte_rate.index + 1 >= m_byte_rate.seconds)
-				m_byte_rate.last_byte_rate[m_byte_rate.index = 0] = 0;
-			else
-				m_byte_rate.last_byte_rate[++m_byte_rate.index] = 0;
-		}
-
-		// 计算限速.
-		m_drop_size = m_settings.download_rate_limit;
-
-#ifndef AVHTTP_DISABLE_THREAD
-		// 锁定m_streams容器进行操作, 保证m_streams操作的唯一性.
-		boost::mutex::scoped_lock lock(m_streams_mutex);
-#endif
-		for (std::size_t i = 0; i < m_streams.size(); i++)
-		{
-			http_object_ptr &object_item_ptr = m_streams[i];
-			boost::posix_time::time_duration duration =
-				boost::posix_time::microsec_clock::local_time() - object_item_ptr->last_request_time;
-
-			if (!object_item_ptr->done && (duration > boost::posix_time::seconds(m_settings.time_out)
-				|| object_item_ptr->direct_reconnect))
-			{
-				// 超时或出错, 关闭并重新创建连接.
-				boost::system::error_code ec;
-				object_item_ptr->stream->close(ec);
-
-				// 出现下列之一的错误, 将不再尝试连接服务器, 因为重试也是没有意义的.
-				if (object_item_ptr->ec == avhttp::errc::forbidden
-					|| object_item_ptr->ec == avhttp::errc::not_found
-					|| object_item_ptr->ec == avhttp::errc::method_not_allowed)
-				{
-					object_item_ptr->done = true;
-					continue;
-				}
-
-				// 单连接模式, 表示下载停止, 终止下载.
-				if (!m_accept_multi)
-				{
-					m_abort = true;
-					object_item_ptr->done = true;
-					m_number_of_connections--;
-					continue;
-				}
-
-				// 重置重连标识.
-				object_item_ptr->direct_reconnect = false;
-
-				// 重新创建http_object和http_stream.
-				object_item_ptr.reset(new http_stream_object(*object_item_ptr));
-				http_stream_object &object = *object_item_ptr;
-
-				// 使用新的http_stream对象.
-				object.stream.reset(new http_stream(m_io_service));
-
-				http_stream &stream = *object.stream;
-
-				// 配置请求选项.
-				request_opts req_opt = m_settings.opts;
-
-				// 设置是否为长连接.
-				if (m_keep_alive)
-				{
-					req_opt.insert(http_options::connection, "keep-alive");
-				}
-
-				// 继续从上次未完成的位置开始请求.
-				if (m_accept_multi)
-				{
-					boost::int64_t begin = object.request_range.left + object.bytes_transferred;
-					boost::int64_t end = object.request_range.right;
-
-					if (end - begin <= 0)
-					{
-						// 如果分配空闲空间失败, 则跳过这个socket.
-						if (!allocate_range(object.request_range))
-						{
-							object.done = true;	// 已经没什么可以下载了.
-							m_number_of_connections--;
-							continue;
-						}
-
-						object.bytes_transferred = 0;
-						begin = object.request_range.left;
-						end = object.request_range.right;
-					}
-
-					req_opt.insert(http_options::range, boost::str(
-						boost::format("bytes=%lld-%lld", std::locale("C")) % begin % end));
-				}
-
-				// 添加代理设置.
-				stream.proxy(m_settings.proxy);
-				// 设置到请求选项中.
-				stream.request_options(req_opt);
-				// 如果是ssl连接, 默认为检查证书.
-				stream.check_certificate(m_settings.check_certificate);
-				// 禁用重定向.
-				stream.max_redirects(0);
-
-				// 保存最后请求时间, 方便检查超时重置.
-				object.last_request_time = boost::posix_time::microsec_clock::local_time();
-
-				change_outstranding(true);
-				// 重新发起异步请求, 传入object_item_ptr指针, 以确保线程安全.
-				stream.async_open(m_final_url,
-					boost::bind(&multi_download::handle_open,
-						this,
-						i, object_item_ptr,
-						boost::asio::placeholders::error
-					)
-				);
-			}
-		}
-
-		// 统计操作功能完成的http_stream的个数.
-		int done = 0;
-		for (std::size_t i = 0; i < m_streams.size(); i++)
-		{
-			http_object_ptr &object_item_ptr = m_streams[i];
-			if (object_item_ptr->done)
-			{
-				done++;
-			}
-		}
-
-		// 当m_streams中所有连接都done时, 表示已经下载完成.
-		if (done == m_streams.size())
-		{
-			boost::system::error_code ignore;
-			m_abort = true;
-			m_timer.cancel(ignore);
-			// 通知wait_for_complete退出.
-			boost::mutex::scoped_lock l(m_quit_mtx);
-			m_quit_cond.notify_one();
-			return;
-		}
-	}
-
-	bool allocate_range(range &r)
-	{
-#ifndef AVHTTP_DISABLE_THREAD
-		// 在多线程运行io_service时, 必须加锁, 避免重入时多次重复分配相同区域.
-		// 单线程执行io_service(并启用了AVHTTP_DISABLE_THREAD)无需考虑加
-		// 锁, 因为所有操作都是异步串行的动作.
-		boost::mutex::scoped_lock lock(m_rangefield_mutex);
-#endif
-
-		range temp(-1, -1);
-
-		do
-		{
-			// 从指定位置m_download_point开始文件间区中得到一段空间.
-			if (!m_rangefield.out_space(m_download_point, temp.left, temp.right))
-			{
-				return false;
-			}
-
-			// 用于调试.
-			BOOST_ASSERT(temp != r);
-			BOOST_ASSERT(temp.size() >= 0);
-
-			// 重新计算为最大max_request_bytes大小.
-			boost::int64_t max_request_bytes = m_settings.request_piece_num * m_settings.piece_size;
-			if (temp.size() > max_request_bytes)
-			{
-				temp.right = temp.left + max_request_bytes;
-			}
-
-			r = temp;
-
-			// 从m_rangefield中分配这个空间.
-			if (!m_rangefield.update(temp))
-			{
-				continue;
-			}
-			else
-			{
-				break;
-			}
-		} while (!m_abort);
-
-		// 右边边界减1, 因为http请求的区间是包含右边界值, 下载时会将right下标位置的字节下载.
-		if (--r.right < r.left)
-		{
-			return false;
-		}
-
-		return true;
-	}
-
-	bool open_meta(const fs::path &file_path)
-	{
-		boost::system::error_code ec;
-
-		// 得到文件大小.
-		boost::uintmax_t size = fs::file_size(file_path, ec);
-		if (ec)
-		{
-			size = 0;
-		}
-
-		// 打开文件.
-		m_file_meta.close();
-		m_file_meta.open(file_path, ec);
-		if (ec)
-		{
-			return false;
-		}
-
-		// 如果有数据, 则解码meta数据.
-		if (size != 0)
-		{
-			std::vector<char> buffer;
-
-			buffer.resize(size);
-			const std::streamsize num = m_file_meta.read(&buffer[0], 0, size);
-			if (num != size)
-			{
-				return false;
-			}
-
-			entry e = bdecode(buffer.begin(), buffer.end());
-
-			// 最终的url.
-			if (m_settings.allow_use_meta_url)
-			{
-				const std::string url = e["final_url"].string();
-				if (!url.empty())
-				{
-					m_final_url = url;
-				}
-			}
-
-			// 文件大小.
-			m_file_size = e["file_size"].integer();
-			m_rangefield.reset(m_file_size);
-			m_downlaoded_field.reset(m_file_size);
-
-			// 分片大小.
-			m_settings.piece_size = e["piece_size"].integer();
-
-			// 分片数.
-			int piece_num = e["piece_num"].integer();
-
-			// 位图数据.
-			std::string bitfield_data = e["bitfield"].string();
-
-			// 构造到位图.
-			bitfield bf(bitfield_data.c_str(), piece_num);
-
-			// 更新到区间范围.
-			m_rangefield.bitfield_to_range(bf, m_settings.piece_size);
-			m_downlaoded_field.bitfield_to_range(bf, m_settings.piece_size);
-		}
-
-		return true;
-	}
-
-	void update_meta()
-	{
-		if (!m_file_meta.is_open())
-		{
-			boost::system::error_code ec;
-			m_file_meta.open(m_settings.meta_file, ec);
-			if (ec)
-			{
-				return;
-			}
-		}
-
-		entry e;
-
-		e["final_url"] = m_final_url.to_string();
-		e["file_size"] = m_file_size;
-		e["piece_size"] = m_settings.piece_size;
-		e["piece_num"] = (m_file_size / m_settings.piece_size) +
-			(m_file_size % m_settings.piece_size == 0 ? 0 : 1);
-		bitfield bf;
-		m_downlaoded_field.range_to_bitfield(bf, m_settings.piece_size);
-		std::string str(bf.bytes(), bf.bytes_size());
-		e["bitfield"] = str;
-
-		std::vector<char> buffer;
-		bencode(back_inserter(buffer), e);
-
-		m_file_meta.write(&buffer[0], 0, buffer.size());
-	}
-
-private:
-
-	inline void change_outstranding(bool addref = true)
-	{
-#ifndef AVHTTP_DISABLE_THREAD
-		boost::mutex::scoped_lock lock(m_outstanding_mutex);
-#endif
-		if (addref)
-		{
-			m_outstanding++;
-		}
-		else
-		{
-			m_outstanding--;
-		}
-	}
-
-	// 默认根据文件大小自动计算分片大小.
-	std::size_t default_piece_size(const boost::int64_t &file_size) const
-	{
-		const int target_size = 40 * 1024;
-		std::size_t piece_size = boost::int64_t(file_size / (target_size / 20));
-
-		int i = 16 * 1024;
-		for (; i < 16 * 1024 * 1024; i *= 2)
-		{
-			if (piece_size > i) continue;
-			break;
-		}
-		piece_size = i;
-
-		return piece_size;
-	}
-
-private:
-	// io_service引用.
-	boost::asio::io_service &m_io_service;
-
-	// 每一个http_stream_obj是一个http连接.
-	// 注意: 容器中的http_object_ptr只能在on_tick一处进行写操作, 并且确保其它地方
-	// 是新的副本, 这主要体现在发起新的异步操作的时候将http_object_ptr作为参数形式
-	// 传入, 这样在异步回调中只需要访问http_object_ptr的副本指针, 而不是直接访问
-	// m_streams!!!
-	std::vector<http_object_ptr> m_streams;
-
-#ifndef AVHTTP_DISABLE_THREAD
-	// 为m_streams在多线程环境下线程安全.
-	mutable boost::mutex m_streams_mutex;
-#endif
-
-	// 最终的url, 如果有跳转的话, 是跳转最后的那个url.
-	url m_final_url;
-
-	// 是否支持多点下载.
-	bool m_accept_multi;
-
-	// 是否支持长连接.
-	bool m_keep_alive;
-
-	// 文件大小, 如果没有文件大小值为-1.
-	boost::int64_t m_file_size;
-
-	// 保存的文件名.
-	mutable std::string m_file_name;
-
-	// 当前用户设置.
-	settings m_settings;
-
-	// 定时器, 用于定时执行一些任务, 比如检查连接是否超时之类.
-	boost::asio::deadline_timer m_timer;
-
-	// 动态计算速率.
-	byte_rate m_byte_rate;
-
-	// 实际连接数.
-	int m_number_of_connections;
-
-	// 下载计时.
-	int m_time_total;
-
-	// 下载数据存储接口指针, 可由用户定义, 并在open时指定.
-	boost::scoped_ptr<storage_interface> m_storage;
-
-	// meta文件, 用于续传.
-	file m_file_meta;
-
-	// 下载点位置.
-	boost::int64_t m_download_point;
-
-	// 文件区间图, 每次请求将由m_rangefield来分配空间区间.
-	rangefield m_rangefield;
-
-	// 已经下载的文件区间.
-	rangefield m_downlaoded_field;
-
-	// 保证分配空闲区间的唯一性.
-#ifndef AVHTTP_DISABLE_THREAD
-	boost::mutex m_rangefield_mutex;
-#endif
-
-	// 用于限速.
-	int m_drop_size;
-
-	// 用于异步工作计数.
-	int m_outstanding;
-
-#ifndef AVHTTP_DISABLE_THREAD
-	mutable boost::mutex m_outstanding_mutex;
-#endif
-
-	// 用于通知wait_for_complete退出.
-	mutable boost::mutex m_quit_mtx;
-	mutable boost::condition m_quit_cond;
-
-	// 是否中止工作.
-	bool m_abort;
-};
-
-} // avhttp
-
-#endif // MULTI_DOWNLOAD_HPP__
+//
+// multi_download.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// path LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef MULTI_DOWNLOAD_HPP__
+#define MULTI_DOWNLOAD_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <vector>
+#include <list>
+#include <algorithm>    // for std::min/std::max
+
+#include <boost/assert.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time.hpp>
+#include <boost/format.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/crc.hpp>  // for boost::crc_32_type
+#include <boost/asio/strand.hpp>
+
+#include "avhttp/file.hpp"
+#include "avhttp/http_stream.hpp"
+#include "avhttp/rangefield.hpp"
+#include "avhttp/entry.hpp"
+#include "avhttp/settings.hpp"
+#include "avhttp/retry_policy.hpp"
+#include "avhttp/io_service_pool.hpp"
+#include "avhttp/download_event.hpp"
+#include "avhttp/detail/piece_hasher.hpp"
+#include "avhttp/detail/atomic.hpp"
+
+
+namespace avhttp
+{
+
+// multi_download类的具体实现.
+class multi_download : public boost::noncopyable
+{
+	// 重定义http_stream_ptr指针.
+	typedef boost::shared_ptr<http_stream> http_stream_ptr;
+
+	// 定义http_stream_obj.
+	// 这个连接的handler都在strand中串行执行, 只在strand中访问的成员无需加锁. 定时器等
+	// 其它地方也会访问的下载状态(request_range, bytes_transferred, bytes_downloaded,
+	// last_request_time, ec, done, direct_reconnect, reconnecting)由mutex保护.
+	// retries和retry_timer只在strand中访问.
+	struct http_stream_object
+	{
+		explicit http_stream_object(boost::asio::io_service &ios,
+			io_service_pool::shard_ptr s = io_service_pool::shard_ptr())
+			: io(ios)
+			, shard(s)
+			, strand(new boost::asio::io_service::strand(ios))
+			, request_range(0, 0)
+			, bytes_transferred(0)
+			, bytes_downloaded(0)
+			, request_count(0)
+			, rtt(0)
+			, throughput(0)
+			, retries(0)
+			, done(false)
+			, direct_reconnect(false)
+			, reconnecting(false)
+		{}
+
+		// 重新创建连接时, 复制下载状态, 并使用同一个io_service和strand, 数据缓冲不复制.
+		http_stream_object(const http_stream_object &other)
+			: io(other.io)
+			, shard(other.shard)
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(other.mutex);
+#endif
+			stream = other.stream;
+			strand = other.strand;
+			request_range = other.request_range;
+			bytes_transferred = other.bytes_transferred;
+			bytes_downloaded = other.bytes_downloaded;
+			request_count = other.request_count;
+			last_request_time = other.last_request_time;
+			response_time = other.response_time;
+			rtt = other.rtt;
+			throughput = other.throughput;
+			ec = other.ec;
+			retries = other.retries;
+			done = other.done;
+			direct_reconnect = other.direct_reconnect;
+			reconnecting = false;
+		}
+
+		// 这个连接所在的io_service.
+		boost::asio::io_service &io;
+
+		// 使用io_service_pool时, 这个连接在池中的占用, 连接销毁时释放.
+		io_service_pool::shard_ptr shard;
+
+		// http_stream对象.
+		http_stream_ptr stream;
+
+		// 串行执行这个连接所有handler的strand.
+		boost::shared_ptr<boost::asio::io_service::strand> strand;
+
+#ifndef AVHTTP_DISABLE_THREAD
+		// 保护下载状态.
+		mutable boost::mutex mutex;
+#endif
+
+		// 数据缓冲, 下载时的缓冲.
+		boost::array<char, default_buffer_size> buffer;
+
+		// 请求的数据范围, 每次由multi_download分配一个下载范围, stream按这个范围去下载.
+		range request_range;
+
+		// 本次请求已经下载的数据, 相对于request_range, 当一个request_range下载完成后,
+		// bytes_transferred自动置为0.
+		boost::int64_t bytes_transferred;
+
+		// 当前对象下载的数据统计.
+		boost::int64_t bytes_downloaded;
+
+		// 当前对象发起请求的次数.
+		int request_count;
+
+		// 最后请求的时间.
+		boost::posix_time::ptime last_request_time;
+
+		// 收到本次请求响应的时间, 用于计算吞吐量.
+		boost::posix_time::ptime response_time;
+
+		// 平滑后的RTT, 单位毫秒.
+		double rtt;
+
+		// 平滑后的吞吐量, 单位byte/s.
+		double throughput;
+
+		// 最后的错误信息.
+		boost::system::error_code ec;
+
+		// 连续失败的次数, 连接成功后清零.
+		int retries;
+
+		// 按重试策略等待重新连接的定时器.
+		boost::shared_ptr<boost::asio::deadline_timer> retry_timer;
+
+		// 是否操作功能完成.
+		bool done;
+
+		// 立即重新尝试连接, 置位后这个对象上的handler不再继续下载.
+		bool direct_reconnect;
+
+		// 已经投递了重新连接, 或者正在按重试策略等待重新连接.
+		bool reconnecting;
+
+	private:
+		http_stream_object& operator=(const http_stream_object&);
+	};
+
+	// 重定义http_object_ptr指针.
+	typedef boost::shared_ptr<http_stream_object> http_object_ptr;
+
+	// 用于计算下载速率, 各个连接的handler同时累加, 定时器中计算速率.
+	struct byte_rate
+	{
+		byte_rate()
+			: seconds(5)
+			, index(0)
+			, current_byte_rate(0)
+		{
+			last_byte_rate.resize(seconds, 0);
+		}
+
+		// 用于统计速率的时间.
+		const int seconds;
+
+		// 最后的byte_rate.
+		std::vector<detail::atomic<int> > last_byte_rate;
+
+		// last_byte_rate的下标.
+		detail::atomic<int> index;
+
+		// 当前byte_rate.
+		detail::atomic<int> current_byte_rate;
+	};
+
+	// 等待数据下载完成的async_fetch_data请求.
+	struct fetch_waiter
+	{
+		fetch_waiter()
+			: offset(0)
+			, length(0)
+		{}
+
+		// 等待的数据区间[offset, offset + length).
+		boost::int64_t offset;
+		boost::int64_t length;
+
+		// 数据齐全或失败时调用, 完成读取并回调用户的handler.
+		boost::function<void (const boost::system::error_code&)> op;
+	};
+
+	// 续传校验时各个校验任务共享的状态.
+	struct resume_check_state
+	{
+		resume_check_state()
+			: next(0)
+			, running(0)
+		{}
+
+		// 需要校验的分片.
+		std::vector<int> pieces;
+
+		// 下一个待校验分片在pieces中的位置.
+		std::size_t next;
+
+		// 正在运行的校验任务数.
+		int running;
+
+		// 校验失败的分片.
+		std::vector<int> bad;
+
+		boost::mutex mutex;
+		boost::condition cond;
+	};
+
+	// 事件订阅.
+	struct event_subscription
+	{
+		event_subscription()
+			: id(0)
+			, last_bytes(-1)
+			, timer_running(false)
+			, closed(false)
+		{}
+
+		// 订阅id.
+		int id;
+
+		// 订阅设置.
+		event_settings settings;
+
+		// 投递到用户指定的执行器.
+		boost::function<void (const boost::function<void ()>&)> post;
+
+		// 用户的事件处理函数.
+		boost::function<void (const download_events&)> handler;
+
+		// 等待投递的事件.
+		download_events batch;
+
+		// 合并投递定时器.
+		boost::shared_ptr<boost::asio::deadline_timer> timer;
+
+		// 上次进度事件时的下载字节数.
+		boost::int64_t last_bytes;
+
+		// 定时器是否在运行.
+		bool timer_running;
+
+		// 已经取消订阅.
+		bool closed;
+	};
+	typedef boost::shared_ptr<event_subscription> event_subscription_ptr;
+
+	// 把任务投递到Executor(io_service或strand等具有post的对象)中执行.
+	template <typename Executor>
+	struct event_poster
+	{
+		explicit event_poster(Executor &e)
+			: executor(&e)
+		{}
+
+		void operator()(const boost::function<void ()> &f) const
+		{
+			executor->post(f);
+		}
+
+		Executor *executor;
+	};
+
+public:
+	AVHTTP_DECL explicit multi_download(boost::asio::io_service &io)
+		: m_io_service(io)
+		, m_pool(NULL)
+		, m_accept_multi(false)
+		, m_keep_alive(false)
+		, m_file_size(-1)
+		, m_timer(io)
+		, m_tick_strand(io)
+		, m_number_of_connections(0)
+		, m_time_total(0)
+		, m_download_point(0)
+		, m_meta_hash(verify_settings::none)
+		, m_meta_piece_size(-1)
+		, m_refetch(false)
+		, m_subscription_id(0)
+		, m_finished(true)
+		, m_drop_size(-1)
+		, m_outstanding(0)
+		, m_abort(true)
+	{}
+
+	///使用io_service_pool构造multi_download.
+	// @param pool各个连接按pool的分配策略分布到池中的io_service上, 定时器等
+	// 内部任务在pool轮流返回的一个io_service上执行.
+	// @备注: pool的生命期必须长于multi_download.
+	AVHTTP_DECL explicit multi_download(io_service_pool &pool)
+		: m_io_service(pool.get_io_service())
+		, m_pool(&pool)
+		, m_accept_multi(false)
+		, m_keep_alive(false)
+		, m_file_size(-1)
+		, m_timer(m_io_service)
+		, m_tick_strand(m_io_service)
+		, m_number_of_connections(0)
+		, m_time_total(0)
+		, m_download_point(0)
+		, m_meta_hash(verify_settings::none)
+		, m_meta_piece_size(-1)
+		, m_refetch(false)
+		, m_subscription_id(0)
+		, m_finished(true)
+		, m_drop_size(-1)
+		, m_outstanding(0)
+		, m_abort(true)
+	{}
+	AVHTTP_DECL ~multi_download()
+	{
+		// 先停止hash线程池, 因为线程池中的任务会访问m_storage等成员.
+		m_hash_pool.reset();
+
+		// 取消所有事件订阅, 避免定时器回调访问已经析构的对象.
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_events_mutex);
+#endif
+		for (std::size_t i = 0; i < m_subscriptions.size(); i++)
+		{
+			close_subscription(*m_subscriptions[i]);
+		}
+		m_subscriptions.clear();
+	}
+
+public:
+
+	///开始multi_download开始下载.
+	// @param u指定的url.
+	// @param ec当发生错误时, 包含详细的错误信息.
+	// @备注: 直接使用内部的file.hpp下载数据到文件, 若想自己指定数据下载到指定的地方
+	// 可以通过调用另一个open来完成, 具体见另一个open的详细说明.
+	AVHTTP_DECL void start(const std::string &u, boost::system::error_code &ec)
+	{
+		settings s;
+		start(u, s, ec);
+	}
+
+	///开始multi_download开始下载, 打开失败抛出一个异常.
+	// @param u指定的url.
+	// @备注: 直接使用内部的file.hpp下载数据到文件, 若想自己指定数据下载到指定的地方
+	// 可以通过调用另一个open来完成, 具体见另一个open的详细说明.
+	AVHTTP_DECL void start(const std::string &u)
+	{
+		settings s;
+		boost::system::error_code ec;
+		start(u, s, ec);
+		if (ec)
+		{
+			boost::throw_exception(boost::system::system_error(ec));
+		}
+	}
+
+	///开始multi_download开始下载.
+	// @param u指定的url.
+	// @param s指定的设置信息.
+	// @失败抛出一个boost::system::system_error异常, 包含详细的错误信息.
+	AVHTTP_DECL void start(const std::string &u, const settings &s)
+	{
+		boost::system::error_code ec;
+		start(u, s, ec);
+		if (ec)
+		{
+			boost::throw_exception(boost::system::system_error(ec));
+		}
+	}
+
+	///开始multi_download开始下载.
+	// @param u指定的url.
+	// @param s指定的设置信息.
+	// @返回error_code, 包含详细的错误信息.
+	AVHTTP_DECL void start(const std::string &u, const settings &s, boost::system::error_code &ec)
+	{
+		// 清空所有连接.
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_streams_mutex);
+#endif
+			m_streams.clear();
+		}
+
+		// 默认文件大小为-1.
+		m_file_size = -1;
+
+		// 保存设置.
+		m_settings = s;
+		setup_http2();
+		setup_retry_policy();
+
+		// 将url转换成utf8编码.
+		std::string utf8 = detail::ansi_utf8(u);
+		utf8 = detail::escape_path(utf8);
+		m_final_url = utf8;
+		m_file_name = "";
+
+		// 创建一个http_stream对象.
+		http_object_ptr obj = create_stream_object();
+
+		request_opts req_opt = m_settings.opts;
+		req_opt.insert(http_options::range, "bytes=0-");
+		req_opt.insert(http_options::connection, "keep-alive");
+
+		// 创建http_stream并同步打开, 检查返回状态码是否为206, 如果非206则表示该http服务器不支持多点下载.
+		obj->stream.reset(new http_stream(obj->io));
+		http_stream &h = *obj->stream;
+		// 添加代理设置.
+		h.proxy(m_settings.proxy);
+		// 添加请求设置.
+		h.request_options(req_opt);
+		// 如果是ssl连接, 默认为检查证书.
+		h.check_certificate(m_settings.check_certificate);
+		// 打开http_stream.
+		h.open(m_final_url, ec);
+		// 打开失败则退出.
+		if (ec)
+		{
+			return;
+		}
+
+		// 保存最终url信息.
+		std::string location = h.location();
+		if (!location.empty())
+		{
+			m_final_url = location;
+		}
+
+		// 判断是否支持多点下载.
+		std::string status_code;
+		h.response_options().find(http_options::status_code, status_code);
+		if (status_code != "206")
+		{
+			m_accept_multi = false;
+		}
+		else
+		{
+			m_accept_multi = true;
+		}
+
+		// 禁用并发模式下载.
+		if (m_settings.disable_multi_download)
+		{
+			m_accept_multi = false;
+		}
+
+		// 得到文件大小.
+		std::string length;
+		h.response_options().find(http_options::content_length, length);
+		if (length.empty())
+		{
+			h.response_options().find(http_options::content_length, length);
+			std::string::size_type f = length.find('/');
+			if (f++ != std::string::npos)
+			{
+				length = length.substr(f);
+			}
+			else
+			{
+				length = "";
+			}
+
+			if (length.empty())
+			{
+				// 得到不文件长度, 设置为不支持多下载模式.
+				m_accept_multi = false;
+			}
+		}
+
+		boost::int64_t file_size = -1;
+		if (!length.empty())
+		{
+			try
+			{
+				file_size = boost::lexical_cast<boost::int64_t>(length);
+			}
+			catch (boost::bad_lexical_cast &)
+			{
+				// 得不到正确的文件长度, 设置为不支持多下载模式.
+				m_accept_multi = false;
+			}
+		}
+
+		// 按文件大小重新分配rangefield.
+		if (file_size != -1 && file_size != m_file_size)
+		{
+			m_file_size = file_size;
+			m_rangefield.reset(m_file_size);
+			m_downlaoded_field.reset(m_file_size);
+		}
+
+		// 读取校验清单文件, 清单中的分片大小需要在打开meta文件前确定.
+		if (m_accept_multi && !m_settings.verify.manifest.empty())
+		{
+			load_manifest(m_settings.verify.manifest, ec);
+			if (ec)
+			{
+				return;
+			}
+		}
+
+		// 是否支持长连接模式, 不支持多点下载, 长连接也没有意义.
+		if (m_accept_multi)
+		{
+			std::string keep_alive;
+			h.response_options().find(http_options::connection, keep_alive);
+			boost::to_lower(keep_alive);
+			if (keep_alive == "keep-alive")
+			{
+				m_keep_alive = true;
+			}
+			else
+			{
+				m_keep_alive = false;
+			}
+
+			// 如果未指定meta文件名, 则使用最终url生成meta文件名.
+			if (m_settings.meta_file.empty())
+			{
+				// 没有指定meta文件名, 自动修正meta文件名.
+				m_settings.meta_file = meta_name(m_final_url.to_string());
+			}
+
+			// 打开meta文件, 如果打开成功, 则表示解析出相应的位图了.
+			if (!open_meta(m_settings.meta_file))
+			{
+				// 位图打开失败, 无所谓, 下载过程中会创建新的位图, 删除meta文件.
+				m_file_meta.close();
+				boost::system::error_code ignore;
+				fs::remove(m_settings.meta_file, ignore);
+			}
+		}
+
+		// 判断文件是否已经下载完成, 完成则直接返回, 需要续传校验时在校验后再判断.
+		if (m_downlaoded_field.is_full() && !m_settings.verify.resume_check)
+		{
+			return;
+		}
+
+		// 创建存储对象.
+		if (!s.storage)
+		{
+			m_storage.reset(default_storage_constructor());
+		}
+		else
+		{
+			m_storage.reset(s.storage());
+		}
+		BOOST_ASSERT(m_storage);
+
+		// 打开文件, 构造文件名.
+		m_storage->open(boost::filesystem::path(file_name()), ec);
+		if (ec)
+		{
+			return;
+		}
+
+		// 保存限速大小.
+		m_drop_size = s.download_rate_limit;
+
+		// 处理默认设置.
+		if (m_settings.connections_limit == -1)
+		{
+			m_settings.connections_limit = default_connections_limit;
+		}
+		if (m_settings.piece_size == -1 && m_file_size != -1)
+		{
+			m_settings.piece_size = default_piece_size(m_file_size);
+		}
+
+		// 准备分片校验.
+		prepare_verify(ec);
+		if (ec)
+		{
+			return;
+		}
+
+		// 校验已经下载的分片, 清除校验失败的分片, 必须在分配下载区间前完成.
+		if (m_settings.verify.resume_check && m_hash_pool)
+		{
+			resume_check();
+		}
+		if (m_downlaoded_field.is_full())
+		{
+			return;
+		}
+
+		// 根据第1个连接返回的信息, 重新设置请求选项.
+		req_opt = m_settings.opts;
+		if (m_keep_alive)
+		{
+			req_opt.insert(http_options::connection, "keep-alive");
+		}
+		else
+		{
+			req_opt.insert(http_options::connection, "close");
+		}
+
+		// 修改终止状态.
+		m_abort = false;
+
+		// 开始投递订阅的下载事件.
+		start_event_timers();
+
+		// 连接计数置为1.
+		m_number_of_connections = 1;
+
+		// 添加第一个连接到连接容器.
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_streams_mutex);
+#endif
+			m_streams.push_back(obj);
+		}
+
+		// 为第1个连接请求的buffer大小.
+		int available_bytes = default_buffer_size;
+
+		// 设置第1个连接下载范围.
+		if (m_accept_multi)
+		{
+			range req_range;
+			bool need_reopen = false;
+
+			// 从文件区间中获得一段空间, 这是第一次分配给obj下载的任务.
+			if (allocate_range(req_range))
+			{
+				// 分配到的起始边界不是0, 需要重新open这个obj.
+				if (req_range.left != 0)
+				{
+					need_reopen = true;
+				}
+
+				// 保存请求区间.
+				obj->request_range = req_range;
+
+				// 设置请求区间到请求选项中.
+				req_opt.remove(http_options::range);
+				req_opt.insert(http_options::range, boost::str(
+					boost::format("bytes=%lld-%lld", std::locale("C")) % req_range.left % req_range.right));
+
+				// 保存最后请求时间, 用于检查超时重置.
+				obj->last_request_time = boost::posix_time::microsec_clock::local_time();
+
+				// 添加代理设置.
+				h.proxy(m_settings.proxy);
+				// 设置请求选项.
+				h.request_options(req_opt);
+				// 如果是ssl连接, 默认为检查证书.
+				h.check_certificate(m_settings.check_certificate);
+				// 禁用重定向.
+				h.max_redirects(0);
+				// 设置http/2连接池.
+				h.http2(http2_connection_pool());
+
+				if (need_reopen)
+				{
+					h.close(ec);	// 关闭原来的连接, 需要请求新的区间.
+					if (ec)
+					{
+						return;
+					}
+
+					change_outstranding(true);
+					// 开始异步打开.
+					h.async_open(m_final_url,
+						obj->strand->wrap(boost::bind(&multi_download::handle_open,
+							this,
+							0, obj,
+							boost::asio::placeholders::error
+						))
+					);
+				}
+				else
+				{
+					emit_connection_state(0, download_event::downloading);
+
+					// 发起数据读取请求.
+					change_outstranding(true);
+					// 传入指针obj, 以确保多线程安全.
+					h.async_read_some(boost::asio::buffer(obj->buffer, available_bytes),
+						obj->strand->wrap(boost::bind(&multi_download::handle_read,
+							this,
+							0, obj,
+							boost::asio::placeholders::bytes_transferred,
+							boost::asio::placeholders::error
+						))
+					);
+				}
+			}
+			else
+			{
+				// 分配空间失败, 说明可能已经没有空闲的空间提供
+				// 给这个stream进行下载了直接跳过好了.
+				obj->done = true;
+			}
+		}
+		else	// 服务器不支持多点下载模式, 继续从第1个连接下载.
+		{
+			emit_connection_state(0, download_event::downloading);
+
+			// 发起数据读取请求.
+			change_outstranding(true);
+			// 传入指针obj, 以确保多线程安全.
+			h.async_read_some(boost::asio::buffer(obj->buffer, available_bytes),
+				obj->strand->wrap(boost::bind(&multi_download::handle_read,
+					this,
+					0, obj,
+					boost::asio::placeholders::bytes_transferred,
+					boost::asio::placeholders::error
+				))
+			);
+		}
+
+		// 如果支持多点下载, 按设置创建其它http_stream.
+		if (m_accept_multi)
+		{
+			for (int i = 1; i < m_settings.connections_limit; i++)
+			{
+				http_object_ptr p = create_stream_object();
+				http_stream_ptr ptr(new http_stream(p->io));
+				range req_range;
+
+				// 从文件间区中得到一段空间.
+				if (!allocate_range(req_range))
+				{
+					// 分配空间失败, 说明可能已经没有空闲的空间提供给这个stream进行下载了直接跳过好了.
+					p->done = true;
+					continue;
+				}
+
+				// 保存请求区间.
+				p->request_range = req_range;
+
+				// 设置请求区间到请求选项中.
+				req_opt.remove(http_options::range);
+				req_opt.insert(http_options::range, boost::str(
+					boost::format("bytes=%lld-%lld", std::locale("C")) % req_range.left % req_range.right));
+
+				// 设置请求选项.
+				ptr->request_options(req_opt);
+				// 如果是ssl连接, 默认为检查证书.
+				ptr->check_certificate(m_settings.check_certificate);
+				// 禁用重定向.
+				ptr->max_redirects(0);
+				// 设置http/2连接池.
+				ptr->http2(http2_connection_pool());
+				// 添加代理设置.
+				ptr->proxy(m_settings.proxy);
+
+				// 将连接添加到容器中.
+				p->stream = ptr;
+
+				{
+#ifndef AVHTTP_DISABLE_THREAD
+					boost::mutex::scoped_lock lock(m_streams_mutex);
+#endif
+					m_streams.push_back(p);
+				}
+
+				// 保存最后请求时间, 方便检查超时重置.
+				p->last_request_time = boost::posix_time::microsec_clock::local_time();
+
+				m_number_of_connections++;
+				change_outstranding(true);
+
+				// 开始异步打开, 传入指针http_object_ptr, 以确保多线程安全.
+				p->stream->async_open(m_final_url,
+					p->strand->wrap(boost::bind(&multi_download::handle_open,
+						this,
+						i, p,
+						boost::asio::placeholders::error
+					))
+				);
+			}
+		}
+
+		change_outstranding(true);
+		// 开启定时器, 执行任务.
+		start_tick();
+
+		return;
+	}
+
+	///异步启动下载, 启动完成将回调对应的Handler.
+	// @param u 将要下载的URL.
+	// @param handler 将被调用在启动完成时. 它必须满足以下条件:
+	// @begin code
+	//  void handler(
+	//    const boost::system::error_code &ec // 用于返回操作状态.
+	//  );
+	// @end code
+	// @begin example
+	//  void start_handler(const boost::system::error_code &ec)
+	//  {
+	//    if (!ec)
+	//    {
+	//      // 启动下载成功!
+	//    }
+	//  }
+	//  ...
+	//  avhttp::multi_download h(io_service);
+	//  h.async_open("http://www.boost.org", start_handler);
+	// @end example
+	// @备注: handler也可以使用boost.bind来绑定一个符合规定的函数作
+	// 为async_start的参数handler.
+	template <typename Handler>
+	void async_start(const std::string &u, Handler handler)
+	{
+		settings s;
+		async_start(u, s, handler);
+	}
+
+	///异步启动下载, 启动完成将回调对应的Handler.
+	// @param u 将要下载的URL.
+	// @param s 下载设置参数信息.
+	// @param handler 将被调用在启动完成时. 它必须满足以下条件:
+	// @begin code
+	//  void handler(
+	//    const boost::system::error_code &ec // 用于返回操作状态.
+	//  );
+	// @end code
+	// @begin example
+	//  void start_handler(const boost::system::error_code &ec)
+	//  {
+	//    if (!ec)
+	//    {
+	//      // 启动下载成功!
+	//    }
+	//  }
+	//  ...
+	//  avhttp::multi_download h(io_service);
+	//  settings s;
+	//  h.async_open("http://www.boost.org", s, start_handler);
+	// @end example
+	// @备注: handler也可以使用boost.bind来绑定一个符合规定的函数作
+	// 为async_start的参数handler.
+	template <typename Handler>
+	void async_start(const std::string &u, const settings &s, Handler handler)
+	{
+		// 清空所有连接.
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_streams_mutex);
+#endif
+			m_streams.clear();
+		}
+
+		// 清空文件大小.
+		m_file_size = -1;
+
+		// 保存参数.
+		std::string utf8 = detail::ansi_utf8(u);
+		utf8 = detail::escape_path(utf8);
+		m_final_url = utf8;
+		m_file_name = "";
+		m_settings = s;
+		setup_http2();
+		setup_retry_policy();
+
+		// 设置状态.
+		m_abort = false;
+
+		// 创建一个http_stream对象.
+		http_object_ptr obj = create_stream_object();
+
+		request_opts req_opt = m_settings.opts;
+		req_opt.insert(http_options::range, "bytes=0-");
+		req_opt.insert(http_options::connection, "keep-alive");
+
+		// 创建http_stream并同步打开, 检查返回状态码是否为206, 如果非206则表示该http服务器不支持多点下载.
+		obj->stream.reset(new http_stream(obj->io));
+		http_stream &h = *obj->stream;
+
+		// 设置请求选项.
+		h.request_options(req_opt);
+		// 添加代理设置.
+		h.proxy(m_settings.proxy);
+		// 如果是ssl连接, 默认为检查证书.
+		h.check_certificate(m_settings.check_certificate);
+		// 设置http/2连接池.
+		h.http2(http2_connection_pool());
+
+		change_outstranding(true);
+		typedef boost::function<void (boost::system::error_code)> HandlerWrapper;
+		h.async_open(m_final_url,
+			obj->strand->wrap(boost::bind(&multi_download::handle_start<HandlerWrapper>,
+				this,
+				HandlerWrapper(handler), obj,
+				boost::asio::placeholders::error
+			))
+		);
+
+		return;
+	}
+
+	///异步等待下载结束.
+	// @param handler 将被调用在下载完成或停止时. 它必须满足以下条件:
+	// @begin code
+	//  void handler(
+	//    const boost::system::error_code &ec // 下载完成时为成功, 停止时为停止的原因.
+	//  );
+	// @end code
+	// @备注: 没有在下载时(未启动或已经结束), handler立即被投递, ec为最近一次下载结束的状态.
+	template <typename Handler>
+	void async_wait(Handler handler)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_events_mutex);
+#endif
+		if (m_finished)
+		{
+			m_io_service.post(boost::asio::detail::bind_handler(handler, m_finish_error));
+			return;
+		}
+		m_wait_handlers.push_back(handler);
+	}
+
+#ifdef AVHTTP_HAS_CO_AWAIT
+	///使用完成令牌的async_start和async_wait, 如boost::asio::use_awaitable, 用于C++20协程.
+	// @begin example
+	//  boost::asio::awaitable<void> download(avhttp::multi_download &d)
+	//  {
+	//    co_await d.async_start("http://www.boost.org/LICENSE_1_0.txt", boost::asio::use_awaitable);
+	//    boost::system::error_code ec;
+	//    co_await d.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+	//  }
+	// @end example
+	template <typename CompletionToken>
+		requires detail::completion_token<CompletionToken, void (boost::system::error_code)>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code))
+	async_start(const std::string &u, CompletionToken token)
+	{
+		settings s;
+		return async_start(u, s, std::move(token));
+	}
+
+	template <typename CompletionToken>
+		requires detail::completion_token<CompletionToken, void (boost::system::error_code)>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code))
+	async_start(const std::string &u, const settings &s, CompletionToken token)
+	{
+		return boost::asio::async_initiate<CompletionToken, void (boost::system::error_code)>(
+			[this](auto handler, const std::string &u, const settings &s)
+			{
+				async_start(u, s, detail::make_shared_handler(std::move(handler)));
+			}, token, u, s);
+	}
+
+	template <typename CompletionToken>
+		requires detail::completion_token<CompletionToken, void (boost::system::error_code)>
+	BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void (boost::system::error_code))
+	async_wait(CompletionToken token)
+	{
+		return boost::asio::async_initiate<CompletionToken, void (boost::system::error_code)>(
+			[this](auto handler)
+			{
+				async_wait(detail::make_shared_handler(std::move(handler)));
+			}, token);
+	}
+#endif // AVHTTP_HAS_CO_AWAIT
+
+	// stop当前所有连接, 停止工作.
+	// @备注: 连接和定时器在各自的strand中关闭, 可以在任意线程中调用.
+	AVHTTP_DECL void stop()
+	{
+		m_abort = true;
+
+		cancel_tick();
+
+		// 通知所有等待数据的async_fetch_data.
+		cancel_fetch_waiters();
+
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_streams_mutex);
+#endif
+		for (std::size_t i = 0; i < m_streams.size(); i++)
+		{
+			const http_object_ptr &ptr = m_streams[i];
+			if (ptr && ptr->stream)
+			{
+				close_stream(ptr);
+			}
+		}
+
+		// 关闭共享的http/2连接.
+		if (m_http2)
+			m_http2->close();
+	}
+
+	///获取指定的数据, 并改变下载点的位置.
+	// @param buffers 指定的数据缓冲. 这个类型必须满足MutableBufferSequence的定义,
+	//          MutableBufferSequence的定义在boost.asio文档中.
+	// @param offset 读取数据的指定偏移位置, 注意: offset影响内部下载位置从offset开始下载.
+	// 返回读取数据的大小.
+	template <typename MutableBufferSequence>
+	std::size_t fetch_data(const MutableBufferSequence &buffers,
+		boost::int64_t offset)
+	{
+		if (!m_storage) // 没有存储设备, 无法获得数据.
+		{
+			return 0;
+		}
+
+		// 更新下载点位置.
+		set_download_point(offset);
+
+		// 得到用户缓冲大小, 以确定最大读取字节数.
+		std::size_t buffer_length = 0;
+		{
+			typename MutableBufferSequence::const_iterator iter = buffers.begin();
+			typename MutableBufferSequence::const_iterator end = buffers.end();
+			// 计算得到用户buffers的总大小.
+			for (; iter != end; ++iter)
+			{
+				boost::asio::mutable_buffer buffer(*iter);
+				buffer_length += boost::asio::buffer_size(buffer);
+			}
+		}
+
+		// 不能超出文件尾.
+		if (m_file_size != -1)
+		{
+			if (offset >= m_file_size)
+			{
+				return 0;
+			}
+			buffer_length = static_cast<std::size_t>(
+				(std::min)(boost::int64_t(buffer_length), m_file_size - offset));
+		}
+
+		// 得到offset后面可读取的数据大小, 使用折半法来获得可读空间大小.
+		while (buffer_length != 0)
+		{
+			if (m_downlaoded_field.check_range(offset, offset + buffer_length))
+			{
+				break;
+			}
+			buffer_length /= 2;
+		}
+
+		// 读取数据.
+		if (buffer_length != 0)
+		{
+			std::size_t available_length = buffer_length;
+			boost::int64_t offset_for_read = offset;
+
+			typename MutableBufferSequence::const_iterator iter = buffers.begin();
+			typename MutableBufferSequence::const_iterator end = buffers.end();
+			// 计算得到用户buffers的总大小.
+			for (; iter != end; ++iter)
+			{
+				boost::asio::mutable_buffer buffer(*iter);
+
+				char* buffer_ptr = boost::asio::buffer_cast<char*>(buffer);
+				std::size_t buffer_size = boost::asio::buffer_size(buffer);
+
+				if ((boost::int64_t)available_length - (boost::int64_t)buffer_size < 0)
+					buffer_size = available_length;
+
+				std::size_t length = 0;
+				{
+#ifndef AVHTTP_DISABLE_THREAD
+					boost::mutex::scoped_lock lock(m_storage_mutex);
+#endif
+					length = m_storage->read(buffer_ptr, offset_for_read, buffer_size);
+				}
+				BOOST_ASSERT(length == buffer_size);
+				offset_for_read += length;
+				available_length -= length;
+
+				if (available_length == 0)
+				{
+					break;
+				}
+			}
+			// 计算实际读取的字节数.
+			buffer_length = offset_for_read - offset;
+		}
+
+		return buffer_length;
+	}
+
+	///异步获取指定的数据, 并改变下载点的位置.
+	// @param buffers 指定的数据缓冲. 这个类型必须满足MutableBufferSequence的定义,
+	//          MutableBufferSequence的定义在boost.asio文档中.
+	// @param offset 读取数据的指定偏移位置, 注意: offset影响内部下载位置从offset开始下载.
+	// @param handler 将在数据下载完成并读取到buffers后被调用. 它必须满足以下条件:
+	// @begin code
+	//  void handler(
+	//    const boost::system::error_code &ec, // 用于返回操作状态.
+	//    std::size_t bytes_transferred        // 返回读取的数据字节数.
+	//  );
+	// @end code
+	// @begin example
+	//  void fetch_handler(const boost::system::error_code &ec, std::size_t bytes_transferred)
+	//  {
+	//    if (!ec)
+	//    {
+	//      // 数据已经在buffer中, 可以发送给客户端了.
+	//    }
+	//  }
+	//  ...
+	//  d.async_fetch_data(boost::asio::buffer(buf), offset, fetch_handler);
+	// @end example
+	// @备注: 等待的数据为[offset, offset + buffers大小), 超出文件尾的部分被忽略, offset
+	// 在文件尾之后时handler返回boost::asio::error::eof. 下载停止时, 所有未完成的
+	// async_fetch_data将以boost::asio::error::operation_aborted完成. 配合
+	// settings::streaming使用时, 等待的数据将被优先下载.
+	template <typename MutableBufferSequence, typename Handler>
+	void async_fetch_data(const MutableBufferSequence &buffers,
+		boost::int64_t offset, Handler handler)
+	{
+		typedef boost::function<void (boost::system::error_code, std::size_t)> HandlerWrapper;
+		fetch_waiter waiter;
+		waiter.offset = offset;
+		waiter.op = boost::bind(&multi_download::fetch_op<MutableBufferSequence, HandlerWrapper>,
+			this, buffers, offset, HandlerWrapper(handler), _1);
+
+		// 不知道文件大小时, 无法得知数据是否已经下载.
+		if (!m_storage || m_file_size == -1)
+		{
+			m_io_service.post(boost::bind(waiter.op,
+				boost::system::error_code(boost::asio::error::operation_not_supported)));
+			return;
+		}
+
+		if (offset >= m_file_size)
+		{
+			m_io_service.post(boost::bind(waiter.op,
+				boost::system::error_code(boost::asio::error::eof)));
+			return;
+		}
+
+		// 得到用户缓冲大小, 以确定需要等待的数据大小.
+		boost::int64_t buffer_length = 0;
+		{
+			typename MutableBufferSequence::const_iterator iter = buffers.begin();
+			typename MutableBufferSequence::const_iterator end = buffers.end();
+			for (; iter != end; ++iter)
+			{
+				boost::asio::mutable_buffer buffer(*iter);
+				buffer_length += boost::asio::buffer_size(buffer);
+			}
+		}
+		waiter.length = (std::min)(buffer_length, m_file_size - offset);
+
+		// 更新下载点位置.
+		set_download_point(offset);
+
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_fetch_waiters_mutex);
+#endif
+			// 数据已经下载, 直接完成.
+			if (waiter.length == 0 ||
+				m_downlaoded_field.check_range(waiter.offset, waiter.offset + waiter.length))
+			{
+				m_io_service.post(boost::bind(waiter.op, boost::system::error_code()));
+				return;
+			}
+
+			if (m_abort)
+			{
+				m_io_service.post(boost::bind(waiter.op,
+					boost::system::error_code(boost::asio::error::operation_aborted)));
+				return;
+			}
+
+			m_fetch_waiters.push_back(waiter);
+		}
+	}
+
+	///订阅下载事件.
+	// @param executor 事件处理函数的执行器, 可以是io_service或strand等具有post的对象,
+	//          它必须在取消订阅之前一直有效.
+	// @param handler 事件处理函数, 一批事件调用一次. 它必须满足以下条件:
+	// @begin code
+	//  void handler(
+	//    const avhttp::download_events &events // 按发生顺序排列的一批事件.
+	//  );
+	// @end code
+	// @param es 订阅设置, 指定合并投递的间隔, 每批最大事件数和订阅的事件类型.
+	// @返回订阅id, 用于unsubscribe.
+	// @begin example
+	//  void on_events(const avhttp::download_events &events)
+	//  {
+	//    for (std::size_t i = 0; i < events.size(); i++)
+	//    {
+	//      if (events[i].type == avhttp::download_event::progress)
+	//        std::cout << events[i].bytes_download << "/" << events[i].file_size << std::endl;
+	//    }
+	//  }
+	//  ...
+	//  d.subscribe(io, on_events);
+	// @end example
+	// @备注: 代替定时轮询bytes_download()和download_rate(), 进度事件只在下载字节数改变时产生.
+	// 下载完成或停止时, 等待的事件立即投递, 之后合并定时器停止, 再次start后自动恢复.
+	template <typename Executor, typename Handler>
+	int subscribe(Executor &executor, Handler handler, const event_settings &es = event_settings())
+	{
+		event_subscription_ptr sub(new event_subscription);
+		sub->settings = es;
+		sub->post = event_poster<Executor>(executor);
+		sub->handler = handler;
+		sub->timer.reset(new boost::asio::deadline_timer(m_io_service));
+
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_events_mutex);
+#endif
+		sub->id = ++m_subscription_id;
+		m_subscriptions.push_back(sub);
+
+		if (!m_abort)
+		{
+			start_event_timer(sub);
+		}
+
+		return sub->id;
+	}
+
+	///取消订阅下载事件.
+	// @param id subscribe返回的订阅id.
+	// @备注: 已经投递到执行器中的事件仍然会被处理, 未投递的事件被丢弃.
+	AVHTTP_DECL void unsubscribe(int id)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_events_mutex);
+#endif
+		for (std::size_t i = 0; i < m_subscriptions.size(); i++)
+		{
+			if (m_subscriptions[i]->id == id)
+			{
+				close_subscription(*m_subscriptions[i]);
+				m_subscriptions.erase(m_subscriptions.begin() + i);
+				return;
+			}
+		}
+	}
+
+	///返回当前设置信息.
+	AVHTTP_DECL const settings& set() const
+	{
+		return m_settings;
+	}
+
+	///是否停止下载.
+	AVHTTP_DECL bool stopped() const
+	{
+		if (m_abort)
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_outstanding_mutex);
+#endif
+			if (m_outstanding == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	///等待直接下载完成.
+	// @完成返回true, 否则返回false.
+	AVHTTP_DECL bool wait_for_complete()
+	{
+		while (!stopped())
+		{
+			if (!m_abort)
+			{
+				boost::mutex::scoped_lock l(m_quit_mtx);
+				m_quit_cond.wait(l);
+			}
+		}
+		// 检查是否下载完成, 完成返回true, 否则返回false.
+		boost::int64_t fs = file_size();
+		if (fs != -1)
+		{
+			if (fs != bytes_download())
+			{
+				return false;	// 未下载完成.
+			}
+		}
+
+		return true; // 下载完成.
+	}
+
+	///设置是否检查证书, 默认检查证书.
+	// @param check指定是否检查ssl证书.
+	AVHTTP_DECL void check_certificate(bool check)
+	{
+		m_settings.check_certificate = check;
+	}
+
+	///返回当前下载的文件大小.
+	// @如果服务器不支持多点下载, 则可能文件大小为-1.
+	AVHTTP_DECL boost::int64_t file_size() const
+	{
+		return m_file_size;
+	}
+
+	///根据url计算出对应的meta文件名.
+	// @param url是指定的url地址.
+	// @返回一串由crc32编码url后的16进制字符串meta文件名.
+	AVHTTP_DECL std::string meta_name(const std::string &url) const
+	{
+		// 使用url的crc作为文件名, 这样只要url是确定的, 那么就不会找错meta文件.
+		boost::crc_32_type result;
+		result.process_bytes(url.c_str(), url.size());
+		std::stringstream ss;
+		ss.imbue(std::locale("C"));
+		ss << std::hex << result.checksum() << ".meta";
+		return ss.str();
+	}
+
+	///得到当前下载的文件名.
+	// @如果请求的url不太规则, 则可能返回错误的文件名.
+	AVHTTP_DECL std::string file_name() const
+	{
+		if (m_file_name.empty())
+		{
+			m_file_name = fs::path(detail::utf8_ansi(m_final_url.path())).leaf().string();
+			if (m_file_name == "/" || m_file_name == "")
+				m_file_name = fs::path(m_final_url.query()).leaf().string();
+			if (m_file_name == "/" || m_file_name == "" || m_file_name == ".")
+				m_file_name = "index.html";
+			if (!m_settings.save_path.empty())
+			{
+				if (fs::is_directory(m_settings.save_path))
+				{
+					fs::path p = m_settings.save_path / m_file_name;
+					m_file_name = p.string();
+				}
+				else
+				{
+					m_file_name = m_settings.save_path.string();
+				}
+			}
+			return m_file_name;
+		}
+		return m_file_name;
+	}
+
+	///当前已经下载的字节总数.
+	AVHTTP_DECL boost::int64_t bytes_download() const
+	{
+		if (m_file_size != -1)
+		{
+			return m_downlaoded_field.range_size();
+		}
+
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock l(m_streams_mutex);
+#endif
+		return streams_bytes_download();
+	}
+
+	///当前下载速率, 单位byte/s.
+	AVHTTP_DECL int download_rate() const
+	{
+		return m_byte_rate.current_byte_rate;
+	}
+
+	///设置下载速率, -1为无限制, 单位byte/s.
+	AVHTTP_DECL void download_rate_limit(int rate)
+	{
+		m_settings.download_rate_limit = rate;
+	}
+
+	///返回当前限速.
+	AVHTTP_DECL int download_rate_limit() const
+	{
+		return m_settings.download_rate_limit;
+	}
+
+protected:
+
+	void handle_open(const int index,
+		http_object_ptr object_ptr, const boost::system::error_code &ec)
+	{
+		change_outstranding(false);
+		http_stream_object &object = *object_ptr;
+		if (ec || m_abort)
+		{
+			// 保存最后的错误信息, 避免一些过期无效或没有允可的链接不断的尝试.
+			// 由check_streams立即重新连接, 等待的时间由重试策略决定.
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(object.mutex);
+#endif
+				object.ec = ec;
+				if (ec && ec != boost::asio::error::operation_aborted)
+					object.direct_reconnect = true;
+			}
+			emit_error(index, ec);
+
+			// 单连接模式, 表示下载停止, 终止下载.
+			if (!m_accept_multi)
+			{
+				m_abort = true;
+				cancel_tick();
+			}
+
+			return;
+		}
+
+		// 连接成功, 清除之前的失败.
+		object.retries = 0;
+		m_retry_policy->on_success(origin_key(m_final_url));
+
+		if (!m_accept_multi)
+		{
+			// 当不支持断点续传时, 有时请求到的文件大小和start请求到的文件大小不一至, 则需要新file_size.
+			if (object.stream->content_length() != -1 &&
+				object.stream->content_length() != m_file_size)
+			{
+				m_file_size = object.stream->content_length();
+				m_rangefield.reset(m_file_size);
+				m_downlaoded_field.reset(m_file_size);
+			}
+		}
+
+		// 由发出请求的时间计算RTT.
+		update_rtt(object);
+
+		// 保存最后请求时间, 方便检查超时重置.
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(object.mutex);
+#endif
+			object.last_request_time = boost::posix_time::microsec_clock::local_time();
+		}
+
+		emit_connection_state(index, download_event::downloading);
+
+		// 计算可请求的字节数.
+		int available_bytes = take_read_bytes();
+
+		// 发起数据读取请求.
+		http_stream_ptr &stream_ptr = object.stream;
+
+		change_outstranding(true);
+		// 传入指针http_object_ptr, 以确保多线程安全.
+		stream_ptr->async_read_some(boost::asio::buffer(object.buffer, available_bytes),
+			object_ptr->strand->wrap(boost::bind(&multi_download::handle_read,
+				this,
+				index, object_ptr,
+				boost::asio::placeholders::bytes_transferred,
+				boost::asio::placeholders::error
+			))
+		);
+	}
+
+	void handle_read(const int index,
+		http_object_ptr object_ptr, int bytes_transferred, const boost::system::error_code &ec)
+	{
+		change_outstranding(false);
+		http_stream_object &object = *object_ptr;
+
+		// 计算offset, 请求区间可能被流式下载调度截断, 需要加锁读取.
+		boost::int64_t offset = 0;
+		boost::int64_t request_right = 0;
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(object.mutex);
+#endif
+			offset = object.request_range.left + object.bytes_transferred;
+			request_right = object.request_range.right;
+		}
+
+		// 保存数据, 当远程服务器断开时, ec为eof, 保证数据全部写入.
+		if (m_storage && bytes_transferred != 0 && (!ec || ec == boost::asio::error::eof))
+		{
+			// 使用m_storage写入, 等待写入的数量记录在write_queue_depth中.
+			AVHTTP_METRIC_GAUGE(metric_write_queue_depth, 1);
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(m_storage_mutex);
+#endif
+				m_storage->write(object.buffer.c_array(), offset, bytes_transferred);
+			}
+			AVHTTP_METRIC_GAUGE(metric_write_queue_depth, -1);
+
+			// 更新完成下载区间位图, 必须在写入之后更新, 保证位图中的数据都是可以读取的.
+			if (m_file_size != -1)
+			{
+				boost::int64_t end = offset + bytes_transferred;
+				m_downlaoded_field.update(offset, end);
+
+				// 完成等待这段数据的async_fetch_data.
+				notify_fetch_waiters(offset, end);
+
+				// 分片只可能在写入到达或越过分片边界, 或写到本次请求区间尾部时下载
+				// 完成, 这样就避免了每次写入都去检查位图.
+				if (!m_verified.empty() && (offset / m_settings.piece_size != end / m_settings.piece_size
+					|| end == m_file_size || end == request_right + 1))
+				{
+					check_pieces(offset, end);
+				}
+			}
+		}
+
+		// 如果发生错误或终止.
+		if (ec || m_abort)
+		{
+			emit_error(index, ec);
+
+			// 单连接模式, 表示下载停止, 终止下载.
+			if (!m_accept_multi)
+			{
+				m_abort = true;
+				cancel_tick();
+			}
+
+			return;
+		}
+
+		// 用于计算下载速率.
+		m_byte_rate.last_byte_rate[m_byte_rate.index] += bytes_transferred;
+
+		bool range_done = false;
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(object.mutex);
+#endif
+
+			// 统计本次已经下载的总字节数.
+			object.bytes_transferred += bytes_transferred;
+
+			// 统计总下载字节数.
+			object.bytes_downloaded += bytes_transferred;
+
+			// 连接将被重新创建(超时, 或请求区间被流式下载调度截断), 由check_streams继续下载.
+			if (object.direct_reconnect)
+			{
+				return;
+			}
+
+			// 判断请求区间的数据已经下载完成, 如果下载完成, 则分配新的区间, 发起新的请求.
+			range_done = m_accept_multi && object.bytes_transferred >= object.request_range.size();
+			if (range_done)
+			{
+				// 统计本次请求的吞吐量, 用于计算下一次请求的大小.
+				update_throughput(object);
+
+				// 不支持长连接, 则创建新的连接.
+				// 如果是第1个连接, 请求范围是0-文件尾, 也需要断开重新连接.
+				if (!m_keep_alive || (object.request_range.left == 0 && index == 0))
+				{
+					// 新建新的http_stream对象.
+					object.direct_reconnect = true;
+					return;
+				}
+			}
+		}
+
+		if (range_done)
+		{
+			http_stream &stream = *object.stream;
+
+			// 配置请求选项.
+			request_opts req_opt = m_settings.opts;
+
+			// 设置是否为长连接.
+			if (m_keep_alive)
+			{
+				req_opt.insert(http_options::connection, "keep-alive");
+			}
+
+			// 如果分配空闲空间失败, 则跳过这个socket, 并立即尝试连接这个socket.
+			range request_range;
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(object.mutex);
+#endif
+				request_range = object.request_range;
+			}
+			bool allocated = allocate_range(request_range, request_size(object));
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(object.mutex);
+#endif
+				if (!allocated)
+				{
+					object.direct_reconnect = true;
+					return;
+				}
+
+				// 保存新的区间并清空计数, 这时连接被要求重新创建时, 由新的连接下载这个区间.
+				object.request_range = request_range;
+				object.bytes_transferred = 0;
+
+				// 保存最后请求时间, 方便检查超时重置.
+				object.last_request_time = boost::posix_time::microsec_clock::local_time();
+
+				if (object.direct_reconnect)
+				{
+					return;
+				}
+			}
+
+			// 插入新的区间请求.
+			req_opt.insert(http_options::range,
+				boost::str(boost::format("bytes=%lld-%lld", std::locale("C")) %
+				request_range.left % request_range.right));
+
+			// 添加代理设置.
+			stream.proxy(m_settings.proxy);
+			// 设置到请求选项中.
+			stream.request_options(req_opt);
+			// 如果是ssl连接, 默认为检查证书.
+			stream.check_certificate(m_settings.check_certificate);
+			// 禁用重定向.
+			stream.max_redirects(0);
+			// 设置http/2连接池.
+			stream.http2(http2_connection_pool());
+
+			change_outstranding(true);
+
+			// 发起异步http数据请求, 传入指针http_object_ptr, 以确保多线程安全.
+			if (!m_keep_alive)
+			{
+				stream.async_open(m_final_url,
+					object_ptr->strand->wrap(boost::bind(&multi_download::handle_open,
+						this,
+						index, object_ptr,
+						boost::asio::placeholders::error
+					))
+				);
+			}
+			else
+			{
+				stream.async_request(req_opt,
+					object_ptr->strand->wrap(boost::bind(&multi_download::handle_request,
+						this,
+						index, object_ptr,
+						boost::asio::placeholders::error
+					))
+				);
+			}
+		}
+		else
+		{
+			// 服务器不支持多点下载, 说明数据已经下载完成.
+			if (!m_accept_multi &&
+				(m_file_size != -1 && object.bytes_downloaded == m_file_size))
+			{
+				m_abort = true;
+				cancel_tick();
+				return;
+			}
+
+			// 保存最后请求时间, 方便检查超时重置.
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(object.mutex);
+#endif
+				object.last_request_time = boost::posix_time::microsec_clock::local_time();
+			}
+
+			// 计算可请求的字节数.
+			int available_bytes = take_read_bytes();
+
+			change_outstranding(true);
+			// 继续读取数据, 传入指针http_object_ptr, 以确保多线程安全.
+			object.stream->async_read_some(boost::asio::buffer(object.buffer, available_bytes),
+				object_ptr->strand->wrap(boost::bind(&multi_download::handle_read,
+					this,
+					index, object_ptr,
+					boost::asio::placeholders::bytes_transferred,
+					boost::asio::placeholders::error
+				))
+			);
+		}
+	}
+
+	void handle_request(const int index,
+		http_object_ptr object_ptr, const boost::system::error_code &ec)
+	{
+		change_outstranding(false);
+		http_stream_object &object = *object_ptr;
+		object.request_count++;
+		if (ec || m_abort)
+		{
+			// 保存最后的错误信息, 避免一些过期无效或没有允可的链接不断的尝试.
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(object.mutex);
+#endif
+				object.ec = ec;
+			}
+			emit_error(index, ec);
+
+			// 单连接模式, 表示下载停止, 终止下载.
+			if (!m_accept_multi)
+			{
+				m_abort = true;
+				cancel_tick();
+			}
+
+			return;
+		}
+
+		// 由发出请求的时间计算RTT.
+		update_rtt(object);
+
+		// 保存最后请求时间, 方便检查超时重置.
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(object.mutex);
+#endif
+			object.last_request_time = boost::posix_time::microsec_clock::local_time();
+		}
+
+		// 计算可请求的字节数.
+		int available_bytes = take_read_bytes();
+
+		change_outstranding(true);
+		// 发起数据读取请求, 传入指针http_object_ptr, 以确保多线程安全.
+		object_ptr->stream->async_read_some(boost::asio::buffer(object.buffer, available_bytes),
+			object_ptr->strand->wrap(boost::bind(&multi_download::handle_read,
+				this,
+				index, object_ptr,
+				boost::asio::placeholders::bytes_transferred,
+				boost::asio::placeholders::error
+			))
+		);
+	}
+
+	template <typename Handler>
+	void handle_start(Handler handler, http_object_ptr object_ptr, const boost::system::error_code &ec)
+	{
+		change_outstranding(false);
+
+		// 打开失败则退出.
+		if (ec)
+		{
+			handler(ec);
+			return;
+		}
+
+		boost::system::error_code err;
+
+		// 下面使用引用http_stream_object对象.
+		http_stream_object &object = *object_ptr;
+
+		// 同样引用http_stream对象.
+		http_stream &h = *object.stream;
+
+		// 保存最终url信息.
+		std::string location = h.location();
+		if (!location.empty())
+		{
+			m_final_url = location;
+		}
+
+		// 判断是否支持多点下载.
+		std::string status_code;
+		h.response_options().find(http_options::status_code, status_code);
+		if (status_code != "206")
+		{
+			m_accept_multi = false;
+		}
+		else
+		{
+			m_accept_multi = true;
+		}
+
+		// 禁用并发模式下载.
+		if (m_settings.disable_multi_download)
+		{
+			m_accept_multi = false;
+		}
+
+		// 得到文件大小.
+		std::string length;
+		h.response_options().find(http_options::content_length, length);
+		if (length.empty())
+		{
+			h.response_options().find(http_options::content_range, length);
+			std::string::size_type f = length.find('/');
+			if (f++ != std::string::npos)
+			{
+				length = length.substr(f);
+			}
+			else
+			{
+				length = "";
+			}
+
+			if (length.empty())
+			{
+				// 得到不文件长度, 设置为不支持多下载模式.
+				m_accept_multi = false;
+			}
+		}
+
+		boost::int64_t file_size = -1;
+		if (!length.empty())
+		{
+			try
+			{
+				file_size = boost::lexical_cast<boost::int64_t>(length);
+			}
+			catch (boost::bad_lexical_cast &)
+			{
+				// 得不到正确的文件长度, 设置为不支持多下载模式.
+				m_accept_multi = false;
+			}
+		}
+
+		// 按文件大小分配rangefield.
+		if (file_size != -1 && file_size != m_file_size)
+		{
+			m_file_size = file_size;
+			m_rangefield.reset(m_file_size);
+			m_downlaoded_field.reset(m_file_size);
+		}
+
+		// 读取校验清单文件, 清单中的分片大小需要在打开meta文件前确定.
+		if (m_accept_multi && !m_settings.verify.manifest.empty())
+		{
+			load_manifest(m_settings.verify.manifest, err);
+			if (err)
+			{
+				handler(err);
+				return;
+			}
+		}
+
+		// 是否支持长连接模式, 不支持多点下载, 长连接也没有意义.
+		if (m_accept_multi)
+		{
+			std::string keep_alive;
+			h.response_options().find(http_options::connection, keep_alive);
+			boost::to_lower(keep_alive);
+			if (keep_alive == "keep-alive")
+			{
+				m_keep_alive = true;
+			}
+			else
+			{
+				m_keep_alive = false;
+			}
+
+			// 如果未指定meta文件名, 则使用最终url生成meta文件名.
+			if (m_settings.meta_file.empty())
+			{
+				// 没有指定meta文件名, 自动修正meta文件名.
+				m_settings.meta_file = meta_name(m_final_url.to_string());
+			}
+
+			// 打开meta文件, 如果打开成功, 则表示解析出相应的位图了.
+			if (!open_meta(m_settings.meta_file))
+			{
+				// 位图打开失败, 无所谓, 下载过程中会创建新的位图, 删除meta文件.
+				m_file_meta.close();
+				fs::remove(m_settings.meta_file, err);
+			}
+		}
+
+		// 判断文件是否已经下载完成, 完成则直接返回, 需要续传校验时在校验后再判断.
+		if (m_downlaoded_field.is_full() && !m_settings.verify.resume_check)
+		{
+			handler(err);
+			return;
+		}
+
+		// 创建存储对象.
+		if (!m_settings.storage)
+		{
+			m_storage.reset(default_storage_constructor());
+		}
+		else
+		{
+			m_storage.reset(m_settings.storage());
+		}
+		BOOST_ASSERT(m_storage);
+
+		// 打开文件, 构造文件名.
+		m_storage->open(boost::filesystem::path(file_name()), err);
+		if (err)
+		{
+			handler(err);
+			return;
+		}
+
+		// 处理默认设置.
+		if (m_settings.connections_limit == -1)
+		{
+			m_settings.connections_limit = default_connections_limit;
+		}
+		if (m_settings.piece_size == -1 && m_file_size != -1)
+		{
+			m_settings.piece_size = default_piece_size(m_file_size);
+		}
+
+		// 准备分片校验.
+		prepare_verify(err);
+		if (err)
+		{
+			handler(err);
+			return;
+		}
+
+		// 校验已经下载的分片, 清除校验失败的分片, 必须在分配下载区间前完成.
+		if (m_settings.verify.resume_check && m_hash_pool)
+		{
+			resume_check();
+		}
+		if (m_downlaoded_field.is_full())
+		{
+			handler(err);
+			return;
+		}
+
+		// 根据第1个连接返回的信息, 设置请求选项.
+		request_opts req_opt = m_settings.opts;
+		if (m_keep_alive)
+		{
+			req_opt.insert(http_options::connection, "keep-alive");
+		}
+		else
+		{
+			req_opt.insert(http_options::connection, "close");
+		}
+
+		// 修改终止状态.
+		m_abort = false;
+
+		// 开始投递订阅的下载事件.
+		start_event_timers();
+
+		// 连接计数置为1.
+		m_number_of_connections = 1;
+
+		// 添加第一个连接到连接容器.
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_streams_mutex);
+#endif
+			m_streams.push_back(object_ptr);
+		}
+
+		// 为第1个连接请求的buffer大小.
+		int available_bytes = default_buffer_size;
+
+		// 设置第1个连接下载范围.
+		if (m_accept_multi)
+		{
+			range req_range;
+			bool need_reopen = false;
+
+			// 从文件区间中获得一段空间, 这是第一次分配给obj下载的任务.
+			if (allocate_range(req_range))
+			{
+				// 分配到的起始边界不是0, 需要重新open这个obj.
+				if (req_range.left != 0)
+				{
+					need_reopen = true;
+				}
+
+				// 保存请求区间.
+				object_ptr->request_range = req_range;
+
+				// 设置请求区间到请求选项中.
+				req_opt.remove(http_options::range);
+				req_opt.insert(http_options::range, boost::str(
+					boost::format("bytes=%lld-%lld", std::locale("C")) % req_range.left % req_range.right));
+
+				// 保存最后请求时间, 用于检查超时重置.
+				object_ptr->last_request_time = boost::posix_time::microsec_clock::local_time();
+
+				// 添加代理设置.
+				h.proxy(m_settings.proxy);
+				// 设置请求选项.
+				h.request_options(req_opt);
+				// 如果是ssl连接, 默认为检查证书.
+				h.check_certificate(m_settings.check_certificate);
+				// 禁用重定向.
+				h.max_redirects(0);
+				// 设置http/2连接池.
+				h.http2(http2_connection_pool());
+
+				if (need_reopen)
+				{
+					h.close(err);	// 关闭原来的连接, 需要请求新的区间.
+					if (err)
+					{
+						handler(err);
+						return;
+					}
+
+					change_outstranding(true);
+					// 开始异步打开.
+					h.async_open(m_final_url,
+						object_ptr->strand->wrap(boost::bind(&multi_download::handle_open,
+							this,
+							0, object_ptr,
+							boost::asio::placeholders::error
+						))
+					);
+				}
+				else
+				{
+					emit_connection_state(0, download_event::downloading);
+
+					// 发起数据读取请求.
+					change_outstranding(true);
+					// 传入指针obj, 以确保多线程安全.
+					h.async_read_some(boost::asio::buffer(object_ptr->buffer, available_bytes),
+						object_ptr->strand->wrap(boost::bind(&multi_download::handle_read,
+							this,
+							0, object_ptr,
+							boost::asio::placeholders::bytes_transferred,
+							boost::asio::placeholders::error
+						))
+					);
+				}
+			}
+			else
+			{
+				// 分配空间失败, 说明可能已经没有空闲的空间提供
+				// 给这个stream进行下载了直接跳过好了.
+				object_ptr->done = true;
+			}
+		}
+		else	// 服务器不支持多点下载模式, 继续从第1个连接下载.
+		{
+			emit_connection_state(0, download_event::downloading);
+
+			// 发起数据读取请求.
+			change_outstranding(true);
+			// 传入指针obj, 以确保多线程安全.
+			h.async_read_some(boost::asio::buffer(object_ptr->buffer, available_bytes),
+				object_ptr->strand->wrap(boost::bind(&multi_download::handle_read,
+					this,
+					0, object_ptr,
+					boost::asio::placeholders::bytes_transferred,
+					boost::asio::placeholders::error
+				))
+			);
+		}
+
+		// 如果支持多点下载, 按设置创建其它http_stream.
+		if (m_accept_multi)
+		{
+			for (int i = 1; i < m_settings.connections_limit; i++)
+			{
+				http_object_ptr p = create_stream_object();
+				http_stream_ptr ptr(new http_stream(p->io));
+				range req_range;
+
+				// 从文件间区中得到一段空间.
+				if (!allocate_range(req_range))
+				{
+					// 分配空间失败, 说明可能已经没有空闲的空间提供给这个stream进行下载了直接跳过好了.
+					p->done = true;
+					continue;
+				}
+
+				// 保存请求区间.
+				p->request_range = req_range;
+
+				// 设置请求区间到请求选项中.
+				req_opt.remove(http_options::range);
+				req_opt.insert(http_options::range, boost::str(
+					boost::format("bytes=%lld-%lld", std::locale("C")) % req_range.left % req_range.right));
+
+				// 设置请求选项.
+				ptr->request_options(req_opt);
+				// 添加代理设置.
+				ptr->proxy(m_settings.proxy);
+				// 如果是ssl连接, 默认为检查证书.
+				ptr->check_certificate(m_settings.check_certificate);
+				// 禁用重定向.
+				ptr->max_redirects(0);
+				// 设置http/2连接池.
+				ptr->http2(http2_connection_pool());
+
+				// 将连接添加到容器中.
+				p->stream = ptr;
+
+				{
+#ifndef AVHTTP_DISABLE_THREAD
+					boost::mutex::scoped_lock lock(m_streams_mutex);
+#endif
+					m_streams.push_back(p);
+				}
+
+				// 保存最后请求时间, 方便检查超时重置.
+				p->last_request_time = boost::posix_time::microsec_clock::local_time();
+
+				m_number_of_connections++;
+				change_outstranding(true);
+
+				// 开始异步打开, 传入指针http_object_ptr, 以确保多线程安全.
+				p->stream->async_open(m_final_url,
+					p->strand->wrap(boost::bind(&multi_download::handle_open,
+						this,
+						i, p,
+						boost::asio::placeholders::error
+					))
+				);
+			}
+		}
+
+		change_outstranding(true);
+
+		// 开启定时器, 执行任务.
+		start_tick();
+
+		// 回调通知用户, 已经成功启动下载.
+		handler(ec);
+
+		return;
+	}
+
+	void on_tick(const boost::system::error_code &e)
+	{
+		change_outstranding(false);
+		m_time_total++;
+
+		// 在这里更新位图.
+		if (m_accept_multi)
+		{
+			update_meta();
+		}
+
+		// 每隔1秒进行一次on_tick.
+		if (!m_abort && !e)
+		{
+			change_outstranding(true);
+			start_tick();
+		}
+		else
+		{
+			// 已经终止, 通知所有等待数据的async_fetch_data.
+			cancel_fetch_waiters();
+
+			// 关闭共享的http/2连接, 空闲的连接不再占用io_service.
+			if (m_http2)
+				m_http2->close();
+
+			// 通知订阅者下载结束, 文件大小已知且全部下载时为完成, 否则为停止.
+			bool full = m_file_size != -1 && m_downlaoded_field.is_full() && !verify_pending();
+			download_event ev = make_event(full ? download_event::completed : download_event::stopped, false);
+			if (!full)
+			{
+				ev.ec = e ? e : boost::system::error_code(boost::asio::error::operation_aborted);
+			}
+			emit(ev);
+			return;
+		}
+
+		// 用于计算动态下载速率.
+		{
+			int bytes_count = 0;
+
+			for (int i = 0; i < m_byte_rate.seconds; i++)
+				bytes_count += m_byte_rate.last_byte_rate[i];
+
+			m_byte_rate.current_byte_rate = (double)bytes_count / m_byte_rate.seconds;
+
+			// 先清零下一秒的计数再移动下标, 其它线程中的handle_read可能正在累加.
+			int next = m_byte_rate.index + 1 >= m_byte_rate.seconds ? 0 : m_byte_rate.index + 1;
+			m_byte_rate.last_byte_rate[next] = 0;
+			m_byte_rate.index = next;
+		}
+
+		// 计算限速.
+		m_drop_size = m_settings.download_rate_limit;
+
+#ifndef AVHTTP_DISABLE_THREAD
+		// 锁定m_streams容器进行操作, 保证m_streams操作的唯一性.
+		boost::mutex::scoped_lock lock(m_streams_mutex);
+#endif
+
+		// 有分片校验失败被清除, 重新启用已经完成的连接来下载这些分片.
+		if (m_accept_multi && take_refetch())
+		{
+			for (std::size_t i = 0; i < m_streams.size(); i++)
+			{
+				revive_stream(*m_streams[i]);
+			}
+		}
+
+		// 流式下载模式下, 优先调度读取位置之后的数据.
+		schedule_streaming();
+
+		// 检查超时和需要重新连接的连接.
+		check_streams();
+
+		// 统计操作功能完成的http_stream的个数.
+		int done = 0;
+		for (std::size_t i = 0; i < m_streams.size(); i++)
+		{
+			http_stream_object &object = *m_streams[i];
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(object.mutex);
+#endif
+			if (object.done)
+			{
+				done++;
+			}
+		}
+
+		// 当m_streams中所有连接都done, 并且没有等待校验的分片时, 表示已经下载完成.
+		if (done == m_streams.size() && !verify_pending())
+		{
+			m_abort = true;
+			cancel_tick();
+			// 通知wait_for_complete退出.
+			boost::mutex::scoped_lock l(m_quit_mtx);
+			m_quit_cond.notify_one();
+			return;
+		}
+	}
+
+	// 重新启用一个已经完成的连接, 使它在check_streams中重新分配区间下载.
+	// 调用时必须已经锁定m_streams_mutex.
+	bool revive_stream(http_stream_object &object)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(object.mutex);
+#endif
+		// 出现下列之一的错误的连接, 重试也是没有意义的.
+		if (!object.done
+			|| object.ec == avhttp::errc::forbidden
+			|| object.ec == avhttp::errc::not_found
+			|| object.ec == avhttp::errc::method_not_allowed)
+		{
+			return false;
+		}
+
+		object.done = false;
+		object.direct_reconnect = true;
+		m_number_of_connections++;
+
+		return true;
+	}
+
+	// 流式下载调度, 保证读取位置m_download_point之后预读窗口中的数据被优先下载.
+	// 窗口中第一个没有下载的位置被称为紧急位置, 按以下情况处理:
+	// 1. 紧急位置正在被某个连接下载, 但这个连接已经停滞, 则立即重新请求.
+	// 2. 紧急位置在某个连接请求区间的中间, 且这个连接还需要下载超过一个窗口的
+	//    数据才能到达, 则把请求区间在紧急位置处截断, 剩余部分交给其它连接.
+	// 3. 紧急位置没有连接在下载, 则启用一个已完成的连接, 或者抢占一个正在下载
+	//    窗口之外数据的连接来下载.
+	// 调用时必须已经锁定m_streams_mutex.
+	void schedule_streaming()
+	{
+		if (!m_settings.streaming || !m_accept_multi || m_file_size <= 0 || m_abort)
+		{
+			return;
+		}
+
+		const boost::int64_t point = m_download_point;
+		if (point < 0 || point >= m_file_size)
+		{
+			return;
+		}
+		const boost::int64_t window_end = (std::min)(point + m_settings.read_ahead, m_file_size.load());
+
+		// 得到窗口中第一个没有下载的位置.
+		boost::int64_t missing = -1;
+		boost::int64_t missing_end = -1;
+		if (!m_downlaoded_field.out_space(point, missing, missing_end)
+			|| missing < point || missing >= window_end)
+		{
+			return;
+		}
+
+		const boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+		bool need_check = false;
+
+		// 查找正在下载紧急位置的连接, 以及紧急位置之后最近的连接下载位置.
+		// 连接的下载位置在它的strand中不断改变, 这里读取的只是一个快照, 修改时还需要重新检查.
+		http_stream_object *owner = NULL;
+		boost::int64_t next_cursor = missing_end;
+		for (std::size_t i = 0; i < m_streams.size(); i++)
+		{
+			http_stream_object &object = *m_streams[i];
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(object.mutex);
+#endif
+			if (object.done || object.direct_reconnect)
+			{
+				continue;
+			}
+
+			boost::int64_t cursor = object.request_range.left + object.bytes_transferred;
+			if (cursor <= missing && missing <= object.request_range.right)
+			{
+				owner = &object;
+			}
+			else if (cursor > missing)
+			{
+				next_cursor = (std::min)(next_cursor, cursor);
+			}
+		}
+
+		if (owner)
+		{
+			http_stream_object &object = *owner;
+			bool stalled = false;
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(object.mutex);
+#endif
+				boost::int64_t cursor = object.request_range.left + object.bytes_transferred;
+				if (object.done || object.direct_reconnect
+					|| cursor > missing || missing > object.request_range.right)
+				{
+					return;
+				}
+
+				if (missing - cursor <= m_settings.read_ahead)
+				{
+					// 连接停滞, 在check_streams中关闭并立即从停止的位置重新请求.
+					if (now - object.last_request_time <= boost::posix_time::seconds(default_urgent_time_out))
+					{
+						return;
+					}
+					object.direct_reconnect = true;
+					stalled = true;
+				}
+				else
+				{
+					// 截断请求区间, 连接重新请求[cursor, missing)部分, 剩余部分被释放.
+					boost::int64_t right = object.request_range.right;
+					object.request_range.right = missing - 1;
+					object.direct_reconnect = true;
+					need_check = true;
+					next_cursor = (std::min)(next_cursor, right + 1);
+				}
+			}
+
+			if (stalled)
+			{
+				check_streams();
+				return;
+			}
+		}
+
+		// 释放紧急位置开始的空间, 使allocate_range从m_download_point分配时能得到它.
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_rangefield_mutex);
+#endif
+			m_rangefield.remove(missing, (std::min)(next_cursor, missing_end));
+		}
+
+		// 优先启用已经完成的连接.
+		bool assigned = false;
+		for (std::size_t i = 0; i < m_streams.size() && !assigned; i++)
+		{
+			assigned = revive_stream(*m_streams[i]);
+		}
+
+		// 抢占下载位置离窗口最远的连接, 释放它剩余的请求区间.
+		if (!assigned)
+		{
+			http_stream_object *victim = NULL;
+			boost::int64_t farthest = window_end;
+			for (std::size_t i = 0; i < m_streams.size(); i++)
+			{
+				http_stream_object &object = *m_streams[i];
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(object.mutex);
+#endif
+				if (object.done || object.direct_reconnect)
+				{
+					continue;
+				}
+
+				boost::int64_t cursor = object.request_range.left + object.bytes_transferred;
+				if (cursor >= farthest)
+				{
+					farthest = cursor;
+					victim = &object;
+				}
+			}
+
+			if (victim)
+			{
+				http_stream_object &object = *victim;
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(object.mutex);
+#endif
+				boost::int64_t cursor = object.request_range.left + object.bytes_transferred;
+				if (!object.done && !object.direct_reconnect
+					&& cursor >= window_end && cursor <= object.request_range.right + 1)
+				{
+					{
+#ifndef AVHTTP_DISABLE_THREAD
+						boost::mutex::scoped_lock lock(m_rangefield_mutex);
+#endif
+						if (cursor <= object.request_range.right)
+						{
+							m_rangefield.remove(cursor, object.request_range.right + 1);
+						}
+					}
+					object.request_range.right = cursor - 1;
+					object.direct_reconnect = true;
+					assigned = true;
+				}
+			}
+		}
+
+		if (need_check || assigned)
+		{
+			check_streams();
+		}
+	}
+
+	// 用户读取位置改变后, 在io_service中立即进行一次流式下载调度.
+	void handle_schedule()
+	{
+		change_outstranding(false);
+
+		if (m_abort)
+		{
+			return;
+		}
+
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_streams_mutex);
+#endif
+		schedule_streaming();
+	}
+
+	// 检查各个连接, 超时或需要立即重新连接的连接在它自己的strand中关闭并重新创建.
+	// 调用时必须已经锁定m_streams_mutex.
+	void check_streams()
+	{
+		boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+		for (std::size_t i = 0; i < m_streams.size(); i++)
+		{
+			http_object_ptr &object_item_ptr = m_streams[i];
+			http_stream_object &object = *object_item_ptr;
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(object.mutex);
+#endif
+
+			// 正在重新创建的连接, 等待handle_reconnect完成.
+			if (object.done || object.reconnecting)
+			{
+				continue;
+			}
+
+			bool timeout = now - object.last_request_time > boost::posix_time::seconds(m_settings.time_out);
+			if (!timeout && !object.direct_reconnect)
+			{
+				continue;
+			}
+
+			// 超时作为一次失败, 由重试策略决定是否重新连接.
+			if (!object.direct_reconnect)
+			{
+				AVHTTP_METRIC_ADD(metric_timeouts, 1);
+				if (!object.ec)
+					object.ec = boost::asio::error::timed_out;
+			}
+
+			// 置位后这个连接上的handler不再继续下载.
+			object.direct_reconnect = true;
+			object.reconnecting = true;
+
+			change_outstranding(true);
+			object.strand->post(boost::bind(&multi_download::handle_reconnect,
+				this, i, object_item_ptr));
+		}
+	}
+
+	// 在连接的strand中关闭超时或出错的连接, 并重新创建http_object和http_stream.
+	void handle_reconnect(const int index, http_object_ptr old_ptr)
+	{
+		change_outstranding(false);
+
+		http_stream_object &old_object = *old_ptr;
+
+		// 超时或出错, 关闭连接, 这个连接上未完成的handler将以operation_aborted返回.
+		boost::system::error_code ec;
+		old_object.stream->close(ec);
+
+		if (m_abort)
+		{
+			return;
+		}
+
+		// 在old_object上做最后的判断, 新的对象在替换到m_streams之前只属于这个handler.
+		bool closed = false;
+		boost::posix_time::time_duration delay;
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(old_object.mutex);
+#endif
+
+			// 出错或超时的连接, 由重试策略决定是否重新连接, 例如403/404这样重试也没有
+			// 意义的错误, 或者重试次数和预算用完时, 不再连接服务器. 被调度截断的连接不算失败.
+			if (old_object.ec)
+			{
+				old_object.retries++;
+				if (!m_retry_policy->should_retry(origin_key(m_final_url), old_object.retries,
+					old_object.ec, old_object.stream->response_options(), delay))
+					closed = true;
+			}
+			if (closed)
+			{
+				old_object.done = true;
+				old_object.reconnecting = false;
+			}
+		}
+		if (closed)
+		{
+			emit_connection_state(index, download_event::closed);
+			return;
+		}
+
+		// 单连接模式, 表示下载停止, 终止下载.
+		if (!m_accept_multi)
+		{
+			m_abort = true;
+			cancel_tick();
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(old_object.mutex);
+#endif
+				old_object.done = true;
+				old_object.reconnecting = false;
+			}
+			m_number_of_connections--;
+			emit_connection_state(index, download_event::closed);
+			return;
+		}
+
+		// 重新创建http_object和http_stream, 复制时会重置重连标识.
+		http_object_ptr object_item_ptr(new http_stream_object(old_object));
+		http_stream_object &object = *object_item_ptr;
+		object.direct_reconnect = false;
+
+		// 使用新的http_stream对象.
+		object.stream.reset(new http_stream(object.io));
+
+		http_stream &stream = *object.stream;
+
+		// 配置请求选项.
+		request_opts req_opt = m_settings.opts;
+
+		// 设置是否为长连接.
+		if (m_keep_alive)
+		{
+			req_opt.insert(http_options::connection, "keep-alive");
+		}
+
+		// 继续从上次未完成的位置开始请求.
+		boost::int64_t begin = object.request_range.left + object.bytes_transferred;
+		boost::int64_t end = object.request_range.right;
+
+		if (end - begin <= 0)
+		{
+			// 如果分配空闲空间失败, 则跳过这个socket.
+			if (!allocate_range(object.request_range, request_size(object)))
+			{
+				{
+#ifndef AVHTTP_DISABLE_THREAD
+					boost::mutex::scoped_lock lock(old_object.mutex);
+#endif
+					old_object.done = true;	// 已经没什么可以下载了.
+					old_object.reconnecting = false;
+				}
+				m_number_of_connections--;
+				emit_connection_state(index, download_event::closed);
+				return;
+			}
+
+			object.bytes_transferred = 0;
+			begin = object.request_range.left;
+			end = object.request_range.right;
+		}
+
+		req_opt.insert(http_options::range, boost::str(
+			boost::format("bytes=%lld-%lld", std::locale("C")) % begin % end));
+
+		// 添加代理设置.
+		stream.proxy(m_settings.proxy);
+		// 设置到请求选项中.
+		stream.request_options(req_opt);
+		// 如果是ssl连接, 默认为检查证书.
+		stream.check_certificate(m_settings.check_certificate);
+		// 禁用重定向.
+		stream.max_redirects(0);
+		// 设置http/2连接池.
+		stream.http2(http2_connection_pool());
+
+		// 保存最后请求时间, 方便检查超时重置.
+		object.last_request_time = boost::posix_time::microsec_clock::local_time();
+
+		// 需要等待时, 等待期间check_streams跳过这个连接.
+		bool wait = delay > boost::posix_time::seconds(0);
+		object.reconnecting = wait;
+
+		// 替换m_streams中的连接, 之后定时器检查的是新的连接.
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_streams_mutex);
+#endif
+			if (index >= m_streams.size() || m_streams[index] != old_ptr)
+			{
+				return;
+			}
+			m_streams[index] = object_item_ptr;
+		}
+
+		emit_connection_state(index, download_event::reconnecting);
+		AVHTTP_METRIC_ADD(metric_retries, 1);
+
+		if (wait)
+		{
+			wait_reconnect(index, object_item_ptr, delay);
+			return;
+		}
+
+		start_reconnect(index, object_item_ptr);
+	}
+
+	// 在连接的strand中等待delay后重新连接.
+	void wait_reconnect(const int index, http_object_ptr object_ptr,
+		const boost::posix_time::time_duration &delay)
+	{
+		http_stream_object &object = *object_ptr;
+		if (!object.retry_timer)
+			object.retry_timer.reset(new boost::asio::deadline_timer(object.io));
+		object.retry_timer->expires_from_now(delay);
+
+		change_outstranding(true);
+		object.retry_timer->async_wait(object_ptr->strand->wrap(
+			boost::bind(&multi_download::handle_reconnect_timer,
+				this, index, object_ptr, boost::asio::placeholders::error)));
+	}
+
+	void handle_reconnect_timer(const int index, http_object_ptr object_ptr,
+		const boost::system::error_code &ec)
+	{
+		change_outstranding(false);
+		if (ec || m_abort)
+		{
+			return;
+		}
+
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(object_ptr->mutex);
+#endif
+			object_ptr->reconnecting = false;
+			object_ptr->last_request_time = boost::posix_time::microsec_clock::local_time();
+		}
+
+		start_reconnect(index, object_ptr);
+	}
+
+	// 发起重新连接的请求, 熔断器打开时等待到允许请求.
+	void start_reconnect(const int index, http_object_ptr object_ptr)
+	{
+		boost::posix_time::time_duration delay;
+		if (!m_retry_policy->allow_request(origin_key(m_final_url), delay))
+		{
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(object_ptr->mutex);
+#endif
+				object_ptr->reconnecting = true;
+			}
+			wait_reconnect(index, object_ptr, delay);
+			return;
+		}
+
+		change_outstranding(true);
+		// 重新发起异步请求, 传入object_item_ptr指针, 以确保线程安全.
+		object_ptr->stream->async_open(m_final_url,
+			object_ptr->strand->wrap(boost::bind(&multi_download::handle_open,
+				this,
+				index, object_ptr,
+				boost::asio::placeholders::error
+			))
+		);
+	}
+
+	// 收到响应, 以发出请求到收到响应的时间作为RTT, 包括建立连接的时间.
+	void update_rtt(http_stream_object &object)
+	{
+		boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+		double sample = (now - object.last_request_time).total_microseconds() / 1000.0;
+		object.rtt = object.rtt == 0 ? sample : (object.rtt * 3 + sample) / 4;
+		object.response_time = now;
+	}
+
+	// 请求区间下载完成, 以收到响应到下载完成的时间计算吞吐量.
+	void update_throughput(http_stream_object &object)
+	{
+		if (object.response_time.is_not_a_date_time())
+		{
+			return;
+		}
+
+		boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+		boost::int64_t us = (now - object.response_time).total_microseconds();
+
+		// 时间太短时误差太大, 忽略.
+		if (us < 1000)
+		{
+			return;
+		}
+
+		double sample = object.bytes_transferred * 1000000.0 / us;
+		object.throughput = object.throughput == 0 ? sample : (object.throughput * 3 + sample) / 4;
+	}
+
+	// 计算连接下一次请求的大小, 请求大小为带宽时延积的若干倍, 使等待响应的时间只占
+	// 传输时间的一小部分. 没有开启动态请求大小或还没有测量数据时为request_piece_num个分片.
+	boost::int64_t request_size(const http_stream_object &object) const
+	{
+		boost::int64_t bytes = boost::int64_t(m_settings.request_piece_num) * m_settings.piece_size;
+		if (!m_settings.dynamic_request_size || object.rtt <= 0 || object.throughput <= 0)
+		{
+			return bytes;
+		}
+
+		double bdp = object.throughput * object.rtt / 1000.0;
+		bytes = static_cast<boost::int64_t>(bdp * default_request_rtt_factor);
+
+		return (std::min)(bytes, boost::int64_t(m_settings.max_request_size));
+	}
+
+	// 按设置准备http/2连接池, 连接池在multi_download的io_service中运行.
+	void setup_http2()
+	{
+		if (!m_settings.http2)
+			return;
+		if (!m_http2)
+			m_http2.reset(new http2_pool(m_io_service));
+		m_http2->prior_knowledge(m_settings.http2_prior_knowledge);
+		m_http2->check_certificate(m_settings.check_certificate);
+	}
+
+	// 按设置准备重试策略, 没有设置时使用默认策略, 不限制重新连接的次数.
+	void setup_retry_policy()
+	{
+		m_retry_policy = m_settings.retry;
+		if (!m_retry_policy)
+		{
+			retry_settings s;
+			s.max_attempts = -1;
+			m_retry_policy.reset(new default_retry_policy(s));
+		}
+	}
+
+	// 数据连接使用的http/2连接池, 没有开启http/2时为NULL.
+	http2_pool* http2_connection_pool()
+	{
+		return m_settings.http2 ? m_http2.get() : NULL;
+	}
+
+	// 创建一个连接对象, 使用io_service_pool时按池的分配策略选择io_service.
+	http_object_ptr create_stream_object()
+	{
+		if (m_pool)
+		{
+			io_service_pool::shard_ptr shard = m_pool->acquire();
+			return http_object_ptr(new http_stream_object(shard->get_io_service(), shard));
+		}
+
+		return http_object_ptr(new http_stream_object(m_io_service));
+	}
+
+	// 分配一段空闲区间.
+	// @param r返回分配的区间, 包含右边界.
+	// @param request_bytes期望的请求大小, 小于等于0时为request_piece_num个分片.
+	bool allocate_range(range &r, boost::int64_t request_bytes = -1)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		// 在多线程运行io_service时, 必须加锁, 避免重入时多次重复分配相同区域.
+		// 单线程执行io_service(并启用了AVHTTP_DISABLE_THREAD)无需考虑加
+		// 锁, 因为所有操作都是异步串行的动作.
+		boost::mutex::scoped_lock lock(m_rangefield_mutex);
+#endif
+
+		range temp(-1, -1);
+
+		do
+		{
+			// 从指定位置m_download_point开始文件间区中得到一段空间.
+			if (!m_rangefield.out_space(m_download_point, temp.left, temp.right))
+			{
+				return false;
+			}
+
+			// 用于调试.
+			BOOST_ASSERT(temp != r);
+			BOOST_ASSERT(temp.size() >= 0);
+
+			// 重新计算为最大max_request_bytes大小.
+			boost::int64_t max_request_bytes = request_bytes > 0 ?
+				request_bytes : m_settings.request_piece_num * m_settings.piece_size;
+
+			// 动态请求大小, 不超过剩余未分配数据按连接数平分的大小, 避免最后只剩
+			// 少数连接在下载很大的区间, 结束位置按分片对齐.
+			if (m_settings.dynamic_request_size)
+			{
+				const boost::int64_t piece_size = m_settings.piece_size;
+				boost::int64_t remain = (m_file_size - m_rangefield.range_size())
+					/ (std::max)(m_settings.connections_limit, 1);
+				max_request_bytes = (std::max)((std::min)(max_request_bytes, remain), boost::int64_t(1));
+				boost::int64_t end = temp.left + max_request_bytes;
+				end = ((end + piece_size - 1) / piece_size) * piece_size;
+				max_request_bytes = end - temp.left;
+			}
+
+			if (temp.size() > max_request_bytes)
+			{
+				temp.right = temp.left + max_request_bytes;
+			}
+
+			// 流式下载模式下, 在预读窗口内的请求按连接数分成较小的块, 使多个连接
+			// 同时下载窗口内的数据, 并且不超出窗口, 结束位置按分片对齐.
+			if (m_settings.streaming && m_download_point >= 0)
+			{
+				boost::int64_t window_end = m_download_point + m_settings.read_ahead;
+				if (temp.left >= m_download_point && temp.left < window_end)
+				{
+					const boost::int64_t piece_size = m_settings.piece_size;
+					boost::int64_t chunk = (std::max)(piece_size,
+						boost::int64_t(m_settings.read_ahead / (std::max)(m_settings.connections_limit, 1)));
+					boost::int64_t end = (std::min)(temp.left + chunk, window_end);
+					end = ((end + piece_size - 1) / piece_size) * piece_size;
+					if (end > temp.left && end < temp.right)
+					{
+						temp.right = end;
+					}
+				}
+			}
+
+			r = temp;
+
+			// 从m_rangefield中分配这个空间.
+			if (!m_rangefield.update(temp))
+			{
+				continue;
+			}
+			else
+			{
+				break;
+			}
+		} while (!m_abort);
+
+		// 右边边界减1, 因为http请求的区间是包含右边界值, 下载时会将right下标位置的字节下载.
+		if (--r.right < r.left)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	bool open_meta(const fs::path &file_path)
+	{
+		boost::system::error_code ec;
+
+		// 得到文件大小.
+		boost::uintmax_t size = fs::file_size(file_path, ec);
+		if (ec)
+		{
+			size = 0;
+		}
+
+		// 清除上次meta中的分片hash.
+		m_meta_hash = verify_settings::none;
+		m_meta_piece_size = -1;
+		m_meta_hashes.clear();
+
+		// 打开文件.
+		m_file_meta.close();
+		m_file_meta.open(file_path, ec);
+		if (ec)
+		{
+			return false;
+		}
+
+		// 如果有数据, 则解码meta数据.
+		if (size != 0)
+		{
+			std::vector<char> buffer;
+
+			buffer.resize(size);
+			const std::streamsize num = m_file_meta.read(&buffer[0], 0, size);
+			if (num != size)
+			{
+				return false;
+			}
+
+			entry e = bdecode(buffer.begin(), buffer.end());
+
+			// 最终的url.
+			if (m_settings.allow_use_meta_url)
+			{
+				const std::string url = e["final_url"].string();
+				if (!url.empty())
+				{
+					m_final_url = url;
+				}
+			}
+
+			// 文件大小.
+			m_file_size = e["file_size"].integer();
+			m_rangefield.reset(m_file_size);
+			m_downlaoded_field.reset(m_file_size);
+
+			// 分片大小.
+			int piece_size = e["piece_size"].integer();
+
+			// 分片数.
+			int piece_num = e["piece_num"].integer();
+
+			// 位图数据.
+			std::string bitfield_data = e["bitfield"].string();
+
+			// 构造到位图.
+			bitfield bf(bitfield_data.c_str(), piece_num);
+
+			// 更新到区间范围.
+			m_rangefield.bitfield_to_range(bf, piece_size);
+			m_downlaoded_field.bitfield_to_range(bf, piece_size);
+
+			// 有期望的分片hash时, 分片大小必须与hash对应, 不能使用meta中的分片大小.
+			if (m_settings.verify.piece_hashes.empty())
+			{
+				m_settings.piece_size = piece_size;
+			}
+
+			// 已完成分片的hash, 用于续传时校验磁盘上的数据.
+			const entry *hash = e.find_key("hash");
+			const entry *hashes = e.find_key("piece_hashes");
+			if (hash && hash->type() == entry::string_t
+				&& hashes && hashes->type() == entry::list_t)
+			{
+				const entry::list_type &l = hashes->list();
+				for (entry::list_type::const_iterator i = l.begin(); i != l.end(); i++)
+				{
+					m_meta_hashes.push_back(i->type() == entry::string_t ? i->string() : "");
+				}
+				m_meta_hash = detail::piece_hasher::from_name(hash->string());
+				m_meta_piece_size = piece_size;
+			}
+		}
+
+		return true;
+	}
+
+	void update_meta()
+	{
+		if (!m_file_meta.is_open())
+		{
+			boost::system::error_code ec;
+			m_file_meta.open(m_settings.meta_file, ec);
+			if (ec)
+			{
+				return;
+			}
+		}
+
+		entry e;
+
+		e["final_url"] = m_final_url.to_string();
+		e["file_size"] = m_file_size;
+		e["piece_size"] = m_settings.piece_size;
+		e["piece_num"] = (m_file_size / m_settings.piece_size) +
+			(m_file_size % m_settings.piece_size == 0 ? 0 : 1);
+		bitfield bf;
+		m_downlaoded_field.range_to_bitfield(bf, m_settings.piece_size);
+
+		// 还没有通过校验的分片不写入位图, 避免续传时使用未经校验的数据.
+		// 同时保存已校验分片的hash, 续传时用于校验磁盘上的数据.
+		if (m_hash_pool)
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_verify_mutex);
+#endif
+			entry::list_type hashes;
+			for (std::size_t i = 0; i < bf.size(); i++)
+			{
+				if (bf.get_bit(i) && !m_verified.get_bit(i))
+				{
+					bf.clear_bit(i);
+				}
+				hashes.push_back(entry(bf.get_bit(i) ? m_piece_hashes[i] : std::string()));
+			}
+			e["hash"] = detail::piece_hasher::name(m_hasher.type());
+			e["piece_hashes"] = hashes;
+		}
+
+		std::string str(bf.bytes(), bf.bytes_size());
+		e["bitfield"] = str;
+
+		std::vector<char> buffer;
+		bencode(back_inserter(buffer), e);
+
+		m_file_meta.write(&buffer[0], 0, buffer.size());
+	}
+
+	void load_manifest(const fs::path &file_path, boost::system::error_code &ec)
+	{
+		ec = boost::system::error_code();
+
+		fs::ifstream in(file_path, std::ios::binary);
+		if (!in.is_open())
+		{
+			ec = errc::invalid_hash_manifest;
+			return;
+		}
+
+		std::vector<char> buffer((std::istreambuf_iterator<char>(in)),
+			std::istreambuf_iterator<char>());
+		entry e = bdecode(buffer.begin(), buffer.end());
+		if (e.type() != entry::dictionary_t)
+		{
+			ec = errc::invalid_hash_manifest;
+			return;
+		}
+
+		const entry *hash = e.find_key("hash");
+		const entry *piece_size = e.find_key("piece_size");
+		const entry *pieces = e.find_key("pieces");
+		if (!hash || hash->type() != entry::string_t
+			|| !piece_size || piece_size->type() != entry::int_t || piece_size->integer() <= 0
+			|| !pieces || pieces->type() != entry::list_t)
+		{
+			ec = errc::invalid_hash_manifest;
+			return;
+		}
+
+		verify_settings::hash_type type = detail::piece_hasher::from_name(hash->string());
+		if (type == verify_settings::none)
+		{
+			ec = errc::invalid_hash_manifest;
+			return;
+		}
+
+		std::vector<std::string> hashes;
+		const entry::list_type &l = pieces->list();
+		for (entry::list_type::const_iterator i = l.begin(); i != l.end(); i++)
+		{
+			if (i->type() != entry::string_t)
+			{
+				ec = errc::invalid_hash_manifest;
+				return;
+			}
+			hashes.push_back(i->string());
+		}
+
+		// 使用清单中的设置.
+		m_settings.verify.hash = type;
+		m_settings.verify.piece_hashes.swap(hashes);
+		m_settings.piece_size = piece_size->integer();
+	}
+
+	void prepare_verify(boost::system::error_code &ec)
+	{
+		ec = boost::system::error_code();
+
+		m_hash_pool.reset();
+		m_expected_hashes.clear();
+		m_piece_hashes.clear();
+		m_hash_failures.clear();
+		m_refetch = false;
+		m_verified.free();
+		m_hashing.free();
+
+		// 不支持多点下载时, 没有分片, 校验失败的分片也无法单独重新下载, 所以不进行校验.
+		if (!m_accept_multi || m_file_size <= 0)
+		{
+			return;
+		}
+
+		const int piece_num = (m_file_size / m_settings.piece_size) +
+			(m_file_size % m_settings.piece_size == 0 ? 0 : 1);
+
+		// 在开始下载前已经完成的分片(从meta中恢复的)视为已经通过校验.
+		// 不校验时m_verified只用于记录已经完成的分片, 以产生分片完成事件.
+		m_downlaoded_field.range_to_bitfield(m_verified, m_settings.piece_size);
+		m_hashing.resize(piece_num, false);
+
+		const verify_settings &vs = m_settings.verify;
+
+		// 没有指定算法时, 沿用meta中记录的算法, 以便续传时继续计算和校验分片hash.
+		verify_settings::hash_type type = vs.hash;
+		if (type == verify_settings::none)
+		{
+			type = m_meta_hash;
+		}
+
+		if (type == verify_settings::none)
+		{
+			return;
+		}
+
+		if (!detail::piece_hasher::is_supported(type))
+		{
+			ec = boost::asio::error::operation_not_supported;
+			return;
+		}
+
+		// 期望的hash值必须与分片一一对应.
+		if (!vs.piece_hashes.empty())
+		{
+			if (vs.piece_hashes.size() != static_cast<std::size_t>(piece_num))
+			{
+				ec = errc::invalid_hash_manifest;
+				return;
+			}
+
+			m_expected_hashes = vs.piece_hashes;
+			for (std::size_t i = 0; i < m_expected_hashes.size(); i++)
+			{
+				boost::to_lower(m_expected_hashes[i]);
+			}
+		}
+
+		m_hasher = detail::piece_hasher(type);
+		m_hash_failures.resize(piece_num, 0);
+
+		// meta中保存的分片hash, 只有算法和分片大小都一致时才能继续使用.
+		if (m_meta_hash == type && m_meta_piece_size == m_settings.piece_size
+			&& m_meta_hashes.size() == static_cast<std::size_t>(piece_num))
+		{
+			m_piece_hashes = m_meta_hashes;
+		}
+		else
+		{
+			m_piece_hashes.resize(piece_num);
+		}
+
+		m_hash_pool.reset(new detail::hash_pool(vs.threads));
+	}
+
+	// 检查[left, right)所在的分片是否下载完成, 完成则投递到线程池计算hash,
+	// 未启用校验时直接标记为完成.
+	void check_pieces(boost::int64_t left, boost::int64_t right)
+	{
+		const boost::int64_t piece_size = m_settings.piece_size;
+		const int first = left / piece_size;
+		const int last = (right - 1) / piece_size;
+
+		for (int i = first; i <= last; i++)
+		{
+			boost::int64_t l = i * piece_size;
+			boost::int64_t r = (std::min)(l + piece_size, m_file_size.load());
+
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(m_verify_mutex);
+#endif
+				if (m_verified.get_bit(i) || m_hashing.get_bit(i))
+				{
+					continue;
+				}
+				if (!m_downlaoded_field.check_range(l, r))
+				{
+					continue;
+				}
+				if (!m_hash_pool)
+				{
+					m_verified.set_bit(i);
+				}
+				else
+				{
+					m_hashing.set_bit(i);
+				}
+			}
+
+			if (!m_hash_pool)
+			{
+				emit_piece(download_event::piece_completed, i);
+				continue;
+			}
+
+			change_outstranding(true);
+			m_hash_pool->post(boost::bind(&multi_download::hash_piece, this, i, l, r));
+		}
+	}
+
+	// 在hash线程池中执行, 读取分片数据并计算hash.
+	void hash_piece(int index, boost::int64_t left, boost::int64_t right)
+	{
+		std::vector<char> buffer(right - left);
+		std::streamsize num = 0;
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_storage_mutex);
+#endif
+			num = m_storage->read(&buffer[0], left, buffer.size());
+		}
+
+		// 读取失败时hash为空串, 将被当作校验失败处理.
+		std::string digest;
+		if (num == static_cast<std::streamsize>(buffer.size()))
+		{
+			digest = m_hasher.digest(&buffer[0], buffer.size());
+		}
+
+		// 回到io_service中处理校验结果.
+		m_io_service.post(boost::bind(&multi_download::handle_hash, this, index, digest));
+	}
+
+	void handle_hash(int index, const std::string &digest)
+	{
+		change_outstranding(false);
+
+		const boost::int64_t piece_size = m_settings.piece_size;
+		boost::int64_t l = index * piece_size;
+		boost::int64_t r = (std::min)(l + piece_size, m_file_size.load());
+
+		bool passed = false;
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_verify_mutex);
+#endif
+			m_hashing.clear_bit(index);
+			m_piece_hashes[index] = digest;
+
+			if (!digest.empty() && (m_expected_hashes.empty() || m_expected_hashes[index] == digest))
+			{
+				m_verified.set_bit(index);
+				passed = true;
+			}
+		}
+
+		if (passed)
+		{
+			emit_piece(download_event::piece_completed, index);
+			return;
+		}
+
+		emit_piece(download_event::piece_failed, index);
+
+		LOG_WARNING_CAT(log_storage, "Piece " << index << " hash check failed, expected \'"
+			<< (m_expected_hashes.empty() ? "" : m_expected_hashes[index])
+			<< "\' got \'" << digest << "\'");
+
+		// 多次重新下载仍然校验失败, 数据源可能已经改变, 终止下载.
+		if (++m_hash_failures[index] > m_settings.verify.max_retries)
+		{
+			LOG_ERROR_CAT(log_storage, "Piece " << index << " hash check failed "
+				<< m_hash_failures[index] << " times, abort download");
+			stop();
+			return;
+		}
+
+		// 从已下载区间和已分配区间中删除这个分片, 以便重新分配下载.
+		m_downlaoded_field.remove(l, r);
+		{
+#ifndef AVHTTP_DISABLE_THREAD
+			boost::mutex::scoped_lock lock(m_rangefield_mutex);
+#endif
+			m_rangefield.remove(l, r);
+		}
+
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_verify_mutex);
+#endif
+		m_refetch = true;
+	}
+
+	// 续传校验: 重新计算所有已完成分片的hash, 与期望的hash或meta中保存的hash比较,
+	// 清除校验失败的分片. 多个线程各自取出一批连续的分片进行大块顺序读取, 读取
+	// 时串行访问存储, 计算时并行, 使校验速度尽量接近磁盘读取速度.
+	void resume_check()
+	{
+		resume_check_state state;
+		for (std::size_t i = 0; i < m_verified.size(); i++)
+		{
+			if (m_verified.get_bit(i))
+			{
+				state.pieces.push_back(i);
+			}
+		}
+
+		if (state.pieces.empty())
+		{
+			return;
+		}
+
+		boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::local_time();
+
+		// 启动与线程池线程数相同的校验任务, 并等待全部完成.
+		int tasks = (std::min)(m_hash_pool->size(), state.pieces.size());
+		state.running = tasks;
+		for (int i = 0; i < tasks; i++)
+		{
+			m_hash_pool->post(boost::bind(&multi_download::resume_check_worker,
+				this, boost::ref(state)));
+		}
+		{
+			boost::mutex::scoped_lock lock(state.mutex);
+			while (state.running != 0)
+			{
+				state.cond.wait(lock);
+			}
+		}
+
+		// 清除校验失败的分片, 这些分片将被重新下载.
+		const boost::int64_t piece_size = m_settings.piece_size;
+		for (std::size_t i = 0; i < state.bad.size(); i++)
+		{
+			int index = state.bad[i];
+			boost::int64_t l = index * piece_size;
+			boost::int64_t r = (std::min)(l + piece_size, m_file_size.load());
+
+			m_verified.clear_bit(index);
+			m_piece_hashes[index] = "";
+			m_downlaoded_field.remove(l, r);
+			m_rangefield.remove(l, r);
+		}
+
+		LOG_INFO_CAT(log_storage, "Resume check " << state.pieces.size() << " pieces, "
+			<< state.bad.size() << " failed, "
+			<< (boost::posix_time::microsec_clock::local_time() - start_time).total_milliseconds() << " ms");
+	}
+
+	// 在hash线程池中执行的续传校验任务.
+	void resume_check_worker(resume_check_state &state)
+	{
+		const boost::int64_t piece_size = m_settings.piece_size;
+		const std::size_t batch = (std::max)(boost::int64_t(1), default_resume_read_size / piece_size);
+		std::vector<char> buffer;
+
+		for (;;)
+		{
+			// 取出一批连续的分片, 一次读取完成.
+			std::size_t first = 0;
+			std::size_t last = 0;
+			{
+				boost::mutex::scoped_lock lock(state.mutex);
+				if (state.next >= state.pieces.size())
+				{
+					break;
+				}
+				first = state.next;
+				last = first + 1;
+				while (last < state.pieces.size() && last - first < batch
+					&& state.pieces[last] == state.pieces[last - 1] + 1)
+				{
+					last++;
+				}
+				state.next = last;
+			}
+
+			boost::int64_t left = state.pieces[first] * piece_size;
+			boost::int64_t right = (std::min)(state.pieces[last - 1] * piece_size + piece_size, m_file_size.load());
+			buffer.resize(right - left);
+
+			std::streamsize num = 0;
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(m_storage_mutex);
+#endif
+				num = m_storage->read(&buffer[0], left, buffer.size());
+			}
+
+			for (std::size_t i = first; i < last; i++)
+			{
+				int index = state.pieces[i];
+				boost::int64_t l = index * piece_size - left;
+				boost::int64_t r = (std::min)(l + piece_size, right - left);
+
+				// 读取失败(如文件被截断)视为校验失败.
+				std::string digest;
+				if (num == static_cast<std::streamsize>(buffer.size()))
+				{
+					digest = m_hasher.digest(&buffer[l], r - l);
+				}
+
+				// 优先使用用户给出的hash, 其次是meta中保存的hash, 都没有时只计算不校验.
+				const std::string &expected = m_expected_hashes.empty()
+					? m_piece_hashes[index] : m_expected_hashes[index];
+
+				if (digest.empty() || (!expected.empty() && expected != digest))
+				{
+					boost::mutex::scoped_lock lock(state.mutex);
+					state.bad.push_back(index);
+				}
+				else
+				{
+					// 每个分片只由一个任务处理, 无需加锁.
+					m_piece_hashes[index] = digest;
+				}
+			}
+		}
+
+		boost::mutex::scoped_lock lock(state.mutex);
+		if (--state.running == 0)
+		{
+			state.cond.notify_all();
+		}
+	}
+
+	// 更新下载点位置, 流式下载模式下立即重新调度.
+	void set_download_point(boost::int64_t offset)
+	{
+		bool changed = (m_download_point != offset);
+		m_download_point = offset;
+
+		if (changed && m_settings.streaming && !m_abort)
+		{
+			change_outstranding(true);
+			m_tick_strand.post(boost::bind(&multi_download::handle_schedule, this));
+		}
+	}
+
+	template <typename MutableBufferSequence, typename Handler>
+	void fetch_op(const MutableBufferSequence &buffers, boost::int64_t offset,
+		Handler handler, const boost::system::error_code &ec)
+	{
+		if (ec)
+		{
+			handler(ec, 0);
+			return;
+		}
+
+		std::size_t bytes_transferred = fetch_data(buffers, offset);
+		handler(ec, bytes_transferred);
+	}
+
+	// 在[left, right)下载完成后, 完成所有数据已经齐全的async_fetch_data.
+	void notify_fetch_waiters(boost::int64_t left, boost::int64_t right)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_fetch_waiters_mutex);
+#endif
+		std::list<fetch_waiter>::iterator i = m_fetch_waiters.begin();
+		while (i != m_fetch_waiters.end())
+		{
+			// 只检查与本次写入重叠的等待.
+			if (right > i->offset && left < i->offset + i->length
+				&& m_downlaoded_field.check_range(i->offset, i->offset + i->length))
+			{
+				m_io_service.post(boost::bind(i->op, boost::system::error_code()));
+				i = m_fetch_waiters.erase(i);
+				continue;
+			}
+			i++;
+		}
+	}
+
+	// 以operation_aborted完成所有等待中的async_fetch_data.
+	void cancel_fetch_waiters()
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_fetch_waiters_mutex);
+#endif
+		for (std::list<fetch_waiter>::iterator i = m_fetch_waiters.begin();
+			i != m_fetch_waiters.end(); i++)
+		{
+			m_io_service.post(boost::bind(i->op,
+				boost::system::error_code(boost::asio::error::operation_aborted)));
+		}
+		m_fetch_waiters.clear();
+	}
+
+	// 取出并清除重新下载标识.
+	bool take_refetch()
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_verify_mutex);
+#endif
+		bool refetch = m_refetch;
+		m_refetch = false;
+		return refetch;
+	}
+
+	// 是否还有正在计算hash或等待重新下载的分片.
+	bool verify_pending() const
+	{
+		if (!m_hash_pool)
+		{
+			return false;
+		}
+
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_verify_mutex);
+#endif
+		return m_refetch || m_hashing.count() != 0;
+	}
+
+	// 统计所有连接下载的字节数, 调用时必须已经锁定m_streams_mutex.
+	boost::int64_t streams_bytes_download() const
+	{
+		boost::int64_t bytes_transferred = 0;
+
+		for (std::size_t i = 0; i < m_streams.size(); i++)
+		{
+			const http_object_ptr &ptr = m_streams[i];
+			if (ptr)
+			{
+#ifndef AVHTTP_DISABLE_THREAD
+				boost::mutex::scoped_lock lock(ptr->mutex);
+#endif
+				bytes_transferred += ptr->bytes_downloaded;
+			}
+		}
+
+		return bytes_transferred;
+	}
+
+	// 构造一个包含当前下载进度的事件.
+	// @param streams_locked调用时是否已经锁定m_streams_mutex.
+	download_event make_event(download_event::event_type type, bool streams_locked) const
+	{
+		download_event ev;
+		ev.type = type;
+		ev.file_size = m_file_size;
+		ev.download_rate = m_byte_rate.current_byte_rate;
+		if (m_file_size != -1)
+		{
+			ev.bytes_download = m_downlaoded_field.range_size();
+		}
+		else
+		{
+			ev.bytes_download = streams_locked ? streams_bytes_download() : bytes_download();
+		}
+		return ev;
+	}
+
+	// 连接状态改变.
+	void emit_connection_state(int index, download_event::connection_state_type state)
+	{
+		download_event ev;
+		ev.type = download_event::connection_state;
+		ev.connection = index;
+		ev.state = state;
+		emit(ev);
+	}
+
+	// 连接出错, 连接正常关闭或被主动关闭时不产生错误事件.
+	void emit_error(int index, const boost::system::error_code &ec)
+	{
+		if (!ec || m_abort || ec == boost::asio::error::operation_aborted
+			|| ec == boost::asio::error::eof)
+		{
+			return;
+		}
+
+		download_event ev;
+		ev.type = download_event::error;
+		ev.connection = index;
+		ev.ec = ec;
+		emit(ev);
+	}
+
+	// 分片完成或校验失败.
+	void emit_piece(download_event::event_type type, int index)
+	{
+		download_event ev;
+		ev.type = type;
+		ev.piece = index;
+		emit(ev);
+	}
+
+	// 把事件加入到各个订阅的待投递事件中, 不合并, 达到最大个数或下载结束时立即投递.
+	void emit(const download_event &ev)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_events_mutex);
+#endif
+		if (ev.type == download_event::completed || ev.type == download_event::stopped)
+		{
+			// 下载结束, 完成所有async_wait.
+			m_finished = true;
+			m_finish_error = ev.ec;
+			for (std::size_t i = 0; i < m_wait_handlers.size(); i++)
+			{
+				m_io_service.post(boost::bind(m_wait_handlers[i], m_finish_error));
+			}
+			m_wait_handlers.clear();
+		}
+
+		for (std::size_t i = 0; i < m_subscriptions.size(); i++)
+		{
+			event_subscription &sub = *m_subscriptions[i];
+			if (!(sub.settings.mask & ev.type))
+			{
+				continue;
+			}
+
+			sub.batch.push_back(ev);
+
+			bool finished = ev.type == download_event::completed || ev.type == download_event::stopped;
+			if (finished)
+			{
+				// 结束事件已经包含最终进度, 避免之后再产生相同的进度事件.
+				sub.last_bytes = ev.bytes_download;
+			}
+
+			if (finished || sub.settings.interval <= 0
+				|| static_cast<int>(sub.batch.size()) >= sub.settings.max_events)
+			{
+				flush_events(sub);
+			}
+		}
+	}
+
+	// 投递订阅中等待的事件, 调用时必须已经锁定m_events_mutex.
+	void flush_events(event_subscription &sub)
+	{
+		if (sub.batch.empty())
+		{
+			return;
+		}
+
+		download_events batch;
+		batch.swap(sub.batch);
+		sub.post(boost::bind(sub.handler, batch));
+	}
+
+	// 启动所有订阅的合并投递定时器.
+	void start_event_timers()
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_events_mutex);
+#endif
+		// 下载已经开始, 之后的async_wait等待这次下载结束.
+		m_finished = false;
+		m_finish_error = boost::system::error_code();
+
+		for (std::size_t i = 0; i < m_subscriptions.size(); i++)
+		{
+			start_event_timer(m_subscriptions[i]);
+		}
+	}
+
+	// 启动合并投递定时器, 调用时必须已经锁定m_events_mutex.
+	// 定时器不计入m_outstanding, 下载结束后最多再触发一次, 投递剩余的事件后停止.
+	void start_event_timer(event_subscription_ptr sub)
+	{
+		if (sub->settings.interval <= 0 || sub->timer_running || sub->closed)
+		{
+			return;
+		}
+
+		sub->timer_running = true;
+		sub->timer->expires_from_now(boost::posix_time::milliseconds(sub->settings.interval));
+		sub->timer->async_wait(boost::bind(&multi_download::handle_event_timer,
+			this, sub, boost::asio::placeholders::error));
+	}
+
+	// 订阅被取消时对象可能已经析构, 所以先检查订阅状态, 再访问对象.
+	static void handle_event_timer(multi_download *self,
+		event_subscription_ptr sub, const boost::system::error_code &ec)
+	{
+		if (ec == boost::asio::error::operation_aborted || sub->closed)
+		{
+			return;
+		}
+
+		self->on_event_timer(sub);
+	}
+
+	void on_event_timer(event_subscription_ptr sub)
+	{
+		// bytes_download可能需要锁定m_streams_mutex, 所以在锁定m_events_mutex之前取得进度.
+		download_event ev = make_event(download_event::progress, false);
+
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_events_mutex);
+#endif
+		if (sub->closed)
+		{
+			return;
+		}
+
+		// 进度没有改变时不产生进度事件.
+		if (ev.bytes_download != sub->last_bytes)
+		{
+			sub->last_bytes = ev.bytes_download;
+			if (sub->settings.mask & download_event::progress)
+			{
+				sub->batch.push_back(ev);
+			}
+		}
+
+		flush_events(*sub);
+
+		sub->timer_running = false;
+		if (!m_abort)
+		{
+			start_event_timer(sub);
+		}
+	}
+
+	// 取消订阅, 调用时必须已经锁定m_events_mutex.
+	void close_subscription(event_subscription &sub)
+	{
+		sub.closed = true;
+		sub.batch.clear();
+		boost::system::error_code ignore;
+		sub.timer->cancel(ignore);
+	}
+
+private:
+
+	// 1秒后在定时器的strand中执行on_tick.
+	void start_tick()
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_timer_mutex);
+#endif
+		m_timer.expires_from_now(boost::posix_time::seconds(1));
+		m_timer.async_wait(m_tick_strand.wrap(
+			boost::bind(&multi_download::on_tick, this, boost::asio::placeholders::error)));
+	}
+
+	// 取消定时器, deadline_timer不能在多个线程中同时操作, 所以和start_tick使用同一个锁.
+	void cancel_tick()
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_timer_mutex);
+#endif
+		boost::system::error_code ignore;
+		m_timer.cancel(ignore);
+	}
+
+	// 在连接的strand中关闭连接, 正在进行的操作将以operation_aborted完成.
+	// 投递的handler只持有连接对象, 不计入m_outstanding, 这样io_service已经没有其它
+	// 任务而退出时, 不会因为它没有执行而使wait_for_complete一直等待.
+	void close_stream(http_object_ptr object_ptr)
+	{
+		object_ptr->strand->dispatch(boost::bind(&multi_download::handle_close_stream, object_ptr));
+	}
+
+	static void handle_close_stream(http_object_ptr object_ptr)
+	{
+		boost::system::error_code ignore;
+		object_ptr->stream->close(ignore);
+		if (object_ptr->retry_timer)
+			object_ptr->retry_timer->cancel(ignore);
+	}
+
+	// 计算本次可请求的字节数, 限速时从本秒剩余的额度中扣除.
+	int take_read_bytes()
+	{
+		int drop_size = m_drop_size;
+		int available_bytes = default_buffer_size;
+		do
+		{
+			if (drop_size == -1)
+			{
+				return default_buffer_size;
+			}
+			available_bytes = (std::max)((std::min)(drop_size, int(default_buffer_size)), 0);
+		} while (!m_drop_size.compare_exchange(drop_size, drop_size - available_bytes));
+
+		if (available_bytes == 0)
+		{
+			// 避免空请求占用大量CPU, 让出CPU资源.
+			boost::this_thread::sleep(boost::posix_time::millisec(1));
+		}
+
+		return available_bytes;
+	}
+
+	inline void change_outstranding(bool addref = true)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_outstanding_mutex);
+#endif
+		if (addref)
+		{
+			m_outstanding++;
+			AVHTTP_METRIC_GAUGE(metric_pending_operations, 1);
+		}
+		else
+		{
+			m_outstanding--;
+			AVHTTP_METRIC_GAUGE(metric_pending_operations, -1);
+		}
+	}
+
+	// 默认根据文件大小自动计算分片大小.
+	std::size_t default_piece_size(const boost::int64_t &file_size) const
+	{
+		const int target_size = 40 * 1024;
+		std::size_t piece_size = boost::int64_t(file_size / (target_size / 20));
+
+		int i = 16 * 1024;
+		for (; i < 16 * 1024 * 1024; i *= 2)
+		{
+			if (piece_size > i) continue;
+			break;
+		}
+		piece_size = i;
+
+		return piece_size;
+	}
+
+private:
+	// io_service引用.
+	boost::asio::io_service &m_io_service;
+
+	// io_service池, 不使用时为NULL.
+	io_service_pool *m_pool;
+
+	// 数据连接共享的http/2连接池, 在所有连接之后析构.
+	boost::scoped_ptr<http2_pool> m_http2;
+
+	// 重新连接使用的重试策略.
+	retry_policy_ptr m_retry_policy;
+
+	// 每一个http_stream_obj是一个http连接.
+	// 注意: 容器中的http_object_ptr只能在on_tick一处进行写操作, 并且确保其它地方
+	// 是新的副本, 这主要体现在发起新的异步操作的时候将http_object_ptr作为参数形式
+	// 传入, 这样在异步回调中只需要访问http_object_ptr的副本指针, 而不是直接访问
+	// m_streams!!!
+	std::vector<http_object_ptr> m_streams;
+
+#ifndef AVHTTP_DISABLE_THREAD
+	// 为m_streams在多线程环境下线程安全.
+	mutable boost::mutex m_streams_mutex;
+#endif
+
+	// 最终的url, 如果有跳转的话, 是跳转最后的那个url.
+	url m_final_url;
+
+	// 是否支持多点下载.
+	bool m_accept_multi;
+
+	// 是否支持长连接.
+	bool m_keep_alive;
+
+	// 文件大小, 如果没有文件大小值为-1.
+	detail::atomic<boost::int64_t> m_file_size;
+
+	// 保存的文件名.
+	mutable std::string m_file_name;
+
+	// 当前用户设置.
+	settings m_settings;
+
+	// 定时器, 用于定时执行一些任务, 比如检查连接是否超时之类.
+	boost::asio::deadline_timer m_timer;
+
+	// 定时器的strand, on_tick和流式下载调度在其中串行执行.
+	boost::asio::io_service::strand m_tick_strand;
+
+	// 保证定时器操作的唯一性.
+#ifndef AVHTTP_DISABLE_THREAD
+	boost::mutex m_timer_mutex;
+#endif
+
+	// 动态计算速率.
+	byte_rate m_byte_rate;
+
+	// 实际连接数.
+	detail::atomic<int> m_number_of_connections;
+
+	// 下载计时.
+	int m_time_total;
+
+	// 下载数据存储接口指针, 可由用户定义, 并在open时指定.
+	boost::scoped_ptr<storage_interface> m_storage;
+
+	// meta文件, 用于续传.
+	file m_file_meta;
+
+	// 下载点位置.
+	detail::atomic<boost::int64_t> m_download_point;
+
+	// 文件区间图, 每次请求将由m_rangefield来分配空间区间.
+	rangefield m_rangefield;
+
+	// 已经下载的文件区间.
+	rangefield m_downlaoded_field;
+
+	// 保证分配空闲区间的唯一性.
+#ifndef AVHTTP_DISABLE_THREAD
+	boost::mutex m_rangefield_mutex;
+#endif
+
+	// 保证存储读写的唯一性, hash线程池会同时读取存储.
+#ifndef AVHTTP_DISABLE_THREAD
+	boost::mutex m_storage_mutex;
+#endif
+
+	// 分片hash计算.
+	detail::piece_hasher m_hasher;
+
+	// 用于计算分片hash的线程池, 未启用校验时为空.
+	boost::scoped_ptr<detail::hash_pool> m_hash_pool;
+
+	// 期望的分片hash值, 为空表示只计算不校验.
+	std::vector<std::string> m_expected_hashes;
+
+	// 计算得到的分片hash值.
+	std::vector<std::string> m_piece_hashes;
+
+	// 已经通过校验的分片.
+	bitfield m_verified;
+
+	// 正在计算hash的分片.
+	bitfield m_hashing;
+
+	// 每个分片校验失败的次数.
+	std::vector<int> m_hash_failures;
+
+	// meta文件中记录的hash算法, 分片大小和已完成分片的hash.
+	verify_settings::hash_type m_meta_hash;
+	int m_meta_piece_size;
+	std::vector<std::string> m_meta_hashes;
+
+	// 有校验失败的分片需要重新下载.
+	bool m_refetch;
+
+#ifndef AVHTTP_DISABLE_THREAD
+	mutable boost::mutex m_verify_mutex;
+#endif
+
+	// 等待数据下载完成的async_fetch_data请求.
+	std::list<fetch_waiter> m_fetch_waiters;
+#ifndef AVHTTP_DISABLE_THREAD
+	boost::mutex m_fetch_waiters_mutex;
+#endif
+
+	// 下载事件订阅.
+	std::vector<event_subscription_ptr> m_subscriptions;
+	int m_subscription_id;
+
+	// 等待下载结束的async_wait, 和最近一次下载是否结束及结束时的状态, 由m_events_mutex保护.
+	std::vector<boost::function<void (const boost::system::error_code&)> > m_wait_handlers;
+	bool m_finished;
+	boost::system::error_code m_finish_error;
+#ifndef AVHTTP_DISABLE_THREAD
+	boost::mutex m_events_mutex;
+#endif
+
+	// 用于限速, 本秒内还可以读取的字节数, -1为不限速.
+	detail::atomic<int> m_drop_size;
+
+	// 用于异步工作计数.
+	int m_outstanding;
+
+#ifndef AVHTTP_DISABLE_THREAD
+	mutable boost::mutex m_outstanding_mutex;
+#endif
+
+	// 用于通知wait_for_complete退出.
+	mutable boost::mutex m_quit_mtx;
+	mutable boost::condition m_quit_cond;
+
+	// 是否中止工作.
+	detail::atomic<bool> m_abort;
+};
+
+} // avhttp
+
+#endif // MULTI_DOWNLOAD_HPP__
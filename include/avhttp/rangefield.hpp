@@ -24,6 +24,7 @@
 #include <boost/thread/mutex.hpp>
 
 #include "avhttp/bitfield.hpp"
+#include "avhttp/detail/atomic.hpp"
 
 
 
@@ -151,6 +152,47 @@ public:
 		return true;
 	}
 
+	///从range中删除区间, 区间为[left, right)
+	// @param left左边边界.
+	// @param right右边边界, 不包含边界处.
+	// @备注: 与已有区间重叠的部分将被删除, 部分重叠的区间会被切分, 成功返回true.
+	inline bool remove(const boost::int64_t &left, const boost::int64_t &right)
+	{
+		BOOST_ASSERT((left >= 0 && left < right) && right <= m_size);
+
+		// 先整理.
+		if (m_need_merge)
+			merge();
+
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(*m_mutex);
+#endif
+
+		if ((left < 0 || right > m_size) || (right <= left))
+			return false;
+
+		range_map result;
+		for (range_map::iterator i = m_ranges.begin();
+			i != m_ranges.end(); i++)
+		{
+			// 没有重叠, 原样保留.
+			if (i->second <= left || i->first >= right)
+			{
+				result.insert(*i);
+				continue;
+			}
+
+			// 保留左右两边没有重叠的部分.
+			if (i->first < left)
+				result.insert(std::make_pair(i->first, left));
+			if (i->second > right)
+				result.insert(std::make_pair(right, i->second));
+		}
+		m_ranges.swap(result);
+
+		return true;
+	}
+
 	///检查是否在区间里.
 	// @param r区间, 不包含右边界处.
 	// @返回这个range这个区间是否完整的被包含在range中.
@@ -580,7 +622,8 @@ protected:
 	}
 
 private:
-	bool m_need_merge;
+	// 在加锁之前检查, 所以使用原子变量.
+	detail::atomic<bool> m_need_merge;
 	boost::int64_t m_size;
 	range_map m_ranges;
 #ifndef AVHTTP_DISABLE_THREAD
@@ -0,0 +1,152 @@
+//
+// redirect_cache.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __REDIRECT_CACHE_HPP__
+#define __REDIRECT_CACHE_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <map>
+#include <list>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+// 默认最多缓存的永久重定向个数.
+#ifndef AVHTTP_REDIRECT_CACHE_SIZE
+# define AVHTTP_REDIRECT_CACHE_SIZE 64
+#endif
+
+namespace avhttp {
+
+///永久重定向(301/308)的缓存.
+// 使用说明:
+//	http_stream在GET或HEAD请求收到301或308时, 将原地址和跳转地址记录到缓存中, 以后打开
+//	同一地址时直接请求跳转后的地址, 省去一次往返. 缓存按最近使用的顺序淘汰, 可以在多个
+//	线程的http_stream之间共享. 默认所有http_stream共享default_redirect_cache().
+// @begin example
+//  avhttp::redirect_cache cache(16);
+//  avhttp::http_stream h(io);
+//  h.permanent_redirect_cache(&cache);
+//  h.open("http://example.com/old");	// 301到http://example.com/new.
+//  h.close();
+//  h.open("http://example.com/old");	// 直接请求http://example.com/new.
+// @end example
+class redirect_cache : public boost::noncopyable
+{
+	typedef std::pair<std::string, std::string> entry_type;
+	typedef std::list<entry_type> entry_list;
+	typedef std::map<std::string, entry_list::iterator> entry_map;
+
+public:
+
+	///构造缓存.
+	// @param capacity 最多缓存的重定向个数, 超出时淘汰最久未使用的.
+	explicit redirect_cache(std::size_t capacity = AVHTTP_REDIRECT_CACHE_SIZE)
+		: m_capacity(capacity)
+	{}
+
+	///记录from永久重定向到to.
+	void insert(const std::string &from, const std::string &to)
+	{
+		if (m_capacity == 0 || from == to)
+			return;
+
+		boost::mutex::scoped_lock lock(m_mutex);
+		entry_map::iterator i = m_map.find(from);
+		if (i != m_map.end())
+		{
+			i->second->second = to;
+			m_entries.splice(m_entries.begin(), m_entries, i->second);
+			return;
+		}
+
+		m_entries.push_front(entry_type(from, to));
+		m_map[from] = m_entries.begin();
+		if (m_entries.size() > m_capacity)
+		{
+			m_map.erase(m_entries.back().first);
+			m_entries.pop_back();
+		}
+	}
+
+	///查找from的重定向地址.
+	// @param from 原地址.
+	// @param to 找到时保存跳转地址.
+	// @返回值为true表示找到.
+	bool find(const std::string &from, std::string &to)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		entry_map::iterator i = m_map.find(from);
+		if (i == m_map.end())
+			return false;
+		to = i->second->second;
+		m_entries.splice(m_entries.begin(), m_entries, i->second);
+		return true;
+	}
+
+	///删除from的重定向记录.
+	void remove(const std::string &from)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		entry_map::iterator i = m_map.find(from);
+		if (i == m_map.end())
+			return;
+		m_entries.erase(i->second);
+		m_map.erase(i);
+	}
+
+	///清空缓存.
+	void clear()
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_entries.clear();
+		m_map.clear();
+	}
+
+	///返回当前缓存的重定向个数.
+	std::size_t size() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_entries.size();
+	}
+
+private:
+	mutable boost::mutex m_mutex;
+	std::size_t m_capacity;
+	entry_list m_entries;	// 按最近使用的顺序排列, 最近使用的在前面.
+	entry_map m_map;
+};
+
+namespace aux {
+
+template <class T = void>
+struct redirect_cache_instance
+{
+	static redirect_cache cache;
+};
+
+template <class T>
+redirect_cache redirect_cache_instance<T>::cache;
+
+} // namespace aux
+
+///返回进程内所有http_stream默认共享的永久重定向缓存.
+inline redirect_cache& default_redirect_cache()
+{
+	return aux::redirect_cache_instance<>::cache;
+}
+
+} // namespace avhttp
+
+#endif // __REDIRECT_CACHE_HPP__
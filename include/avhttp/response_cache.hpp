@@ -0,0 +1,593 @@
+//
+// response_cache.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __RESPONSE_CACHE_HPP__
+#define __RESPONSE_CACHE_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <map>
+#include <list>
+#include <vector>
+#include <string>
+
+#include <boost/format.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "avhttp/settings.hpp"
+#include "avhttp/body_source.hpp"
+#include "avhttp/detail/parsers.hpp"
+
+// 响应缓存默认的容量(字节).
+#ifndef AVHTTP_RESPONSE_CACHE_SIZE
+# define AVHTTP_RESPONSE_CACHE_SIZE (64 * 1024 * 1024)
+#endif
+
+namespace avhttp {
+
+namespace detail {
+
+// 磁盘上缓存的body文件, 最后一个引用释放时删除.
+class cache_file : public boost::noncopyable
+{
+public:
+	explicit cache_file(const fs::path &path)
+		: m_path(path)
+	{}
+
+	~cache_file()
+	{
+		boost::system::error_code ec;
+		fs::remove(m_path, ec);
+	}
+
+	const fs::path& path() const
+	{
+		return m_path;
+	}
+
+private:
+	fs::path m_path;
+};
+
+// 所有名为name的头的值, 多个同名的头以逗号连接.
+inline std::string header_values(const option::option_item_list &headers, const std::string &name)
+{
+	std::string values;
+	for (option::option_item_list::const_iterator i = headers.begin(); i != headers.end(); i++)
+	{
+		if (!headers_equal(i->first, name))
+			continue;
+		if (!values.empty())
+			values += ",";
+		values += i->second;
+	}
+	return values;
+}
+
+// 删除所有名为name的头.
+inline void remove_headers(option::option_item_list &headers, const std::string &name)
+{
+	for (option::option_item_list::iterator i = headers.begin(); i != headers.end();)
+	{
+		if (headers_equal(i->first, name))
+			i = headers.erase(i);
+		else
+			++i;
+	}
+}
+
+// 查找Cache-Control中的指令, 找到时value保存指令的值(没有值时为空).
+inline bool find_cache_directive(const option::option_item_list &headers,
+	const std::string &directive, std::string *value = NULL)
+{
+	std::vector<std::string> directives;
+	std::string all = header_values(headers, "Cache-Control");
+	boost::split(directives, all, boost::is_any_of(","));
+	for (std::vector<std::string>::iterator i = directives.begin(); i != directives.end(); i++)
+	{
+		std::string::size_type pos = i->find('=');
+		if (!boost::algorithm::iequals(boost::algorithm::trim_copy(i->substr(0, pos)), directive))
+			continue;
+		if (value)
+		{
+			*value = (pos == std::string::npos) ? "" : boost::algorithm::trim_copy(i->substr(pos + 1));
+			boost::algorithm::trim_if(*value, boost::is_any_of("\""));
+		}
+		return true;
+	}
+	return false;
+}
+
+} // namespace detail
+
+class response_cache;
+
+///缓存的响应.
+// 保存了响应头和解码后的body, 创建后不再修改, 可以在多个线程中同时读取.
+class cached_response
+{
+	friend class response_cache;
+
+public:
+	cached_response()
+		: m_initial_age(boost::posix_time::seconds(0))
+		, m_lifetime(boost::posix_time::seconds(0))
+		, m_no_cache(false)
+		, m_size(0)
+	{}
+
+	///根据响应创建缓存项.
+	// @param request 发出请求时的请求选项, 用于记录Vary中的请求头.
+	// @param response 响应头.
+	// @param request_time 发出请求的时间(UTC).
+	// @param response_time 收到响应的时间(UTC).
+	// @返回值为空表示响应不能缓存.
+	static boost::shared_ptr<cached_response> create(const request_opts &request,
+		const response_opts &response, const boost::posix_time::ptime &request_time,
+		const boost::posix_time::ptime &response_time)
+	{
+		boost::shared_ptr<cached_response> entry;
+		const option::option_item_list &headers = response.option_all();
+
+		// 请求或者响应禁止保存.
+		if (detail::find_cache_directive(request.option_all(), "no-store") ||
+			detail::find_cache_directive(headers, "no-store"))
+			return entry;
+
+		// 记录Vary中的请求头, 以后只用于匹配相同的请求, Vary为*时不能匹配任何请求.
+		std::vector<std::string> names;
+		std::vector<std::pair<std::string, std::string> > vary;
+		std::string vary_header = detail::header_values(headers, "Vary");
+		boost::split(names, vary_header, boost::is_any_of(","));
+		for (std::vector<std::string>::iterator i = names.begin(); i != names.end(); i++)
+		{
+			std::string name = boost::algorithm::trim_copy(*i);
+			if (name.empty())
+				continue;
+			if (name == "*")
+				return entry;
+			vary.push_back(std::make_pair(name, request.find(name)));
+		}
+
+		entry.reset(new cached_response);
+		entry->m_vary.swap(vary);
+		entry->m_headers = response;
+		option::option_item_list &saved = entry->m_headers.option_all();
+		// body以解码后的数据保存, Content-Length在保存body时设置, Age记录在m_initial_age中.
+		detail::remove_headers(saved, http_options::content_encoding);
+		detail::remove_headers(saved, http_options::transfer_encoding);
+		detail::remove_headers(saved, http_options::content_length);
+		detail::remove_headers(saved, http_options::connection);
+		detail::remove_headers(saved, "Keep-Alive");
+		detail::remove_headers(saved, "Age");
+		entry->update_freshness(response, request_time, response_time);
+
+		// 既没有新鲜期也不能验证的响应保存了也无法使用.
+		if (entry->m_lifetime <= boost::posix_time::seconds(0) && !entry->has_validator())
+			entry.reset();
+		return entry;
+	}
+
+	///使用304响应更新缓存项.
+	// @param response 304响应的响应头.
+	// @返回更新后的缓存项, 它与原来的缓存项共享body.
+	boost::shared_ptr<cached_response> refresh(const response_opts &response,
+		const boost::posix_time::ptime &request_time, const boost::posix_time::ptime &response_time) const
+	{
+		boost::shared_ptr<cached_response> entry(new cached_response(*this));
+		option::option_item_list &saved = entry->m_headers.option_all();
+		const option::option_item_list &headers = response.option_all();
+
+		// 用304中的头替换保存的同名头, 描述body的头保持不变.
+		for (option::option_item_list::const_iterator i = headers.begin(); i != headers.end(); i++)
+		{
+			if (i->first == http_options::status_code ||
+				detail::headers_equal(i->first, http_options::content_length) ||
+				detail::headers_equal(i->first, http_options::content_encoding) ||
+				detail::headers_equal(i->first, http_options::transfer_encoding) ||
+				detail::headers_equal(i->first, http_options::connection))
+				continue;
+			detail::remove_headers(saved, i->first);
+		}
+		for (option::option_item_list::const_iterator i = headers.begin(); i != headers.end(); i++)
+		{
+			if (i->first == http_options::status_code ||
+				detail::headers_equal(i->first, http_options::content_length) ||
+				detail::headers_equal(i->first, http_options::content_encoding) ||
+				detail::headers_equal(i->first, http_options::transfer_encoding) ||
+				detail::headers_equal(i->first, http_options::connection))
+				continue;
+			saved.push_back(*i);
+		}
+
+		entry->update_freshness(response, request_time, response_time);
+		detail::remove_headers(saved, "Age");
+		return entry;
+	}
+
+	///是否新鲜, 新鲜的响应可以不经验证直接使用.
+	bool fresh(const boost::posix_time::ptime &now =
+		boost::posix_time::microsec_clock::universal_time()) const
+	{
+		if (m_no_cache)
+			return false;
+		return m_lifetime > m_initial_age + (now - m_response_time);
+	}
+
+	///是否有ETag或者Last-Modified, 可以发出条件请求验证.
+	bool has_validator() const
+	{
+		return !m_etag.empty() || !m_last_modified.empty();
+	}
+
+	///返回ETag.
+	const std::string& etag() const
+	{
+		return m_etag;
+	}
+
+	///返回Last-Modified.
+	const std::string& last_modified() const
+	{
+		return m_last_modified;
+	}
+
+	///请求是否与缓存的响应匹配, 即Vary中的各个请求头都相同.
+	bool match(const request_opts &request) const
+	{
+		for (std::size_t i = 0; i < m_vary.size(); i++)
+		{
+			if (request.find(m_vary[i].first) != m_vary[i].second)
+				return false;
+		}
+		return true;
+	}
+
+	///返回保存的响应头.
+	const response_opts& headers() const
+	{
+		return m_headers;
+	}
+
+	///返回body的大小.
+	boost::int64_t size() const
+	{
+		return m_size;
+	}
+
+	///打开body用于读取.
+	// @param ec在出错时保存了详细的错误信息.
+	// @返回读取body的body_source, 内存中的body不发生复制, 磁盘上的body按偏移读取文件;
+	//  同一个缓存项可以同时打开多次.
+	body_source body(boost::system::error_code &ec) const
+	{
+		ec = boost::system::error_code();
+		if (m_file)
+			return body_source::from_file(m_file->path(), 0, m_size, ec);
+		if (m_data)
+			return body_source::from_string(m_data);
+		return body_source::from_memory("", 0);
+	}
+
+private:
+	// 计算响应的年龄和新鲜期, 参见RFC 7234 4.2.
+	void update_freshness(const response_opts &response,
+		const boost::posix_time::ptime &request_time, const boost::posix_time::ptime &response_time)
+	{
+		using namespace boost::posix_time;
+		const option::option_item_list &headers = response.option_all();
+
+		std::string value = response.find("ETag");
+		if (!value.empty())
+			m_etag = value;
+		value = response.find("Last-Modified");
+		if (!value.empty())
+			m_last_modified = value;
+
+		ptime date;
+		if (!detail::parse_http_date(response.find("Date"), date))
+			date = response_time;
+		ptime sent = request_time.is_special() ? response_time : request_time;
+
+		// 初始年龄取Date推算的年龄和Age加上往返时间中较大的一个.
+		time_duration apparent_age = response_time > date ? response_time - date : seconds(0);
+		time_duration corrected_age = seconds(std::atol(response.find("Age").c_str())) +
+			(response_time - sent);
+		m_initial_age = (std::max)(apparent_age, corrected_age);
+		m_response_time = response_time;
+
+		// 新鲜期依次取max-age, Expires, 都没有时按距离Last-Modified时间的10%估计.
+		ptime expires;
+		ptime last_modified;
+		if (detail::find_cache_directive(headers, "max-age", &value))
+			m_lifetime = seconds(std::atol(value.c_str()));
+		else if (!response.find("Expires").empty())
+			m_lifetime = (detail::parse_http_date(response.find("Expires"), expires) && expires > date)
+				? expires - date : seconds(0);
+		else if (detail::parse_http_date(m_last_modified, last_modified) && date > last_modified)
+			m_lifetime = (date - last_modified) / 10;
+		else
+			m_lifetime = seconds(0);
+
+		m_no_cache = detail::find_cache_directive(headers, "no-cache");
+	}
+
+private:
+	response_opts m_headers;
+	std::vector<std::pair<std::string, std::string> > m_vary;	// Vary中的请求头和它们的值.
+	std::string m_etag;
+	std::string m_last_modified;
+	boost::posix_time::ptime m_response_time;					// 收到响应的时间.
+	boost::posix_time::time_duration m_initial_age;				// 收到响应时的年龄.
+	boost::posix_time::time_duration m_lifetime;				// 新鲜期.
+	bool m_no_cache;											// 每次使用前都需要验证.
+	boost::shared_ptr<std::string> m_data;						// 内存中的body.
+	boost::shared_ptr<detail::cache_file> m_file;				// 磁盘上的body.
+	boost::int64_t m_size;										// body的大小.
+};
+
+typedef boost::shared_ptr<cached_response> cached_response_ptr;
+
+///http响应缓存.
+// 使用说明:
+//	http_stream设置了缓存后, 对GET请求先查找缓存: 新鲜的响应直接从缓存读取, 不发出请求;
+//	过期但有ETag或Last-Modified的响应以If-None-Match/If-Modified-Since发出条件请求, 服务
+//	器返回304时从缓存读取. 可以缓存的200响应在body读取完成后保存.
+//	缓存以url和Vary中的请求头区分响应, 遵守Cache-Control(no-store, no-cache, max-age)和
+//	Expires, 按最近使用的顺序在容量内淘汰. 指定目录时body保存在目录下的文件中(只在本进程
+//	内有效), 否则保存在内存中. 缓存可以在多个线程的http_stream之间共享.
+// @begin example
+//  avhttp::response_cache cache(16 * 1024 * 1024);
+//  avhttp::http_stream h(io);
+//  h.cache(&cache);
+//  h.open("http://example.com/");
+//  std::cout << &h;	// 读取完整的body后保存到缓存中.
+//  h.close();
+//  h.open("http://example.com/");	// 新鲜时直接从缓存读取.
+// @end example
+class response_cache : public boost::noncopyable
+{
+	struct node
+	{
+		node(const std::string &u, const cached_response_ptr &e)
+			: url(u)
+			, entry(e)
+		{}
+
+		std::string url;
+		cached_response_ptr entry;
+	};
+	typedef std::list<node> node_list;
+	typedef std::multimap<std::string, node_list::iterator> node_map;
+
+public:
+
+	///构造内存缓存.
+	// @param max_bytes 缓存的容量, 包括body和响应头, 超出时淘汰最久未使用的响应.
+	explicit response_cache(std::size_t max_bytes = AVHTTP_RESPONSE_CACHE_SIZE)
+		: m_max_bytes(max_bytes)
+		, m_bytes(0)
+		, m_file_id(0)
+	{}
+
+	///构造磁盘缓存.
+	// @param max_bytes 缓存的容量.
+	// @param directory 保存body的目录, 必须已经存在.
+	response_cache(std::size_t max_bytes, const fs::path &directory)
+		: m_max_bytes(max_bytes)
+		, m_bytes(0)
+		, m_directory(directory)
+		, m_file_id(0)
+	{}
+
+	///查找与请求匹配的响应.
+	// @param url 请求的url.
+	// @param request 请求选项, 用于匹配Vary.
+	// @返回值为空表示没有缓存.
+	cached_response_ptr find(const std::string &url, const request_opts &request)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		std::pair<node_map::iterator, node_map::iterator> range = m_map.equal_range(url);
+		for (node_map::iterator i = range.first; i != range.second; i++)
+		{
+			if (i->second->entry->match(request))
+			{
+				m_nodes.splice(m_nodes.begin(), m_nodes, i->second);
+				return i->second->entry;
+			}
+		}
+		return cached_response_ptr();
+	}
+
+	///保存响应.
+	// @param url 请求的url.
+	// @param entry 由cached_response::create创建的缓存项.
+	// @param body 解码后的body, 数据被交换到缓存中.
+	// @返回值为false表示body太大或者写入文件失败, 没有保存.
+	bool insert(const std::string &url, const cached_response_ptr &entry, std::string &body)
+	{
+		if (body.size() > max_entry_size())
+			return false;
+
+		entry->m_size = body.size();
+		entry->m_headers.insert(http_options::content_length,
+			boost::str(boost::format("%d") % body.size()));
+		if (m_directory.empty())
+		{
+			entry->m_data.reset(new std::string);
+			entry->m_data->swap(body);
+		}
+		else
+		{
+			boost::uint64_t id;
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				id = ++m_file_id;
+			}
+			fs::path file_path = m_directory / boost::str(boost::format("%x-%x.body")
+				% reinterpret_cast<std::size_t>(this) % id);
+			fs::ofstream file(file_path, std::ios::binary | std::ios::trunc);
+			file.write(body.data(), body.size());
+			file.close();
+			entry->m_file.reset(new detail::cache_file(file_path));
+			if (!file)
+				return false;
+			body.clear();
+		}
+
+		boost::mutex::scoped_lock lock(m_mutex);
+		// 替换同一请求的旧响应.
+		std::pair<node_map::iterator, node_map::iterator> range = m_map.equal_range(url);
+		for (node_map::iterator i = range.first; i != range.second; i++)
+		{
+			if (i->second->entry->m_vary == entry->m_vary)
+			{
+				erase(i);
+				break;
+			}
+		}
+		m_nodes.push_front(node(url, entry));
+		m_map.insert(std::make_pair(url, m_nodes.begin()));
+		m_bytes += entry_bytes(*entry);
+		evict();
+		return true;
+	}
+
+	///用验证后的缓存项替换原来的缓存项.
+	// @param url 请求的url.
+	// @param old_entry 原来的缓存项.
+	// @param new_entry 由cached_response::refresh得到的缓存项.
+	void update(const std::string &url, const cached_response_ptr &old_entry,
+		const cached_response_ptr &new_entry)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		std::pair<node_map::iterator, node_map::iterator> range = m_map.equal_range(url);
+		for (node_map::iterator i = range.first; i != range.second; i++)
+		{
+			if (i->second->entry == old_entry)
+			{
+				m_bytes -= entry_bytes(*old_entry);
+				m_bytes += entry_bytes(*new_entry);
+				i->second->entry = new_entry;
+				m_nodes.splice(m_nodes.begin(), m_nodes, i->second);
+				evict();
+				return;
+			}
+		}
+
+		// 原来的缓存项已经被淘汰.
+		m_nodes.push_front(node(url, new_entry));
+		m_map.insert(std::make_pair(url, m_nodes.begin()));
+		m_bytes += entry_bytes(*new_entry);
+		evict();
+	}
+
+	///删除url的所有响应.
+	void remove(const std::string &url)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		std::pair<node_map::iterator, node_map::iterator> range = m_map.equal_range(url);
+		while (range.first != range.second)
+			erase(range.first++);
+	}
+
+	///清空缓存.
+	void clear()
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_map.clear();
+		m_nodes.clear();
+		m_bytes = 0;
+	}
+
+	///返回缓存占用的字节数.
+	std::size_t size() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_bytes;
+	}
+
+	///返回缓存的响应个数.
+	std::size_t count() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_nodes.size();
+	}
+
+	///返回缓存的容量.
+	std::size_t max_bytes() const
+	{
+		return m_max_bytes;
+	}
+
+	///返回单个响应body的最大大小, 为容量的1/8, 更大的响应不保存.
+	std::size_t max_entry_size() const
+	{
+		return m_max_bytes / 8;
+	}
+
+private:
+	static std::size_t entry_bytes(const cached_response &entry)
+	{
+		std::size_t bytes = static_cast<std::size_t>(entry.m_size);
+		const option::option_item_list &headers = entry.m_headers.option_all();
+		for (option::option_item_list::const_iterator i = headers.begin(); i != headers.end(); i++)
+			bytes += i->first.size() + i->second.size();
+		return bytes;
+	}
+
+	void erase(node_map::iterator i)
+	{
+		m_bytes -= entry_bytes(*i->second->entry);
+		m_nodes.erase(i->second);
+		m_map.erase(i);
+	}
+
+	// 超出容量时淘汰最久未使用的响应.
+	void evict()
+	{
+		while (m_bytes > m_max_bytes && !m_nodes.empty())
+		{
+			node_list::iterator last = --m_nodes.end();
+			std::pair<node_map::iterator, node_map::iterator> range = m_map.equal_range(last->url);
+			for (node_map::iterator i = range.first; i != range.second; i++)
+			{
+				if (i->second == last)
+				{
+					erase(i);
+					break;
+				}
+			}
+		}
+	}
+
+private:
+	mutable boost::mutex m_mutex;
+	std::size_t m_max_bytes;
+	std::size_t m_bytes;
+	fs::path m_directory;
+	boost::uint64_t m_file_id;
+	node_list m_nodes;		// 按最近使用的顺序排列, 最近使用的在前面.
+	node_map m_map;			// url到各个响应(不同的Vary)的索引.
+};
+
+} // namespace avhttp
+
+#endif // __RESPONSE_CACHE_HPP__
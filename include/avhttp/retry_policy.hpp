@@ -0,0 +1,385 @@
+//
+// retry_policy.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2013 Jack (jack dot wgm at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __RETRY_POLICY_HPP__
+#define __RETRY_POLICY_HPP__
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include <map>
+#include <string>
+#include <cstdlib>		// for std::atoi
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#ifndef AVHTTP_DISABLE_THREAD
+#include <boost/thread/mutex.hpp>
+#endif
+
+#include "avhttp/url.hpp"
+#include "avhttp/logging.hpp"
+#include "avhttp/settings.hpp"
+#include "avhttp/detail/parsers.hpp"
+#include "avhttp/detail/error_codec.hpp"
+
+namespace avhttp {
+
+///重试策略的设置.
+struct retry_settings
+{
+	retry_settings()
+		: max_attempts(3)
+		, base_delay(boost::posix_time::milliseconds(100))
+		, max_delay(boost::posix_time::seconds(30))
+		, jitter(true)
+		, max_retry_after(boost::posix_time::seconds(120))
+		, breaker_threshold(5)
+		, breaker_cooldown(boost::posix_time::seconds(10))
+		, budget_ratio(0.2)
+		, budget_min_per_second(10)
+	{}
+
+	// 最多请求的次数, 包括第一次请求, -1为不限制, 默认为3.
+	int max_attempts;
+
+	// 第一次重试前等待的时间, 之后每次加倍, 默认为100毫秒.
+	boost::posix_time::time_duration base_delay;
+
+	// 等待时间的上限, 默认为30秒.
+	boost::posix_time::time_duration max_delay;
+
+	// 在0到退避时间之间随机选择等待时间(full jitter), 避免大量连接在同一时刻重试, 默认开启.
+	bool jitter;
+
+	// 429/503响应中Retry-After的上限, 超过时按上限等待, 为0时忽略Retry-After, 默认为120秒.
+	boost::posix_time::time_duration max_retry_after;
+
+	// 同一主机连续失败多少次后打开熔断器, 打开后在breaker_cooldown内不再请求这个主机,
+	// 之后只放行一个试探请求, 成功后关闭熔断器, 失败则再次打开. 为0时不使用熔断器, 默认为5.
+	int breaker_threshold;
+
+	// 熔断器打开的时间, 默认为10秒.
+	boost::posix_time::time_duration breaker_cooldown;
+
+	// 全局的重试预算, 每个请求存入budget_ratio次重试的额度, 每次重试消耗1次, 额度用完时
+	// 不再重试, 使重试最多只占请求的一定比例. 小于0时不限制, 默认为0.2.
+	double budget_ratio;
+
+	// 重试预算每秒至少补充的次数, 保证请求很少时也可以重试, 预算最多积累10秒的补充量
+	// 加上请求存入的额度, 默认为10.
+	int budget_min_per_second;
+};
+
+///重试策略接口.
+// 用于http_stream的async_open_retry, batch_fetcher和multi_download的重新连接.
+// 实现必须是线程安全的, multi_download的各个连接可能在不同的线程中调用.
+class retry_policy
+{
+public:
+	virtual ~retry_policy() {}
+
+	///发出请求前调用.
+	// @param host 请求的主机, 由origin_key得到.
+	// @param delay 返回false时, 需要等待的时间.
+	// @返回是否可以发出请求, 熔断器打开时返回false.
+	virtual bool allow_request(const std::string &host, boost::posix_time::time_duration &delay) = 0;
+
+	///请求失败后调用.
+	// @param host 请求的主机, 由origin_key得到.
+	// @param attempts 已经请求的次数, 包括这次失败的请求.
+	// @param ec 失败的错误, 非200/206的状态以对应的errc表示, 为空表示请求停滞或没有完成.
+	// @param response 收到的响应头, 用于读取Retry-After, 没有收到响应时为空.
+	// @param delay 返回true时, 重试前需要等待的时间.
+	// @返回是否重试.
+	virtual bool should_retry(const std::string &host, int attempts, const boost::system::error_code &ec,
+		const response_opts &response, boost::posix_time::time_duration &delay) = 0;
+
+	///请求成功后调用.
+	virtual void on_success(const std::string &host) = 0;
+};
+
+typedef boost::shared_ptr<retry_policy> retry_policy_ptr;
+
+///返回url所在的主机, protocol://host:port, 用于区分重试策略中的主机和复用连接.
+inline std::string origin_key(const url &u)
+{
+	return u.protocol() + "://" + boost::algorithm::to_lower_copy(u.host()) + ":" +
+		boost::lexical_cast<std::string>(u.port());
+}
+
+///错误是否是暂时的, 重试可能成功.
+// 连接和超时的错误, 408/429/500/502/503/504的响应可以重试. 其它非200/206的状态,
+// 不支持的协议, 无效的跳转, 找不到主机和取消的操作不能重试.
+inline bool is_retryable_error(const boost::system::error_code &ec)
+{
+	if (!ec)
+		return true;
+
+	if (ec.category() == avhttp::error_category())
+	{
+		int value = ec.value();
+		if (value >= 300 && value < 600)
+		{
+			return value == errc::request_timeout || value == 429 ||
+				value == errc::internal_server_error || value == errc::bad_gateway ||
+				value == errc::service_unavailable || value == errc::gateway_timeout;
+		}
+		return value != errc::invalid_redirect;
+	}
+
+	return ec != boost::asio::error::operation_aborted &&
+		ec != boost::asio::error::operation_not_supported &&
+		ec != boost::asio::error::invalid_argument &&
+		ec != boost::asio::error::host_not_found;
+}
+
+///解析Retry-After, 可以是秒数或者http日期.
+// @返回是否得到了等待时间.
+inline bool parse_retry_after(const response_opts &response, boost::posix_time::time_duration &delay)
+{
+	std::string value;
+	if (!response.find("Retry-After", value))
+		return false;
+	boost::algorithm::trim(value);
+	if (value.empty())
+		return false;
+
+	if (value.find_first_not_of("0123456789") == std::string::npos)
+	{
+		delay = boost::posix_time::seconds(std::atoi(value.c_str()));
+		return true;
+	}
+
+	boost::posix_time::ptime time;
+	if (!detail::parse_http_date(value, time))
+		return false;
+	boost::posix_time::ptime now = boost::posix_time::second_clock::universal_time();
+	delay = time > now ? time - now : boost::posix_time::seconds(0);
+	return true;
+}
+
+///默认的重试策略.
+// 指数退避加随机抖动, 429/503时遵守Retry-After, 每个主机一个熔断器, 全局的重试预算.
+// @begin example
+//  avhttp::retry_settings s;
+//  s.max_attempts = 5;
+//  s.base_delay = boost::posix_time::milliseconds(200);
+//  avhttp::retry_policy_ptr policy(new avhttp::default_retry_policy(s));
+//  avhttp::http_stream h(io);
+//  avhttp::async_open_retry(h, "http://example.com/", policy, handler);
+// @end example
+class default_retry_policy
+	: public retry_policy
+	, public boost::noncopyable
+{
+	// 每个主机的熔断器状态.
+	struct breaker
+	{
+		breaker()
+			: failures(0)
+			, probing(false)
+		{}
+
+		int failures;							// 连续失败的次数.
+		boost::posix_time::ptime open_until;	// 熔断器打开的截止时间, 没有打开时为not_a_date_time.
+		bool probing;							// 半开状态下已经放行了试探请求.
+	};
+
+public:
+	explicit default_retry_policy(const retry_settings &s = retry_settings())
+		: m_settings(s)
+		, m_generator(static_cast<boost::uint32_t>(
+			boost::posix_time::microsec_clock::universal_time().time_of_day().total_microseconds()))
+		, m_tokens(0)
+	{
+		m_tokens = budget_capacity();
+		m_refill_time = now();
+	}
+
+	virtual ~default_retry_policy()
+	{}
+
+	///返回设置.
+	const retry_settings& settings() const
+	{
+		return m_settings;
+	}
+
+	virtual bool allow_request(const std::string &host, boost::posix_time::time_duration &delay)
+	{
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_mutex);
+#endif
+		// 每个请求存入重试额度.
+		if (m_settings.budget_ratio >= 0)
+		{
+			refill();
+			m_tokens = (std::min)(m_tokens + m_settings.budget_ratio, budget_capacity());
+		}
+
+		if (m_settings.breaker_threshold <= 0)
+			return true;
+		std::map<std::string, breaker>::iterator i = m_breakers.find(host);
+		if (i == m_breakers.end() || i->second.open_until.is_not_a_date_time())
+			return true;
+
+		// 熔断器打开, 等待到截止时间.
+		breaker &b = i->second;
+		boost::posix_time::ptime t = now();
+		if (t < b.open_until)
+		{
+			delay = b.open_until - t;
+			return false;
+		}
+
+		// 半开状态, 只放行一个试探请求, 其它请求等待试探的结果.
+		if (b.probing)
+		{
+			delay = m_settings.breaker_cooldown;
+			return false;
+		}
+		b.probing = true;
+		return true;
+	}
+
+	virtual bool should_retry(const std::string &host, int attempts, const boost::system::error_code &ec,
+		const response_opts &response, boost::posix_time::time_duration &delay)
+	{
+		// 不能重试的错误, 不是主机的故障, 不计入熔断器.
+		if (!is_retryable_error(ec))
+			return false;
+
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_mutex);
+#endif
+		boost::posix_time::ptime t = now();
+
+		// 记录失败, 连续失败达到阈值或者试探请求失败时打开熔断器.
+		boost::posix_time::ptime open_until;
+		if (m_settings.breaker_threshold > 0)
+		{
+			breaker &b = m_breakers[host];
+			b.failures++;
+			if (b.probing || (b.open_until.is_not_a_date_time() && b.failures >= m_settings.breaker_threshold))
+			{
+				LOG_WARNING_CAT(log_connect, "Circuit breaker open for \'" << host << "\' after "
+					<< b.failures << " failures");
+				b.open_until = t + m_settings.breaker_cooldown;
+				b.probing = false;
+			}
+			open_until = b.open_until;
+		}
+
+		if (m_settings.max_attempts >= 0 && attempts >= m_settings.max_attempts)
+			return false;
+
+		// 消耗重试预算.
+		if (m_settings.budget_ratio >= 0)
+		{
+			refill();
+			if (m_tokens < 1.0)
+			{
+				LOG_WARNING_CAT(log_connect, "Retry budget exhausted, not retrying \'" << host << "\'");
+				return false;
+			}
+			m_tokens -= 1.0;
+		}
+
+		delay = backoff(attempts);
+
+		// 429/503时服务器指定了重试的时间.
+		if (m_settings.max_retry_after > boost::posix_time::seconds(0) &&
+			(ec == errc::service_unavailable || ec.value() == 429 && ec.category() == avhttp::error_category()))
+		{
+			boost::posix_time::time_duration retry_after;
+			if (parse_retry_after(response, retry_after))
+				delay = (std::max)(delay, (std::min)(retry_after, m_settings.max_retry_after));
+		}
+
+		// 熔断器打开时等待到半开.
+		if (!open_until.is_not_a_date_time() && open_until > t)
+			delay = (std::max)(delay, open_until - t);
+
+		return true;
+	}
+
+	virtual void on_success(const std::string &host)
+	{
+		if (m_settings.breaker_threshold <= 0)
+			return;
+#ifndef AVHTTP_DISABLE_THREAD
+		boost::mutex::scoped_lock lock(m_mutex);
+#endif
+		m_breakers.erase(host);
+	}
+
+private:
+
+	static boost::posix_time::ptime now()
+	{
+		return boost::posix_time::microsec_clock::universal_time();
+	}
+
+	// 第attempts次失败后的退避时间.
+	boost::posix_time::time_duration backoff(int attempts)
+	{
+		boost::posix_time::time_duration delay = m_settings.base_delay;
+		for (int i = 1; i < attempts && delay < m_settings.max_delay; i++)
+			delay = delay * 2;
+		if (delay > m_settings.max_delay)
+			delay = m_settings.max_delay;
+
+		if (m_settings.jitter && delay.total_microseconds() > 0)
+		{
+			boost::random::uniform_int_distribution<boost::int64_t> dist(0, delay.total_microseconds());
+			delay = boost::posix_time::microseconds(dist(m_generator));
+		}
+		return delay;
+	}
+
+	// 预算的上限.
+	double budget_capacity() const
+	{
+		return (std::max)(m_settings.budget_min_per_second, 1) * 10.0;
+	}
+
+	// 按时间补充重试预算.
+	void refill()
+	{
+		boost::posix_time::ptime t = now();
+		double seconds = (t - m_refill_time).total_microseconds() / 1000000.0;
+		m_refill_time = t;
+		if (seconds > 0)
+			m_tokens = (std::min)(m_tokens + seconds * m_settings.budget_min_per_second, budget_capacity());
+	}
+
+private:
+	retry_settings m_settings;
+#ifndef AVHTTP_DISABLE_THREAD
+	boost::mutex m_mutex;
+#endif
+	boost::random::mt19937 m_generator;
+	std::map<std::string, breaker> m_breakers;
+	double m_tokens;						// 剩余的重试次数.
+	boost::posix_time::ptime m_refill_time;
+};
+
+} // namespace avhttp
+
+#endif // __RETRY_POLICY_HPP__
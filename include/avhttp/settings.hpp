@@ -17,12 +17,14 @@
 
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <string>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/date_time.hpp>
 
 #include "avhttp/storage_interface.hpp"
+#include "avhttp/detail/escape_string.hpp"
 
 namespace avhttp {
 
@@ -31,6 +33,11 @@ namespace avhttp {
 #define AVHTTP_MAX_REDIRECTS 5
 #endif
 
+// 跳转到同一服务器时, 跳转响应的body不超过这个大小才读完它并复用连接, 否则重新连接.
+#ifndef AVHTTP_REDIRECT_DRAIN_LIMIT
+#define AVHTTP_REDIRECT_DRAIN_LIMIT 65536
+#endif
+
 // 常用有以下http选项.
 namespace http_options {
 
@@ -56,6 +63,7 @@ namespace http_options {
 	static const std::string accept_encoding("Accept-Encoding");
 	static const std::string transfer_encoding("Transfer-Encoding");
 	static const std::string content_encoding("Content-Encoding");
+	static const std::string expect("Expect");
 
 } // namespace http_options
 
@@ -112,16 +120,13 @@ public:
 		return *this;
 	}
 
-	// 查找指定key的value.
+	// 查找指定key的value, key不区分大小写.
 	bool find(const std::string &key, std::string &val) const
 	{
-		std::string s = key;
-		boost::to_lower(s);
 		for (option_item_list::const_iterator f = m_opts.begin(); f != m_opts.end(); f++)
 		{
-			std::string temp = f->first;
-			boost::to_lower(temp);
-			if (temp == s)
+			if (f->first.size() == key.size() &&
+				std::equal(key.begin(), key.end(), f->first.begin(), detail::tolower_compare))
 			{
 				val = f->second;
 				return true;
@@ -162,6 +167,11 @@ public:
 		return m_opts;
 	}
 
+	const option_item_list& option_all() const
+	{
+		return m_opts;
+	}
+
 	// 返回当前option个数.
 	int size() const
 	{
@@ -175,7 +185,7 @@ protected:
 // 请求时的http选项.
 // _http_version, 取值 "HTTP/1.0" / "HTTP/1.1", 默认为"HTTP/1.1".
 // _request_method, 取值 "GET/POST/HEAD", 默认为"GET".
-// _request_body, 请求中的body内容, 取值任意, 默认为空.
+// _request_body, 请求中的body内容, 取值任意, 默认为空, 大的body请使用http_stream::request_body.
 // Host, 取值为http服务器, 默认为http服务器.
 // Accept, 取值任意, 默认为"*/*".
 // 这些比较常用的选项被定义在http_options中.
@@ -225,11 +235,102 @@ struct proxy_settings
 };
 
 
+// http_stream的超时设置, 值为boost::posix_time::pos_infin时表示不限制.
+// 超时后连接被关闭, 正在进行的操作以errc::timed_out返回.
+
+struct timeout_settings
+{
+	timeout_settings()
+		: connect_timeout(boost::posix_time::pos_infin)
+		, handshake_timeout(boost::posix_time::pos_infin)
+		, header_timeout(boost::posix_time::pos_infin)
+		, read_timeout(boost::posix_time::pos_infin)
+		, total_timeout(boost::posix_time::pos_infin)
+	{}
+
+	// 连接超时, 包括域名解析, 建立tcp连接以及和代理服务器的握手.
+	// 同步open中的域名解析不受限制.
+	boost::posix_time::time_duration connect_timeout;
+
+	// ssl握手超时.
+	boost::posix_time::time_duration handshake_timeout;
+
+	// 从发送请求到收到完整的http头的超时.
+	boost::posix_time::time_duration header_timeout;
+
+	// 读取body的空闲超时, 每一次read_some/async_read_some超过这个时间没有收到数据即超时.
+	boost::posix_time::time_duration read_timeout;
+
+	// 整个请求的超时, 从open(在已打开的连接上为request)开始, 到读取完body为止,
+	// 只在http_stream有操作进行时检查.
+	boost::posix_time::time_duration total_timeout;
+};
+
+
+// multi_download下载数据校验设置.
+
+struct verify_settings
+{
+	verify_settings()
+		: hash(none)
+		, threads(0)
+		, max_retries(3)
+		, resume_check(false)
+	{}
+
+	enum hash_type
+	{
+		// 不计算分片hash.
+		none,
+		// crc32c, 编译时启用SSE4.2则使用硬件指令计算.
+		crc32c,
+		// 64位xxHash.
+		xxhash64,
+		// sha256, 需要定义AVHTTP_ENABLE_OPENSSL.
+		sha256,
+	};
+
+	// 分片hash算法, 默认为none, 即不校验.
+	// 如果指定了算法但没有期望的hash值, 则只计算不校验.
+	hash_type hash;
+
+	// 每个分片期望的hash值, 小写或大写的16进制字符串, 按分片顺序排列.
+	// 分片大小必须通过settings::piece_size明确指定.
+	std::vector<std::string> piece_hashes;
+
+	// 校验清单文件, bencode编码的字典, 包括以下字段:
+	// hash: 算法名称, 如"crc32c", "xxhash64", "sha256".
+	// piece_size: 分片大小.
+	// pieces: 所有分片的16进制hash值列表.
+	// 指定清单文件后, 清单中的设置将覆盖hash/piece_hashes以及settings::piece_size.
+	fs::path manifest;
+
+	// 计算hash的线程数, 小于等于0为CPU核心数.
+	int threads;
+
+	// 同一分片校验失败后重新下载的最大次数, 超过后终止下载.
+	int max_retries;
+
+	// 续传校验, 开始下载前使用多个线程重新计算磁盘上已完成分片的hash, 与期望的hash
+	// 或meta中保存的hash比较, 只重新下载校验失败的分片. 校验在start/async_start
+	// 中同步完成. 没有可比较hash的分片(如旧版本的meta)只计算hash, 不会被清除.
+	bool resume_check;
+};
+
+
 // 一些默认的值.
 static const int default_request_piece_num = 10;
 static const int default_time_out = 11;
 static const int default_connections_limit = 5;
 static const int default_buffer_size = 1024;
+static const int default_decode_buffer_size = 64 * 1024;
+static const int default_body_buffer_size = 64 * 1024;
+static const int default_continue_time_out = 1;
+static const int default_resume_read_size = 4 * 1024 * 1024;
+static const int default_read_ahead = 4 * 1024 * 1024;
+static const int default_urgent_time_out = 2;
+static const int default_request_rtt_factor = 8;
+static const int default_max_request_size = 32 * 1024 * 1024;
 
 // multi_download下载设置.
 
@@ -241,9 +342,15 @@ struct settings
 		, piece_size(-1)
 		, time_out(default_time_out)
 		, request_piece_num(default_request_piece_num)
+		, dynamic_request_size(false)
+		, max_request_size(default_max_request_size)
 		, allow_use_meta_url(true)
 		, disable_multi_download(false)
+		, streaming(false)
+		, read_ahead(default_read_ahead)
 		, check_certificate(true)
+		, http2(false)
+		, http2_prior_knowledge(false)
 		, storage(NULL)
 	{}
 
@@ -262,6 +369,16 @@ struct settings
 	// 每次请求的分片数, 默认为10.
 	int request_piece_num;
 
+	// 根据每个连接测得的RTT(发出请求到收到响应的时间)和吞吐量动态计算请求大小, 默认关闭.
+	// 开启后请求大小为带宽时延积的default_request_rtt_factor倍, 使连接等待响应的时间
+	// 只占很小一部分, 同时不超过剩余未分配数据按连接数平分的大小, 使各连接尽量同时
+	// 完成. 请求大小按分片对齐, 不小于一个分片, 不大于max_request_size, 连接还没有
+	// 测量数据时使用request_piece_num.
+	bool dynamic_request_size;
+
+	// 动态请求大小的上限, 单位为字节, 默认为32M.
+	int max_request_size;
+
 	// meta_file路径, 默认为当前路径下同文件名的.meta文件.
 	fs::path meta_file;
 
@@ -276,12 +393,29 @@ struct settings
 	// multi_download主要应用在大文件, 静态页面下载!
 	bool disable_multi_download;
 
+	// 流式下载模式(边下边播), 默认关闭.
+	// 开启后优先下载fetch_data/async_fetch_data读取位置之后read_ahead字节内的数据,
+	// 窗口内停滞超过default_urgent_time_out秒的数据会被立即重新请求, 用户跳转读取
+	// 位置时, 正在下载窗口外数据的连接会被抢占.
+	bool streaming;
+
+	// 流式下载模式下的预读窗口大小, 单位为字节, 默认为4M.
+	int read_ahead;
+
 	// 下载文件路径, 默认为当前目录.
 	fs::path save_path;
 
 	// 设置是否检查证书, 默认检查证书.
 	bool check_certificate;
 
+	// 数据连接使用http/2, 默认关闭. https地址通过ALPN协商, 服务器不支持时使用http/1.1,
+	// 开启后所有数据连接的请求作为同一个http/2连接上的并发流, 不再为每个连接握手.
+	// 使用代理时不使用http/2.
+	bool http2;
+
+	// http地址也直接使用http/2(h2c), 服务器必须支持, 只在http2开启时有效, 默认关闭.
+	bool http2_prior_knowledge;
+
 	// 存储接口创建函数指针, 默认为multi_download提供的file.hpp实现.
 	storage_constructor_type storage;
 
@@ -290,6 +424,9 @@ struct settings
 
 	// 代理设置.
 	proxy_settings proxy;
+
+	// 数据校验设置, 仅在支持多点下载时有效.
+	verify_settings verify;
 };
 
 } // namespace avhttp